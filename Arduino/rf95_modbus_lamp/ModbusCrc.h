@@ -0,0 +1 @@
+../../include/ModbusCrc.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../src/ModbusRelay.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../src/RHAdaptiveDriver.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../include/RHCompactDriver.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../src/RHCtrEncryptedDriver.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../include/RHCtrEncryptedDriver.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../src/ModbusCompact.cpp
\ No newline at end of file
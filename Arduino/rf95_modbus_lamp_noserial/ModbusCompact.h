@@ -0,0 +1 @@
+../../include/ModbusCompact.h
\ No newline at end of file
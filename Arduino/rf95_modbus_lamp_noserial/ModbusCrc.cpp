@@ -0,0 +1 @@
+../../src/ModbusCrc.cpp
\ No newline at end of file
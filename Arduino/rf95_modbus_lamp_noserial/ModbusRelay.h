@@ -0,0 +1 @@
+../../include/ModbusRelay.h
\ No newline at end of file
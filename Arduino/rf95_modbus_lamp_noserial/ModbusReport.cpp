@@ -0,0 +1 @@
+../../src/ModbusReport.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../include/ModbusReport.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../include/RHAdaptiveDriver.h
\ No newline at end of file
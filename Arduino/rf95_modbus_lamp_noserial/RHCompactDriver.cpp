@@ -0,0 +1 @@
+../../src/RHCompactDriver.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../src/RHRelayDriver.cpp
\ No newline at end of file
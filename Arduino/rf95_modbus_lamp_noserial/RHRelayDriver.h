@@ -0,0 +1 @@
+../../include/RHRelayDriver.h
\ No newline at end of file
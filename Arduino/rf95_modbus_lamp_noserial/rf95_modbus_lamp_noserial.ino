@@ -8,6 +8,12 @@
 */
 #include <ModbusRadio.h>
 #include <RH_RF95.h>
+#include <AES.h>
+#include "RHAdaptiveDriver.h"
+#include "RHCompactDriver.h"
+#include "RHCtrEncryptedDriver.h"
+#include "RHRelayDriver.h"
+#include "ModbusReport.h"
 
 // Slave address (1-247)
 const byte SlaveId = 10;
@@ -20,12 +26,50 @@ const int LampPin = LED_BUILTIN;
 const float frequency = 868.0;
 // const float frequency = 915.0;
 // const float frequency = 433.0;
+// Spreading factor of the bridge (rf95_rtu_bridge -s), with --adr the bridge
+// may ask for a lower one, the slave comes back to this one after
+// RH_ADR_FALLBACK ms without request
+const uint8_t spreadingFactor = 7;
 
 // RFM95 Module
 // You can use any module derived from RHGenericDriver, uncomment the module corresponding to your module
 RH_RF95 radio;
 // RH_RF95 radio (6, 7); // LoRasSpi with Arduino MKR VIDOR 4000
 
+// AES encryption in counter mode (rf95_rtu_bridge --key ... --aes-mode ctr)
+// Set isEncrypted to true and the key of the bridge, 16 characters
+const bool isEncrypted = false;
+const char EncryptKey[] = "1234567890abcdef";
+AES128 cipher;
+RHCtrEncryptedDriver encrypted (radio, cipher, RHCtrEncryptedDriver::Slave, SlaveId);
+
+// Compact over-the-air encoding (rf95_rtu_bridge --compact)
+// The slave answers in the encoding of each request, it also works with a
+// bridge which does not use it
+RHCompactDriver compact (isEncrypted ? static_cast<RHGenericDriver &> (encrypted) : radio, RHCompactDriver::Slave);
+
+// Adaptive data rate (rf95_rtu_bridge --adr)
+// The slave switches to the spreading factor announced by the bridge, it
+// also works with a bridge which does not use it
+RHAdaptiveDriver adaptive (compact, radio, SlaveId, spreadingFactor);
+
+// Relaying (rf95_rtu_bridge --relay or --relay-path)
+// The slave answers the discovery of its route, as a repeater it also passes
+// on the frames of the slaves out of range of the bridge. The bridge must
+// not use --compact, --adr nor --aes-mode ctr.
+const bool isRepeater = false;
+RHRelayDriver relay (adaptive, SlaveId);
+
+// Report by exception (rf95_rtu_bridge --report 10:1:0)
+// The slave sends the state of the lamp when it changes and every heartbeat
+// period, the bridge answers the reads of the master without the radio.
+// The heartbeat must be shorter than --report-age, the bridge must not use --adr.
+const bool isReporting = false;
+const unsigned long heartbeatPeriod = 60000; // ms
+uint8_t reportSequence = 0;
+unsigned long lastReport = 0;
+bool lastLamp = false;
+
 // ModbusRadio object
 ModbusRadio mb(SlaveId);
 
@@ -57,8 +101,17 @@ void setup() {
     }
   }
 
+  if (isEncrypted) {
+    cipher.setKey (reinterpret_cast<const uint8_t *> (EncryptKey), 16);
+    // the reports must not reuse the nonces of the previous run, store the
+    // counter in EEPROM if the analog input is not floating
+    randomSeed(analogRead(A0) ^ micros());
+    encrypted.setOwnCounter(random(0x7FFFFFFF));
+  }
+
   // Setup ISM frequency
   radio.setFrequency(frequency);
+  radio.setSpreadingFactor(spreadingFactor);
 
   // You can change the modulation parameters with eg
   // radio.setModemConfig(RH_RF95::Bw500Cr45Sf128);
@@ -68,7 +121,8 @@ void setup() {
   // you can set transmitter powers from 2 to 20 dBm:
   // radio.setTxPower(20, false);
 
-  mb.config(radio);                    // Set radio driver
+  relay.setRepeater(isRepeater);
+  mb.config(relay);                    // Set radio driver, through the relaying, the adaptive data rate and the compact encoding
   mb.setAdditionalServerData("LAMP");  // for Report Server ID function (0x11)
   blink(5, 300, 300);
 
@@ -76,10 +130,27 @@ void setup() {
   mb.addCoil(Lamp1Coil);
 }
 
+// Sends an integrity report of Lamp1Coil, the bridge sees a lost one with the sequence
+void report(bool lamp) {
+  uint8_t data = lamp;
+  uint8_t frame[ModbusReport::HeaderSize + 1 + 2];
+  size_t len = ModbusReport::encode(SlaveId, reportSequence++, true, 0x01, Lamp1Coil, 1, &data, frame, sizeof(frame));
+
+  relay.send(frame, len);
+  relay.waitPacketSent();
+  lastReport = millis();
+  lastLamp = lamp;
+}
+
 void loop() {
   // Call once inside loop() - all magic here
   mb.task();
 
   // Attach LampPin to Lamp1Coil register
-  digitalWrite(LampPin, mb.coil(Lamp1Coil));
+  bool lamp = mb.coil(Lamp1Coil);
+  digitalWrite(LampPin, lamp);
+
+  if (isReporting && (lamp != lastLamp || millis() - lastReport >= heartbeatPeriod)) {
+    report(lamp);
+  }
 }
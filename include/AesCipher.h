@@ -0,0 +1,68 @@
+#pragma once
+
+#include <BlockCipher.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// AES-128 block cipher for RHEncryptedDriver, with several backends
+// The AES instructions of the CPU are used when present (AES-NI on x86,
+// Cryptography Extensions on ARMv8), otherwise a table-based implementation
+// (4 encryption and 4 decryption tables of 1 KiB, one lookup per byte and
+// per round). Every backend computes the standard AES-128, the frames are
+// the same as with AES128 of the Crypto library, on both sides of the link.
+class AesCipher : public BlockCipher {
+  public:
+    enum Backend {
+      Auto,       // the fastest supported by the CPU
+      Table,      // portable, 32-bit tables
+      AesNi,      // x86 AES-NI instructions
+      ArmCrypto   // ARMv8 Cryptography Extensions
+    };
+
+    explicit AesCipher (Backend backend = Auto);
+    virtual ~AesCipher();
+
+    virtual size_t blockSize() const;
+    virtual size_t keySize() const;
+    virtual bool setKey (const uint8_t *key, size_t len);
+    virtual void encryptBlock (uint8_t *output, const uint8_t *input);
+    virtual void decryptBlock (uint8_t *output, const uint8_t *input);
+    virtual void clear();
+
+    // Chooses the backend, false if the CPU does not support it
+    bool setBackend (Backend backend);
+
+    // true if the backend can be used on this CPU (and was compiled in)
+    static bool isSupported (Backend backend);
+
+    // Fastest backend of this CPU
+    static Backend bestBackend();
+
+    // Backend name for reports
+    static const char *backendName (Backend backend);
+
+    // Backend from its name (auto, table, aes-ni, armv8), false if unknown
+    static bool backendFromName (const char *name, Backend & backend);
+
+  private:
+    void encryptTable (uint8_t *output, const uint8_t *input) const;
+    void decryptTable (uint8_t *output, const uint8_t *input) const;
+    void encryptAesNi (uint8_t *output, const uint8_t *input) const;
+    void decryptAesNi (uint8_t *output, const uint8_t *input) const;
+    void encryptArm (uint8_t *output, const uint8_t *input) const;
+    void decryptArm (uint8_t *output, const uint8_t *input) const;
+
+    Backend m_backend;
+    // round keys of the cipher and of the equivalent inverse cipher, as
+    // 32-bit words (first byte in the high byte) for the tables and as bytes
+    // for the instructions
+    uint32_t m_ek[44];
+    uint32_t m_dk[44];
+    alignas (16) uint8_t m_ekBytes[176];
+    alignas (16) uint8_t m_dkBytes[176];
+
+  public:
+    inline Backend backend() const {
+      return m_backend;
+    }
+};
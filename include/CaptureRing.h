@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary traffic capture in a memory-mapped ring file
+// The file is a header followed by a data area of fixed size where the
+// records are appended one after the other, the oldest ones are overwritten
+// when the area is full. A record does not wrap around the end of the area,
+// a padding record fills the end when the next one does not fit.
+// Writing a record is a memcpy in the mapping, the kernel writes the pages
+// to the file, so the capture survives a crash of the bridge. The monotonic
+// clock restarts at each boot, a capture is continued only in the boot
+// which created it.
+
+// File header
+struct CaptureHeader {
+  char magic[8];        // "RF95CAP"
+  uint32_t version;
+  uint32_t headerSize;  // offset of the data area
+  uint64_t size;        // size of the data area in bytes
+  uint64_t head;        // logical offset of the next record
+  uint64_t tail;        // logical offset of the oldest record
+  uint64_t records;     // records written since the creation of the file
+  uint64_t overwritten; // records lost because the area was full
+  int64_t realtime;     // CLOCK_REALTIME in ns when the file was created...
+  int64_t monotonic;    // ... and CLOCK_MONOTONIC at the same time
+  char boot[40];        // boot id of the kernel at the same time, empty if unknown
+};
+
+// Record header, followed by the bytes of the frame, padded to 8 bytes
+struct CaptureRecord {
+  uint16_t size;    // size of the record in bytes, header and padding included
+  uint8_t direction;
+  uint8_t status;
+  uint8_t radio;
+  uint8_t slave;    // first byte of the frame, 0 if empty
+  uint8_t function; // second byte of the frame, 0 if shorter
+  int8_t snr;       // dB, CaptureRing::NoSnr if unknown
+  int16_t rssi;     // dBm, 0 if unknown
+  uint16_t len;     // bytes of the frame
+  uint32_t reserved;
+  uint64_t time;    // CLOCK_MONOTONIC in ns
+
+  inline const uint8_t *data() const {
+    return reinterpret_cast<const uint8_t *> (this + 1);
+  }
+};
+
+class CaptureRing {
+  public:
+    enum Direction {
+      Padding = 0,
+      FromMaster,   // frame received on the serial line
+      ToMaster,     // frame written to the serial line
+      ToRadio,      // request sent on a radio
+      FromRadio     // frame received from a radio
+    };
+
+    enum Status {
+      Ok = 0,
+      CrcError,     // wrong CRC or too long frame on the serial line
+      Flushed,      // too short frame on the serial line
+      TooLong,      // request too long for the radio
+      QueueFull,    // request dropped, too many requests queued
+      DutyCycle,    // request dropped, no duty cycle budget
+      Cached,       // request answered from the cache
+      Timeout,      // request without response (the frame is the request)
+      Late,         // response after the timeout
+      Unexpected,   // response without request
+      Invalid,      // wrong CRC on the radio
+      Retry,        // request sent again, the previous attempt is lost
+      Unreachable,  // request answered with an exception, the slave is unreachable
+      Report        // report by exception of a slave, without request
+    };
+
+    static const int8_t NoSnr = -128;
+    static const uint32_t Version = 2;
+
+    CaptureRing();
+    ~CaptureRing();
+
+    // Opens or creates the file, size is the size of the data area in bytes
+    // An existing capture of the same size is continued, otherwise the file
+    // is initialized again. A capture of a previous boot is moved to
+    // path.prev, its timestamps do not follow the ones of this boot.
+    bool open (const std::string & path, size_t size);
+    void close();
+
+    // Appends a record, the oldest records are overwritten if needed
+    void write (Direction direction, Status status, size_t radio,
+                const uint8_t *frame, size_t len, int16_t rssi = 0, int8_t snr = NoSnr);
+
+    static const char *directionName (uint8_t direction);
+    static const char *statusName (uint8_t status);
+
+  private:
+    void drop (uint64_t bytes);
+
+    CaptureHeader *m_header;
+    uint8_t *m_data;
+    size_t m_mapSize;
+    int m_fd;
+
+  public:
+    inline bool isOpen() const {
+      return m_header != nullptr;
+    }
+
+    inline const CaptureHeader *header() const {
+      return m_header;
+    }
+};
+
+// Reads a capture file, the records from the oldest to the newest
+class CaptureReader {
+  public:
+    CaptureReader();
+    ~CaptureReader();
+
+    bool open (const std::string & path);
+    void close();
+
+    // Next record, false at the end of the capture
+    bool next (const CaptureRecord *& record);
+
+    // Back to the oldest record
+    inline void rewind() {
+      m_pos = m_header ? m_header->tail : 0;
+    }
+
+  private:
+    const CaptureHeader *m_header;
+    const uint8_t *m_data;
+    size_t m_mapSize;
+    uint64_t m_pos;
+    int m_fd;
+
+  public:
+    inline const CaptureHeader *header() const {
+      return m_header;
+    }
+};
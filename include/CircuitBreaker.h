@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Circuit breaker of the slaves
+// A slave which has not answered threshold requests in a row is open: the
+// requests of the master are answered at once by the bridge with the
+// exception 0x0B (gateway target device failed to respond) instead of
+// waiting for the radio, so that the other slaves are polled at full speed.
+// Meanwhile the bridge probes the slave every probePeriod, the breaker is
+// closed by the first response to a probe.
+class CircuitBreaker {
+  public:
+    CircuitBreaker();
+
+    // Number of timeouts in a row which open the breaker of a slave, 0 disables it
+    inline void setThreshold (unsigned int threshold) {
+      m_threshold = threshold;
+    }
+
+    // Time between two probes of an open slave
+    inline void setProbePeriod (unsigned long usec) {
+      m_probePeriod = usec;
+    }
+
+    inline bool isOpen (uint8_t slave) const {
+      return m_slaves[slave].open;
+    }
+
+    // The slave has answered a request or a probe
+    void onResponse (uint8_t slave);
+
+    // The slave has not answered a request or a probe sent before now
+    void onTimeout (uint8_t slave, unsigned long now);
+
+    // Returns an open slave whose probe is due at now and schedules its next
+    // probe, 0 if none
+    uint8_t probe (unsigned long now);
+
+    // Time of the next probe, false if no slave is open
+    bool nextProbe (unsigned long & when) const;
+
+    // Remembers the last read of the master to a slave, sent as probe
+    void setProbeRequest (const uint8_t *frame, size_t len);
+
+    // Probe of a slave, the last read of the master or a diagnostic echo
+    // (function 0x08, sub-function 0x0000), any response proves the slave
+    // reachable, even an exception
+    size_t probeRequest (uint8_t slave, uint8_t *frame) const;
+
+  private:
+    struct Slave {
+      bool open;
+      uint8_t failures;      // timeouts in a row
+      uint8_t len;           // of request, 0 if none
+      uint8_t request[8];    // last read of the master
+      unsigned long probe;   // micros() of the next probe
+    };
+
+    Slave m_slaves[256];
+    unsigned int m_threshold;
+    unsigned long m_probePeriod;
+
+    // statistics
+    unsigned long m_opened;
+    unsigned long m_closed;
+    unsigned long m_probes;
+
+  public:
+    inline bool isEnabled() const {
+      return m_threshold > 0;
+    }
+
+    inline unsigned int threshold() const {
+      return m_threshold;
+    }
+
+    // Slaves declared unreachable
+    inline unsigned long opened() const {
+      return m_opened;
+    }
+
+    // Slaves reachable again after a probe
+    inline unsigned long closed() const {
+      return m_closed;
+    }
+
+    inline unsigned long probes() const {
+      return m_probes;
+    }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "TransactionTable.h"
+
+// Merges the read requests to the same slave and function code into one
+// radio frame, and cuts the response into the replies to the original
+// requests. Two ranges are merged if the registers (or coils) between them
+// are less than maxGap and if the response still fits in a radio frame.
+class Coalescer {
+  public:
+    Coalescer();
+
+    // Time a read request waits for other reads to merge with, 0 disables
+    inline void setWindow (unsigned long usec) {
+      m_window = usec;
+    }
+
+    // Maximum number of registers or coils between two merged ranges
+    inline void setMaxGap (uint16_t maxGap) {
+      m_maxGap = maxGap;
+    }
+
+    // Maximum length of a response, eg RHGenericDriver::maxMessageLength()
+    inline void setMaxLength (size_t maxLength) {
+      m_maxLength = maxLength;
+    }
+
+    // Merges the read request frame in the queued transaction t, returns
+    // false if it can not be merged (t is unchanged)
+    // master: which waits for the reply to frame (Transaction::masters)
+    bool merge (Transaction & t, const uint8_t *frame, size_t len, uint32_t master = 0);
+
+    // Cuts the response to a merged transaction into the replies to its parts
+    // Returns false if the response does not match the merged request or is
+    // an exception, which may concern only some parts: they must be sent
+    // again alone.
+    static bool split (const Transaction & t, const uint8_t *response, size_t len,
+                       std::vector<std::vector<uint8_t>> & replies);
+
+    // true if the request is a read which can be merged (FC 01 to 04)
+    static bool isMergeable (const uint8_t *frame, size_t len);
+
+    // Maximum quantity of a read which can be answered in maxLength bytes
+    static uint16_t maxQuantity (uint8_t function, size_t maxLength);
+
+  private:
+    unsigned long m_window;
+    uint16_t m_maxGap;
+    size_t m_maxLength;
+
+    // statistics
+    unsigned long m_merged;
+
+  public:
+    inline bool isEnabled() const {
+      return m_window > 0;
+    }
+
+    inline unsigned long window() const {
+      return m_window;
+    }
+
+    inline size_t maxLength() const {
+      return m_maxLength;
+    }
+
+    //Nombre de requêtes fusionnées dans une autre.
+    inline unsigned long merged() const {
+      return m_merged;
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <deque>
+#include <utility>
+
+// Transmit time budget over a rolling window, eg 1% per hour in the
+// European 868 MHz bands (ETSI EN 300 220)
+// All times are micros() values, the window must be shorter than the
+// wrap period of micros() (71 minutes).
+class DutyCycle {
+  public:
+    // ratio: fraction of the window the transmitter may be on, 0 disables
+    // window: length of the rolling window in microseconds
+    DutyCycle (double ratio = 0.01, unsigned long window = 3600000000UL);
+
+    void setRatio (double ratio);
+    void setWindow (unsigned long window);
+
+    // Time from which a transmission of airtime microseconds fits in the
+    // budget, now if it can be sent at once. Returns false if it never fits.
+    bool earliest (unsigned long airtime, unsigned long now, unsigned long & when);
+
+    // Records a transmission started at now
+    void record (unsigned long airtime, unsigned long now);
+
+    // Airtime used in the window ending at now
+    unsigned long used (unsigned long now);
+
+    // Airtime left in the window ending at now
+    unsigned long remaining (unsigned long now);
+
+  private:
+    void prune (unsigned long now);
+
+    std::deque<std::pair<unsigned long, unsigned long>> m_history; // start, airtime
+    unsigned long m_used; // sum of the airtimes in m_history
+    unsigned long m_window;
+    unsigned long m_budget;
+    double m_ratio;
+
+    // statistics
+    unsigned long m_delayed;
+    unsigned long m_rejected;
+
+  public:
+    inline bool isEnabled() const {
+      return m_ratio > 0;
+    }
+
+    inline double ratio() const {
+      return m_ratio;
+    }
+
+    inline unsigned long window() const {
+      return m_window;
+    }
+
+    inline unsigned long budget() const {
+      return m_budget;
+    }
+
+    //Nombre de transmissions retardées, budget épuisé.
+    inline unsigned long delayed() const {
+      return m_delayed;
+    }
+
+    //Nombre de transmissions refusées, budget épuisé.
+    inline unsigned long rejected() const {
+      return m_rejected;
+    }
+
+    inline void countDelayed() {
+      m_delayed++;
+    }
+
+    inline void countRejected() {
+      m_rejected++;
+    }
+};
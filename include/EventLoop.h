@@ -0,0 +1,73 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <stdint.h>
+
+// Event loop based on epoll
+// Serial port, radio notification and timers are file descriptors of the same
+// epoll set, so the bridge sleeps until there is real work to do.
+class EventLoop {
+  public:
+    // events: epoll events (EPOLLIN, EPOLLOUT...) signaled for the file descriptor
+    typedef std::function<void (uint32_t events)> Handler;
+
+    EventLoop();
+    ~EventLoop();
+
+    // Adds a file descriptor to watch, handler is called from run()
+    bool add (int fd, uint32_t events, Handler handler);
+
+    // Changes the events watched for fd
+    bool modify (int fd, uint32_t events);
+
+    // Removes a file descriptor, may be called from a handler
+    void remove (int fd);
+
+    // Waits for events at most timeoutMs (-1 for ever) and calls the handlers
+    // Returns the number of handlers called, -1 on error
+    int run (int timeoutMs = -1);
+
+  private:
+    int m_epfd;
+    std::map<int, Handler> m_handlers;
+
+  public:
+    //Vrai si l'instance epoll a pu être créée.
+    inline bool isOpen() const {
+      return m_epfd >= 0;
+    }
+};
+
+// One shot or periodic timer (timerfd) watched by an EventLoop
+class EventTimer {
+  public:
+    EventTimer (EventLoop & loop, std::function<void()> handler);
+    ~EventTimer();
+
+    // Arms the timer, usec is the delay in microseconds (0 is rounded to 1)
+    void start (unsigned long usec, bool periodic = false);
+
+    // Disarms the timer
+    void stop();
+
+    // Replaces the function called at expiration
+    inline void setHandler (std::function<void()> handler) {
+      m_handler = handler;
+    }
+
+  private:
+    void onExpire();
+
+    EventLoop & m_loop;
+    std::function<void()> m_handler;
+    int m_fd;
+    bool m_active;
+    bool m_periodic;
+
+  public:
+    //Vrai si le timer est armé.
+    inline bool isActive() const {
+      return m_active;
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Writes to groups of slaves
+// A group is an address which no slave uses, eg 248 to 255 (reserved by
+// Modbus), with a list of members. A write of the master to a group (FC 05,
+// 06, 0F or 10) is copied to each member, the copies are queued together
+// and go on the air back to back, as many at a time as the radios allow.
+// The responses are collected, once all the members have answered or timed
+// out the master receives one reply: the normal write response if all have
+// succeeded, the exception of the first member which answered one, or the
+// exception 0x0B if a member has not answered.
+class FanOut {
+  public:
+    enum Result {
+      Ok,
+      Exception, // the member has answered an exception
+      Failed     // no response, or the request has been dropped
+    };
+
+    // Outcome of a member
+    struct Member {
+      uint8_t slave;
+      bool pending; // without outcome yet
+      Result result;
+      uint8_t code; // exception code, 0x0B if failed
+    };
+
+    // Write to a group in progress
+    struct Operation {
+      uint16_t id;
+      std::vector<uint8_t> request; // of the master, to the group
+      std::vector<Member> members;
+      size_t pending;               // members without outcome
+      unsigned long received;       // micros() of the request
+      uint32_t master;              // which waits for the reply (Transaction::master)
+    };
+
+    FanOut();
+
+    // Sets the members of a group, none removes it
+    void setGroup (uint8_t group, const std::vector<uint8_t> & members);
+
+    inline bool isGroup (uint8_t address) const {
+      return !m_groups[address].empty();
+    }
+
+    inline const std::vector<uint8_t> & members (uint8_t group) const {
+      return m_groups[group];
+    }
+
+    // true if the request can be sent to a group (FC 05, 06, 0F, 10)
+    static bool isWrite (const uint8_t *frame, size_t len);
+
+    // Starts the write of the master to its group, returns the id of the
+    // operation, carried by the transactions of the members (Transaction::fanout)
+    uint16_t start (const uint8_t *frame, size_t len, unsigned long now, uint32_t master = 0);
+
+    // Copy of the request to a group for a member, with its CRC
+    static void copy (const uint8_t *frame, size_t len, uint8_t slave, std::vector<uint8_t> & copy);
+
+    // Records the outcome of a member, returns true if the operation is
+    // complete, reply then receives the frame for the master and done the
+    // operation, which ends
+    bool onResult (uint16_t id, uint8_t slave, Result result, uint8_t code,
+                   std::vector<uint8_t> & reply, Operation & done);
+
+  private:
+    std::vector<uint8_t> m_groups[256];
+    size_t m_count; // groups
+    std::deque<Operation> m_operations;
+    uint16_t m_nextId;
+
+    // statistics
+    unsigned long m_writes;
+    unsigned long m_complete; // all the members have succeeded
+    unsigned long m_partial;
+
+  public:
+    inline bool isEnabled() const {
+      return m_count > 0;
+    }
+
+    inline size_t inProgress() const {
+      return m_operations.size();
+    }
+
+    // Writes to a group
+    inline unsigned long writes() const {
+      return m_writes;
+    }
+
+    // Writes to a group whose members have all succeeded
+    inline unsigned long complete() const {
+      return m_complete;
+    }
+
+    // Writes to a group with a member which has failed or answered an exception
+    inline unsigned long partial() const {
+      return m_partial;
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// Histogram of durations in microseconds, log-linear buckets like HdrHistogram
+// Values below 64 have their own bucket, above each power of 2 is split in 32
+// buckets, the relative error is less than 3.2% up to 2^32 us. Recording is
+// a few shifts and an increment, there is no allocation, a histogram can be
+// copied with memcpy.
+class Histogram {
+  public:
+    static const size_t SubBuckets = 32;
+    static const size_t Buckets = 2 * SubBuckets + 26 * SubBuckets;
+
+    Histogram();
+
+    void record (unsigned long value);
+    void clear();
+
+    // Value under which a fraction q (0..1) of the values are
+    unsigned long percentile (double q) const;
+
+    // Number of values below or equal to value, value must be a power of 2 minus 1
+    uint64_t countBelow (unsigned long value) const;
+
+    // Prometheus text format, the values are exported in seconds with buckets
+    // at the powers of 2 from 64 us to 2^24 us (16 s)
+    // labels: eg "slave=\"10\"" or empty
+    void exportText (std::string & out, const char *name, const char *labels = "") const;
+
+    static size_t index (unsigned long value);
+    static unsigned long highestEquivalent (size_t index);
+
+  private:
+    uint64_t m_counts[Buckets];
+    uint64_t m_count;
+    uint64_t m_sum;
+    unsigned long m_min;
+    unsigned long m_max;
+
+  public:
+    inline uint64_t count() const {
+      return m_count;
+    }
+
+    inline uint64_t sum() const {
+      return m_sum;
+    }
+
+    inline unsigned long min() const {
+      return m_count ? m_min : 0;
+    }
+
+    inline unsigned long max() const {
+      return m_max;
+    }
+
+    inline double mean() const {
+      return m_count ? (double) m_sum / m_count : 0;
+    }
+};
+
+// Histogram of signal levels (RSSI in dBm, SNR in dB), buckets of step from
+// lowest, the values out of range are counted in the first or last bucket
+class LevelHistogram {
+  public:
+    static const size_t MaxBuckets = 48;
+
+    LevelHistogram (int lowest = -140, int step = 5, size_t buckets = 30);
+
+    void record (int value);
+    void clear();
+
+    // Prometheus text format
+    void exportText (std::string & out, const char *name, const char *labels = "") const;
+
+  private:
+    uint64_t m_counts[MaxBuckets];
+    uint64_t m_count;
+    int64_t m_sum;
+    int m_lowest;
+    int m_step;
+    size_t m_buckets;
+
+  public:
+    inline uint64_t count() const {
+      return m_count;
+    }
+
+    inline double mean() const {
+      return m_count ? (double) m_sum / m_count : 0;
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LoraAirtime.h"
+
+// Adaptive data rate of the slaves
+// Each slave is served with a profile: the profile 0 is the modem setting of
+// the radio, the profile n lowers its spreading factor by n (down to SF7),
+// the bandwidth and the coding rate are unchanged. The faster profiles need
+// a better link.
+// After each response the link of the slave is estimated from the SNR (the
+// RSSI if the SNR is unknown), averaged, and the fastest profile which keeps
+// margin dB above the demodulation floor is chosen. The profile of the next
+// request is announced in the header of the current one, the slave switches
+// after its response (RHAdaptiveDriver), then the bridge does.
+// If a change is not confirmed, the request or the response has been lost:
+// the next requests are sent in turn with the announced profile, the
+// previous one and the profile 0, which the slave listens to after a silence
+// of fallback, until the slave answers.
+// A slave which does not answer maxFailures times in a row is announced the
+// profile 0, and its profile is capped below the one which failed until it
+// has answered promoteAfter times.
+class LinkAdapter {
+  public:
+    static const uint8_t MaxProfile = 5; // SF12 to SF7
+
+    LinkAdapter();
+
+    inline void setEnabled (bool enabled) {
+      m_enabled = enabled;
+    }
+
+    // Margin in dB above the demodulation floor of a profile
+    inline void setMargin (double margin) {
+      m_margin = margin;
+    }
+
+    // Number of timeouts in a row which bring a slave back to the profile 0
+    inline void setMaxFailures (unsigned int maxFailures) {
+      m_maxFailures = maxFailures;
+    }
+
+    // Number of responses after which a capped profile is raised by one
+    inline void setPromoteAfter (unsigned int promoteAfter) {
+      m_promoteAfter = promoteAfter;
+    }
+
+    // Time without request after which a slave listens to the profile 0,
+    // must be the one of the slaves
+    inline void setFallback (unsigned long usec) {
+      m_fallback = usec;
+    }
+
+    // Profile of a request sent now to a slave
+    uint8_t profile (uint8_t slave, unsigned long now) const;
+
+    // Profile announced in a request sent now to a slave
+    uint8_t next (uint8_t slave, unsigned long now) const;
+
+    // true if a change of profile has been announced to the slave and not
+    // confirmed by its response, the requests to the slave must wait
+    inline bool isChanging (uint8_t slave) const {
+      return m_links[slave].changing;
+    }
+
+    // A request has been sent to a slave with profile() and next()
+    void onSent (uint8_t slave, unsigned long now);
+
+    // The slave has answered, with this signal on the radio of modem base
+    void onResponse (uint8_t slave, const LoraModem & base, int rssi, int snr, bool hasSnr);
+
+    // The slave has not answered
+    void onTimeout (uint8_t slave);
+
+    // Modem settings of a profile of the radio base
+    static LoraModem modem (const LoraModem & base, uint8_t profile);
+
+    // Number of profiles of the radio base, 1 for SF7
+    static uint8_t profiles (const LoraModem & base);
+
+  private:
+    struct Link {
+      uint8_t profile;   // of the next request
+      uint8_t next;      // announced in the next request
+      uint8_t from;      // profile of the slave when the change was announced
+      uint8_t search;    // timeouts since the change was announced
+      uint8_t cap;       // highest profile allowed
+      uint8_t failures;  // timeouts in a row
+      uint16_t answers;  // responses since the cap was lowered or raised
+      bool changing;     // next announced, not confirmed
+      bool measured;
+      bool hasSnr;
+      float snr;         // dB, mean
+      float rssi;        // dBm, mean
+      unsigned long sent; // micros() of the last request
+    };
+
+    bool isIdle (const Link & l, unsigned long now) const;
+    uint8_t target (const Link & l, const LoraModem & base) const;
+
+    Link m_links[256];
+    bool m_enabled;
+    double m_margin;
+    unsigned int m_maxFailures;
+    unsigned int m_promoteAfter;
+    unsigned long m_fallback;
+
+    // statistics
+    unsigned long m_promotions;
+    unsigned long m_demotions;
+    unsigned long m_fallbacks;
+
+  public:
+    inline bool isEnabled() const {
+      return m_enabled;
+    }
+
+    inline unsigned long fallback() const {
+      return m_fallback;
+    }
+
+    // Changes to a faster profile announced
+    inline unsigned long promotions() const {
+      return m_promotions;
+    }
+
+    // Changes to a slower profile announced
+    inline unsigned long demotions() const {
+      return m_demotions;
+    }
+
+    // Slaves brought back to the profile 0 after timeouts
+    inline unsigned long fallbacks() const {
+      return m_fallbacks;
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <stddef.h>
+#include <stdint.h>
+#include "SpscRing.h"
+
+// Console output of the bridge, written by a dedicated thread
+// The event loop only copies the text and the frame in a preallocated record
+// of a SPSC ring, the logging thread formats them in hexadecimal and writes
+// them in batches. When the ring is full, the record is dropped and counted,
+// the forwarding never waits for the console.
+class Logger {
+  public:
+    enum Stream {
+      Out,
+      Err
+    };
+
+    Logger();
+    ~Logger();
+
+    // Starts the logging thread
+    bool start();
+
+    // Writes the records left and stops the thread
+    void stop();
+
+    // File descriptors of the streams, 1 (Out) and 2 (Err) by default
+    inline void setOutput (int out, int err) {
+      m_stream[Out] = out;
+      m_stream[Err] = err;
+    }
+
+    // Prefix of the lines logged with prefix true, eg "rf95_rtu_bridge: "
+    inline void setPrefix (const std::string & prefix) {
+      m_prefix = prefix;
+    }
+
+    // Logs a line: the text then the frame in hexadecimal, between [] for a
+    // request (req true), between <> for a response. To be called by the
+    // event loop thread only (single producer).
+    void log (Stream stream, bool prefix, const char *text, const uint8_t *frame = nullptr,
+              size_t len = 0, bool req = true);
+
+    // Logs a line of text, printf format
+    void printf (Stream stream, const char *format, ...) __attribute__ ( (format (printf, 3, 4)));
+
+    // Formats a frame in hexadecimal, each byte between [] for a request (req
+    // true), between <> for a response, returns the end of the text
+    static char *format (char *out, const uint8_t *frame, size_t len, bool req);
+
+    static const size_t MaxText = 94;
+    static const size_t MaxFrame = 256;
+    static const size_t MaxPrefix = 64;
+    // a line: prefix, text, 4 characters per byte, new line
+    static const size_t MaxLine = MaxPrefix + MaxText + 4 * MaxFrame + 1;
+
+  private:
+    // output buffer of the logging thread, written when full or when the ring is empty
+    static const size_t BatchSize = 16384;
+
+    struct Record {
+      uint8_t stream;
+      bool prefix;
+      bool request;
+      uint8_t textLen;
+      char text[MaxText];
+      uint16_t len;
+      uint8_t frame[MaxFrame];
+    };
+
+    Record *reserve();
+    void commit (const Record & r);
+    char *render (const Record & r, char *out) const;
+    void run();
+
+    SpscRing<Record, 256> m_ring;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_sleeping; // the logging thread waits on m_fd
+    std::atomic<unsigned long> m_overflows;
+    std::string m_prefix;
+    int m_stream[2]; // file descriptors of Out and Err
+    int m_fd; // eventfd, wakes up the logging thread
+    char m_batch[2][BatchSize]; // lines of Out and Err waiting for a write(), used by the logging thread only
+
+  public:
+    inline bool isRunning() const {
+      return m_running;
+    }
+
+    //Nombre de lignes perdues, file pleine.
+    inline unsigned long overflows() const {
+      return m_overflows;
+    }
+};
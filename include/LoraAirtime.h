@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LoRa modem settings and time on air model (Semtech SX1276 datasheet, 4.1.1.7)
+struct LoraModem {
+  // Encryption between the bridge and the radio
+  enum Encryption {
+    Clear,
+    Padded,   // RHEncryptedDriver, 16 bytes blocks
+    Stream    // RHCtrEncryptedDriver, nonce then as many bytes as the message
+  };
+
+  uint8_t spreadingFactor; // 6..12
+  long bandwidth;          // Hz
+  uint8_t codingRate;      // denominator, 5..8 for 4/5..4/8
+  uint16_t preamble;       // symbols, 8 with RadioHead
+  bool crc;                // payload CRC, on with RadioHead
+  Encryption encryption;
+
+  // RadioHead defaults after init(): Bw = 125 kHz, Cr = 4/5, Sf = 7, CRC on
+  LoraModem() :
+    spreadingFactor (7), bandwidth (125000), codingRate (5), preamble (8),
+    crc (true), encryption (Clear) {}
+
+  // Duration of a symbol in microseconds
+  unsigned long symbolTime() const;
+
+  // Low data rate optimization, set by RH_RF95 when a symbol lasts more than 16 ms
+  inline bool lowDataRateOptimize() const {
+    return symbolTime() > 16000UL;
+  }
+
+  // Time on air in microseconds of a LoRa payload of len bytes (explicit header)
+  unsigned long timeOnAir (size_t payloadLen) const;
+
+  // LoRa payload length of a message given to the driver: RadioHead header
+  // (to, from, id, flags) and the overhead of the encryption
+  size_t payloadLength (size_t messageLen) const;
+
+  // Time on air in microseconds of a message given to the driver
+  inline unsigned long messageTimeOnAir (size_t messageLen) const {
+    return timeOnAir (payloadLength (messageLen));
+  }
+
+  // Lowest SNR in dB at which a frame is demodulated with the spreading
+  // factor, -7.5 dB at SF7 then 2.5 dB less at each step
+  static double demodulationFloor (uint8_t spreadingFactor);
+
+  // Lowest RSSI in dBm at which a frame is received with these settings:
+  // thermal noise in the bandwidth, noise figure of the SX1276 (6 dB) and
+  // demodulation floor
+  double sensitivity() const;
+
+  // RHEncryptedDriver message length: a length byte (STRICT_CONTENT_LEN) then
+  // padding to the cipher block size
+  static size_t encryptedLength (size_t len, size_t blockSize = 16);
+
+  // RHCtrEncryptedDriver message length: the nonce (RH_CTR_NONCE_LEN) then
+  // the message
+  static size_t streamLength (size_t len);
+
+  // Bandwidth really used by RH_RF95::setSignalBandwidth(), rounded up to the
+  // next value supported by the SX1276
+  static long supportedBandwidth (long bandwidth);
+};
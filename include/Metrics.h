@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include "Histogram.h"
+
+// Instrumentation of the bridge
+// Updated by the event loop only, without lock nor allocation. A copy is
+// taken periodically and exported by MetricsExporter in the Prometheus text
+// format, so that a slow reader never delays the frames.
+class Metrics {
+  public:
+    static const size_t MaxRadios = 8;
+    static const size_t MaxPorts = 8;
+
+    // Counters of a slave
+    struct Slave {
+      uint64_t requests;    // sent on the radio
+      uint64_t responses;   // matching a request
+      uint64_t crcErrors;   // serial frames with a wrong CRC, invalid radio frames
+      uint64_t timeouts;
+      uint64_t flushed;     // too short frames on the serial line
+      uint64_t cached;      // answered from the cache
+      uint64_t reports;     // reports by exception received
+      uint64_t imaged;      // answered from the register image
+      uint64_t stale;       // answered with an exception, mirror too old
+      uint64_t late;
+      uint64_t unexpected;
+      uint64_t dropped;     // queue full or duty cycle
+      uint64_t retries;     // requests sent again without response
+      uint64_t recovered;   // responses to a request sent again
+      uint64_t exceptions;  // exception responses made by the bridge
+      uint64_t latencySum;  // us, request sent to response received
+      uint64_t latencyMax;
+      int64_t rssiSum;
+      int64_t snrSum;
+      uint64_t snrCount;
+      uint8_t spreadingFactor; // of the last request, adaptive data rate
+      uint8_t unreachable;  // 1 while the circuit breaker is open
+      uint8_t hops;         // repeaters on the route of the last request, 0 direct
+    };
+
+    // Signal of the frames received by a radio
+    struct Radio {
+      Radio();
+
+      LevelHistogram rssi;
+      LevelHistogram snr;
+    };
+
+    // Queue of the requests of a serial port (master)
+    struct Port {
+      Histogram wait;       // request received to request sent on the radio
+      uint64_t requests;    // queued for the radio
+      uint64_t dropped;     // queue full, duty cycle or breaker, never sent
+      uint32_t depth;       // requests waiting for the radio
+      uint32_t maxDepth;
+    };
+
+    Metrics();
+
+    void clear();
+
+    // A request has been sent on the radio
+    void onRequest (uint8_t slave, unsigned long serialToAir);
+
+    // A response has been received, latency from the request on the air
+    void onResponse (uint8_t slave, size_t radio, unsigned long latency, int rssi, int snr, bool hasSnr);
+
+    // A response has been written to the serial line
+    inline void onReply (unsigned long airToSerial) {
+      m_airToSerial.record (airToSerial);
+    }
+
+    // A request of a master has been queued for the radio, the masters
+    // beyond MaxPorts (TCP clients) are ignored
+    void onQueued (uint32_t master);
+
+    // A request of a master leaves the queue, sent on the radio or dropped
+    void onDequeued (uint32_t master, unsigned long wait, bool sent);
+
+    // A request of a master has been refused, the queue is full
+    void onRejected (uint32_t master);
+
+    inline Slave & slave (uint8_t address) {
+      return m_slaves[address];
+    }
+
+    // Appends the metrics in the Prometheus text format
+    void exportText (std::string & out) const;
+
+  private:
+    Histogram m_latency;      // request sent to response received
+    Histogram m_serialToAir;  // request received on the serial line to request sent
+    Histogram m_airToSerial;  // response received to response written
+    Radio m_radios[MaxRadios];
+    Port m_ports[MaxPorts];
+    Slave m_slaves[256];
+
+  public:
+    inline const Histogram & latency() const {
+      return m_latency;
+    }
+
+    inline const Histogram & serialToAir() const {
+      return m_serialToAir;
+    }
+
+    inline const Histogram & airToSerial() const {
+      return m_airToSerial;
+    }
+
+    inline const Slave & slave (uint8_t address) const {
+      return m_slaves[address];
+    }
+
+    inline const Radio & radio (size_t index) const {
+      return m_radios[index];
+    }
+
+    inline const Port & port (size_t index) const {
+      return m_ports[index];
+    }
+};
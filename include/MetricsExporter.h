@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "Metrics.h"
+#include "SpscRing.h"
+
+// Exports copies of the bridge metrics in the Prometheus text format, from
+// a dedicated thread
+// The event loop publishes a copy periodically, the thread formats it and
+// rewrites the text file (for the textfile collector of node_exporter) and
+// answers the clients of the Unix socket, eg socat - UNIX-CONNECT:path
+class MetricsExporter {
+  public:
+    MetricsExporter();
+    ~MetricsExporter();
+
+    // File rewritten at each publication (written to path.tmp then renamed)
+    inline void setFile (const std::string & path) {
+      m_file = path;
+    }
+
+    // Unix socket, a client which connects receives the last metrics
+    inline void setSocket (const std::string & path) {
+      m_socket = path;
+    }
+
+    bool start();
+    void stop();
+
+    // Copies the metrics for the exporter thread, to be called by the event
+    // loop only. Returns false if the thread is still busy with the previous
+    // copies, this copy is then skipped.
+    bool publish (const Metrics & metrics);
+
+  private:
+    void run();
+    void writeFile();
+    bool listen();
+
+    SpscRing<Metrics, 2> m_ring;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<unsigned long> m_skipped;
+    std::string m_file;
+    std::string m_socket;
+    std::string m_text; // last metrics, Prometheus text format
+    int m_fd;           // eventfd, a copy is available
+    int m_listenFd;
+
+  public:
+    inline bool isRunning() const {
+      return m_running;
+    }
+
+    //Nombre de copies abandonnées, thread occupé.
+    inline unsigned long skipped() const {
+      return m_skipped;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact over-the-air encoding of the Modbus RTU frames
+// This file is shared with the Arduino sketches, it must stay portable (no STL).
+//
+// The Modbus CRC is removed, the LoRa PHY CRC already protects the frame, and
+// it is computed again by the receiver. The first byte is the slave address,
+// the second one a code:
+// - bit 6 clear: function code, then the PDU data unchanged
+// - 0x7F: escape, the function code (bit 6 set) follows, then the PDU data
+// - bit 6 set: compact form of the function code (code & 0x1F), the start
+//   addresses and quantities are varints (7 bits per byte, LSB first), byte
+//   counts are implicit. With bit 5 set, the registers are delta encoded
+//   (zigzag varint of the difference with the previous register).
+// The form depends on the direction of the frame, the encoder keeps the
+// shortest one.
+class ModbusCompact {
+  public:
+    enum Direction {
+      Request,  // master to slave
+      Response  // slave to master
+    };
+
+    // Encodes a RTU frame (CRC included, not checked), returns the length of
+    // the compact frame in out, 0 if outSize is too small
+    // delta: allows the delta encoding of the registers
+    static size_t encode (const uint8_t *frame, size_t len, uint8_t *out, size_t outSize,
+                          Direction dir, bool delta = true);
+
+    // Decodes a compact frame to a RTU frame with its CRC, returns its length,
+    // 0 if the compact frame is invalid or frameSize too small
+    static size_t decode (const uint8_t *in, size_t len, uint8_t *frame, size_t frameSize,
+                          Direction dir);
+};
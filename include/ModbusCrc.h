@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Calcule le CRC d'une trame
+// address: 1st byte of the message
+// pduFrame: pointer to the message
+// pduLen: length of the message
+// CRC is 2 bytes long, high byte first
+// This is the reference implementation (Modicon tables), ModbusCrc gives the
+// same results faster and incrementally.
+uint16_t calcCrc (uint8_t address, const uint8_t *pduFrame, uint8_t pduLen);
+
+// big endian word of a Modbus PDU
+static inline uint16_t pduWord (const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+// Incremental CRC16/Modbus (polynomial 0xA001 reflected, initial value 0xFFFF)
+// The CRC can be updated as the bytes arrive, once the two CRC bytes of a
+// frame have been processed, the register is 0 (isResidueOk()).
+// On Arduino, only compute() and append() are provided, the CRC is computed
+// bit by bit, the tables do not fit in the RAM of small MCUs.
+class ModbusCrc {
+  public:
+#if defined(ARDUINO)
+    // CRC16/Modbus of len bytes
+    static uint16_t compute (const uint8_t *data, size_t len);
+#else
+    enum Kernel {
+      Reference,  // Modicon high/low tables, byte by byte, as calcCrc()
+      Table,      // one 16-bit table, byte by byte
+      SliceBy4,   // 4 tables, 4 bytes per iteration
+      SliceBy8    // 8 tables, 8 bytes per iteration
+    };
+
+    ModbusCrc() : m_crc (0xFFFF) {}
+
+    inline void reset() {
+      m_crc = 0xFFFF;
+    }
+
+    inline void update (uint8_t b) {
+      m_crc = (m_crc >> 8) ^ m_table[0][ (m_crc ^ b) & 0xFF];
+    }
+
+    inline void update (const uint8_t *data, size_t len, Kernel kernel = SliceBy8) {
+      m_crc = update (m_crc, data, len, kernel);
+    }
+
+    // Updates crc with len bytes using the kernel
+    static uint16_t update (uint16_t crc, const uint8_t *data, size_t len, Kernel kernel = SliceBy8);
+
+    // CRC16/Modbus of len bytes
+    static inline uint16_t compute (const uint8_t *data, size_t len, Kernel kernel = SliceBy8) {
+      return update (0xFFFF, data, len, kernel);
+    }
+#endif
+
+    // Writes the CRC of the len first bytes of frame after them, returns
+    // the length of the frame with its CRC
+    static inline size_t append (uint8_t *frame, size_t len) {
+      uint16_t crc = compute (frame, len);
+
+      frame[len] = crc & 0xFF;
+      frame[len + 1] = crc >> 8;
+      return len + 2;
+    }
+
+#if !defined(ARDUINO)
+    // Kernel name for reports
+    static const char *kernelName (Kernel kernel);
+
+  private:
+    static uint16_t updateReference (uint16_t crc, const uint8_t *data, size_t len);
+    static uint16_t updateTable (uint16_t crc, const uint8_t *data, size_t len);
+    static uint16_t updateSliceBy4 (uint16_t crc, const uint8_t *data, size_t len);
+    static uint16_t updateSliceBy8 (uint16_t crc, const uint8_t *data, size_t len);
+
+    uint16_t m_crc;
+
+    // m_table[k][i]: CRC of the byte i followed by k zero bytes
+    static uint16_t m_table[8][256];
+    friend struct ModbusCrcTables;
+
+  public:
+    // CRC16/Modbus value, the low byte is transmitted first
+    inline uint16_t value() const {
+      return m_crc;
+    }
+
+    // Same representation as calcCrc(): first byte transmitted in the high byte
+    inline uint16_t frameCrc() const {
+      return (m_crc << 8) | (m_crc >> 8);
+    }
+
+    // true if the bytes processed end with their valid CRC
+    inline bool isResidueOk() const {
+      return m_crc == 0;
+    }
+#endif
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Multi-hop relaying of the Modbus frames through slaves acting as repeaters
+// This file is shared with the Arduino sketches, it must stay portable (no STL).
+//
+// A slave out of range of the bridge is reached through at most MaxHops
+// repeaters, along a route chosen by the bridge (source routing, as RHRouter
+// does with the routes found by RHMesh). Between the bridge and the last
+// repeater, the frames are wrapped with the user defined function code 0x42:
+//   slave, 0x42, control, count, path (count), PDU, CRC (2)
+// slave is the final slave, path the addresses of the repeaters from the
+// bridge side, the PDU that of the wrapped frame (function code and data).
+// The control holds the type of the frame (bits 6-7) and its hop (bits 0-3):
+// the position in the path of the node which handles it next, Bridge for
+// the bridge.
+// - Request: sent by the bridge to path[0], each repeater passes it to the
+//   next one, the last one sends the PDU to the slave in a plain RTU frame
+//   and wraps its response.
+// - Response: passed back from the last repeater to the bridge.
+// - Discover: broadcast by the bridge to find a route to the slave, without
+//   PDU, the hop bits hold the sequence of the discovery. Each node which
+//   hears it for the first time adds itself to the path and sends it again.
+// - Route: the answer of the slave to its first discover, passed back along
+//   the path like a response, the bridge learns the path.
+// Unlike RHRouter, the hops are not acknowledged, the bridge sends the
+// request again end to end (--retries).
+class ModbusRelay {
+  public:
+    static const uint8_t Function = 0x42;
+    static const uint8_t MaxHops = 4;
+    static const uint8_t Request = 0x00;
+    static const uint8_t Response = 0x40;
+    static const uint8_t Discover = 0x80;
+    static const uint8_t Route = 0xC0;
+    static const uint8_t TypeMask = 0xC0;
+    static const uint8_t HopMask = 0x0F;
+    static const uint8_t Bridge = 0x0F;           // hop of the frames for the bridge
+    static const size_t HeaderSize = 4;           // slave to count
+    static const unsigned long PendingTime = 10000; // ms a repeater waits for the response of a slave
+
+    struct Frame {
+      uint8_t slave;
+      uint8_t type;
+      uint8_t hop;          // or sequence of a discover
+      uint8_t count;
+      const uint8_t *path;  // in the frame
+      const uint8_t *pdu;   // in the frame
+      size_t pduLength;
+    };
+
+    // Wraps a RTU frame (CRC included) to send it along path, returns the
+    // length of the frame, 0 if size is too small
+    static size_t wrap (uint8_t type, uint8_t hop, const uint8_t *path, uint8_t count,
+                        const uint8_t *rtu, size_t len, uint8_t *frame, size_t size);
+
+    // Builds the discover of a route to a slave, returns its length
+    static size_t discover (uint8_t slave, uint8_t sequence, uint8_t *frame, size_t size);
+
+    // true if the frame (CRC included and checked) is a valid relay frame
+    static bool decode (const uint8_t *frame, size_t len, Frame & f);
+
+    // Builds the RTU frame (CRC included) wrapped in f, returns its length,
+    // 0 if size is too small or f has no PDU
+    static size_t unwrap (const Frame & f, uint8_t *rtu, size_t size);
+
+    // Length of a RTU frame of len bytes wrapped for count repeaters
+    static inline size_t wrappedLength (size_t len, uint8_t count) {
+      return len + HeaderSize - 1 + count;
+    }
+
+    // A node which may act as a repeater, address: its Modbus address
+    explicit ModbusRelay (uint8_t address);
+
+    // Handles a frame heard by the node, builds in out the frame it must
+    // send, returns its length, 0 if none. now: a clock in milliseconds.
+    // The relay frames are never for the Modbus slave of the node, the
+    // plain frames are.
+    size_t onFrame (const uint8_t *frame, size_t len, unsigned long now, uint8_t *out, size_t size);
+
+  private:
+    static const uint8_t MaxPending = 4;
+
+    // Route of a request passed to a slave, its response goes back along it
+    struct Pending {
+      uint8_t slave;          // 0 if free
+      uint8_t count;
+      uint8_t path[MaxHops];
+      unsigned long sent;     // ms
+    };
+
+    size_t forward (const uint8_t *frame, size_t len, uint8_t control, uint8_t *out, size_t size) const;
+
+    uint8_t m_address;
+    Pending m_pending[MaxPending];
+    uint8_t m_lastSlave;    // last discover heard, 0 if none
+    uint8_t m_lastSequence;
+    unsigned long m_lastHeard; // ms
+
+  public:
+    inline uint8_t address() const {
+      return m_address;
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Report by exception frames, sent by a slave without request
+// This file is shared with the Arduino sketches, it must stay portable (no STL).
+//
+// A slave which reports its coils or registers sends, when they change, a
+// frame with the user defined function code 0x41:
+//   slave, 0x41, sequence, table, start (2), quantity (2), byte count, data, CRC (2)
+// The sequence (bits 0-6) is incremented at each report, the bridge sees a
+// lost report when it jumps. With the bit 7 set, the report is an integrity
+// report: it holds all the values of the range and is sent again every
+// heartbeat period, even without change. The table is the function code
+// which reads the values (01 coils, 02 discrete inputs, 03 holding
+// registers, 04 input registers), the data is that of its response: bits
+// packed LSB first or registers big-endian.
+class ModbusReport {
+  public:
+    static const uint8_t Function = 0x41;
+    static const uint8_t Integrity = 0x80;
+    static const uint8_t SequenceMask = 0x7F;
+    static const size_t HeaderSize = 9; // slave to byte count
+
+    struct Report {
+      uint8_t slave;
+      uint8_t sequence;
+      bool integrity;
+      uint8_t table;
+      uint16_t start;
+      uint16_t quantity;
+      const uint8_t *data; // in the frame
+      uint8_t count;       // bytes of data
+    };
+
+    // Builds a report in frame, CRC included, returns its length, 0 if size
+    // is too small or the table is not 01 to 04
+    static size_t encode (uint8_t slave, uint8_t sequence, bool integrity, uint8_t table,
+                          uint16_t start, uint16_t quantity, const uint8_t *data,
+                          uint8_t *frame, size_t size);
+
+    // true if the frame (CRC included, not checked) is a valid report
+    static bool decode (const uint8_t *frame, size_t len, Report & report);
+
+    // Bytes of data of quantity values of a table, 0 if the table is not 01 to 04
+    static size_t dataSize (uint8_t table, uint16_t quantity);
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "EventLoop.h"
+
+// Modbus TCP front end of the bridge
+// Clients connect to a TCP port and send Modbus TCP requests (MBAP header
+// followed by the PDU), as many at a time as they want. Each request becomes
+// an RTU frame (the unit id is the slave address, CRC appended) given to the
+// bridge with a master id. The response comes back with this id and is sent
+// to the client with the transaction id of its request, whatever the order
+// of the responses. The sockets are non-blocking and watched by the event
+// loop of the bridge, there is no serial line and no T3.5 on this path.
+class ModbusTcpServer {
+  public:
+    // Master id of the first TCP request, those below are the serial lines
+    static const uint32_t FirstMaster = 0x100;
+
+    // Called with each request, frame is an RTU frame with its CRC
+    typedef std::function<void (uint32_t master, const uint8_t *frame, size_t len)> Handler;
+
+    ModbusTcpServer (EventLoop & loop, Handler handler);
+    ~ModbusTcpServer();
+
+    // Listens on address (IPv4, "" for all the interfaces) and port, 0
+    // for a port chosen by the system (port())
+    bool listen (const std::string & address, uint16_t port);
+
+    // Closes the clients and the listening socket
+    void close();
+
+    // Maximum number of clients connected, the others are refused
+    inline void setMaxClients (size_t maxClients) {
+      m_maxClients = maxClients;
+    }
+
+    // Time in microseconds after which a request without response is
+    // forgotten, a response which comes later is dropped
+    inline void setTimeout (unsigned long usec) {
+      m_timeout = usec;
+    }
+
+    // Sends the response to the request of master, frame is an RTU frame
+    // with its CRC. Returns false if the request is unknown: broadcast,
+    // forgotten or client gone.
+    bool reply (uint32_t master, const uint8_t *frame, size_t len);
+
+  private:
+    struct Client {
+      int fd;
+      std::vector<uint8_t> in;  // bytes received, the start of a request
+      std::vector<uint8_t> out; // bytes which the socket has not taken yet
+      bool watching;            // EPOLLOUT watched, out is not empty
+    };
+
+    // Request waiting for its response
+    struct Request {
+      int fd;                   // of the client
+      uint16_t transaction;     // MBAP transaction id
+      unsigned long received;   // micros()
+    };
+
+    void onAccept();
+    void onClient (int fd, uint32_t events);
+    bool receive (Client & client);
+    bool send (Client & client);
+    void drop (int fd);
+    void forget (unsigned long now);
+
+    EventLoop & m_loop;
+    Handler m_handler;
+    int m_fd;
+    uint16_t m_port;
+    size_t m_maxClients;
+    unsigned long m_timeout;
+    std::map<int, Client> m_clients;
+    std::map<uint32_t, Request> m_requests;
+    uint32_t m_nextMaster;
+
+    // statistics
+    unsigned long m_connections;
+    unsigned long m_received;
+    unsigned long m_sent;
+    unsigned long m_errors;
+    unsigned long m_forgotten;
+
+  public:
+    inline bool isListening() const {
+      return m_fd >= 0;
+    }
+
+    inline uint16_t port() const {
+      return m_port;
+    }
+
+    inline size_t clients() const {
+      return m_clients.size();
+    }
+
+    // Requests waiting for their response
+    inline size_t pending() const {
+      return m_requests.size();
+    }
+
+    // Clients accepted
+    inline unsigned long connections() const {
+      return m_connections;
+    }
+
+    // Requests received
+    inline unsigned long received() const {
+      return m_received;
+    }
+
+    // Responses sent
+    inline unsigned long sent() const {
+      return m_sent;
+    }
+
+    // Clients disconnected for an invalid MBAP header or a full output
+    inline unsigned long errors() const {
+      return m_errors;
+    }
+
+    // Requests forgotten without response
+    inline unsigned long forgotten() const {
+      return m_forgotten;
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <RHGenericDriver.h>
+#include <RH_RF95.h>
+
+// Application header flags of the profile announced by the bridge, the
+// compact flag (RH_COMPACT_FLAG) is above
+#define RH_ADR_PROFILE_MASK 0x07
+
+// Highest profile, the profile n lowers the spreading factor by n
+#define RH_ADR_MAX_PROFILE 5
+
+// Time in milliseconds without request after which a slave listens to the
+// profile 0, the bridge must use the same (--adr-fallback)
+#define RH_ADR_FALLBACK 60000UL
+
+// Slave side of the adaptive data rate of the bridge (LinkAdapter).
+// The bridge announces in the header of each request the profile of the
+// next one, the slave answers with its current profile then switches the
+// RH_RF95 to the spreading factor of the announced profile. A slave which
+// has not received a request for the fallback time goes back to the profile
+// 0, the spreading factor given to the constructor, which the bridge uses
+// when it has lost a slave.
+// This file is shared with the Arduino sketches. It must be the outermost
+// driver, above RHCompactDriver, to see the Modbus address of the frames.
+class RHAdaptiveDriver : public RHGenericDriver {
+  public:
+    // address: Modbus address of the slave
+    // spreadingFactor: profile 0, the spreading factor of the bridge
+    RHAdaptiveDriver (RHGenericDriver & driver, RH_RF95 & rf95, uint8_t address, uint8_t spreadingFactor);
+
+    virtual bool init();
+    virtual bool available();
+    virtual bool recv (uint8_t *buf, uint8_t *len);
+    virtual bool send (const uint8_t *data, uint8_t len);
+    virtual uint8_t maxMessageLength();
+    virtual bool waitPacketSent();
+
+    virtual void setThisAddress (uint8_t thisAddress);
+    virtual void setHeaderTo (uint8_t to);
+    virtual void setHeaderFrom (uint8_t from);
+    virtual void setHeaderId (uint8_t id);
+    virtual void setHeaderFlags (uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+    virtual uint8_t headerTo();
+    virtual uint8_t headerFrom();
+    virtual uint8_t headerId();
+    virtual uint8_t headerFlags();
+    virtual int16_t lastRssi();
+    virtual RHMode mode();
+    virtual void setModeIdle();
+    virtual void setModeRx();
+    virtual void setModeTx();
+
+    // Time in milliseconds without request before the profile 0
+    inline void setFallback (unsigned long ms) {
+      m_fallback = ms;
+    }
+
+  private:
+    void setProfile (uint8_t profile);
+
+    RHGenericDriver & m_driver;
+    RH_RF95 & m_rf95;
+    uint8_t m_address;
+    uint8_t m_spreadingFactor;
+    uint8_t m_profile;
+    uint8_t m_next;              // announced by the last request
+    unsigned long m_fallback;
+    unsigned long m_lastRequest; // millis()
+
+  public:
+    inline uint8_t profile() const {
+      return m_profile;
+    }
+
+    inline RHGenericDriver & driver() {
+      return m_driver;
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <RHGenericDriver.h>
+#include "ModbusCompact.h"
+
+// Application header flag of the compact frames, the receiver decodes only
+// the frames which carry it, so that a bridge or a slave understands both
+// encodings
+#define RH_COMPACT_FLAG 0x08
+
+// Maximum length of a Modbus RTU frame
+#define RH_COMPACT_MAX_FRAME_LEN 256
+
+// Driver which encodes the Modbus RTU frames in the compact form
+// (ModbusCompact) before giving them to another driver (RH_RF95,
+// RHEncryptedDriver...), and decodes them after reception.
+// This file is shared with the Arduino sketches.
+//
+// The bridge (Master) encodes the requests when compact mode is on. A slave
+// (Slave) answers in the encoding of the last request received, the bridge
+// decides alone.
+class RHCompactDriver : public RHGenericDriver {
+  public:
+    enum Role {
+      Master, // sends requests, receives responses
+      Slave   // receives requests, sends responses
+    };
+
+    RHCompactDriver (RHGenericDriver & driver, Role role);
+
+    virtual bool init();
+    virtual bool available();
+    virtual bool recv (uint8_t *buf, uint8_t *len);
+    virtual bool send (const uint8_t *data, uint8_t len);
+    virtual uint8_t maxMessageLength();
+    virtual bool waitPacketSent();
+
+    virtual void setThisAddress (uint8_t thisAddress);
+    virtual void setHeaderTo (uint8_t to);
+    virtual void setHeaderFrom (uint8_t from);
+    virtual void setHeaderId (uint8_t id);
+    virtual void setHeaderFlags (uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+    virtual uint8_t headerTo();
+    virtual uint8_t headerFrom();
+    virtual uint8_t headerId();
+    virtual uint8_t headerFlags();
+    virtual int16_t lastRssi();
+    virtual RHMode mode();
+    virtual void setModeIdle();
+    virtual void setModeRx();
+    virtual void setModeTx();
+
+    // Master: the requests are sent in compact form
+    inline void setCompact (bool compact) {
+      m_compact = compact;
+    }
+
+    // Allows the delta encoding of the registers
+    inline void setDelta (bool delta) {
+      m_delta = delta;
+    }
+
+  private:
+    RHGenericDriver & m_driver;
+    Role m_role;
+    bool m_compact;
+    bool m_delta;
+    uint8_t m_buf[RH_COMPACT_MAX_FRAME_LEN];
+
+  public:
+    inline bool isCompact() const {
+      return m_compact;
+    }
+
+    inline RHGenericDriver & driver() {
+      return m_driver;
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <RHGenericDriver.h>
+#include <BlockCipher.h>
+
+// Nonce sent in clear before the encrypted bytes: the node then a 32-bit
+// frame counter, big endian
+#define RH_CTR_NONCE_LEN 5
+
+// Maximum length of a message with its nonce
+#define RH_CTR_MAX_MESSAGE_LEN 255
+
+// Nodes of the bridge radios, above the Modbus slave addresses (1..247)
+#define RH_CTR_MASTER_NODE 248
+
+// Bit of the counter of the frames a slave sends on its own (reports), the
+// counters of the masters never have it
+#define RH_CTR_OWN_FLAG 0x80000000UL
+
+// Driver which encrypts the messages in counter mode (AES-CTR) before giving
+// them to another driver (RH_RF95...), and decrypts them after reception.
+// Unlike RHEncryptedDriver, which encrypts 16 bytes blocks, the message is
+// not padded: it goes on air with the length of the plaintext plus the
+// nonce. This file is shared with the Arduino sketches.
+//
+// Block i of the keystream is the encryption of the nonce followed by ten
+// zeros and i. A nonce must never be used twice with the same key:
+// - the master (the bridge) uses its node (RH_CTR_MASTER_NODE + radio) and
+//   its counter, which starts at a random value and is incremented at each
+//   message, without RH_CTR_OWN_FLAG,
+// - a slave uses its Modbus address and the counter of the last request
+//   received from a master for its first frame after it, the answer,
+// - the other frames of a slave (reports, heartbeats) use its own counter,
+//   with RH_CTR_OWN_FLAG, which must start at a random or persisted value.
+// As with RHEncryptedDriver, the frames are neither authenticated nor
+// protected against replay, the Modbus CRC rejects the wrong keys.
+class RHCtrEncryptedDriver : public RHGenericDriver {
+  public:
+    enum Role {
+      Master, // sends requests with its own counter
+      Slave   // answers with the counter of the request
+    };
+
+    RHCtrEncryptedDriver (RHGenericDriver & driver, BlockCipher & cipher, Role role, uint8_t node);
+
+    virtual bool init();
+    virtual bool available();
+    virtual bool recv (uint8_t *buf, uint8_t *len);
+    virtual bool send (const uint8_t *data, uint8_t len);
+    virtual uint8_t maxMessageLength();
+    virtual bool waitPacketSent();
+
+    virtual void setThisAddress (uint8_t thisAddress);
+    virtual void setHeaderTo (uint8_t to);
+    virtual void setHeaderFrom (uint8_t from);
+    virtual void setHeaderId (uint8_t id);
+    virtual void setHeaderFlags (uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+    virtual uint8_t headerTo();
+    virtual uint8_t headerFrom();
+    virtual uint8_t headerId();
+    virtual uint8_t headerFlags();
+    virtual int16_t lastRssi();
+    virtual RHMode mode();
+    virtual void setModeIdle();
+    virtual void setModeRx();
+    virtual void setModeTx();
+
+    // Master: first counter, a random value so that a restart does not
+    // reuse the nonces of the previous run
+    inline void setCounter (uint32_t counter) {
+      m_counter = counter & ~RH_CTR_OWN_FLAG;
+    }
+
+    // Slave: first counter of the frames it sends on its own, a random or
+    // persisted value for the same reason
+    inline void setOwnCounter (uint32_t counter) {
+      m_own = counter & ~RH_CTR_OWN_FLAG;
+    }
+
+  private:
+    // XOR of len bytes with the keystream of the nonce
+    void crypt (const uint8_t *nonce, uint8_t *out, const uint8_t *in, uint8_t len);
+
+    RHGenericDriver & m_driver;
+    BlockCipher & m_cipher;
+    Role m_role;
+    uint8_t m_node;
+    uint32_t m_counter; // last counter sent (Master) or received from a master (Slave)
+    uint32_t m_own;     // Slave: last counter of the frames sent on its own
+    bool m_answered;    // Slave: m_counter has been used
+    uint8_t m_buf[RH_CTR_MAX_MESSAGE_LEN];
+
+  public:
+    inline uint32_t counter() const {
+      return m_counter;
+    }
+
+    inline uint32_t ownCounter() const {
+      return m_own;
+    }
+
+    inline RHGenericDriver & driver() {
+      return m_driver;
+    }
+};
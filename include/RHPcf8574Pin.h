@@ -1,17 +1,46 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
 #include "RHPin.h"
 #include "pcf8574.h"
 
+// Rx/Tx led on a PCF8574 I2C expander
+// RadioHead switches the led around each transmission and reception, an I2C
+// write takes 100 us or more, so the state is only stored by setState() and
+// written to the expander by a dedicated thread started by begin(). Once
+// changed, the led keeps its state at least minPulse milliseconds: the
+// changes which come faster are merged, and an on which is switched off
+// before the thread has seen it still lights the led for minPulse.
 class RHPcf8574Pin : public RHPin {
   public:
-    RHPcf8574Pin (int pin, Pcf8574 & ctrl);
+    RHPcf8574Pin (int pin, Pcf8574 & ctrl, unsigned long minPulse = 30);
+    virtual ~RHPcf8574Pin();
 
+    // Minimum time in milliseconds between two changes of the led
+    inline void setMinPulse (unsigned long ms) {
+      m_minPulse = ms;
+    }
+
+    // Stops the thread, the expander is written by setState() afterwards
+    void stop();
 
   private:
+    void run();
+    void write (bool on);
+    bool isPending (bool shown) const;
+
     int m_pinNumber;
     Pcf8574 & m_ctrl;
-
+    std::atomic<bool> m_state;   // requested
+    std::atomic<bool> m_pulse;   // on requested since the last write
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_sleeping; // the thread waits on m_fd
+    std::atomic<unsigned long> m_minPulse;
+    std::atomic<unsigned long> m_changes;
+    std::atomic<unsigned long> m_writes;
+    std::thread m_thread;
+    int m_fd; // eventfd, wakes up the thread
 
   public:
     //Numéro de broche GPIO à laquelle la led est connectée.
@@ -19,6 +48,16 @@ class RHPcf8574Pin : public RHPin {
       return m_pinNumber;
     }
 
+    // Changes requested by setState()
+    inline unsigned long changes() const {
+      return m_changes;
+    }
+
+    // Writes to the expander, the changes left are merged
+    inline unsigned long writes() const {
+      return m_writes;
+    }
+
     //Lecture de l'état binaire de la led.
     //true si allumée.
     virtual bool state() const;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <RHGenericDriver.h>
+#include "ModbusRelay.h"
+
+// Maximum time in milliseconds a repeater waits before sending a discover
+// again, at random, so that the repeaters which hear it do not collide
+#define RH_RELAY_JITTER 100
+
+// Maximum length of a frame
+#define RH_RELAY_MAX_MESSAGE_LEN 255
+
+// Driver of a slave which acts as a repeater for the slaves out of range of
+// the bridge (ModbusRelay, rf95_rtu_bridge --relay).
+// The relay frames it must pass are sent again at once, the Modbus slave
+// above it never sees them, the plain frames go up as usual.
+// This file is shared with the Arduino sketches. It must be the outermost
+// driver, above RHAdaptiveDriver, the relaying needs the decoded frames.
+// Not compatible with the compact encoding and the AES-CTR encryption: a
+// repeater would send the requests of the bridge as responses, and use the
+// nonce of a request twice.
+class RHRelayDriver : public RHGenericDriver {
+  public:
+    // address: Modbus address of the slave
+    RHRelayDriver (RHGenericDriver & driver, uint8_t address);
+
+    virtual bool init();
+    virtual bool available();
+    virtual bool recv (uint8_t *buf, uint8_t *len);
+    virtual bool send (const uint8_t *data, uint8_t len);
+    virtual uint8_t maxMessageLength();
+    virtual bool waitPacketSent();
+
+    virtual void setThisAddress (uint8_t thisAddress);
+    virtual void setHeaderTo (uint8_t to);
+    virtual void setHeaderFrom (uint8_t from);
+    virtual void setHeaderId (uint8_t id);
+    virtual void setHeaderFlags (uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+    virtual uint8_t headerTo();
+    virtual uint8_t headerFrom();
+    virtual uint8_t headerId();
+    virtual uint8_t headerFlags();
+    virtual int16_t lastRssi();
+    virtual RHMode mode();
+    virtual void setModeIdle();
+    virtual void setModeRx();
+    virtual void setModeTx();
+
+    // The slave passes the relay frames, false: it only answers the discovery of its own route
+    inline void setRepeater (bool repeater) {
+      m_repeater = repeater;
+    }
+
+    // Maximum random wait in milliseconds before a discover is sent again
+    inline void setJitter (unsigned long ms) {
+      m_jitter = ms;
+    }
+
+  private:
+    RHGenericDriver & m_driver;
+    ModbusRelay m_relay;
+    bool m_repeater;
+    unsigned long m_jitter;
+    uint8_t m_buf[RH_RELAY_MAX_MESSAGE_LEN];
+    uint8_t m_len;    // of the frame in m_buf, 0 if none
+    uint8_t m_out[RH_RELAY_MAX_MESSAGE_LEN];
+
+  public:
+    inline bool isRepeater() const {
+      return m_repeater;
+    }
+
+    inline RHGenericDriver & driver() {
+      return m_driver;
+    }
+};
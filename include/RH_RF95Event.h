@@ -0,0 +1,37 @@
+#pragma once
+
+#include <RH_RF95.h>
+
+// Maximum number of RH_RF95Event instances, one interrupt routine each
+#define RH_RF95_EVENT_NUM_INTERRUPTS 3
+
+// RH_RF95 driver which signals an eventfd each time the DIO0 interrupt has been
+// handled (packet received, packet sent...).
+// The bridge watches eventFd() instead of polling available().
+class RH_RF95Event : public RH_RF95 {
+  public:
+    RH_RF95Event (uint8_t slaveSelectPin, uint8_t interruptPin);
+    virtual ~RH_RF95Event();
+
+    // Initialises the RF95 then replaces its interrupt routine by ours
+    virtual bool init();
+
+  private:
+    void handleEvent();
+    static void isr0();
+    static void isr1();
+    static void isr2();
+
+    static RH_RF95Event *m_deviceForInterrupt[RH_RF95_EVENT_NUM_INTERRUPTS];
+    static uint8_t m_interruptCount;
+
+    uint8_t m_interruptPin;
+    uint8_t m_myInterruptIndex;
+    int m_fd;
+
+  public:
+    //Descripteur eventfd signalé après chaque interruption DIO0.
+    inline int eventFd() const {
+      return m_fd;
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cache of the responses to the Modbus read requests (function codes 01 to 04)
+// A read identical to a previous one (same slave, function, start address and
+// quantity) is answered with the last response from the radio if it is
+// younger than the TTL. The TTL is chosen per slave, then per function code,
+// then the default one, a TTL of 0 disables the cache. A write to a slave
+// invalidates the entries whose range it overlaps.
+class ReadCache {
+  public:
+    explicit ReadCache (size_t maxEntries = 64);
+
+    // Default TTL in microseconds, 0 disables the cache
+    inline void setTtl (unsigned long usec) {
+      m_ttl = usec;
+    }
+
+    // TTL of the reads from a slave, overrides the function code and default TTL
+    void setSlaveTtl (uint8_t slave, unsigned long usec);
+
+    // TTL of the reads with a function code, overrides the default TTL
+    void setFunctionTtl (uint8_t function, unsigned long usec);
+
+    // TTL of the responses of a slave to a function
+    unsigned long ttl (uint8_t slave, uint8_t function) const;
+
+    // Looks for the response to a read request, true if found, response
+    // receives the complete frame (CRC included)
+    bool lookup (const uint8_t *request, size_t len, unsigned long now, std::vector<uint8_t> & response);
+
+    // Stores the response to a read request, other requests and the
+    // exception responses are ignored
+    void store (const uint8_t *request, size_t len, const uint8_t *response, size_t rlen, unsigned long now);
+
+    // Removes the entries overlapped by a write request, returns their number
+    size_t invalidate (const uint8_t *request, size_t len);
+
+    // Removes all entries
+    void clear();
+
+    // Function codes which are cached
+    static bool isRead (uint8_t function);
+
+    // Function codes which modify coils or holding registers
+    static bool isWrite (uint8_t function);
+
+    // Range modified by a write request, table is the function code which
+    // reads it (0x01 coils, 0x03 holding registers), returns false if the
+    // request is not a write
+    static bool writtenRange (const uint8_t *request, size_t len, uint8_t & table, uint16_t & start, uint16_t & quantity);
+
+  private:
+    struct Entry {
+      uint8_t slave;
+      uint8_t function;
+      uint16_t start;
+      uint16_t quantity;
+      unsigned long time; // micros() of the response
+      std::vector<uint8_t> response;
+    };
+
+    void invalidate (uint8_t slave, uint8_t function, uint16_t start, uint16_t quantity, size_t & count);
+
+    std::vector<Entry> m_entries;
+    std::map<uint8_t, unsigned long> m_slaveTtl;
+    std::map<uint8_t, unsigned long> m_functionTtl;
+    size_t m_maxEntries;
+    unsigned long m_ttl;
+
+    // statistics
+    unsigned long m_hits;
+    unsigned long m_misses;
+    unsigned long m_invalidations;
+
+  public:
+    //Vrai si au moins un TTL est non nul.
+    bool isEnabled() const;
+
+    inline size_t size() const {
+      return m_entries.size();
+    }
+
+    inline unsigned long hits() const {
+      return m_hits;
+    }
+
+    inline unsigned long misses() const {
+      return m_misses;
+    }
+
+    //Nombre d'entrées supprimées par une écriture.
+    inline unsigned long invalidations() const {
+      return m_invalidations;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "ModbusReport.h"
+
+// Image of the coils and registers of the slaves, kept by the bridge
+// Only the subscribed ranges are kept, each value is known or not. The
+// slaves which report by exception (ModbusReport) update it: a report
+// stores its values, and proves that the other known values of the slave
+// are still current, unless its sequence has jumped, in which case a report
+// has been lost and the values of the slave are unknown until they are
+// reported again. A read of the master which falls in a range whose values
+// are all known and younger than the maximum age is answered from the image
+// at serial speed, the others go on the air. A write of the master makes
+// the values it overlaps unknown until the slave reports them.
+// The ranges read by the bridge itself (ShadowPoller) are mirrored: their
+// values are those of the last response, and a read whose values are
+// unknown or stale is answered with an exception instead of going on the air.
+class RegisterImage {
+  public:
+    enum Result {
+      Absent, // not in the image, or unknown or stale values of a reported range
+      Found,  // the response is built
+      Stale   // unknown or stale values of a mirrored range
+    };
+
+    RegisterImage();
+
+    // Adds a range to the image, table: function code which reads it (01 to 04)
+    // maxAge: overrides the one of setMaxAge() if not 0
+    // mirrored: kept by the reads of the bridge, stale values are not read on the air
+    // Returns false if the table is invalid
+    bool subscribe (uint8_t slave, uint8_t table, uint16_t start, uint16_t quantity,
+                    unsigned long maxAge = 0, bool mirrored = false);
+
+    // Time in microseconds after which the values of a range which has
+    // received nothing are stale, 0 never
+    inline void setMaxAge (unsigned long usec) {
+      m_maxAge = usec;
+    }
+
+    // Applies a report of a slave, returns false if it covers no subscribed range
+    bool onReport (const ModbusReport::Report & report, unsigned long now);
+
+    // Stores quantity values of a table from start, data in the format of
+    // the response to a read (bits packed LSB first or registers big-endian),
+    // returns the number of values stored
+    size_t store (uint8_t slave, uint8_t table, uint16_t start, uint16_t quantity,
+                  const uint8_t *data, unsigned long now);
+
+    // Stores the values of the response to a read request (01 to 04)
+    size_t store (const uint8_t *request, size_t len, const uint8_t *response, size_t rlen, unsigned long now);
+
+    // Answers a read request (01 to 04) from the image, response receives
+    // the complete frame (CRC included) if found
+    Result lookup (const uint8_t *request, size_t len, unsigned long now, std::vector<uint8_t> & response);
+
+    // Makes unknown the values overlapped by a write request, returns their number
+    size_t invalidate (const uint8_t *request, size_t len);
+
+    // Makes unknown all the values of a slave
+    void invalidate (uint8_t slave);
+
+  private:
+    struct Range {
+      uint8_t slave;
+      uint8_t table;
+      uint16_t start;
+      uint16_t quantity;
+      unsigned long updated;        // micros() of the last report or store of the whole range
+      unsigned long maxAge;         // 0 for that of the image
+      bool mirrored;
+      std::vector<uint16_t> values; // one per coil or register
+      std::vector<bool> known;
+    };
+
+    void invalidate (uint8_t slave, uint8_t table, uint16_t start, uint16_t quantity, size_t & count);
+
+    std::vector<Range> m_ranges;
+    int16_t m_sequence[256]; // last sequence reported by a slave, -1 if none
+    unsigned long m_maxAge;
+
+    // statistics
+    unsigned long m_reports;
+    unsigned long m_gaps;
+    unsigned long m_hits;
+    unsigned long m_misses;
+    unsigned long m_stale;
+
+  public:
+    inline bool isEnabled() const {
+      return !m_ranges.empty();
+    }
+
+    inline unsigned long maxAge() const {
+      return m_maxAge;
+    }
+
+    // Reports applied
+    inline unsigned long reports() const {
+      return m_reports;
+    }
+
+    // Reports lost, seen by a jump of the sequence
+    inline unsigned long gaps() const {
+      return m_gaps;
+    }
+
+    // Reads answered from the image
+    inline unsigned long hits() const {
+      return m_hits;
+    }
+
+    // Reads of a subscribed range sent on the air, values unknown or stale
+    inline unsigned long misses() const {
+      return m_misses;
+    }
+
+    // Reads of a mirrored range answered with an exception, values unknown or stale
+    inline unsigned long stale() const {
+      return m_stale;
+    }
+};
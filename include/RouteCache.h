@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ModbusRelay.h"
+
+// Routes of the slaves reached through repeaters (ModbusRelay), keyed by
+// their Modbus address
+// A slave has a fixed route (setPath()), or its route is discovered
+// (setDiscovery()): on a miss, when a request goes to a slave whose route is
+// unknown, and after a failure, a request along the route without response.
+// The bridge then broadcasts a discover and learns the path of the first
+// answer, the requests keep the route until it fails, no discovery is sent
+// meanwhile. A discovery without answer leaves the slave on its last
+// route, direct if it has none, it is not discovered again before the hold
+// time. The slaves without route are direct, in range of the bridge.
+class RouteCache {
+  public:
+    struct Route {
+      uint8_t count;                       // repeaters, 0 direct
+      uint8_t path[ModbusRelay::MaxHops];  // from the bridge side
+      bool known;                          // fixed or discovered
+      bool fixed;
+      bool discover;                       // discovered on a miss or failure
+      bool pending;                        // discovery in progress
+      unsigned long held;                  // micros() until which a miss is not discovered
+    };
+
+    RouteCache();
+
+    // Discovers the route of a slave on a miss or failure
+    void setDiscovery (uint8_t slave, bool enable);
+
+    // Relays a slave along a fixed route of count repeaters, returns false
+    // if count is above ModbusRelay::MaxHops or the path holds the slave
+    bool setPath (uint8_t slave, const uint8_t *path, uint8_t count);
+
+    // Time during which a slave is not discovered again after a discovery
+    // without answer
+    inline void setHoldTime (unsigned long usec) {
+      m_holdTime = usec;
+    }
+
+    inline const Route & route (uint8_t slave) const {
+      return m_routes[slave];
+    }
+
+    // Repeaters on the route of a slave, 0 if direct
+    inline uint8_t hops (uint8_t slave) const {
+      return m_routes[slave].count;
+    }
+
+    // true if a request to the slave sent at now must wait for a discovery
+    bool isMiss (uint8_t slave, unsigned long now) const;
+
+    // Builds the discover of the route of a slave, pending until learn() or
+    // onDiscoverTimeout(), returns its length
+    size_t discover (uint8_t slave, uint8_t *frame, size_t size);
+
+    // Learns the route of an answer to a discover, returns false if it
+    // answers none
+    bool learn (const ModbusRelay::Frame & route);
+
+    // The discovery of a slave has no answer
+    void onDiscoverTimeout (uint8_t slave, unsigned long now);
+
+    // A request to a slave has no response, its route is discovered again
+    void onTimeout (uint8_t slave);
+
+    // Longest frame on air for a request of len bytes to a slave, the route
+    // may change until it is sent
+    size_t maxLength (uint8_t slave, size_t len) const;
+
+  private:
+    Route m_routes[256];
+    bool m_enabled;
+    unsigned long m_holdTime;
+    uint8_t m_sequence;
+
+    // statistics
+    unsigned long m_discoveries;
+    unsigned long m_learned;
+    unsigned long m_failed;
+    unsigned long m_lost;
+
+  public:
+    inline bool isEnabled() const {
+      return m_enabled;
+    }
+
+    inline unsigned long holdTime() const {
+      return m_holdTime;
+    }
+
+    // Discovers sent
+    inline unsigned long discoveries() const {
+      return m_discoveries;
+    }
+
+    // Routes learned
+    inline unsigned long learned() const {
+      return m_learned;
+    }
+
+    // Discoveries without answer
+    inline unsigned long failed() const {
+      return m_failed;
+    }
+
+    // Routes forgotten after a request without response
+    inline unsigned long lost() const {
+      return m_lost;
+    }
+};
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <RHGenericDriver.h>
+#include <RH_RF95.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "CaptureRing.h"
+#include "CircuitBreaker.h"
+#include "Coalescer.h"
+#include "DutyCycle.h"
+#include "EventLoop.h"
+#include "FanOut.h"
+#include "LinkAdapter.h"
+#include "Logger.h"
+#include "LoraAirtime.h"
+#include "Metrics.h"
+#include "MetricsExporter.h"
+#include "ModbusRelay.h"
+#include "ModbusTcpServer.h"
+#include "ReadCache.h"
+#include "RegisterImage.h"
+#include "RouteCache.h"
+#include "RtuFramer.h"
+#include "SerialLine.h"
+#include "SerialReader.h"
+#include "ShadowPoller.h"
+#include "TransactionTable.h"
+
+// Modbus RTU bridge between a serial line and RadioHead drivers
+// Everything is event driven: the serial port, the radio notification
+// file descriptors (eventfd signaled after each radio interrupt) and the
+// timers belong to the same epoll set.
+// Several masters may share the radios: serial lines (addPort()), each
+// with its own timings and priority class, and Modbus TCP clients
+// (listenTcp()). Each request remembers its master so that its response
+// goes back to it, the most urgent requests are sent first.
+// Each radio has its own transactions and duty cycle budget, the slaves are
+// routed to the radios by their address, so that the requests to slaves on
+// different radios proceed in parallel.
+// The slaves out of range are reached through other slaves which repeat
+// the frames (routes()), the requests to them are wrapped in a relay frame
+// along their route, and their response comes back the same way.
+// The event loop thread drives the radios. The serial bytes may be read and
+// timestamped by a dedicated thread (setSerialThread()), and the console is
+// written by the logging thread, both connected to the event loop by SPSC
+// rings, so that neither the console nor a busy loop delays the frames.
+class RtuBridge {
+  public:
+    // A radio of the bridge
+    struct Radio {
+      Radio (EventLoop & loop, RHGenericDriver & drv, int notifyFd, size_t n);
+
+      RHGenericDriver & driver;
+      int fd; // readable when the driver needs attention
+      size_t index;
+      RH_RF95 *rf95; // module under the driver, for the SNR, may be nullptr
+      LoraModem modem;
+      LoraModem tuned; // settings on air, those of a slave profile with the adaptive data rate
+      std::function<void (const LoraModem &)> modemHandler; // changes the settings, nullptr for rf95
+      DutyCycle dutyCycle;
+      TransactionTable transactions;
+      EventTimer deadlineTimer;  // first transaction which expires
+      EventTimer dutyCycleTimer; // the duty cycle budget allows the next request
+      EventTimer holdTimer;      // reads waiting for other reads to merge with, keys waiting for late responses
+    };
+
+    // radioFd: file descriptor readable when the driver needs attention,
+    // eg RH_RF95Event::eventFd(). The driver is the radio 0, the serial
+    // line the port 0.
+    RtuBridge (SerialLine & serial, RHGenericDriver & driver, int radioFd);
+    ~RtuBridge();
+
+    // Adds a radio, returns its index. Must be called before begin().
+    size_t addRadio (RHGenericDriver & driver, int radioFd, const LoraModem & modem = LoraModem());
+
+    // Routes the requests to a slave to a radio, the slaves without route
+    // use the radio 0, broadcasts are sent on all the radios
+    void setRoute (uint8_t slave, size_t radio);
+
+    // Radio of a slave
+    size_t route (uint8_t slave) const;
+
+    // Adds a serial line with its master, returns its index, the master
+    // id of its requests. Must be called before begin().
+    size_t addPort (SerialLine & serial, uint8_t priority = 0);
+
+    // Priority class of the requests of a port, 0 is the most urgent
+    void setPriority (uint8_t priority, size_t port = 0);
+
+    // A request which waits for the radio gains a priority class every usec
+    // microseconds, so that the least urgent ones are not starved, 0 disables it
+    void setAging (unsigned long usec);
+
+    // Reads the serial lines in dedicated threads, must be called before begin()
+    void setSerialThread (bool enable);
+
+    // Serves the Modbus TCP clients on address ("" for all) and port, must
+    // be called before begin(). The serial line may then be closed.
+    bool listenTcp (const std::string & address, uint16_t port, size_t maxClients = 16);
+
+    // Registers the file descriptors in the event loop and starts the threads
+    bool begin();
+
+    // Waits for events at most timeoutMs (-1 for ever) and processes them
+    void poll (int timeoutMs = -1);
+
+    // Watches a file descriptor of the application, eg a signalfd, handler
+    // is called from poll() when it is readable
+    bool watch (int fd, std::function<void()> handler);
+
+    // RTU Modbus timing of a port, the silence between two frames must be
+    // at least 3.5T and the time between two characters must be less than 1.5T
+    void setTimings (unsigned long charInterval, unsigned long frameInterval, size_t port = 0);
+
+    // Response deadline of a transaction
+    void setTimeout (unsigned long usec);
+
+    // Number of transactions which can be in progress at the same time on a radio
+    void setMaxInFlight (size_t maxInFlight);
+
+    // Sends again a request without response, at most retries times before
+    // the response deadline, 0 disables it. The request waits for the time
+    // on air of the request and of its response, the usual response time of
+    // the slave and guard microseconds, this wait doubles at each attempt.
+    // Only the reads and the writes are sent again, not the diagnostics
+    // (0x08) nor the reads of a FIFO queue (0x18).
+    void setRetries (unsigned int retries, unsigned long guard);
+
+    // RF95 module under the driver of a radio (encryption, compact encoding),
+    // the SNR of the received frames is captured if set
+    inline void setRf95 (RH_RF95 & rf95, size_t radio = 0) {
+      m_radios[radio]->rf95 = &rf95;
+    }
+
+    // Called to change the modem settings of a radio to those of a slave
+    // profile (adaptive data rate), by default the spreading factor of the
+    // RF95 module set by setRf95() is changed. Must be called before begin().
+    inline void setModemHandler (std::function<void (const LoraModem &)> handler, size_t radio = 0) {
+      m_radios[radio]->modemHandler = handler;
+    }
+
+    // Answers the master with an exception when the radio fails it: 0x0B
+    // (gateway target device failed to respond) at the deadline of a request
+    // without response, 0x0A (gateway path unavailable) when a request is
+    // dropped, queue full, duty cycle or too long
+    inline void setExceptions (bool enable) {
+      m_exceptions = enable;
+    }
+
+    // Records the traffic in a capture ring, nullptr disables it
+    inline void setCapture (CaptureRing *capture) {
+      m_capture = capture;
+    }
+
+    // Publishes a copy of the metrics to the exporter every period microseconds,
+    // nullptr disables it. Must be called before begin().
+    void setMetricsExporter (MetricsExporter *exporter, unsigned long period);
+
+    // Radio settings used to compute the time on air of the requests
+    inline void setModem (const LoraModem & modem, size_t radio = 0) {
+      m_radios[radio]->modem = modem;
+    }
+
+    // Duty cycle budget of each radio, ratio 0 disables it. A request which
+    // does not fit in the budget waits, it is rejected if it would wait more
+    // than maxDelay microseconds since its reception.
+    void setDutyCycle (double ratio, unsigned long maxDelay);
+
+    // Cache of the read responses, disabled until a TTL is set
+    inline ReadCache & cache() {
+      return m_cache;
+    }
+
+    // Image of the slaves which report by exception, disabled until a range
+    // is subscribed
+    inline RegisterImage & image() {
+      return m_image;
+    }
+
+    // Reads a range of a slave every period microseconds in the background,
+    // the reads of the masters in the range are answered from the image, with
+    // the exception 0x0B if its values are older than maxAge. Returns false
+    // if the function is not a read or the response would not fit in a frame.
+    // Must be called before begin().
+    bool addPoll (uint8_t slave, uint8_t function, uint16_t start, uint16_t quantity,
+                  unsigned long period, unsigned long maxAge);
+
+    // Part of the duty cycle budget of a radio the background reads leave to
+    // the masters, 0 to 1
+    inline void setPollReserve (double reserve) {
+      m_pollReserve = reserve;
+    }
+
+    inline const ShadowPoller & poller() const {
+      return m_poller;
+    }
+
+    // Merging of the reads to the same slave, disabled until a window is set
+    inline Coalescer & coalescer() {
+      return m_coalescer;
+    }
+
+    // Adaptive data rate of the slaves, disabled by default
+    inline LinkAdapter & adapter() {
+      return m_adapter;
+    }
+
+    // Groups of slaves, a write to a group is sent to all its members
+    inline FanOut & fanOut() {
+      return m_fanOut;
+    }
+
+    // Circuit breaker of the unreachable slaves, disabled until a threshold
+    // is set, their requests are answered with the exception 0x0B
+    inline CircuitBreaker & breaker() {
+      return m_breaker;
+    }
+
+    // Routes of the slaves reached through repeaters, disabled until a route
+    // is set or discovered
+    inline RouteCache & routes() {
+      return m_routes;
+    }
+
+    // Time a repeater takes to pass a frame on, added for each hop to the
+    // response deadline with the time on air of the frames passed on
+    inline void setRelayDelay (unsigned long usec) {
+      m_relayDelay = usec;
+    }
+
+    //Si true, aucun affichage sur la console.
+    inline void setQuiet (bool quiet) {
+      m_quiet = quiet;
+    }
+
+  private:
+    // Frame waiting for the serial line
+    struct Reply {
+      std::vector<uint8_t> frame;
+      bool fromRadio;
+      unsigned long received; // micros() of the radio frame
+    };
+
+    // A serial line and its master
+    struct Port {
+      Port (EventLoop & loop, SerialLine & line, size_t n, RtuFramer::Handler handler);
+
+      SerialLine & serial;
+      size_t index;
+      uint8_t priority;
+      RtuFramer framer;
+      std::unique_ptr<SerialReader> reader; // serial ingress thread, nullptr if the loop reads
+      EventTimer frameTimer;
+      EventTimer replyTimer;
+      std::deque<Reply> replies;
+      unsigned long lineFree;      // micros() from which the master can receive a frame
+      unsigned long charInterval;  // maximum time  between 2 characters (1.5c)
+      unsigned long frameInterval; // minimum time between 2 frames (3.5c)
+      unsigned long byteTime;      // time of a character on the line (11 bits)
+    };
+
+    void onSerialReadable (Port & port);
+    void onSerialChunks (Port & port);
+    void onSerialReceived (Port & port);
+    void onFrameTimer (Port & port);
+    void onSerialFrame (Port & port, const uint8_t *frame, size_t len, RtuFramer::Status status);
+    void onRequest (const uint8_t *frame, size_t len, uint32_t master);
+    void onRadioEvent (Radio & radio);
+    void onRadioFrame (Radio & radio, const uint8_t *frame, size_t len);
+    void onResponse (Radio & radio, const uint8_t *frame, size_t len);
+    void onRelay (Radio & radio, const uint8_t *frame, size_t len);
+    void onReport (Radio & radio, const uint8_t *frame, size_t len);
+    void onDeadlineTimer (Radio & radio);
+    void onProbeTimer();
+    void scheduleProbe();
+    void onPollTimer();
+    void schedulePoll();
+    bool isPollable (const Radio & radio) const;
+    void onPollResult (const Transaction & t, bool ok);
+    void invalidate (const uint8_t *frame, size_t len);
+    bool isCurrent (const Transaction & t) const;
+    void except (const uint8_t *request, size_t len, uint8_t code, uint32_t master);
+    void except (const Transaction & t, uint8_t code);
+    void writeGroup (const uint8_t *frame, size_t len, unsigned long now, uint32_t master);
+    void onFanOutResult (const Transaction & t, FanOut::Result result, uint8_t code);
+    void capture (CaptureRing::Direction direction, CaptureRing::Status status,
+                  const Radio & radio, const uint8_t *frame, size_t len);
+    void reply (const uint8_t *frame, size_t len, uint32_t master, bool fromRadio = false, unsigned long received = 0);
+    void flushReplies (Port & port);
+    uint8_t priority (uint32_t master) const;
+    void queued (Radio & radio, const uint8_t *frame, uint32_t master);
+    void discover (Radio & radio, uint8_t slave, unsigned long now);
+    void leave (const Transaction & t, unsigned long now, bool sent);
+    bool queue (Radio & radio, const uint8_t *frame, size_t len, unsigned long now, uint32_t master);
+    bool broadcast (Radio & radio, const uint8_t *frame, size_t len, unsigned long now, uint32_t master);
+    void tune (Radio & radio, const LoraModem & modem);
+    unsigned long roundTrip (const LoraModem & modem, const Transaction & t) const;
+    unsigned long retryAfter (const LoraModem & modem, const Transaction & t) const;
+    unsigned long relayTime (const LoraModem & modem, const Transaction & t) const;
+    void onTurnaround (const Radio & radio, const Transaction & t, size_t len, unsigned long dt);
+    void dispatch();
+    void dispatch (Radio & radio);
+
+    EventLoop m_loop;
+    std::vector<std::unique_ptr<Port>> m_ports;
+    bool m_serialThread;
+    std::vector<std::unique_ptr<Radio>> m_radios;
+    uint8_t m_route[256]; // radio of each slave
+    unsigned long m_maxDutyDelay; // maximum time a request waits for the duty cycle budget
+    unsigned long m_retryGuard;   // added to the expected round trip of a request sent again
+    // Time a slave takes to answer, out of the time on air, in microseconds
+    struct Turnaround {
+      unsigned long mean;
+      unsigned long deviation;
+    };
+    Turnaround m_turnaround[256]; // mean 0 if the slave has not answered yet
+    uint32_t m_writes[256]; // writes to each slave received or answered, stamped on the reads when sent
+    ReadCache m_cache;
+    RegisterImage m_image;
+    Coalescer m_coalescer;
+    LinkAdapter m_adapter;
+    CircuitBreaker m_breaker;
+    FanOut m_fanOut;
+    RouteCache m_routes;
+    unsigned long m_relayDelay; // time a repeater takes to pass a frame on
+    EventTimer m_probeTimer;
+    ShadowPoller m_poller;
+    EventTimer m_pollTimer;
+    double m_pollReserve;
+    bool m_exceptions;
+    CaptureRing *m_capture;
+    Metrics m_metrics;
+    MetricsExporter *m_exporter;
+    unsigned long m_metricsPeriod;
+    EventTimer m_metricsTimer;
+    std::unique_ptr<ModbusTcpServer> m_tcp; // nullptr without TCP clients
+    Logger m_log;
+    bool m_quiet;
+
+    uint8_t m_rxbuf[255]; // frame from the radio, longer than RH_RF95_MAX_MESSAGE_LEN once decoded by RHCompactDriver
+
+  public:
+    inline unsigned long charInterval (size_t port = 0) const {
+      return m_ports[port]->charInterval;
+    }
+
+    inline unsigned long frameInterval (size_t port = 0) const {
+      return m_ports[port]->frameInterval;
+    }
+
+    inline size_t ports() const {
+      return m_ports.size();
+    }
+
+    inline const Metrics & metrics() const {
+      return m_metrics;
+    }
+
+    inline Logger & logger() {
+      return m_log;
+    }
+
+    // Serial ingress thread of a port, nullptr if disabled
+    inline const SerialReader *serialReader (size_t port = 0) const {
+      return m_ports[port]->reader.get();
+    }
+
+    // Modbus TCP server, nullptr if disabled
+    inline const ModbusTcpServer *tcpServer() const {
+      return m_tcp.get();
+    }
+
+    inline const RtuFramer & framer (size_t port = 0) const {
+      return m_ports[port]->framer;
+    }
+
+    inline size_t radios() const {
+      return m_radios.size();
+    }
+
+    inline Radio & radio (size_t index = 0) {
+      return *m_radios[index];
+    }
+
+    inline const TransactionTable & transactions (size_t radio = 0) const {
+      return m_radios[radio]->transactions;
+    }
+
+    inline const LoraModem & modem (size_t radio = 0) const {
+      return m_radios[radio]->modem;
+    }
+
+    inline DutyCycle & dutyCycle (size_t radio = 0) {
+      return m_radios[radio]->dutyCycle;
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include "ModbusCrc.h"
+
+// Modbus RTU receive state machine
+// The bytes are given as they are read from the serial port with the time of
+// the read. A silence of T3.5 ends a frame, a silence longer than T1.5 inside
+// a frame is counted as a gap error. When several frames are received back to
+// back (pipelined requests, bytes batched by the kernel...), the burst is
+// split by checking the CRC at each candidate boundary.
+class RtuFramer {
+  public:
+    enum Status {
+      FrameOk,
+      CrcError,   // no valid CRC found
+      TooShort,   // less than 4 bytes, flushed
+      Overflow    // more bytes than BufferSize without silence
+    };
+
+    // Called for each frame (or garbage) found
+    typedef std::function<void (const uint8_t *frame, size_t len, Status status)> Handler;
+
+    // Two RTU frames of 256 bytes
+    static const size_t BufferSize = 512;
+    // Frame boundaries candidates remembered for a burst
+    static const size_t MaxCandidates = 32;
+
+    explicit RtuFramer (Handler handler);
+
+    // charInterval: T1.5, frameInterval: T3.5, byteTime: time of one character
+    // on the line (11 bits), all in microseconds
+    void setTimings (unsigned long charInterval, unsigned long frameInterval, unsigned long byteTime);
+
+    // Bytes read at time t (micros()), t is the time of the last byte
+    void receive (const uint8_t *data, size_t len, unsigned long t);
+
+    // To be called at deadline(), ends the frame if T3.5 has elapsed since
+    // the last byte. Returns false if it was too early.
+    bool timeout (unsigned long t);
+
+    // Discards the bytes received
+    void clear();
+
+    // Returns the expected length of a request, 0 if it can not be known yet
+    static size_t requestLength (const uint8_t *frame, size_t len);
+
+    // true if the last 2 bytes of frame are its CRC
+    static bool isValid (const uint8_t *frame, size_t len);
+
+  private:
+    void emitComplete();
+    void flush();
+    bool split (size_t pos, size_t depth, size_t *ends, size_t & count);
+    void emit (const uint8_t *frame, size_t len, Status status);
+
+    Handler m_handler;
+    unsigned long m_charInterval;
+    unsigned long m_frameInterval;
+    unsigned long m_byteTime;
+    unsigned long m_last; // time of the last byte
+    bool m_gap; // T1.5 exceeded in the current frame
+    size_t m_len;
+    uint8_t m_buf[BufferSize];
+    ModbusCrc m_crc; // CRC of m_buf, updated as the bytes arrive
+    size_t m_candidate[MaxCandidates]; // lengths for which the CRC of m_buf checks
+    size_t m_candidates;
+
+    // statistics
+    unsigned long m_frames;
+    unsigned long m_crcErrors;
+    unsigned long m_gapErrors;
+    unsigned long m_splits;
+
+  public:
+    //Vrai si des octets attendent la fin de trame.
+    inline bool pending() const {
+      return m_len > 0;
+    }
+
+    //Date à laquelle appeler timeout().
+    inline unsigned long deadline() const {
+      return m_last + m_frameInterval;
+    }
+
+    inline unsigned long frames() const {
+      return m_frames;
+    }
+
+    inline unsigned long crcErrors() const {
+      return m_crcErrors;
+    }
+
+    //Nombre de trames reçues avec un silence > T1.5.
+    inline unsigned long gapErrors() const {
+      return m_gapErrors;
+    }
+
+    //Nombre de trames séparées dans une rafale.
+    inline unsigned long splits() const {
+      return m_splits;
+    }
+};
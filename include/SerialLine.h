@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Serial port opened in raw mode, 8 data bits, even parity, 1 stop bit (Modbus RTU)
+// Unlike Piduino::SerialPort, the file descriptor is available so that it can
+// be watched by an EventLoop, the reads are non-blocking.
+class SerialLine {
+  public:
+    SerialLine();
+    ~SerialLine();
+
+    // Opens the port, baudrate must be a standard value (1200..4000000)
+    bool open (const std::string & path, unsigned long baudrate);
+    void close();
+
+    // Reads at most len bytes, returns 0 if there is nothing to read, -1 on error
+    ssize_t read (uint8_t *buf, size_t len);
+
+    // Writes len bytes, waits if the kernel buffer is full, returns -1 on error
+    ssize_t write (const uint8_t *buf, size_t len);
+
+  private:
+    int m_fd;
+    unsigned long m_baudrate;
+    std::string m_path;
+
+  public:
+    //Descripteur de fichier du port, -1 si fermé.
+    inline int fd() const {
+      return m_fd;
+    }
+
+    inline bool isOpen() const {
+      return m_fd >= 0;
+    }
+
+    inline unsigned long baudrate() const {
+      return m_baudrate;
+    }
+
+    inline const std::string & path() const {
+      return m_path;
+    }
+};
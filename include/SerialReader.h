@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+#include "SerialLine.h"
+#include "SpscRing.h"
+
+// Serial ingress thread
+// The bytes are read as soon as the kernel has them and timestamped by this
+// thread, then passed to the event loop through a SPSC ring of preallocated
+// chunks. The event loop watches fd(), an eventfd signaled for each chunk, so
+// that a busy event loop (radio, console) no longer delays the timestamps the
+// RTU framer relies on.
+class SerialReader {
+  public:
+    // Bytes read by one read()
+    struct Chunk {
+      unsigned long time; // micros() after the read
+      uint16_t len;
+      uint8_t data[256];
+    };
+
+    explicit SerialReader (SerialLine & serial);
+    ~SerialReader();
+
+    bool start();
+    void stop();
+
+    // Consumer side, to be called by the event loop thread only
+    // Oldest chunk, nullptr if none
+    inline const Chunk *front() {
+      return m_ring.front();
+    }
+
+    inline void pop() {
+      m_ring.pop();
+    }
+
+  private:
+    void run();
+
+    SerialLine & m_serial;
+    SpscRing<Chunk, 64> m_ring;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<unsigned long> m_stalls;
+    int m_fd;     // eventfd, a chunk is available
+    int m_stopFd; // eventfd, wakes up the thread to stop
+
+  public:
+    //Descripteur à surveiller, lisible quand un bloc est disponible.
+    inline int fd() const {
+      return m_fd;
+    }
+
+    inline bool isRunning() const {
+      return m_running;
+    }
+
+    // Number of times the ring was full, the reads waited for the event loop
+    // (the bytes stay in the kernel buffer, nothing is lost)
+    inline unsigned long stalls() const {
+      return m_stalls;
+    }
+};
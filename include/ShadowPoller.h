@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Schedule of the reads the bridge sends itself to keep a mirror of the
+// slaves (RegisterImage), so that the master is answered without waiting
+// for the radio. Each entry reads a range of a slave every period, the next
+// read is due one period after the previous one was due, the reads missed
+// meanwhile are skipped rather than sent in a burst. An entry is pending
+// from the time its read is sent until its response or its failure.
+// A write to the range makes it due at once, the written values are read back.
+class ShadowPoller {
+  public:
+    // Master id of the reads of the poller, nobody waits for their responses
+    static const uint32_t Master = 0xFFFFFFFFUL;
+    // Priority class of the reads, after those of the masters
+    static const uint8_t Priority = 15;
+
+    struct Entry {
+      uint8_t slave;
+      uint8_t function;     // 01 to 04
+      uint16_t start;
+      uint16_t quantity;
+      unsigned long period; // us
+      unsigned long due;    // micros() of the next read
+      bool pending;
+      bool again;           // written while pending, read again at once
+      unsigned long polls;
+      unsigned long failures; // timeouts, exceptions and requests dropped
+      unsigned long deferred; // reads skipped, duty cycle reserve or slave unreachable
+    };
+
+    ShadowPoller();
+
+    // Adds a read of a range every period microseconds, returns its index,
+    // -1 if the function is not a read or the response would not fit in a frame
+    int add (uint8_t slave, uint8_t function, uint16_t start, uint16_t quantity, unsigned long period);
+
+    // The first reads are due at now, spread over their period
+    void start (unsigned long now);
+
+    // true if the entry is due at now and not pending
+    bool isDue (size_t index, unsigned long now) const;
+
+    // Builds the read of an entry (8 bytes, CRC included), returns its length
+    size_t request (size_t index, uint8_t *frame) const;
+
+    // The read of an entry has been queued, it is pending until done()
+    void sent (size_t index);
+
+    // The read of an entry has ended, with its response if ok
+    void done (size_t index, bool ok, unsigned long now);
+
+    // The read of an entry has not been sent, it is due again one period later
+    void defer (size_t index, unsigned long now);
+
+    // Makes due at once the entries whose range a write request overlaps,
+    // returns their number
+    size_t expedite (const uint8_t *request, size_t len, unsigned long now);
+
+  private:
+    void schedule (Entry & e, unsigned long now);
+
+    std::vector<Entry> m_entries;
+
+  public:
+    inline bool isEnabled() const {
+      return !m_entries.empty();
+    }
+
+    inline size_t size() const {
+      return m_entries.size();
+    }
+
+    inline const Entry & entry (size_t index) const {
+      return m_entries[index];
+    }
+
+    // Reads sent
+    unsigned long polls() const;
+
+    // Reads without valid response
+    unsigned long failures() const;
+
+    // Reads skipped
+    unsigned long deferred() const;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded lock-free queue between one producer thread and one consumer thread
+// The N slots are allocated with the ring, a slot is filled in place between
+// reserve() and commit(), and read in place between front() and pop(), so
+// that a frame is copied only once. N must be a power of 2.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert ( (N & (N - 1)) == 0, "SpscRing size must be a power of 2");
+
+  public:
+    SpscRing() : m_head (0), m_tail (0) {}
+
+    // Producer: free slot to fill, nullptr if the ring is full
+    inline T *reserve() {
+      size_t head = m_head.load (std::memory_order_relaxed);
+
+      if (head - m_tail.load (std::memory_order_acquire) == N) {
+        return nullptr;
+      }
+      return &m_slots[head & (N - 1)];
+    }
+
+    // Producer: publishes the slot returned by reserve()
+    inline void commit() {
+      m_head.store (m_head.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: oldest slot, nullptr if the ring is empty
+    inline T *front() {
+      size_t tail = m_tail.load (std::memory_order_relaxed);
+
+      if (tail == m_head.load (std::memory_order_acquire)) {
+        return nullptr;
+      }
+      return &m_slots[tail & (N - 1)];
+    }
+
+    // Consumer: releases the slot returned by front()
+    inline void pop() {
+      m_tail.store (m_tail.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    inline bool empty() const {
+      return m_head.load (std::memory_order_acquire) == m_tail.load (std::memory_order_acquire);
+    }
+
+    inline size_t size() const {
+      return m_head.load (std::memory_order_acquire) - m_tail.load (std::memory_order_acquire);
+    }
+
+    static inline size_t capacity() {
+      return N;
+    }
+
+  private:
+    // head and tail on different cache lines, they are written by different
+    // threads (padding rather than alignas, operator new of C++11 ignores it)
+    std::atomic<size_t> m_head;
+    char m_pad1[64 - sizeof (std::atomic<size_t>)];
+    std::atomic<size_t> m_tail;
+    char m_pad2[64 - sizeof (std::atomic<size_t>)];
+    T m_slots[N];
+};
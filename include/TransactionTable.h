@@ -0,0 +1,256 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+// Modbus request forwarded on the radio, waiting for its response
+struct Transaction {
+  uint8_t slave;
+  uint8_t function;
+  unsigned long received; // micros() when the request was received
+  unsigned long sent;     // micros() when the request was last sent on the radio
+  unsigned long deadline; // micros() after which a response is stale
+  unsigned long retry;    // micros() after which the request is sent again, deadline if it is not
+  unsigned long ready;    // micros() from which the request can be sent
+  unsigned long settle;   // time after an attempt within which its response is expected
+  uint8_t profile;        // of a broadcast with the adaptive data rate, sent once per profile
+  uint8_t priority;       // class of the master, 0 is the most urgent
+  uint8_t attempts;       // times the request has been sent on the radio
+  uint32_t generation;    // writes to the slave seen when the request was first sent (RtuBridge)
+  bool due;               // the last attempt is lost, the request waits to be sent again
+  bool probe;             // sent by the bridge to an unreachable slave, the response is not forwarded
+  bool discover;          // discovery of the route of a slave (RouteCache), the answer is not forwarded
+  bool split;             // part of a merged read which got an exception, sent alone and never merged again
+  uint16_t fanout;        // write to a group it belongs to (FanOut), 0 if none
+  uint16_t shadow;        // entry of the shadow poller + 1 which sent it (ShadowPoller), 0 if none
+  uint32_t master;        // which waits for the response, index of its serial port or TCP client (ModbusTcpServer)
+  std::vector<uint8_t> request;
+  std::vector<std::vector<uint8_t>> parts; // requests of the masters merged in request
+  std::vector<uint32_t> masters;           // master of each part
+
+  // key of the transaction table
+  inline uint16_t key() const {
+    return (slave << 8) | function;
+  }
+};
+
+// Table of the transactions, keyed by slave address and function code
+// The requests received while the radio is busy are queued, a request is
+// sent only if there is no transaction in progress with the same key, so
+// that a response can always be paired with its request, nor while the route
+// of its slave is being discovered. Responses which match no transaction
+// are orphans, those which match a transaction that has expired are late,
+// both are dropped. The response to an attempt may still come after its
+// transaction has ended, so its key stays blocked and a late response can
+// not be taken for the response to the next request: until the responses
+// to the other attempts have come or the deadline when it has ended by the
+// response to an attempt, during the settle time after its deadline when it
+// has expired.
+// The queued requests leave by priority class, the oldest first in a class,
+// a request gains a class each time it has waited the aging time so that a
+// busy urgent master does not starve the others. A write to a slave does
+// not leave before an older read to the slave held to be merged.
+// A request without response after its retry time is sent again, at most
+// retries times, until its deadline. It stays in progress meanwhile, so that
+// a response to any attempt ends it, the responses to the other attempts
+// are late.
+class TransactionTable {
+  public:
+    enum Match {
+      Matched,
+      Late,
+      Orphan
+    };
+
+    // maxQueue: maximum number of requests waiting for the radio
+    // maxInFlight: maximum number of transactions in progress
+    TransactionTable (size_t maxQueue = 32, size_t maxInFlight = 1);
+
+    // Response deadline after the request has been sent
+    inline void setTimeout (unsigned long usec) {
+      m_timeout = usec;
+    }
+
+    inline void setMaxInFlight (size_t maxInFlight) {
+      m_maxInFlight = maxInFlight;
+    }
+
+    // Number of times a request without response is sent again, 0 disables it
+    inline void setRetries (unsigned int retries) {
+      m_retries = retries;
+    }
+
+    // Waiting time after which a queued request gains a priority class,
+    // 0 for strict priorities
+    inline void setAging (unsigned long usec) {
+      m_aging = usec;
+    }
+
+    // Queues a request from the master, returns false if the queue is full
+    // hold: time the request waits before it can be sent
+    bool push (const uint8_t *frame, size_t len, unsigned long now, unsigned long hold = 0);
+
+    // Queues again at the head of the queue a request which has already been
+    // counted, a part of a merged read, even if the queue is full
+    Transaction *requeue (const uint8_t *frame, size_t len, unsigned long received);
+
+    // Last queued request with the slave and function, nullptr if none
+    Transaction *queued (uint8_t slave, uint8_t function);
+
+    // Last queued request with the slave and function into which a read can
+    // be merged, nullptr if none or if another request to the slave has
+    // been queued after it
+    Transaction *mergeable (uint8_t slave, uint8_t function);
+
+    // Returns the next request which can be sent, nullptr if none,
+    // the request is in progress from now, until match() or expire()
+    // retryAfter: time after which the request is sent again without
+    // response, 0 if it is not
+    // extend: added to the response deadline, time spent by the repeaters
+    // settle: time after an attempt within which its response is expected,
+    // its key is blocked that long after the deadline
+    // generation: stamped on the request (Transaction::generation)
+    const Transaction *next (unsigned long now, unsigned long retryAfter = 0, unsigned long extend = 0,
+                             unsigned long settle = 0, uint32_t generation = 0);
+
+    // Returns the request that next() would return, without starting it
+    const Transaction *peek (unsigned long now);
+
+    // Removes from the queue the request returned by peek(), returns false if none
+    bool discard (unsigned long now);
+
+    // Time at which the first held request becomes ready, or its key free,
+    // false if none is held
+    bool nextReady (unsigned long now, unsigned long & when) const;
+
+    // Pairs a radio response with its transaction, which ends, t receives it
+    Match match (const uint8_t *frame, size_t len, unsigned long now, Transaction & t);
+
+    // Ends the transactions whose deadline has passed, calls handler for each,
+    // the transactions whose retry time has passed become due, lost is
+    // called for each
+    size_t expire (unsigned long now, std::function<void (const Transaction &)> handler,
+                   std::function<void (const Transaction &)> lost = nullptr);
+
+    // Oldest transaction due to be sent again, nullptr if none
+    const Transaction *due() const;
+
+    // Sends again the transaction returned by due(), as next() does
+    const Transaction *resend (unsigned long now, unsigned long retryAfter);
+
+    // The transaction returned by due() will not be sent again, it waits
+    // for its deadline
+    void abandon();
+
+    // Deadline or retry time of the first transaction which will expire,
+    // only valid if inFlight() > 0
+    unsigned long nextDeadline() const;
+
+  private:
+    bool isInFlight (uint16_t key) const;
+    bool isBlocked (uint16_t key, unsigned long now, unsigned long & until) const;
+    bool isDiscovering (uint8_t slave) const;
+    void init (Transaction & t, const uint8_t *frame, size_t len, unsigned long received);
+    size_t firstDue() const;
+    void remember (uint16_t key, unsigned long now, unsigned long until, uint8_t pending);
+    void schedule (Transaction & t, unsigned long now, unsigned long retryAfter);
+    std::deque<Transaction>::iterator candidate (unsigned long now);
+
+    std::deque<Transaction> m_queue;
+    std::vector<Transaction> m_inFlight;
+    Transaction m_broadcast; // last broadcast request returned by next()
+    // An ended transaction which may still receive a late response
+    struct Expired {
+      uint16_t key;
+      uint8_t pending;     // responses to its attempts which may still come
+      unsigned long time;  // micros() when it ended
+      unsigned long until; // micros() until which its key is blocked, if a response may still come
+    };
+    std::deque<Expired> m_expired;
+    std::vector<uint64_t> m_keys; // master and key of the requests seen by candidate(), kept to avoid an allocation per call
+
+    size_t m_maxQueue;
+    size_t m_maxInFlight;
+    unsigned long m_timeout;
+    unsigned int m_retries;
+    unsigned long m_aging;
+
+    // statistics
+    unsigned long m_requests;
+    unsigned long m_responses;
+    unsigned long m_timeouts;
+    unsigned long m_late;
+    unsigned long m_orphans;
+    unsigned long m_overflows;
+    unsigned long m_resent;
+    unsigned long m_recovered;
+    size_t m_maxDepth;
+
+  public:
+    inline unsigned long timeout() const {
+      return m_timeout;
+    }
+
+    inline unsigned int retries() const {
+      return m_retries;
+    }
+
+    inline unsigned long aging() const {
+      return m_aging;
+    }
+
+    inline size_t maxInFlight() const {
+      return m_maxInFlight;
+    }
+
+    inline size_t queued() const {
+      return m_queue.size();
+    }
+
+    inline size_t inFlight() const {
+      return m_inFlight.size();
+    }
+
+    inline unsigned long requests() const {
+      return m_requests;
+    }
+
+    inline unsigned long responses() const {
+      return m_responses;
+    }
+
+    inline unsigned long timeouts() const {
+      return m_timeouts;
+    }
+
+    inline unsigned long late() const {
+      return m_late;
+    }
+
+    inline unsigned long orphans() const {
+      return m_orphans;
+    }
+
+    // Requests sent again
+    inline unsigned long resent() const {
+      return m_resent;
+    }
+
+    // Responses to a request which has been sent again
+    inline unsigned long recovered() const {
+      return m_recovered;
+    }
+
+    //Nombre de requêtes perdues, file pleine.
+    inline unsigned long overflows() const {
+      return m_overflows;
+    }
+
+    //Profondeur maximale atteinte par la file.
+    inline size_t maxDepth() const {
+      return m_maxDepth;
+    }
+};
@@ -0,0 +1,414 @@
+#include <string.h>
+
+#include "AesCipher.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define AES_HAVE_AESNI 1
+#define AES_TARGET_AESNI __attribute__ ((target ("aes,sse2")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define AES_HAVE_ARM 1
+#if defined(__clang__)
+#define AES_TARGET_ARM __attribute__ ((target ("aes")))
+#else
+#define AES_TARGET_ARM __attribute__ ((target ("+crypto")))
+#endif
+#elif defined(__arm__) && defined(__ARM_FEATURE_CRYPTO)
+// 32-bit ARM, only if built with -mfpu=crypto-neon-fp-armv8
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define AES_HAVE_ARM 1
+#define AES_TARGET_ARM
+#endif
+
+// -----------------------------------------------------------------------------
+// Tables, computed at startup from the GF(2^8) arithmetic
+static uint8_t sbox[256];
+static uint8_t invSbox[256];
+static uint32_t Te[4][256];
+static uint32_t Td[4][256];
+
+static inline uint8_t xtime (uint8_t x) {
+  return (x << 1) ^ ( (x & 0x80) ? 0x1B : 0);
+}
+
+static uint8_t gmul (uint8_t a, uint8_t b) {
+  uint8_t p = 0;
+
+  while (b) {
+    if (b & 1) {
+      p ^= a;
+    }
+    a = xtime (a);
+    b >>= 1;
+  }
+  return p;
+}
+
+static inline uint32_t rotr8 (uint32_t w) {
+  return (w >> 8) | (w << 24);
+}
+
+struct AesTables {
+  AesTables() {
+    uint8_t p = 1, q = 1;
+
+    // p runs through the multiplicative group, q is its inverse
+    do {
+      p = p ^ xtime (p);
+      q ^= q << 1;
+      q ^= q << 2;
+      q ^= q << 4;
+      if (q & 0x80) {
+        q ^= 0x09;
+      }
+      uint8_t x = q ^ ( (q << 1) | (q >> 7)) ^ ( (q << 2) | (q >> 6)) ^ ( (q << 3) | (q >> 5)) ^ ( (q << 4) | (q >> 4));
+      sbox[p] = x ^ 0x63;
+    }
+    while (p != 1);
+    sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+      invSbox[sbox[i]] = i;
+    }
+
+    for (int i = 0; i < 256; i++) {
+      uint8_t s = sbox[i];
+      uint8_t v = invSbox[i];
+
+      Te[0][i] = (gmul (s, 2) << 24) | (s << 16) | (s << 8) | gmul (s, 3);
+      Td[0][i] = (gmul (v, 14) << 24) | (gmul (v, 9) << 16) | (gmul (v, 13) << 8) | gmul (v, 11);
+      for (int k = 1; k < 4; k++) {
+        Te[k][i] = rotr8 (Te[k - 1][i]);
+        Td[k][i] = rotr8 (Td[k - 1][i]);
+      }
+    }
+  }
+};
+static AesTables aesTables;
+
+static inline uint32_t load32 (const uint8_t *p) {
+  return ( (uint32_t) p[0] << 24) | ( (uint32_t) p[1] << 16) | ( (uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void store32 (uint8_t *p, uint32_t w) {
+  p[0] = w >> 24;
+  p[1] = w >> 16;
+  p[2] = w >> 8;
+  p[3] = w;
+}
+
+// -----------------------------------------------------------------------------
+AesCipher::AesCipher (Backend backend) {
+
+  clear();
+  if (!setBackend (backend)) {
+    m_backend = Table;
+  }
+}
+
+AesCipher::~AesCipher() {
+
+  clear();
+}
+
+size_t AesCipher::blockSize() const {
+  return 16;
+}
+
+size_t AesCipher::keySize() const {
+  return 16;
+}
+
+void AesCipher::clear() {
+
+  memset (m_ek, 0, sizeof (m_ek));
+  memset (m_dk, 0, sizeof (m_dk));
+  memset (m_ekBytes, 0, sizeof (m_ekBytes));
+  memset (m_dkBytes, 0, sizeof (m_dkBytes));
+}
+
+bool AesCipher::setBackend (Backend backend) {
+
+  if (backend == Auto) {
+    backend = bestBackend();
+  }
+  if (!isSupported (backend)) {
+    return false;
+  }
+  m_backend = backend;
+  return true;
+}
+
+bool AesCipher::isSupported (Backend backend) {
+
+  switch (backend) {
+    case Auto:
+    case Table:
+      return true;
+
+    case AesNi: {
+#if defined(AES_HAVE_AESNI)
+      unsigned int a, b, c, d;
+
+      return __get_cpuid (1, &a, &b, &c, &d) && (c & bit_AES);
+#else
+      return false;
+#endif
+    }
+
+    case ArmCrypto:
+#if defined(AES_HAVE_ARM) && defined(__aarch64__)
+      return (getauxval (AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(AES_HAVE_ARM)
+      return (getauxval (AT_HWCAP2) & HWCAP2_AES) != 0;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+AesCipher::Backend AesCipher::bestBackend() {
+
+  if (isSupported (AesNi)) {
+    return AesNi;
+  }
+  if (isSupported (ArmCrypto)) {
+    return ArmCrypto;
+  }
+  return Table;
+}
+
+const char *AesCipher::backendName (Backend backend) {
+  static const char *names[] = { "auto", "table", "aes-ni", "armv8" };
+
+  return names[backend];
+}
+
+bool AesCipher::backendFromName (const char *name, Backend & backend) {
+
+  for (int b = Auto; b <= ArmCrypto; b++) {
+    if (strcmp (name, backendName (static_cast<Backend> (b))) == 0) {
+
+      backend = static_cast<Backend> (b);
+      return true;
+    }
+  }
+  return false;
+}
+
+// FIPS-197 key expansion, the decryption keys are those of the equivalent
+// inverse cipher (InvMixColumns applied to the rounds 1 to 9), as expected
+// by the tables, AESDEC and AESD
+bool AesCipher::setKey (const uint8_t *key, size_t len) {
+  uint8_t rcon = 1;
+
+  if (len != 16) {
+    return false;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    m_ek[i] = load32 (key + 4 * i);
+  }
+  for (int i = 4; i < 44; i++) {
+    uint32_t t = m_ek[i - 1];
+
+    if (i % 4 == 0) {
+      t = ( (uint32_t) sbox[ (t >> 16) & 0xFF] << 24) | ( (uint32_t) sbox[ (t >> 8) & 0xFF] << 16) |
+          ( (uint32_t) sbox[t & 0xFF] << 8) | sbox[t >> 24];
+      t ^= (uint32_t) rcon << 24;
+      rcon = xtime (rcon);
+    }
+    m_ek[i] = m_ek[i - 4] ^ t;
+  }
+
+  for (int r = 0; r <= 10; r++) {
+    for (int c = 0; c < 4; c++) {
+      uint32_t w = m_ek[4 * (10 - r) + c];
+
+      if (r > 0 && r < 10) {
+        w = Td[0][sbox[w >> 24]] ^ Td[1][sbox[ (w >> 16) & 0xFF]] ^
+            Td[2][sbox[ (w >> 8) & 0xFF]] ^ Td[3][sbox[w & 0xFF]];
+      }
+      m_dk[4 * r + c] = w;
+    }
+  }
+
+  for (int i = 0; i < 44; i++) {
+    store32 (m_ekBytes + 4 * i, m_ek[i]);
+    store32 (m_dkBytes + 4 * i, m_dk[i]);
+  }
+  return true;
+}
+
+void AesCipher::encryptBlock (uint8_t *output, const uint8_t *input) {
+
+  switch (m_backend) {
+    case AesNi:
+      encryptAesNi (output, input);
+      break;
+    case ArmCrypto:
+      encryptArm (output, input);
+      break;
+    default:
+      encryptTable (output, input);
+      break;
+  }
+}
+
+void AesCipher::decryptBlock (uint8_t *output, const uint8_t *input) {
+
+  switch (m_backend) {
+    case AesNi:
+      decryptAesNi (output, input);
+      break;
+    case ArmCrypto:
+      decryptArm (output, input);
+      break;
+    default:
+      decryptTable (output, input);
+      break;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Table backend
+void AesCipher::encryptTable (uint8_t *output, const uint8_t *input) const {
+  const uint32_t *rk = m_ek;
+  uint32_t s0 = load32 (input) ^ rk[0];
+  uint32_t s1 = load32 (input + 4) ^ rk[1];
+  uint32_t s2 = load32 (input + 8) ^ rk[2];
+  uint32_t s3 = load32 (input + 12) ^ rk[3];
+  uint32_t t0, t1, t2, t3;
+
+  for (int r = 1; r < 10; r++) {
+    rk += 4;
+    t0 = Te[0][s0 >> 24] ^ Te[1][ (s1 >> 16) & 0xFF] ^ Te[2][ (s2 >> 8) & 0xFF] ^ Te[3][s3 & 0xFF] ^ rk[0];
+    t1 = Te[0][s1 >> 24] ^ Te[1][ (s2 >> 16) & 0xFF] ^ Te[2][ (s3 >> 8) & 0xFF] ^ Te[3][s0 & 0xFF] ^ rk[1];
+    t2 = Te[0][s2 >> 24] ^ Te[1][ (s3 >> 16) & 0xFF] ^ Te[2][ (s0 >> 8) & 0xFF] ^ Te[3][s1 & 0xFF] ^ rk[2];
+    t3 = Te[0][s3 >> 24] ^ Te[1][ (s0 >> 16) & 0xFF] ^ Te[2][ (s1 >> 8) & 0xFF] ^ Te[3][s2 & 0xFF] ^ rk[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+
+  // last round without MixColumns
+  rk += 4;
+  store32 (output, ( (uint32_t) sbox[s0 >> 24] << 24 | (uint32_t) sbox[ (s1 >> 16) & 0xFF] << 16 |
+                     (uint32_t) sbox[ (s2 >> 8) & 0xFF] << 8 | sbox[s3 & 0xFF]) ^ rk[0]);
+  store32 (output + 4, ( (uint32_t) sbox[s1 >> 24] << 24 | (uint32_t) sbox[ (s2 >> 16) & 0xFF] << 16 |
+                         (uint32_t) sbox[ (s3 >> 8) & 0xFF] << 8 | sbox[s0 & 0xFF]) ^ rk[1]);
+  store32 (output + 8, ( (uint32_t) sbox[s2 >> 24] << 24 | (uint32_t) sbox[ (s3 >> 16) & 0xFF] << 16 |
+                         (uint32_t) sbox[ (s0 >> 8) & 0xFF] << 8 | sbox[s1 & 0xFF]) ^ rk[2]);
+  store32 (output + 12, ( (uint32_t) sbox[s3 >> 24] << 24 | (uint32_t) sbox[ (s0 >> 16) & 0xFF] << 16 |
+                          (uint32_t) sbox[ (s1 >> 8) & 0xFF] << 8 | sbox[s2 & 0xFF]) ^ rk[3]);
+}
+
+void AesCipher::decryptTable (uint8_t *output, const uint8_t *input) const {
+  const uint32_t *rk = m_dk;
+  uint32_t s0 = load32 (input) ^ rk[0];
+  uint32_t s1 = load32 (input + 4) ^ rk[1];
+  uint32_t s2 = load32 (input + 8) ^ rk[2];
+  uint32_t s3 = load32 (input + 12) ^ rk[3];
+  uint32_t t0, t1, t2, t3;
+
+  for (int r = 1; r < 10; r++) {
+    rk += 4;
+    t0 = Td[0][s0 >> 24] ^ Td[1][ (s3 >> 16) & 0xFF] ^ Td[2][ (s2 >> 8) & 0xFF] ^ Td[3][s1 & 0xFF] ^ rk[0];
+    t1 = Td[0][s1 >> 24] ^ Td[1][ (s0 >> 16) & 0xFF] ^ Td[2][ (s3 >> 8) & 0xFF] ^ Td[3][s2 & 0xFF] ^ rk[1];
+    t2 = Td[0][s2 >> 24] ^ Td[1][ (s1 >> 16) & 0xFF] ^ Td[2][ (s0 >> 8) & 0xFF] ^ Td[3][s3 & 0xFF] ^ rk[2];
+    t3 = Td[0][s3 >> 24] ^ Td[1][ (s2 >> 16) & 0xFF] ^ Td[2][ (s1 >> 8) & 0xFF] ^ Td[3][s0 & 0xFF] ^ rk[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+
+  rk += 4;
+  store32 (output, ( (uint32_t) invSbox[s0 >> 24] << 24 | (uint32_t) invSbox[ (s3 >> 16) & 0xFF] << 16 |
+                     (uint32_t) invSbox[ (s2 >> 8) & 0xFF] << 8 | invSbox[s1 & 0xFF]) ^ rk[0]);
+  store32 (output + 4, ( (uint32_t) invSbox[s1 >> 24] << 24 | (uint32_t) invSbox[ (s0 >> 16) & 0xFF] << 16 |
+                         (uint32_t) invSbox[ (s3 >> 8) & 0xFF] << 8 | invSbox[s2 & 0xFF]) ^ rk[1]);
+  store32 (output + 8, ( (uint32_t) invSbox[s2 >> 24] << 24 | (uint32_t) invSbox[ (s1 >> 16) & 0xFF] << 16 |
+                         (uint32_t) invSbox[ (s0 >> 8) & 0xFF] << 8 | invSbox[s3 & 0xFF]) ^ rk[2]);
+  store32 (output + 12, ( (uint32_t) invSbox[s3 >> 24] << 24 | (uint32_t) invSbox[ (s2 >> 16) & 0xFF] << 16 |
+                          (uint32_t) invSbox[ (s1 >> 8) & 0xFF] << 8 | invSbox[s0 & 0xFF]) ^ rk[3]);
+}
+
+// -----------------------------------------------------------------------------
+// AES-NI backend
+#if defined(AES_HAVE_AESNI)
+AES_TARGET_AESNI
+void AesCipher::encryptAesNi (uint8_t *output, const uint8_t *input) const {
+  const __m128i *rk = reinterpret_cast<const __m128i *> (m_ekBytes);
+  __m128i s = _mm_xor_si128 (_mm_loadu_si128 (reinterpret_cast<const __m128i *> (input)), _mm_load_si128 (rk));
+
+  for (int r = 1; r < 10; r++) {
+    s = _mm_aesenc_si128 (s, _mm_load_si128 (rk + r));
+  }
+  s = _mm_aesenclast_si128 (s, _mm_load_si128 (rk + 10));
+  _mm_storeu_si128 (reinterpret_cast<__m128i *> (output), s);
+}
+
+AES_TARGET_AESNI
+void AesCipher::decryptAesNi (uint8_t *output, const uint8_t *input) const {
+  const __m128i *rk = reinterpret_cast<const __m128i *> (m_dkBytes);
+  __m128i s = _mm_xor_si128 (_mm_loadu_si128 (reinterpret_cast<const __m128i *> (input)), _mm_load_si128 (rk));
+
+  for (int r = 1; r < 10; r++) {
+    s = _mm_aesdec_si128 (s, _mm_load_si128 (rk + r));
+  }
+  s = _mm_aesdeclast_si128 (s, _mm_load_si128 (rk + 10));
+  _mm_storeu_si128 (reinterpret_cast<__m128i *> (output), s);
+}
+#else
+void AesCipher::encryptAesNi (uint8_t *output, const uint8_t *input) const {
+  encryptTable (output, input);
+}
+
+void AesCipher::decryptAesNi (uint8_t *output, const uint8_t *input) const {
+  decryptTable (output, input);
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// ARMv8 Cryptography Extensions backend
+// AESE/AESD add the round key before SubBytes, the last key is added apart
+#if defined(AES_HAVE_ARM)
+AES_TARGET_ARM
+void AesCipher::encryptArm (uint8_t *output, const uint8_t *input) const {
+  uint8x16_t s = vld1q_u8 (input);
+
+  for (int r = 0; r < 9; r++) {
+    s = vaesmcq_u8 (vaeseq_u8 (s, vld1q_u8 (m_ekBytes + 16 * r)));
+  }
+  s = vaeseq_u8 (s, vld1q_u8 (m_ekBytes + 16 * 9));
+  vst1q_u8 (output, veorq_u8 (s, vld1q_u8 (m_ekBytes + 16 * 10)));
+}
+
+AES_TARGET_ARM
+void AesCipher::decryptArm (uint8_t *output, const uint8_t *input) const {
+  uint8x16_t s = vld1q_u8 (input);
+
+  for (int r = 0; r < 9; r++) {
+    s = vaesimcq_u8 (vaesdq_u8 (s, vld1q_u8 (m_dkBytes + 16 * r)));
+  }
+  s = vaesdq_u8 (s, vld1q_u8 (m_dkBytes + 16 * 9));
+  vst1q_u8 (output, veorq_u8 (s, vld1q_u8 (m_dkBytes + 16 * 10)));
+}
+#else
+void AesCipher::encryptArm (uint8_t *output, const uint8_t *input) const {
+  encryptTable (output, input);
+}
+
+void AesCipher::decryptArm (uint8_t *output, const uint8_t *input) const {
+  decryptTable (output, input);
+}
+#endif
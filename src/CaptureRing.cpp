@@ -0,0 +1,280 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CaptureRing.h"
+
+static const char Magic[8] = "RF95CAP";
+
+static inline int64_t clockNs (clockid_t id) {
+  struct timespec ts;
+
+  clock_gettime (id, &ts);
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Boot id of the kernel, empty if unknown
+static void bootId (char *id, size_t size) {
+  int fd = ::open ("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+  ssize_t n = fd >= 0 ? read (fd, id, size - 1) : -1;
+
+  if (fd >= 0) {
+    ::close (fd);
+  }
+  n = n > 0 ? n : 0;
+  while (n > 0 && (id[n - 1] == '\n' || id[n - 1] == ' ')) {
+    n--;
+  }
+  memset (id + n, 0, size - n);
+}
+
+// Size of a record, multiple of 8 bytes
+static inline size_t recordSize (size_t len) {
+  return (sizeof (CaptureRecord) + len + 7) & ~ (size_t) 7;
+}
+
+// Checks the header of a file of fileSize bytes
+static bool isValid (const CaptureHeader *h, size_t fileSize) {
+
+  return memcmp (h->magic, Magic, sizeof (Magic)) == 0 && h->version == CaptureRing::Version &&
+         h->headerSize == sizeof (CaptureHeader) && h->size % 8 == 0 &&
+         h->size + h->headerSize == fileSize && h->tail <= h->head && h->head - h->tail <= h->size;
+}
+
+// -----------------------------------------------------------------------------
+CaptureRing::CaptureRing() :
+  m_header (nullptr), m_data (nullptr), m_mapSize (0), m_fd (-1) {}
+
+CaptureRing::~CaptureRing() {
+
+  close();
+}
+
+bool CaptureRing::open (const std::string & path, size_t size) {
+  struct stat st;
+  char boot[sizeof (CaptureHeader::boot)];
+
+  close();
+  // at least two records of the longest frame
+  size = (size + 7) & ~ (size_t) 7;
+  if (size < 2 * recordSize (256)) {
+    size = 2 * recordSize (256);
+  }
+
+  m_fd = ::open (path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    return false;
+  }
+  m_mapSize = sizeof (CaptureHeader) + size;
+  if (fstat (m_fd, &st) < 0 || ( (size_t) st.st_size != m_mapSize && ftruncate (m_fd, m_mapSize) < 0)) {
+
+    close();
+    return false;
+  }
+
+  void *p = mmap (nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (p == MAP_FAILED) {
+
+    close();
+    return false;
+  }
+  m_header = static_cast<CaptureHeader *> (p);
+  m_data = static_cast<uint8_t *> (p) + sizeof (CaptureHeader);
+
+  bootId (boot, sizeof (boot));
+  if (isValid (m_header, m_mapSize) && (memcmp (m_header->boot, boot, sizeof (boot)) != 0 ||
+                                        clockNs (CLOCK_MONOTONIC) < m_header->monotonic)) {
+
+    // written before a reboot, the monotonic clock has gone backwards
+    // (checked without boot id), kept aside
+    close();
+    if (rename (path.c_str(), (path + ".prev").c_str()) < 0) {
+      return false;
+    }
+    return open (path, size);
+  }
+  if (!isValid (m_header, m_mapSize)) {
+
+    // new file or another size, a new capture
+    memset (m_header, 0, sizeof (CaptureHeader));
+    memcpy (m_header->magic, Magic, sizeof (Magic));
+    m_header->version = Version;
+    m_header->headerSize = sizeof (CaptureHeader);
+    m_header->size = size;
+    m_header->realtime = clockNs (CLOCK_REALTIME);
+    m_header->monotonic = clockNs (CLOCK_MONOTONIC);
+    memcpy (m_header->boot, boot, sizeof (boot));
+  }
+  return true;
+}
+
+void CaptureRing::close() {
+
+  if (m_header) {
+
+    munmap (m_header, m_mapSize);
+    m_header = nullptr;
+    m_data = nullptr;
+  }
+  if (m_fd >= 0) {
+
+    ::close (m_fd);
+    m_fd = -1;
+  }
+}
+
+// Frees bytes at the end of the area by moving the tail
+void CaptureRing::drop (uint64_t bytes) {
+  CaptureHeader & h = *m_header;
+
+  while (h.head + bytes - h.tail > h.size) {
+    const CaptureRecord *r = reinterpret_cast<const CaptureRecord *> (m_data + h.tail % h.size);
+
+    if (r->direction != Padding) {
+      h.overwritten++;
+    }
+    h.tail += r->size;
+  }
+}
+
+void CaptureRing::write (Direction direction, Status status, size_t radio,
+                         const uint8_t *frame, size_t len, int16_t rssi, int8_t snr) {
+
+  if (!m_header) {
+    return;
+  }
+
+  CaptureHeader & h = *m_header;
+  size_t size = recordSize (len);
+  size_t pos = h.head % h.size;
+
+  if (h.size - pos < size) {
+    // the end of the area is too short, filled with a padding record
+    size_t pad = h.size - pos;
+
+    drop (pad);
+    CaptureRecord *r = reinterpret_cast<CaptureRecord *> (m_data + pos);
+    r->size = pad;
+    r->direction = Padding;
+    h.head += pad;
+    pos = 0;
+  }
+  drop (size);
+
+  CaptureRecord *r = reinterpret_cast<CaptureRecord *> (m_data + pos);
+  r->size = size;
+  r->direction = direction;
+  r->status = status;
+  r->radio = radio;
+  r->slave = len > 0 ? frame[0] : 0;
+  r->function = len > 1 ? frame[1] : 0;
+  r->snr = snr;
+  r->rssi = rssi;
+  r->len = len;
+  r->reserved = 0;
+  r->time = clockNs (CLOCK_MONOTONIC);
+  memcpy (r + 1, frame, len);
+
+  h.records++;
+  // published after the record, for a reader of the live file
+  __atomic_store_n (&h.head, h.head + size, __ATOMIC_RELEASE);
+}
+
+const char *CaptureRing::directionName (uint8_t direction) {
+  static const char *names[] = { "pad", "master>", "master<", "radio>", "radio<" };
+
+  return direction < sizeof (names) / sizeof (names[0]) ? names[direction] : "?";
+}
+
+const char *CaptureRing::statusName (uint8_t status) {
+  static const char *names[] = {
+    "ok", "crc-error", "flushed", "too-long", "queue-full", "duty-cycle",
+    "cached", "timeout", "late", "unexpected", "invalid", "retry",
+    "unreachable", "report"
+  };
+
+  return status < sizeof (names) / sizeof (names[0]) ? names[status] : "?";
+}
+
+// -----------------------------------------------------------------------------
+CaptureReader::CaptureReader() :
+  m_header (nullptr), m_data (nullptr), m_mapSize (0), m_pos (0), m_fd (-1) {}
+
+CaptureReader::~CaptureReader() {
+
+  close();
+}
+
+bool CaptureReader::open (const std::string & path) {
+  struct stat st;
+
+  close();
+  m_fd = ::open (path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (m_fd < 0 || fstat (m_fd, &st) < 0 || (size_t) st.st_size < sizeof (CaptureHeader)) {
+
+    close();
+    return false;
+  }
+  m_mapSize = st.st_size;
+
+  void *p = mmap (nullptr, m_mapSize, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (p == MAP_FAILED) {
+
+    close();
+    return false;
+  }
+  m_header = static_cast<const CaptureHeader *> (p);
+  m_data = static_cast<const uint8_t *> (p) + sizeof (CaptureHeader);
+  if (!isValid (m_header, m_mapSize)) {
+
+    close();
+    return false;
+  }
+  rewind();
+  return true;
+}
+
+void CaptureReader::close() {
+
+  if (m_header) {
+
+    munmap (const_cast<CaptureHeader *> (m_header), m_mapSize);
+    m_header = nullptr;
+    m_data = nullptr;
+  }
+  if (m_fd >= 0) {
+
+    ::close (m_fd);
+    m_fd = -1;
+  }
+}
+
+bool CaptureReader::next (const CaptureRecord *& record) {
+
+  if (!m_header) {
+    return false;
+  }
+
+  uint64_t head = __atomic_load_n (&m_header->head, __ATOMIC_ACQUIRE);
+  while (m_pos < head) {
+    size_t pos = m_pos % m_header->size;
+    const CaptureRecord *r = reinterpret_cast<const CaptureRecord *> (m_data + pos);
+
+    // a damaged record ends the capture
+    if (r->size == 0 || r->size % 8 != 0 || pos + r->size > m_header->size ||
+        (r->direction != CaptureRing::Padding && recordSize (r->len) != r->size)) {
+      return false;
+    }
+    m_pos += r->size;
+    if (r->direction != CaptureRing::Padding) {
+
+      record = r;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,90 @@
+#include <string.h>
+#include "CircuitBreaker.h"
+#include "ModbusCrc.h"
+
+CircuitBreaker::CircuitBreaker() :
+  m_threshold (0), m_probePeriod (10000000UL), m_opened (0), m_closed (0), m_probes (0) {
+
+  memset (m_slaves, 0, sizeof (m_slaves));
+}
+
+void CircuitBreaker::onResponse (uint8_t slave) {
+  Slave & s = m_slaves[slave];
+
+  if (s.open) {
+
+    s.open = false;
+    m_closed++;
+  }
+  s.failures = 0;
+}
+
+void CircuitBreaker::onTimeout (uint8_t slave, unsigned long now) {
+  Slave & s = m_slaves[slave];
+
+  if (m_threshold == 0 || s.open) {
+    return;
+  }
+  if (++s.failures >= m_threshold) {
+
+    s.open = true;
+    s.probe = now + m_probePeriod;
+    m_opened++;
+  }
+}
+
+uint8_t CircuitBreaker::probe (unsigned long now) {
+
+  for (unsigned int slave = 1; slave < 248; slave++) {
+    Slave & s = m_slaves[slave];
+
+    if (s.open && (long) (now - s.probe) >= 0) {
+
+      s.probe = now + m_probePeriod;
+      m_probes++;
+      return slave;
+    }
+  }
+  return 0;
+}
+
+bool CircuitBreaker::nextProbe (unsigned long & when) const {
+  bool found = false;
+
+  for (unsigned int slave = 1; slave < 248; slave++) {
+    const Slave & s = m_slaves[slave];
+
+    if (s.open && (!found || (long) (s.probe - when) < 0)) {
+      when = s.probe;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void CircuitBreaker::setProbeRequest (const uint8_t *frame, size_t len) {
+
+  // a read has no side effect on the slave
+  if (len == 8 && frame[1] >= 0x01 && frame[1] <= 0x04) {
+    Slave & s = m_slaves[frame[0]];
+
+    memcpy (s.request, frame, len);
+    s.len = len;
+  }
+}
+
+size_t CircuitBreaker::probeRequest (uint8_t slave, uint8_t *frame) const {
+  const Slave & s = m_slaves[slave];
+
+  if (s.len) {
+
+    memcpy (frame, s.request, s.len);
+    return s.len;
+  }
+
+  // return query data, with no data
+  frame[0] = slave;
+  frame[1] = 0x08;
+  frame[2] = frame[3] = 0;
+  return ModbusCrc::append (frame, 4);
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include "Coalescer.h"
+#include "ModbusCrc.h"
+
+Coalescer::Coalescer() :
+  m_window (0), m_maxGap (4), m_maxLength (251), m_merged (0) {
+}
+
+bool Coalescer::isMergeable (const uint8_t *frame, size_t len) {
+
+  // slave, function, start, quantity, CRC
+  return len == 8 && frame[0] != 0 && frame[1] >= 0x01 && frame[1] <= 0x04;
+}
+
+uint16_t Coalescer::maxQuantity (uint8_t function, size_t maxLength) {
+  // slave, function, byte count, data, CRC
+  size_t bytes = maxLength > 5 ? std::min<size_t> (maxLength - 5, 255) : 0;
+
+  if (function <= 0x02) {
+    // coils and discrete inputs, Modbus limit 2000
+    return std::min<size_t> (bytes * 8, 2000);
+  }
+  // registers, Modbus limit 125
+  return std::min<size_t> (bytes / 2, 125);
+}
+
+bool Coalescer::merge (Transaction & t, const uint8_t *frame, size_t len, uint32_t master) {
+
+  if (!isMergeable (frame, len) || !isMergeable (t.request.data(), t.request.size()) ||
+      frame[0] != t.slave || frame[1] != t.function) {
+    return false;
+  }
+
+  unsigned long start = pduWord (&t.request[2]);
+  unsigned long end = start + pduWord (&t.request[4]);
+  unsigned long s = pduWord (&frame[2]);
+  unsigned long e = s + pduWord (&frame[4]);
+
+  if (s > end + m_maxGap || start > e + m_maxGap) {
+    return false;
+  }
+
+  start = std::min (start, s);
+  end = std::max (end, e);
+  if (end - start > maxQuantity (t.function, m_maxLength) || end > 0x10000UL) {
+    return false;
+  }
+
+  if (t.parts.empty()) {
+    t.parts.push_back (t.request);
+    t.masters.push_back (t.master);
+  }
+  t.parts.push_back (std::vector<uint8_t> (frame, frame + len));
+  t.masters.push_back (master);
+
+  uint8_t *r = t.request.data();
+  r[2] = start >> 8;
+  r[3] = start & 0xFF;
+  r[4] = (end - start) >> 8;
+  r[5] = (end - start) & 0xFF;
+  ModbusCrc::append (r, 6);
+  m_merged++;
+  return true;
+}
+
+bool Coalescer::split (const Transaction & t, const uint8_t *response, size_t len,
+                       std::vector<std::vector<uint8_t>> & replies) {
+
+  replies.clear();
+  if (len < 5 || response[0] != t.slave || response[1] != t.function) {
+    return false;
+  }
+
+  uint16_t start = pduWord (&t.request[2]);
+  uint16_t quantity = pduWord (&t.request[4]);
+  bool bits = t.function <= 0x02;
+  size_t bytes = bits ? (quantity + 7) / 8 : quantity * 2;
+  if (response[2] != bytes || len != bytes + 5) {
+    return false;
+  }
+
+  const uint8_t *data = &response[3];
+  for (const auto & p : t.parts) {
+    uint16_t offset = pduWord (&p[2]) - start;
+    uint16_t q = pduWord (&p[4]);
+    size_t n = bits ? (q + 7) / 8 : q * 2;
+    std::vector<uint8_t> r (n + 5, 0);
+
+    r[0] = t.slave;
+    r[1] = t.function;
+    r[2] = n;
+    if (bits) {
+
+      for (uint16_t i = 0; i < q; i++) {
+        uint16_t b = offset + i;
+
+        if (data[b / 8] & (1 << (b % 8))) {
+          r[3 + i / 8] |= 1 << (i % 8);
+        }
+      }
+    }
+    else {
+
+      std::copy (data + offset * 2, data + offset * 2 + n, &r[3]);
+    }
+    ModbusCrc::append (r.data(), n + 3);
+    replies.push_back (std::move (r));
+  }
+  return true;
+}
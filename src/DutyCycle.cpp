@@ -0,0 +1,77 @@
+#include "DutyCycle.h"
+
+DutyCycle::DutyCycle (double ratio, unsigned long window) :
+  m_used (0), m_window (window), m_budget (0), m_ratio (0),
+  m_delayed (0), m_rejected (0) {
+
+  setRatio (ratio);
+}
+
+void DutyCycle::setRatio (double ratio) {
+
+  m_ratio = ratio > 0 ? ratio : 0;
+  m_budget = (unsigned long) (m_ratio * m_window);
+}
+
+void DutyCycle::setWindow (unsigned long window) {
+
+  m_window = window;
+  setRatio (m_ratio);
+}
+
+bool DutyCycle::earliest (unsigned long airtime, unsigned long now, unsigned long & when) {
+
+  when = now;
+  if (!isEnabled()) {
+    return true;
+  }
+
+  if (airtime > m_budget) {
+    return false;
+  }
+
+  prune (now);
+  unsigned long used = m_used;
+
+  // the oldest transmissions leave the window one after the other
+  for (const auto & h : m_history) {
+
+    if (used + airtime <= m_budget) {
+      break;
+    }
+    used -= h.second;
+    when = h.first + m_window;
+  }
+  return true;
+}
+
+void DutyCycle::record (unsigned long airtime, unsigned long now) {
+
+  if (isEnabled()) {
+
+    prune (now);
+    m_history.push_back (std::make_pair (now, airtime));
+    m_used += airtime;
+  }
+}
+
+unsigned long DutyCycle::used (unsigned long now) {
+
+  prune (now);
+  return m_used;
+}
+
+unsigned long DutyCycle::remaining (unsigned long now) {
+
+  prune (now);
+  return m_used < m_budget ? m_budget - m_used : 0;
+}
+
+void DutyCycle::prune (unsigned long now) {
+
+  while (!m_history.empty() && (now - m_history.front().first) >= m_window) {
+
+    m_used -= m_history.front().second;
+    m_history.pop_front();
+  }
+}
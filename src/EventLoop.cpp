@@ -0,0 +1,121 @@
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "EventLoop.h"
+
+// Maximum number of events handled by one call to epoll_wait()
+const int MaxEvents = 16;
+
+EventLoop::EventLoop() : m_epfd (epoll_create1 (EPOLL_CLOEXEC)) {
+}
+
+EventLoop::~EventLoop() {
+
+  if (m_epfd >= 0) {
+    ::close (m_epfd);
+  }
+}
+
+bool EventLoop::add (int fd, uint32_t events, Handler handler) {
+  struct epoll_event ev;
+
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl (m_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+
+    return false;
+  }
+  m_handlers[fd] = handler;
+  return true;
+}
+
+bool EventLoop::modify (int fd, uint32_t events) {
+  struct epoll_event ev;
+
+  ev.events = events;
+  ev.data.fd = fd;
+  return epoll_ctl (m_epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove (int fd) {
+
+  epoll_ctl (m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+  m_handlers.erase (fd);
+}
+
+int EventLoop::run (int timeoutMs) {
+  struct epoll_event events[MaxEvents];
+  int called = 0;
+
+  int n = epoll_wait (m_epfd, events, MaxEvents, timeoutMs);
+  if (n < 0) {
+
+    return errno == EINTR ? 0 : -1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    // the handler may have been removed by a previous handler
+    auto it = m_handlers.find (events[i].data.fd);
+
+    if (it != m_handlers.end()) {
+      Handler handler = it->second; // copy, the handler may remove itself
+
+      handler (events[i].events);
+      called++;
+    }
+  }
+  return called;
+}
+
+EventTimer::EventTimer (EventLoop & loop, std::function<void()> handler) :
+  m_loop (loop), m_handler (handler),
+  m_fd (timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+  m_active (false), m_periodic (false) {
+
+  m_loop.add (m_fd, EPOLLIN, [this] (uint32_t) { onExpire(); });
+}
+
+EventTimer::~EventTimer() {
+
+  m_loop.remove (m_fd);
+  ::close (m_fd);
+}
+
+void EventTimer::start (unsigned long usec, bool periodic) {
+  struct itimerspec its;
+
+  if (usec == 0) {
+    usec = 1; // a zero value would disarm the timer
+  }
+  its.it_value.tv_sec = usec / 1000000UL;
+  its.it_value.tv_nsec = (usec % 1000000UL) * 1000UL;
+  its.it_interval = periodic ? its.it_value : timespec {0, 0};
+  timerfd_settime (m_fd, 0, &its, nullptr);
+  m_active = true;
+  m_periodic = periodic;
+}
+
+void EventTimer::stop() {
+  struct itimerspec its = {{0, 0}, {0, 0}};
+  uint64_t expirations;
+
+  timerfd_settime (m_fd, 0, &its, nullptr);
+  // an expiration may be pending in the epoll set
+  while (::read (m_fd, &expirations, sizeof (expirations)) > 0);
+  m_active = false;
+}
+
+void EventTimer::onExpire() {
+  uint64_t expirations;
+
+  if (::read (m_fd, &expirations, sizeof (expirations)) != sizeof (expirations)) {
+
+    return; // stopped after epoll_wait() returned
+  }
+  m_active = m_periodic;
+  if (m_handler) {
+    m_handler();
+  }
+}
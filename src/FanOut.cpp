@@ -0,0 +1,118 @@
+#include "FanOut.h"
+#include "ModbusCrc.h"
+
+FanOut::FanOut() :
+  m_count (0), m_nextId (1), m_writes (0), m_complete (0), m_partial (0) {
+}
+
+void FanOut::setGroup (uint8_t group, const std::vector<uint8_t> & members) {
+
+  if (m_groups[group].empty() != members.empty()) {
+    members.empty() ? m_count-- : m_count++;
+  }
+  m_groups[group] = members;
+}
+
+bool FanOut::isWrite (const uint8_t *frame, size_t len) {
+
+  if (len < 8) {
+    return false;
+  }
+  switch (frame[1]) {
+    case 0x05:
+    case 0x06:
+      return len == 8;
+    case 0x0F:
+    case 0x10:
+      return len == 9 + (size_t) frame[6];
+    default:
+      return false;
+  }
+}
+
+uint16_t FanOut::start (const uint8_t *frame, size_t len, unsigned long now, uint32_t master) {
+
+  m_operations.push_back (Operation());
+  Operation & op = m_operations.back();
+
+  // 0 is no operation
+  op.id = m_nextId++;
+  if (m_nextId == 0) {
+    m_nextId = 1;
+  }
+  op.request.assign (frame, frame + len);
+  for (uint8_t slave : m_groups[frame[0]]) {
+    op.members.push_back (Member { slave, true, Failed, 0x0B });
+  }
+  op.pending = op.members.size();
+  op.received = now;
+  op.master = master;
+  m_writes++;
+  return op.id;
+}
+
+void FanOut::copy (const uint8_t *frame, size_t len, uint8_t slave, std::vector<uint8_t> & copy) {
+
+  copy.assign (frame, frame + len);
+  copy[0] = slave;
+  ModbusCrc::append (copy.data(), len - 2);
+}
+
+bool FanOut::onResult (uint16_t id, uint8_t slave, Result result, uint8_t code,
+                       std::vector<uint8_t> & reply, Operation & done) {
+  auto it = m_operations.begin();
+
+  while (it != m_operations.end() && it->id != id) {
+    ++it;
+  }
+  if (it == m_operations.end()) {
+    return false;
+  }
+
+  for (auto & m : it->members) {
+
+    if (m.slave == slave && m.pending) {
+
+      m.pending = false;
+      m.result = result;
+      m.code = result == Ok ? 0 : (result == Failed ? 0x0B : code);
+      it->pending--;
+      break;
+    }
+  }
+  if (it->pending > 0) {
+    return false;
+  }
+
+  // a member without response first, then the first exception
+  uint8_t exception = 0;
+  for (const auto & m : it->members) {
+
+    if (m.result == Failed) {
+
+      exception = 0x0B;
+      break;
+    }
+    if (m.result == Exception && exception == 0) {
+      exception = m.code;
+    }
+  }
+
+  if (exception) {
+    uint8_t e[5] = { it->request[0], (uint8_t) (it->request[1] | 0x80), exception };
+
+    ModbusCrc::append (e, 3);
+    reply.assign (e, e + sizeof (e));
+    m_partial++;
+  }
+  else {
+
+    // the response to a write is the start of the request
+    reply.assign (it->request.begin(), it->request.begin() + 8);
+    ModbusCrc::append (reply.data(), 6);
+    m_complete++;
+  }
+  done = std::move (*it);
+  m_operations.erase (it);
+  return true;
+}
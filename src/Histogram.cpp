@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Histogram.h"
+
+// Appends a sample line of the Prometheus text format
+static void appendSample (std::string & out, const char *name, const char *suffix,
+                          const char *labels, const char *le, double value) {
+  char line[256];
+  bool hasLabels = labels && *labels;
+
+  if (le) {
+    snprintf (line, sizeof (line), "%s%s{%s%sle=\"%s\"} %.15g\n", name, suffix,
+              hasLabels ? labels : "", hasLabels ? "," : "", le, value);
+  }
+  else if (hasLabels) {
+    snprintf (line, sizeof (line), "%s%s{%s} %.15g\n", name, suffix, labels, value);
+  }
+  else {
+    snprintf (line, sizeof (line), "%s%s %.15g\n", name, suffix, value);
+  }
+  out += line;
+}
+
+// -----------------------------------------------------------------------------
+Histogram::Histogram() {
+
+  clear();
+}
+
+void Histogram::clear() {
+
+  memset (m_counts, 0, sizeof (m_counts));
+  m_count = 0;
+  m_sum = 0;
+  m_min = ~0UL;
+  m_max = 0;
+}
+
+size_t Histogram::index (unsigned long value) {
+
+  if (value >= 0xFFFFFFFFUL) {
+    return Buckets - 1;
+  }
+  if (value < 2 * SubBuckets) {
+    return value;
+  }
+  // 6 significant bits: the leading one and 5 bits of sub-bucket
+  unsigned msb = 31 - __builtin_clz ( (uint32_t) value);
+  unsigned shift = msb - 5;
+
+  return 2 * SubBuckets + (shift - 1) * SubBuckets + ( (value >> shift) - SubBuckets);
+}
+
+unsigned long Histogram::highestEquivalent (size_t index) {
+
+  if (index < 2 * SubBuckets) {
+    return index;
+  }
+  unsigned shift = (index - 2 * SubBuckets) / SubBuckets + 1;
+  unsigned long sub = (index - 2 * SubBuckets) % SubBuckets + SubBuckets;
+
+  return ( (sub + 1) << shift) - 1;
+}
+
+void Histogram::record (unsigned long value) {
+
+  m_counts[index (value)]++;
+  m_count++;
+  m_sum += value;
+  if (value < m_min) {
+    m_min = value;
+  }
+  if (value > m_max) {
+    m_max = value;
+  }
+}
+
+unsigned long Histogram::percentile (double q) const {
+
+  if (m_count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t) (q * m_count + 0.5);
+  uint64_t n = 0;
+
+  if (rank < 1) {
+    rank = 1;
+  }
+  for (size_t i = 0; i < Buckets; i++) {
+
+    n += m_counts[i];
+    if (n >= rank) {
+      unsigned long v = highestEquivalent (i);
+
+      return v < m_max ? v : m_max;
+    }
+  }
+  return m_max;
+}
+
+uint64_t Histogram::countBelow (unsigned long value) const {
+  uint64_t n = 0;
+
+  for (size_t i = 0; i < Buckets && highestEquivalent (i) <= value; i++) {
+    n += m_counts[i];
+  }
+  return n;
+}
+
+void Histogram::exportText (std::string & out, const char *name, const char *labels) const {
+  char le[32];
+
+  for (unsigned bit = 6; bit <= 24; bit++) {
+
+    snprintf (le, sizeof (le), "%.6f", (1UL << bit) / 1e6);
+    appendSample (out, name, "_bucket", labels, le, countBelow ( (1UL << bit) - 1));
+  }
+  appendSample (out, name, "_bucket", labels, "+Inf", m_count);
+  appendSample (out, name, "_sum", labels, nullptr, m_sum / 1e6);
+  appendSample (out, name, "_count", labels, nullptr, m_count);
+}
+
+// -----------------------------------------------------------------------------
+LevelHistogram::LevelHistogram (int lowest, int step, size_t buckets) :
+  m_lowest (lowest), m_step (step > 0 ? step : 1), m_buckets (buckets < MaxBuckets ? buckets : MaxBuckets) {
+
+  clear();
+}
+
+void LevelHistogram::clear() {
+
+  memset (m_counts, 0, sizeof (m_counts));
+  m_count = 0;
+  m_sum = 0;
+}
+
+void LevelHistogram::record (int value) {
+  long i = value <= m_lowest ? 0 : (value - m_lowest + m_step - 1) / m_step;
+
+  m_counts[i < (long) m_buckets ? i : m_buckets - 1]++;
+  m_count++;
+  m_sum += value;
+}
+
+void LevelHistogram::exportText (std::string & out, const char *name, const char *labels) const {
+  uint64_t n = 0;
+  char le[16];
+
+  // the last bucket holds the values above the range
+  for (size_t i = 0; i + 1 < m_buckets; i++) {
+
+    n += m_counts[i];
+    snprintf (le, sizeof (le), "%d", m_lowest + (int) i * m_step);
+    appendSample (out, name, "_bucket", labels, le, n);
+  }
+  appendSample (out, name, "_bucket", labels, "+Inf", m_count);
+  appendSample (out, name, "_sum", labels, nullptr, m_sum);
+  appendSample (out, name, "_count", labels, nullptr, m_count);
+}
@@ -0,0 +1,161 @@
+#include <string.h>
+#include "LinkAdapter.h"
+
+LinkAdapter::LinkAdapter() :
+  m_enabled (false), m_margin (5.0), m_maxFailures (2), m_promoteAfter (10), m_fallback (60000000UL),
+  m_promotions (0), m_demotions (0), m_fallbacks (0) {
+
+  memset (m_links, 0, sizeof (m_links));
+  for (auto & l : m_links) {
+    l.cap = MaxProfile;
+  }
+}
+
+// The slave has not received a request for fallback, it listens to the profile 0
+bool LinkAdapter::isIdle (const Link & l, unsigned long now) const {
+
+  return (l.profile || l.next) && (now - l.sent) > m_fallback;
+}
+
+uint8_t LinkAdapter::profile (uint8_t slave, unsigned long now) const {
+  const Link & l = m_links[slave];
+
+  if (!m_enabled || isIdle (l, now)) {
+    return 0;
+  }
+  return l.profile;
+}
+
+uint8_t LinkAdapter::next (uint8_t slave, unsigned long now) const {
+  const Link & l = m_links[slave];
+
+  if (!m_enabled || isIdle (l, now)) {
+    return 0;
+  }
+  return l.next;
+}
+
+void LinkAdapter::onSent (uint8_t slave, unsigned long now) {
+  Link & l = m_links[slave];
+
+  if (!m_enabled) {
+    return;
+  }
+  if (isIdle (l, now)) {
+
+    l.profile = l.next = 0;
+    l.changing = false;
+  }
+  if (!l.changing && l.next != l.profile) {
+
+    l.changing = true;
+    l.from = l.profile;
+    l.search = 0;
+  }
+  l.sent = now;
+}
+
+void LinkAdapter::onResponse (uint8_t slave, const LoraModem & base, int rssi, int snr, bool hasSnr) {
+  Link & l = m_links[slave];
+
+  if (!m_enabled) {
+    return;
+  }
+
+  // the slave has switched after its response
+  l.profile = l.next;
+  l.changing = false;
+  l.failures = 0;
+
+  if (!l.measured || l.hasSnr != hasSnr) {
+
+    l.snr = snr;
+    l.rssi = rssi;
+    l.hasSnr = hasSnr;
+    l.measured = true;
+  }
+  else {
+
+    l.snr += (snr - l.snr) / 4;
+    l.rssi += (rssi - l.rssi) / 4;
+  }
+
+  if (l.cap < MaxProfile && ++l.answers >= m_promoteAfter) {
+
+    l.cap++;
+    l.answers = 0;
+  }
+
+  uint8_t t = target (l, base);
+  if (t > l.profile) {
+
+    l.next = t;
+    m_promotions++;
+  }
+  else if (t < l.profile) {
+
+    l.next = t;
+    m_demotions++;
+  }
+}
+
+void LinkAdapter::onTimeout (uint8_t slave) {
+  Link & l = m_links[slave];
+
+  if (!m_enabled) {
+    return;
+  }
+
+  if (l.changing) {
+    // the slave listens with the profile it had if the request has been
+    // lost, with the announced one if the response has been lost, with the
+    // profile 0 if it has not heard us for a while
+    uint8_t candidates[3] = { l.from, l.next, 0 };
+    uint8_t n = l.from == 0 || l.next == 0 ? 2 : 3;
+
+    l.profile = candidates[++l.search % n];
+  }
+  else if (l.profile > 0 && ++l.failures >= m_maxFailures) {
+
+    // the link has degraded, back to the profile 0
+    l.cap = l.profile - 1;
+    l.answers = 0;
+    l.next = 0;
+    l.failures = 0;
+    m_fallbacks++;
+  }
+}
+
+// Fastest profile allowed whose floor is margin below the link
+uint8_t LinkAdapter::target (const Link & l, const LoraModem & base) const {
+  uint8_t n = profiles (base);
+  uint8_t best = 0;
+
+  for (uint8_t p = 1; p < n && p <= l.cap; p++) {
+    LoraModem m = modem (base, p);
+    double headroom = l.hasSnr ? l.snr - LoraModem::demodulationFloor (m.spreadingFactor) : l.rssi - m.sensitivity();
+
+    if (headroom >= m_margin) {
+      best = p;
+    }
+  }
+  return best;
+}
+
+LoraModem LinkAdapter::modem (const LoraModem & base, uint8_t profile) {
+  LoraModem m = base;
+
+  if (profile < profiles (base)) {
+    m.spreadingFactor -= profile;
+  }
+  return m;
+}
+
+uint8_t LinkAdapter::profiles (const LoraModem & base) {
+  uint8_t n = 1;
+
+  for (uint8_t sf = base.spreadingFactor; sf > 7 && n <= MaxProfile; sf--) {
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,185 @@
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "Logger.h"
+
+Logger::Logger() :
+  m_running (false), m_sleeping (false), m_overflows (0) {
+
+  m_stream[Out] = 1;
+  m_stream[Err] = 2;
+
+  m_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+Logger::~Logger() {
+
+  stop();
+  if (m_fd >= 0) {
+    close (m_fd);
+  }
+}
+
+bool Logger::start() {
+
+  if (m_running || m_fd < 0) {
+    return m_running;
+  }
+  m_running = true;
+  m_thread = std::thread (&Logger::run, this);
+  return true;
+}
+
+void Logger::stop() {
+
+  if (m_running) {
+
+    m_running = false;
+    eventfd_write (m_fd, 1);
+    m_thread.join();
+  }
+}
+
+Logger::Record *Logger::reserve() {
+  Record *r = m_ring.reserve();
+
+  if (!r) {
+    m_overflows++;
+  }
+  return r;
+}
+
+void Logger::commit (const Record & r) {
+
+  if (!m_running) {
+    // no logging thread (not started or stopped), written by the caller
+    char line[MaxLine];
+
+    (void) !write (m_stream[r.stream], line, render (r, line) - line);
+    return;
+  }
+  m_ring.commit();
+  // a system call only when the logging thread sleeps
+  if (m_sleeping.load()) {
+    eventfd_write (m_fd, 1);
+  }
+}
+
+void Logger::log (Stream stream, bool prefix, const char *text, const uint8_t *frame, size_t len, bool req) {
+  Record *r = reserve();
+
+  if (r) {
+    size_t n = text ? strlen (text) : 0;
+
+    r->stream = stream;
+    r->prefix = prefix;
+    r->request = req;
+    r->textLen = n < MaxText ? n : MaxText;
+    memcpy (r->text, text, r->textLen);
+    r->len = len < MaxFrame ? len : MaxFrame;
+    if (frame) {
+      memcpy (r->frame, frame, r->len);
+    }
+    else {
+      r->len = 0;
+    }
+    commit (*r);
+  }
+}
+
+void Logger::printf (Stream stream, const char *format, ...) {
+  Record *r = reserve();
+
+  if (r) {
+    va_list ap;
+
+    va_start (ap, format);
+    int n = vsnprintf (r->text, MaxText, format, ap);
+    va_end (ap);
+
+    r->stream = stream;
+    r->prefix = false;
+    r->request = true;
+    r->textLen = n < 0 ? 0 : (n < (int) MaxText ? n : MaxText - 1);
+    r->len = 0;
+    commit (*r);
+  }
+}
+
+char *Logger::format (char *out, const uint8_t *frame, size_t len, bool req) {
+  static const char hex[] = "0123456789ABCDEF";
+  char open = req ? '[' : '<';
+  char close = req ? ']' : '>';
+
+  for (size_t i = 0; i < len; i++) {
+
+    *out++ = open;
+    *out++ = hex[frame[i] >> 4];
+    *out++ = hex[frame[i] & 0x0F];
+    *out++ = close;
+  }
+  return out;
+}
+
+// Writes the line of a record, returns the end of the line
+char *Logger::render (const Record & r, char *out) const {
+
+  if (r.prefix) {
+    size_t n = m_prefix.size() < MaxPrefix ? m_prefix.size() : MaxPrefix;
+
+    memcpy (out, m_prefix.data(), n);
+    out += n;
+  }
+  memcpy (out, r.text, r.textLen);
+  out = format (out + r.textLen, r.frame, r.len, r.request);
+  *out++ = '\n';
+  return out;
+}
+
+// Logging thread
+void Logger::run() {
+  char *end[2] = { m_batch[0], m_batch[1] };
+
+  for (;;) {
+    Record *r;
+
+    while ( (r = m_ring.front()) != nullptr) {
+      int s = r->stream;
+
+      if (end[s] + MaxLine > m_batch[s] + BatchSize) {
+
+        (void) !write (m_stream[s], m_batch[s], end[s] - m_batch[s]);
+        end[s] = m_batch[s];
+      }
+      end[s] = render (*r, end[s]);
+      m_ring.pop();
+    }
+
+    // the ring is empty, one write() per stream
+    for (int s = 0; s < 2; s++) {
+      if (end[s] > m_batch[s]) {
+
+        (void) !write (m_stream[s], m_batch[s], end[s] - m_batch[s]);
+        end[s] = m_batch[s];
+      }
+    }
+
+    if (!m_running) {
+      break;
+    }
+
+    m_sleeping = true;
+    if (m_ring.empty() && m_running) {
+      struct pollfd pfd = { m_fd, POLLIN, 0 };
+      eventfd_t v;
+
+      poll (&pfd, 1, 100);
+      eventfd_read (m_fd, &v);
+    }
+    m_sleeping = false;
+  }
+}
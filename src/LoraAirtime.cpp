@@ -0,0 +1,69 @@
+#include <math.h>
+#include "LoraAirtime.h"
+
+// RH_RF95_HEADER_LEN: to, from, id, flags
+const size_t RadioHeadHeaderLen = 4;
+
+unsigned long LoraModem::symbolTime() const {
+
+  return (1000000ULL << spreadingFactor) / bandwidth;
+}
+
+unsigned long LoraModem::timeOnAir (size_t payloadLen) const {
+  // all in microseconds * 4 to keep the 0.25 symbol of the preamble
+  unsigned long long tsym = (4000000ULL << spreadingFactor) / bandwidth;
+  unsigned long long preambleTime = (4ULL * preamble + 17) * tsym / 4; // (n + 4.25) symbols
+  int de = lowDataRateOptimize() ? 1 : 0;
+  int ih = 0; // RadioHead always uses the explicit header
+  long num = 8L * payloadLen - 4L * spreadingFactor + 28 + (crc ? 16 : 0) - 20 * ih;
+  long den = 4L * (spreadingFactor - 2 * de);
+  long nb = 8;
+
+  if (num > 0) {
+    nb += ( (num + den - 1) / den) * codingRate;
+  }
+  return (preambleTime + nb * tsym) / 4;
+}
+
+size_t LoraModem::payloadLength (size_t messageLen) const {
+
+  switch (encryption) {
+    case Padded:
+      return RadioHeadHeaderLen + encryptedLength (messageLen);
+    case Stream:
+      return RadioHeadHeaderLen + streamLength (messageLen);
+    default:
+      return RadioHeadHeaderLen + messageLen;
+  }
+}
+
+size_t LoraModem::encryptedLength (size_t len, size_t blockSize) {
+
+  return ( (len + 1 + blockSize - 1) / blockSize) * blockSize;
+}
+
+size_t LoraModem::streamLength (size_t len) {
+
+  return len + 5; // RH_CTR_NONCE_LEN, RHCtrEncryptedDriver.h needs RadioHead
+}
+
+double LoraModem::demodulationFloor (uint8_t spreadingFactor) {
+
+  return -7.5 - 2.5 * ( (int) spreadingFactor - 7);
+}
+
+double LoraModem::sensitivity() const {
+
+  return -174.0 + 10.0 * log10 ( (double) bandwidth) + 6.0 + demodulationFloor (spreadingFactor);
+}
+
+long LoraModem::supportedBandwidth (long bandwidth) {
+  static const long bw[] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000 };
+
+  for (long b : bw) {
+    if (bandwidth <= b) {
+      return b;
+    }
+  }
+  return 500000;
+}
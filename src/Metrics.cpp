@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Metrics.h"
+
+Metrics::Radio::Radio() :
+  rssi (-140, 5, 30), snr (-20, 2, 21) {}
+
+Metrics::Metrics() {
+
+  clear();
+}
+
+void Metrics::clear() {
+
+  m_latency.clear();
+  m_serialToAir.clear();
+  m_airToSerial.clear();
+  for (auto & r : m_radios) {
+    r.rssi.clear();
+    r.snr.clear();
+  }
+  for (auto & p : m_ports) {
+    p.wait.clear();
+    p.requests = p.dropped = 0;
+    p.depth = p.maxDepth = 0;
+  }
+  memset (m_slaves, 0, sizeof (m_slaves));
+}
+
+void Metrics::onRequest (uint8_t slave, unsigned long serialToAir) {
+
+  m_slaves[slave].requests++;
+  m_serialToAir.record (serialToAir);
+}
+
+void Metrics::onQueued (uint32_t master) {
+
+  if (master < MaxPorts) {
+    Port & p = m_ports[master];
+
+    p.requests++;
+    if (++p.depth > p.maxDepth) {
+      p.maxDepth = p.depth;
+    }
+  }
+}
+
+void Metrics::onDequeued (uint32_t master, unsigned long wait, bool sent) {
+
+  if (master < MaxPorts) {
+    Port & p = m_ports[master];
+
+    if (p.depth > 0) {
+      p.depth--;
+    }
+    if (sent) {
+      p.wait.record (wait);
+    }
+    else {
+      p.dropped++;
+    }
+  }
+}
+
+void Metrics::onRejected (uint32_t master) {
+
+  if (master < MaxPorts) {
+
+    m_ports[master].requests++;
+    m_ports[master].dropped++;
+  }
+}
+
+void Metrics::onResponse (uint8_t slave, size_t radio, unsigned long latency, int rssi, int snr, bool hasSnr) {
+  Slave & s = m_slaves[slave];
+
+  s.responses++;
+  s.latencySum += latency;
+  if (latency > s.latencyMax) {
+    s.latencyMax = latency;
+  }
+  s.rssiSum += rssi;
+  m_latency.record (latency);
+  if (radio < MaxRadios) {
+    m_radios[radio].rssi.record (rssi);
+  }
+  if (hasSnr) {
+    s.snrSum += snr;
+    s.snrCount++;
+    if (radio < MaxRadios) {
+      m_radios[radio].snr.record (snr);
+    }
+  }
+}
+
+static void exportHelp (std::string & out, const char *name, const char *type, const char *help) {
+
+  out += "# HELP "; out += name; out += " "; out += help; out += "\n";
+  out += "# TYPE "; out += name; out += " "; out += type; out += "\n";
+}
+
+// One line per slave which has been seen
+static void exportCounter (std::string & out, const char *name, const char *help,
+                           const Metrics & m, uint64_t Metrics::Slave::*field) {
+  char line[128];
+
+  exportHelp (out, name, "counter", help);
+  for (unsigned i = 0; i < 256; i++) {
+    uint64_t v = m.slave (i).*field;
+
+    if (v) {
+      snprintf (line, sizeof (line), "%s{slave=\"%u\"} %llu\n", name, i, (unsigned long long) v);
+      out += line;
+    }
+  }
+}
+
+// One line per serial port which has queued a request
+static void exportPortCounter (std::string & out, const char *name, const char *help,
+                               const Metrics & m, uint64_t Metrics::Port::*field) {
+  char line[128];
+
+  exportHelp (out, name, "counter", help);
+  for (unsigned i = 0; i < Metrics::MaxPorts; i++) {
+
+    if (m.port (i).requests) {
+      snprintf (line, sizeof (line), "%s{port=\"%u\"} %llu\n", name, i, (unsigned long long) (m.port (i).*field));
+      out += line;
+    }
+  }
+}
+
+void Metrics::exportText (std::string & out) const {
+  char line[128];
+  char labels[32];
+
+  exportHelp (out, "rf95_bridge_latency_seconds", "histogram", "Time from a request sent on the radio to its response");
+  m_latency.exportText (out, "rf95_bridge_latency_seconds");
+  exportHelp (out, "rf95_bridge_serial_to_air_seconds", "histogram", "Time from a request received on the serial line to its transmission");
+  m_serialToAir.exportText (out, "rf95_bridge_serial_to_air_seconds");
+  exportHelp (out, "rf95_bridge_air_to_serial_seconds", "histogram", "Time from a response received from the radio to its writing on the serial line");
+  m_airToSerial.exportText (out, "rf95_bridge_air_to_serial_seconds");
+
+  exportCounter (out, "rf95_bridge_requests_total", "Requests sent on the radio", *this, &Slave::requests);
+  exportCounter (out, "rf95_bridge_responses_total", "Responses received from the radio", *this, &Slave::responses);
+  exportCounter (out, "rf95_bridge_crc_errors_total", "Frames with a wrong CRC", *this, &Slave::crcErrors);
+  exportCounter (out, "rf95_bridge_timeouts_total", "Requests without response", *this, &Slave::timeouts);
+  exportCounter (out, "rf95_bridge_flushed_total", "Too short frames on the serial line", *this, &Slave::flushed);
+  exportCounter (out, "rf95_bridge_cache_hits_total", "Requests answered from the cache", *this, &Slave::cached);
+  exportCounter (out, "rf95_bridge_reports_total", "Reports by exception received", *this, &Slave::reports);
+  exportCounter (out, "rf95_bridge_image_hits_total", "Requests answered from the register image", *this, &Slave::imaged);
+  exportCounter (out, "rf95_bridge_mirror_stale_total", "Requests answered with an exception, mirror too old", *this, &Slave::stale);
+  exportCounter (out, "rf95_bridge_late_total", "Responses received after the timeout", *this, &Slave::late);
+  exportCounter (out, "rf95_bridge_unexpected_total", "Responses without request", *this, &Slave::unexpected);
+  exportCounter (out, "rf95_bridge_dropped_total", "Requests dropped, queue full or duty cycle", *this, &Slave::dropped);
+  exportCounter (out, "rf95_bridge_retries_total", "Requests sent again by the bridge without response", *this, &Slave::retries);
+  exportCounter (out, "rf95_bridge_recovered_total", "Responses to a request sent again by the bridge", *this, &Slave::recovered);
+  exportCounter (out, "rf95_bridge_exceptions_total", "Exception responses made by the bridge", *this, &Slave::exceptions);
+
+  // mean and maximum by slave, to spot a slow slave or a weak link
+  exportHelp (out, "rf95_bridge_slave_latency_seconds", "gauge", "Mean and maximum latency of a slave");
+  for (unsigned i = 0; i < 256; i++) {
+    const Slave & s = m_slaves[i];
+
+    if (s.responses) {
+      snprintf (line, sizeof (line), "rf95_bridge_slave_latency_seconds{slave=\"%u\",stat=\"mean\"} %g\n",
+                i, s.latencySum / 1e6 / s.responses);
+      out += line;
+      snprintf (line, sizeof (line), "rf95_bridge_slave_latency_seconds{slave=\"%u\",stat=\"max\"} %g\n",
+                i, s.latencyMax / 1e6);
+      out += line;
+    }
+  }
+  exportHelp (out, "rf95_bridge_slave_rssi_dbm", "gauge", "Mean RSSI of the responses of a slave");
+  for (unsigned i = 0; i < 256; i++) {
+    const Slave & s = m_slaves[i];
+
+    if (s.responses) {
+      snprintf (line, sizeof (line), "rf95_bridge_slave_rssi_dbm{slave=\"%u\"} %g\n", i, (double) s.rssiSum / s.responses);
+      out += line;
+    }
+  }
+  exportHelp (out, "rf95_bridge_slave_snr_db", "gauge", "Mean SNR of the responses of a slave");
+  for (unsigned i = 0; i < 256; i++) {
+    const Slave & s = m_slaves[i];
+
+    if (s.snrCount) {
+      snprintf (line, sizeof (line), "rf95_bridge_slave_snr_db{slave=\"%u\"} %g\n", i, (double) s.snrSum / s.snrCount);
+      out += line;
+    }
+  }
+
+  exportHelp (out, "rf95_bridge_slave_spreading_factor", "gauge", "Spreading factor of the last request to a slave");
+  for (unsigned i = 0; i < 256; i++) {
+    const Slave & s = m_slaves[i];
+
+    if (s.spreadingFactor) {
+      snprintf (line, sizeof (line), "rf95_bridge_slave_spreading_factor{slave=\"%u\"} %u\n", i, s.spreadingFactor);
+      out += line;
+    }
+  }
+
+  // only the slaves which have timed out, the others are reachable
+  exportHelp (out, "rf95_bridge_slave_unreachable", "gauge", "1 while the circuit breaker of a slave is open");
+  for (unsigned i = 0; i < 256; i++) {
+    const Slave & s = m_slaves[i];
+
+    if (s.timeouts) {
+      snprintf (line, sizeof (line), "rf95_bridge_slave_unreachable{slave=\"%u\"} %u\n", i, s.unreachable);
+      out += line;
+    }
+  }
+
+  exportHelp (out, "rf95_bridge_slave_hops", "gauge", "Repeaters on the route of the last request to a slave");
+  for (unsigned i = 0; i < 256; i++) {
+    const Slave & s = m_slaves[i];
+
+    if (s.requests) {
+      snprintf (line, sizeof (line), "rf95_bridge_slave_hops{slave=\"%u\"} %u\n", i, s.hops);
+      out += line;
+    }
+  }
+
+  // only the ports which have queued a request
+  exportHelp (out, "rf95_bridge_port_wait_seconds", "histogram", "Time from a request of a serial port to its transmission");
+  for (size_t p = 0; p < MaxPorts; p++) {
+    if (m_ports[p].wait.count()) {
+      snprintf (labels, sizeof (labels), "port=\"%u\"", (unsigned) p);
+      m_ports[p].wait.exportText (out, "rf95_bridge_port_wait_seconds", labels);
+    }
+  }
+  exportPortCounter (out, "rf95_bridge_port_requests_total", "Requests of a serial port queued for the radio",
+                     *this, &Port::requests);
+  exportPortCounter (out, "rf95_bridge_port_dropped_total", "Requests of a serial port never sent on the radio",
+                     *this, &Port::dropped);
+  exportHelp (out, "rf95_bridge_port_queue_depth", "gauge", "Current and maximum requests of a serial port waiting for the radio");
+  for (size_t p = 0; p < MaxPorts; p++) {
+    const Port & s = m_ports[p];
+
+    if (s.requests) {
+      snprintf (line, sizeof (line), "rf95_bridge_port_queue_depth{port=\"%u\",stat=\"current\"} %u\n", (unsigned) p, s.depth);
+      out += line;
+      snprintf (line, sizeof (line), "rf95_bridge_port_queue_depth{port=\"%u\",stat=\"max\"} %u\n", (unsigned) p, s.maxDepth);
+      out += line;
+    }
+  }
+
+  exportHelp (out, "rf95_bridge_rssi_dbm", "histogram", "RSSI of the responses received by a radio");
+  for (size_t r = 0; r < MaxRadios; r++) {
+    if (m_radios[r].rssi.count()) {
+      snprintf (labels, sizeof (labels), "radio=\"%u\"", (unsigned) r);
+      m_radios[r].rssi.exportText (out, "rf95_bridge_rssi_dbm", labels);
+    }
+  }
+  exportHelp (out, "rf95_bridge_snr_db", "histogram", "SNR of the responses received by a radio");
+  for (size_t r = 0; r < MaxRadios; r++) {
+    if (m_radios[r].snr.count()) {
+      snprintf (labels, sizeof (labels), "radio=\"%u\"", (unsigned) r);
+      m_radios[r].snr.exportText (out, "rf95_bridge_snr_db", labels);
+    }
+  }
+}
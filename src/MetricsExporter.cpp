@@ -0,0 +1,160 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "MetricsExporter.h"
+
+MetricsExporter::MetricsExporter() :
+  m_running (false), m_skipped (0), m_listenFd (-1) {
+
+  m_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+MetricsExporter::~MetricsExporter() {
+
+  stop();
+  if (m_fd >= 0) {
+    close (m_fd);
+  }
+}
+
+bool MetricsExporter::start() {
+
+  if (m_running) {
+    return true;
+  }
+  if (m_fd < 0 || (!m_socket.empty() && !listen())) {
+    return false;
+  }
+  m_running = true;
+  m_thread = std::thread (&MetricsExporter::run, this);
+  return true;
+}
+
+void MetricsExporter::stop() {
+
+  if (m_running) {
+
+    m_running = false;
+    eventfd_write (m_fd, 1);
+    m_thread.join();
+  }
+  if (m_listenFd >= 0) {
+
+    close (m_listenFd);
+    m_listenFd = -1;
+    unlink (m_socket.c_str());
+  }
+}
+
+bool MetricsExporter::publish (const Metrics & metrics) {
+  Metrics *m = m_ring.reserve();
+
+  if (!m) {
+    m_skipped++;
+    return false;
+  }
+  *m = metrics;
+  m_ring.commit();
+  eventfd_write (m_fd, 1);
+  return true;
+}
+
+bool MetricsExporter::listen() {
+  struct sockaddr_un addr;
+
+  if (m_socket.size() >= sizeof (addr.sun_path)) {
+    return false;
+  }
+  m_listenFd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (m_listenFd < 0) {
+    return false;
+  }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, m_socket.c_str());
+  unlink (m_socket.c_str()); // left by a previous run
+  if (bind (m_listenFd, (struct sockaddr *) &addr, sizeof (addr)) < 0 || ::listen (m_listenFd, 4) < 0) {
+
+    close (m_listenFd);
+    m_listenFd = -1;
+    return false;
+  }
+  return true;
+}
+
+// Rewrites the file, the readers never see a partial file
+void MetricsExporter::writeFile() {
+  std::string tmp = m_file + ".tmp";
+  FILE *f = fopen (tmp.c_str(), "w");
+
+  if (f) {
+    bool ok = fwrite (m_text.data(), 1, m_text.size(), f) == m_text.size();
+
+    ok = (fclose (f) == 0) && ok;
+    if (ok) {
+      rename (tmp.c_str(), m_file.c_str());
+    }
+  }
+}
+
+// Exporter thread
+void MetricsExporter::run() {
+  struct pollfd pfd[2] = {
+    { m_fd, POLLIN, 0 },
+    { m_listenFd, POLLIN, 0 }
+  };
+
+  while (m_running) {
+
+    if (::poll (pfd, m_listenFd >= 0 ? 2 : 1, -1) <= 0) {
+      continue;
+    }
+
+    if (pfd[0].revents & POLLIN) {
+      eventfd_t v;
+      Metrics *m;
+
+      eventfd_read (m_fd, &v);
+      // only the newest copy is formatted
+      while ( (m = m_ring.front()) != nullptr) {
+
+        if (m_ring.size() == 1) {
+
+          m_text.clear();
+          m->exportText (m_text);
+          if (!m_file.empty()) {
+            writeFile();
+          }
+        }
+        m_ring.pop();
+      }
+    }
+
+    if (m_listenFd >= 0 && (pfd[1].revents & POLLIN)) {
+      int client;
+
+      while ( (client = accept4 (m_listenFd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+        // a client which does not read does not block the exporter long
+        struct timeval tv = { 1, 0 };
+        const char *p = m_text.data();
+        size_t left = m_text.size();
+        ssize_t n;
+
+        setsockopt (client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+        while (left > 0 && (n = send (client, p, left, MSG_NOSIGNAL)) > 0) {
+          p += n;
+          left -= n;
+        }
+        close (client);
+      }
+    }
+  }
+}
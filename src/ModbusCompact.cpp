@@ -0,0 +1,391 @@
+#include "ModbusCompact.h"
+#include "ModbusCrc.h"
+
+const uint8_t Escape = 0x7F;
+const uint8_t CompactFlag = 0x40;
+const uint8_t DeltaFlag = 0x20;
+
+// Output buffer with bounds checking, without buffer it only counts the bytes
+struct Writer {
+  uint8_t *p;
+  size_t len;
+  size_t size;
+  bool ok;
+
+  Writer (uint8_t *buf, size_t bufSize) : p (buf), len (0), size (bufSize), ok (true) {}
+
+  void byte (uint8_t b) {
+    if (!p) {
+      len++;
+    }
+    else if (len < size) {
+      p[len++] = b;
+    }
+    else {
+      ok = false;
+    }
+  }
+
+  void word (uint16_t w) {
+    byte (w >> 8);
+    byte (w & 0xFF);
+  }
+
+  void varint (uint16_t v) {
+    while (v >= 0x80) {
+      byte ( (v & 0x7F) | 0x80);
+      v >>= 7;
+    }
+    byte (v);
+  }
+
+  void bytes (const uint8_t *b, size_t n) {
+    while (n--) {
+      byte (*b++);
+    }
+  }
+};
+
+// Input buffer with bounds checking
+struct Reader {
+  const uint8_t *p;
+  size_t len;
+  size_t pos;
+  bool ok;
+
+  Reader (const uint8_t *buf, size_t bufLen) : p (buf), len (bufLen), pos (0), ok (true) {}
+
+  uint8_t byte() {
+    if (pos < len) {
+      return p[pos++];
+    }
+    ok = false;
+    return 0;
+  }
+
+  uint16_t word() {
+    uint16_t w = byte() << 8;
+    return w | byte();
+  }
+
+  uint16_t varint() {
+    uint32_t v = 0;
+
+    for (uint8_t shift = 0; shift < 21; shift += 7) {
+      uint8_t b = byte();
+
+      v |= (uint32_t) (b & 0x7F) << shift;
+      if ( (b & 0x80) == 0) {
+        if (v > 0xFFFF) {
+          ok = false;
+        }
+        return v;
+      }
+    }
+    ok = false;
+    return 0;
+  }
+
+  size_t remaining() const {
+    return len - pos;
+  }
+};
+
+// Registers as zigzag varints of the difference with the previous one
+static void writeDelta (Writer & w, const uint8_t *data, size_t n) {
+  uint16_t prev = 0;
+
+  for (size_t i = 0; i + 1 < n; i += 2) {
+    uint16_t v = pduWord (&data[i]);
+    uint16_t d = v - prev;
+
+    // zigzag in unsigned arithmetic, a shift of a negative value is undefined
+    w.varint ( (uint16_t) ( (d << 1) ^ (uint16_t) - (d >> 15)));
+    prev = v;
+  }
+}
+
+static void readDelta (Reader & r, Writer & w) {
+  uint16_t prev = 0;
+
+  while (r.ok && r.remaining() > 0) {
+    uint16_t z = r.varint();
+    uint16_t d = (z >> 1) ^ (uint16_t) - (z & 1);
+
+    prev += d;
+    w.word (prev);
+  }
+}
+
+// Compact form of the PDU data, returns false if the function has none
+static bool encodeCompact (const uint8_t *pdu, size_t n, uint8_t fc, ModbusCompact::Direction dir, bool delta, Writer & w) {
+
+  if (dir == ModbusCompact::Request) {
+
+    switch (fc) {
+      case 0x01:
+      case 0x02:
+      case 0x03:
+      case 0x04:
+        if (n != 4) {
+          return false;
+        }
+        w.byte (CompactFlag | fc);
+        w.varint (pduWord (&pdu[0]));
+        w.varint (pduWord (&pdu[2]));
+        return true;
+
+      case 0x0F:
+        if (n < 5 || pdu[4] != n - 5) {
+          return false;
+        }
+        w.byte (CompactFlag | fc);
+        w.varint (pduWord (&pdu[0]));
+        w.varint (pduWord (&pdu[2]));
+        w.bytes (&pdu[5], n - 5);
+        return true;
+
+      case 0x10:
+        // quantity = byte count / 2
+        if (n < 5 || pdu[4] != n - 5 || pduWord (&pdu[2]) * 2 != pdu[4]) {
+          return false;
+        }
+        w.byte (CompactFlag | (delta ? DeltaFlag : 0) | fc);
+        w.varint (pduWord (&pdu[0]));
+        if (delta) {
+          writeDelta (w, &pdu[5], n - 5);
+        }
+        else {
+          w.bytes (&pdu[5], n - 5);
+        }
+        return true;
+
+      default:
+        break;
+    }
+  }
+  else {
+
+    switch (fc) {
+      case 0x01:
+      case 0x02:
+      case 0x03:
+      case 0x04:
+        if (n < 1 || pdu[0] != n - 1 || (fc >= 0x03 && (n - 1) % 2)) {
+          return false;
+        }
+        delta = delta && fc >= 0x03;
+        w.byte (CompactFlag | (delta ? DeltaFlag : 0) | fc);
+        if (delta) {
+          writeDelta (w, &pdu[1], n - 1);
+        }
+        else {
+          w.bytes (&pdu[1], n - 1);
+        }
+        return true;
+
+      case 0x0F:
+      case 0x10:
+        if (n != 4) {
+          return false;
+        }
+        w.byte (CompactFlag | fc);
+        w.varint (pduWord (&pdu[0]));
+        w.varint (pduWord (&pdu[2]));
+        return true;
+
+      default:
+        break;
+    }
+  }
+
+  // requests and their echo
+  switch (fc) {
+    case 0x05:
+      if (n != 4 || (pduWord (&pdu[2]) != 0xFF00 && pduWord (&pdu[2]) != 0)) {
+        return false;
+      }
+      w.byte (CompactFlag | fc);
+      w.varint (pduWord (&pdu[0]));
+      w.byte (pdu[2] ? 1 : 0);
+      return true;
+
+    case 0x06:
+      if (n != 4) {
+        return false;
+      }
+      w.byte (CompactFlag | fc);
+      w.varint (pduWord (&pdu[0]));
+      w.varint (pduWord (&pdu[2]));
+      return true;
+
+    default:
+      break;
+  }
+  return false;
+}
+
+size_t ModbusCompact::encode (const uint8_t *frame, size_t len, uint8_t *out, size_t outSize,
+                              Direction dir, bool delta) {
+
+  if (len < 4 || len > 256) {
+    return 0;
+  }
+
+  const uint8_t *pdu = &frame[2];
+  size_t n = len - 4;
+  uint8_t fc = frame[1];
+
+  // the compact forms are sized first, to write only the shortest one
+  size_t best = 2 + ( (fc & CompactFlag) ? 1 : 0) + n; // raw form, always possible
+  int form = -1;
+  for (int d = 0; d < (delta ? 2 : 1); d++) {
+    Writer dry (0, 0);
+
+    dry.byte (frame[0]);
+    if (encodeCompact (pdu, n, fc, dir, d != 0, dry) && dry.len < best) {
+      best = dry.len;
+      form = d;
+    }
+  }
+
+  Writer w (out, outSize);
+  w.byte (frame[0]);
+  if (form >= 0) {
+
+    encodeCompact (pdu, n, fc, dir, form != 0, w);
+  }
+  else {
+
+    if (fc & CompactFlag) {
+      w.byte (Escape);
+    }
+    w.byte (fc);
+    w.bytes (pdu, n);
+  }
+  return w.ok ? w.len : 0;
+}
+
+size_t ModbusCompact::decode (const uint8_t *in, size_t len, uint8_t *frame, size_t frameSize,
+                              Direction dir) {
+  Reader r (in, len);
+  Writer w (frame, frameSize >= 2 ? frameSize - 2 : 0);
+  uint8_t code;
+
+  w.byte (r.byte());
+  code = r.byte();
+  if (!r.ok) {
+    return 0;
+  }
+
+  if (code == Escape) {
+
+    w.byte (r.byte());
+    w.bytes (&in[r.pos], r.remaining());
+  }
+  else if ( (code & CompactFlag) == 0) {
+
+    w.byte (code);
+    w.bytes (&in[r.pos], r.remaining());
+  }
+  else if (code & 0x80) {
+
+    return 0;
+  }
+  else {
+    uint8_t fc = code & 0x1F;
+    bool delta = (code & DeltaFlag) != 0;
+    size_t start;
+
+    w.byte (fc);
+    if (dir == Request && fc <= 0x04 && !delta) {
+
+      w.word (r.varint());
+      w.word (r.varint());
+    }
+    else if (dir == Request && fc == 0x0F && !delta) {
+
+      w.word (r.varint());
+      w.word (r.varint());
+      w.byte (r.remaining());
+      w.bytes (&in[r.pos], r.remaining());
+    }
+    else if (dir == Request && fc == 0x10) {
+
+      w.word (r.varint());
+      start = w.len;
+      w.word (0); // quantity
+      w.byte (0); // byte count
+      if (delta) {
+        readDelta (r, w);
+      }
+      else {
+        w.bytes (&in[r.pos], r.remaining());
+      }
+      if (w.ok) {
+        size_t bc = w.len - start - 3;
+
+        if (bc % 2 || bc > 0xFF) {
+          return 0;
+        }
+        frame[start] = 0;
+        frame[start + 1] = bc / 2;
+        frame[start + 2] = bc;
+      }
+    }
+    else if (dir == Response && fc <= 0x04 && (!delta || fc >= 0x03)) {
+
+      start = w.len;
+      w.byte (0); // byte count
+      if (delta) {
+        readDelta (r, w);
+      }
+      else {
+        w.bytes (&in[r.pos], r.remaining());
+      }
+      if (w.ok) {
+        size_t bc = w.len - start - 1;
+
+        if (bc > 0xFF) {
+          return 0;
+        }
+        frame[start] = bc;
+      }
+    }
+    else if (dir == Response && (fc == 0x0F || fc == 0x10) && !delta) {
+
+      w.word (r.varint());
+      w.word (r.varint());
+    }
+    else if (fc == 0x05 && !delta) {
+
+      w.word (r.varint());
+      w.word (r.byte() ? 0xFF00 : 0);
+    }
+    else if (fc == 0x06 && !delta) {
+
+      w.word (r.varint());
+      w.word (r.varint());
+    }
+    else {
+
+      return 0;
+    }
+
+    // trailing bytes in a fixed length form
+    if (r.remaining() > 0 && !delta && !( (dir == Request && fc == 0x0F) ||
+                                          (dir == Request && fc == 0x10) ||
+                                          (dir == Response && fc <= 0x04))) {
+      return 0;
+    }
+  }
+
+  if (!r.ok || !w.ok) {
+    return 0;
+  }
+
+  uint16_t crc = ModbusCrc::compute (frame, w.len);
+  frame[w.len] = crc & 0xFF;
+  frame[w.len + 1] = crc >> 8;
+  return w.len + 2;
+}
@@ -0,0 +1,168 @@
+#include <string.h>
+#include "ModbusRelay.h"
+#include "ModbusCrc.h"
+
+size_t ModbusRelay::wrap (uint8_t type, uint8_t hop, const uint8_t *path, uint8_t count,
+                          const uint8_t *rtu, size_t len, uint8_t *frame, size_t size) {
+
+  // slave, PDU, CRC
+  if (len < 4 || count > MaxHops || size < wrappedLength (len, count)) {
+    return 0;
+  }
+  frame[0] = rtu[0];
+  frame[1] = Function;
+  frame[2] = (type & TypeMask) | (hop & HopMask);
+  frame[3] = count;
+  memcpy (frame + HeaderSize, path, count);
+  memcpy (frame + HeaderSize + count, rtu + 1, len - 3);
+  return ModbusCrc::append (frame, HeaderSize + count + len - 3);
+}
+
+size_t ModbusRelay::discover (uint8_t slave, uint8_t sequence, uint8_t *frame, size_t size) {
+
+  if (size < HeaderSize + 2) {
+    return 0;
+  }
+  frame[0] = slave;
+  frame[1] = Function;
+  frame[2] = Discover | (sequence & HopMask);
+  frame[3] = 0;
+  return ModbusCrc::append (frame, HeaderSize);
+}
+
+bool ModbusRelay::decode (const uint8_t *frame, size_t len, Frame & f) {
+
+  if (len < HeaderSize + 2 || frame[1] != Function || ModbusCrc::compute (frame, len) != 0 ||
+      frame[3] > MaxHops || len < HeaderSize + frame[3] + 2U) {
+    return false;
+  }
+  f.slave = frame[0];
+  f.type = frame[2] & TypeMask;
+  f.hop = frame[2] & HopMask;
+  f.count = frame[3];
+  f.path = frame + HeaderSize;
+  f.pdu = f.path + f.count;
+  f.pduLength = len - HeaderSize - f.count - 2;
+
+  // the discovery frames have no PDU
+  return (f.type == Discover || f.type == Route) == (f.pduLength == 0);
+}
+
+size_t ModbusRelay::unwrap (const Frame & f, uint8_t *rtu, size_t size) {
+
+  if (f.pduLength == 0 || size < f.pduLength + 3) {
+    return 0;
+  }
+  rtu[0] = f.slave;
+  memcpy (rtu + 1, f.pdu, f.pduLength);
+  return ModbusCrc::append (rtu, f.pduLength + 1);
+}
+
+ModbusRelay::ModbusRelay (uint8_t address) :
+  m_address (address), m_lastSlave (0), m_lastSequence (0), m_lastHeard (0) {
+
+  memset (m_pending, 0, sizeof (m_pending));
+}
+
+// Copy of a relay frame with another control byte
+size_t ModbusRelay::forward (const uint8_t *frame, size_t len, uint8_t control, uint8_t *out, size_t size) const {
+
+  if (size < len) {
+    return 0;
+  }
+  memcpy (out, frame, len - 2);
+  out[2] = control;
+  return ModbusCrc::append (out, len - 2);
+}
+
+size_t ModbusRelay::onFrame (const uint8_t *frame, size_t len, unsigned long now, uint8_t *out, size_t size) {
+  Frame f;
+
+  if (len < 4 || ModbusCrc::compute (frame, len) != 0) {
+    return 0;
+  }
+
+  if (frame[1] != Function) {
+
+    // the response of a slave to which we have passed a request
+    for (uint8_t i = 0; i < MaxPending; i++) {
+      Pending & p = m_pending[i];
+
+      if (p.slave != 0 && p.slave == frame[0] && (now - p.sent) < PendingTime) {
+
+        p.slave = 0;
+        return wrap (Response, p.count > 1 ? p.count - 2 : Bridge, p.path, p.count, frame, len, out, size);
+      }
+    }
+    return 0;
+  }
+
+  if (!decode (frame, len, f)) {
+    return 0;
+  }
+  switch (f.type) {
+
+    case Request:
+      if (f.hop >= f.count || f.path[f.hop] != m_address) {
+        return 0;
+      }
+      if (f.hop + 1 < f.count) {
+        return forward (frame, len, Request | (f.hop + 1), out, size);
+      }
+      else {
+        // last repeater, the slave receives a plain frame
+        Pending *p = &m_pending[0];
+
+        for (uint8_t i = 0; i < MaxPending; i++) {
+          Pending & q = m_pending[i];
+
+          if (q.slave == f.slave || q.slave == 0 || (now - q.sent) >= PendingTime) {
+            p = &q;
+            break;
+          }
+          if ( (long) (q.sent - p->sent) < 0) {
+            p = &q; // the oldest is replaced
+          }
+        }
+        p->slave = f.slave;
+        p->count = f.count;
+        memcpy (p->path, f.path, f.count);
+        p->sent = now;
+        return unwrap (f, out, size);
+      }
+
+    case Response:
+    case Route:
+      if (f.hop >= f.count || f.path[f.hop] != m_address) {
+        return 0;
+      }
+      return forward (frame, len, f.type | (f.hop > 0 ? f.hop - 1 : Bridge), out, size);
+
+    default:
+      // a discover is heard once from each node which passes it
+      if (f.slave == m_lastSlave && f.hop == m_lastSequence && (now - m_lastHeard) < PendingTime) {
+        return 0;
+      }
+      m_lastSlave = f.slave;
+      m_lastSequence = f.hop;
+      m_lastHeard = now;
+
+      if (f.slave == m_address) {
+
+        // the route goes back along the path
+        return forward (frame, len, Route | (f.count > 0 ? f.count - 1 : Bridge), out, size);
+      }
+      for (uint8_t i = 0; i < f.count; i++) {
+        if (f.path[i] == m_address) {
+          return 0;
+        }
+      }
+      if (f.count >= MaxHops || size < len + 1) {
+        return 0;
+      }
+      memcpy (out, frame, HeaderSize + f.count);
+      out[3] = f.count + 1;
+      out[HeaderSize + f.count] = m_address;
+      return ModbusCrc::append (out, HeaderSize + f.count + 1);
+  }
+}
@@ -0,0 +1,61 @@
+#include <string.h>
+#include "ModbusReport.h"
+#include "ModbusCrc.h"
+
+size_t ModbusReport::dataSize (uint8_t table, uint16_t quantity) {
+
+  switch (table) {
+    case 0x01:
+    case 0x02:
+      return (quantity + 7) / 8;
+    case 0x03:
+    case 0x04:
+      return quantity * 2;
+    default:
+      return 0;
+  }
+}
+
+size_t ModbusReport::encode (uint8_t slave, uint8_t sequence, bool integrity, uint8_t table,
+                             uint16_t start, uint16_t quantity, const uint8_t *data,
+                             uint8_t *frame, size_t size) {
+  size_t count = dataSize (table, quantity);
+
+  if (count == 0 || count > 255 || size < HeaderSize + count + 2) {
+    return 0;
+  }
+  frame[0] = slave;
+  frame[1] = Function;
+  frame[2] = (sequence & SequenceMask) | (integrity ? Integrity : 0);
+  frame[3] = table;
+  frame[4] = start >> 8;
+  frame[5] = start & 0xFF;
+  frame[6] = quantity >> 8;
+  frame[7] = quantity & 0xFF;
+  frame[8] = count;
+  memcpy (frame + HeaderSize, data, count);
+
+  size_t len = HeaderSize + count;
+  uint16_t crc = ModbusCrc::compute (frame, len);
+  frame[len] = crc & 0xFF;
+  frame[len + 1] = crc >> 8;
+  return len + 2;
+}
+
+bool ModbusReport::decode (const uint8_t *frame, size_t len, Report & report) {
+
+  if (len < HeaderSize + 2 || frame[1] != Function) {
+    return false;
+  }
+  report.slave = frame[0];
+  report.sequence = frame[2] & SequenceMask;
+  report.integrity = (frame[2] & Integrity) != 0;
+  report.table = frame[3];
+  report.start = (frame[4] << 8) | frame[5];
+  report.quantity = (frame[6] << 8) | frame[7];
+  report.count = frame[8];
+  report.data = frame + HeaderSize;
+
+  return report.quantity > 0 && report.count == dataSize (report.table, report.quantity) &&
+         len == HeaderSize + report.count + 2 && (uint32_t) report.start + report.quantity <= 0x10000;
+}
@@ -0,0 +1,241 @@
+#include <Piduino.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "ModbusTcpServer.h"
+#include "ModbusCrc.h"
+
+// MBAP header: transaction id, protocol id (0), length, unit id
+const size_t HeaderSize = 7;
+
+// Bytes a client may leave unread before it is disconnected
+const size_t MaxOutput = 65536;
+
+ModbusTcpServer::ModbusTcpServer (EventLoop & loop, Handler handler) :
+  m_loop (loop), m_handler (handler), m_fd (-1), m_port (0), m_maxClients (16), m_timeout (60000000UL),
+  m_nextMaster (FirstMaster), m_connections (0), m_received (0), m_sent (0), m_errors (0), m_forgotten (0) {
+}
+
+ModbusTcpServer::~ModbusTcpServer() {
+
+  close();
+}
+
+bool ModbusTcpServer::listen (const std::string & address, uint16_t port) {
+  struct sockaddr_in addr;
+  int on = 1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  if (address.empty()) {
+
+    addr.sin_addr.s_addr = htonl (INADDR_ANY);
+  }
+  else if (inet_pton (AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+
+    return false;
+  }
+
+  m_fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_fd < 0) {
+    return false;
+  }
+  setsockopt (m_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+  if (bind (m_fd, (struct sockaddr *) &addr, sizeof (addr)) < 0 || ::listen (m_fd, 8) < 0 ||
+      !m_loop.add (m_fd, EPOLLIN, [this] (uint32_t) { onAccept(); })) {
+
+    ::close (m_fd);
+    m_fd = -1;
+    return false;
+  }
+  socklen_t len = sizeof (addr);
+  getsockname (m_fd, (struct sockaddr *) &addr, &len);
+  m_port = ntohs (addr.sin_port);
+  return true;
+}
+
+void ModbusTcpServer::close() {
+
+  while (!m_clients.empty()) {
+    drop (m_clients.begin()->first);
+  }
+  if (m_fd >= 0) {
+
+    m_loop.remove (m_fd);
+    ::close (m_fd);
+    m_fd = -1;
+  }
+}
+
+void ModbusTcpServer::onAccept() {
+  int fd;
+
+  while ( (fd = accept4 (m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    int on = 1;
+
+    if (m_clients.size() >= m_maxClients ||
+        !m_loop.add (fd, EPOLLIN | EPOLLRDHUP, [this, fd] (uint32_t events) { onClient (fd, events); })) {
+
+      ::close (fd);
+      continue;
+    }
+    // the responses are small and must leave at once
+    setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on));
+    m_clients[fd].fd = fd;
+    m_clients[fd].watching = false;
+    m_connections++;
+  }
+}
+
+void ModbusTcpServer::onClient (int fd, uint32_t events) {
+  auto it = m_clients.find (fd);
+
+  if (it == m_clients.end()) {
+    return;
+  }
+  if ( (events & (EPOLLERR | EPOLLHUP)) ||
+       ( (events & (EPOLLIN | EPOLLRDHUP)) && !receive (it->second)) ||
+       ( (events & EPOLLOUT) && !send (it->second))) {
+
+    drop (fd);
+  }
+}
+
+// Reads the bytes of a client and gives its complete requests to the
+// handler, returns false if the client must be disconnected
+bool ModbusTcpServer::receive (Client & client) {
+  uint8_t buf[1024];
+  ssize_t n;
+  bool closed = false;
+
+  while ( (n = ::read (client.fd, buf, sizeof (buf))) > 0) {
+    client.in.insert (client.in.end(), buf, buf + n);
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    closed = true; // the requests already received are served
+  }
+
+  size_t start = 0;
+  unsigned long now = micros();
+
+  while (client.in.size() - start >= HeaderSize) {
+    const uint8_t *h = &client.in[start];
+    uint16_t protocol = (h[2] << 8) | h[3];
+    size_t length = (h[4] << 8) | h[5]; // unit id and PDU
+
+    if (protocol != 0 || length < 2 || length > 254) {
+
+      m_errors++;
+      return false;
+    }
+    if (client.in.size() - start < 6 + length) {
+      break;
+    }
+
+    // unit id, PDU and CRC
+    uint8_t frame[256];
+    uint32_t master = m_nextMaster;
+
+    memcpy (frame, h + 6, length);
+    size_t len = ModbusCrc::append (frame, length);
+    if (++m_nextMaster < FirstMaster) {
+      m_nextMaster = FirstMaster;
+    }
+    forget (now);
+    if (frame[0] != 0) {
+      // a broadcast has no response
+      m_requests[master] = Request { client.fd, (uint16_t) ( (h[0] << 8) | h[1]), now };
+    }
+    start += 6 + length;
+    m_received++;
+    m_handler (master, frame, len);
+  }
+  client.in.erase (client.in.begin(), client.in.begin() + start);
+  return !closed;
+}
+
+// Writes the output of a client, watches the socket until it has taken
+// everything, returns false if the client must be disconnected
+bool ModbusTcpServer::send (Client & client) {
+
+  while (!client.out.empty()) {
+    ssize_t n = ::send (client.fd, client.out.data(), client.out.size(), MSG_NOSIGNAL);
+
+    if (n < 0) {
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return false;
+    }
+    client.out.erase (client.out.begin(), client.out.begin() + n);
+  }
+  if (client.watching == client.out.empty()) {
+
+    client.watching = !client.out.empty();
+    m_loop.modify (client.fd, EPOLLIN | EPOLLRDHUP | (client.watching ? (uint32_t) EPOLLOUT : 0u));
+  }
+  return true;
+}
+
+bool ModbusTcpServer::reply (uint32_t master, const uint8_t *frame, size_t len) {
+  auto it = m_requests.find (master);
+
+  if (it == m_requests.end() || len < 4) {
+    return false;
+  }
+  Client & client = m_clients[it->second.fd];
+  size_t length = len - 2; // unit id and PDU, without the CRC
+  uint8_t h[6] = {
+    (uint8_t) (it->second.transaction >> 8), (uint8_t) it->second.transaction, 0, 0,
+    (uint8_t) (length >> 8), (uint8_t) length
+  };
+
+  m_requests.erase (it);
+  if (client.out.size() + sizeof (h) + length > MaxOutput) {
+
+    // the client does not read, the loop will see the end of its connection
+    m_errors++;
+    shutdown (client.fd, SHUT_RDWR);
+    return false;
+  }
+  bool idle = client.out.empty();
+
+  client.out.insert (client.out.end(), h, h + sizeof (h));
+  client.out.insert (client.out.end(), frame, frame + length);
+  m_sent++;
+  if (idle && !send (client)) {
+    shutdown (client.fd, SHUT_RDWR);
+  }
+  return true;
+}
+
+// Disconnects a client, its requests in progress are forgotten
+void ModbusTcpServer::drop (int fd) {
+
+  for (auto it = m_requests.begin(); it != m_requests.end();) {
+
+    it = it->second.fd == fd ? m_requests.erase (it) : std::next (it);
+  }
+  m_loop.remove (fd);
+  ::close (fd);
+  m_clients.erase (fd);
+}
+
+// Forgets the requests whose response will not come, the ids grow with
+// time, the oldest are first
+void ModbusTcpServer::forget (unsigned long now) {
+
+  while (!m_requests.empty() && now - m_requests.begin()->second.received > m_timeout) {
+
+    m_requests.erase (m_requests.begin());
+    m_forgotten++;
+  }
+}
@@ -0,0 +1,149 @@
+#include <Arduino.h>
+#include "RHAdaptiveDriver.h"
+
+RHAdaptiveDriver::RHAdaptiveDriver (RHGenericDriver & driver, RH_RF95 & rf95, uint8_t address, uint8_t spreadingFactor) :
+  m_driver (driver), m_rf95 (rf95), m_address (address), m_spreadingFactor (spreadingFactor),
+  m_profile (0), m_next (0), m_fallback (RH_ADR_FALLBACK), m_lastRequest (0) {
+}
+
+void RHAdaptiveDriver::setProfile (uint8_t profile) {
+  uint8_t sf = m_spreadingFactor;
+
+  for (uint8_t p = 0; p < profile && sf > 7; p++) {
+    sf--;
+  }
+  m_rf95.setSpreadingFactor (sf);
+  m_profile = profile;
+}
+
+bool RHAdaptiveDriver::init() {
+
+  return m_driver.init();
+}
+
+bool RHAdaptiveDriver::available() {
+
+  // the bridge has lost us, it looks for us with the profile 0
+  if (m_profile != 0 && (millis() - m_lastRequest) > m_fallback) {
+
+    m_next = 0;
+    setProfile (0);
+  }
+  return m_driver.available();
+}
+
+bool RHAdaptiveDriver::recv (uint8_t *buf, uint8_t *len) {
+
+  if (!m_driver.recv (buf, len)) {
+    return false;
+  }
+
+  // only our requests, the others may announce another profile
+  if (*len > 0 && buf[0] == m_address) {
+
+    m_next = m_driver.headerFlags() & RH_ADR_PROFILE_MASK;
+    if (m_next > RH_ADR_MAX_PROFILE) {
+      m_next = m_profile;
+    }
+    m_lastRequest = millis();
+  }
+  return true;
+}
+
+bool RHAdaptiveDriver::send (const uint8_t *data, uint8_t len) {
+
+  m_driver.setHeaderFlags (RH_FLAGS_NONE, RH_ADR_PROFILE_MASK);
+  if (!m_driver.send (data, len)) {
+    return false;
+  }
+
+  // the response goes with the profile of the request, the next request
+  // comes with the announced one
+  if (m_next != m_profile) {
+
+    m_driver.waitPacketSent();
+    setProfile (m_next);
+  }
+  return true;
+}
+
+uint8_t RHAdaptiveDriver::maxMessageLength() {
+
+  return m_driver.maxMessageLength();
+}
+
+bool RHAdaptiveDriver::waitPacketSent() {
+
+  return m_driver.waitPacketSent();
+}
+
+void RHAdaptiveDriver::setThisAddress (uint8_t thisAddress) {
+
+  m_driver.setThisAddress (thisAddress);
+}
+
+void RHAdaptiveDriver::setHeaderTo (uint8_t to) {
+
+  m_driver.setHeaderTo (to);
+}
+
+void RHAdaptiveDriver::setHeaderFrom (uint8_t from) {
+
+  m_driver.setHeaderFrom (from);
+}
+
+void RHAdaptiveDriver::setHeaderId (uint8_t id) {
+
+  m_driver.setHeaderId (id);
+}
+
+void RHAdaptiveDriver::setHeaderFlags (uint8_t set, uint8_t clear) {
+
+  // the profile flags belong to us
+  m_driver.setHeaderFlags (set & ~RH_ADR_PROFILE_MASK, clear & ~RH_ADR_PROFILE_MASK);
+}
+
+uint8_t RHAdaptiveDriver::headerTo() {
+
+  return m_driver.headerTo();
+}
+
+uint8_t RHAdaptiveDriver::headerFrom() {
+
+  return m_driver.headerFrom();
+}
+
+uint8_t RHAdaptiveDriver::headerId() {
+
+  return m_driver.headerId();
+}
+
+uint8_t RHAdaptiveDriver::headerFlags() {
+
+  return m_driver.headerFlags() & ~RH_ADR_PROFILE_MASK;
+}
+
+int16_t RHAdaptiveDriver::lastRssi() {
+
+  return m_driver.lastRssi();
+}
+
+RHGenericDriver::RHMode RHAdaptiveDriver::mode() {
+
+  return m_driver.mode();
+}
+
+void RHAdaptiveDriver::setModeIdle() {
+
+  m_driver.setModeIdle();
+}
+
+void RHAdaptiveDriver::setModeRx() {
+
+  m_driver.setModeRx();
+}
+
+void RHAdaptiveDriver::setModeTx() {
+
+  m_driver.setModeTx();
+}
@@ -0,0 +1,147 @@
+#include <string.h>
+#include "RHCompactDriver.h"
+
+RHCompactDriver::RHCompactDriver (RHGenericDriver & driver, Role role) :
+  m_driver (driver), m_role (role), m_compact (false), m_delta (true) {
+}
+
+bool RHCompactDriver::init() {
+
+  return m_driver.init();
+}
+
+bool RHCompactDriver::available() {
+
+  return m_driver.available();
+}
+
+bool RHCompactDriver::recv (uint8_t *buf, uint8_t *len) {
+  uint8_t rxlen = m_driver.maxMessageLength(); // less than sizeof (m_buf)
+
+  if (!m_driver.recv (m_buf, &rxlen)) {
+    return false;
+  }
+
+  bool compact = (m_driver.headerFlags() & RH_COMPACT_FLAG) != 0;
+  if (m_role == Slave) {
+    // answers in the encoding of the request
+    m_compact = compact;
+  }
+
+  if (!compact) {
+
+    if (rxlen > *len) {
+      return false;
+    }
+    memcpy (buf, m_buf, rxlen);
+    *len = rxlen;
+    return true;
+  }
+
+  size_t n = ModbusCompact::decode (m_buf, rxlen, buf, *len,
+                                    m_role == Master ? ModbusCompact::Response : ModbusCompact::Request);
+  if (n == 0) {
+    return false;
+  }
+  *len = n;
+  return true;
+}
+
+bool RHCompactDriver::send (const uint8_t *data, uint8_t len) {
+
+  if (!m_compact) {
+
+    m_driver.setHeaderFlags (RH_FLAGS_NONE, RH_COMPACT_FLAG);
+    return m_driver.send (data, len);
+  }
+
+  size_t n = ModbusCompact::encode (data, len, m_buf, m_driver.maxMessageLength(),
+                                    m_role == Master ? ModbusCompact::Request : ModbusCompact::Response, m_delta);
+  if (n == 0) {
+    return false;
+  }
+  m_driver.setHeaderFlags (RH_COMPACT_FLAG, RH_COMPACT_FLAG);
+  return m_driver.send (m_buf, n);
+}
+
+uint8_t RHCompactDriver::maxMessageLength() {
+
+  // the raw form is the frame without CRC, plus an escape byte at worst
+  return m_compact ? m_driver.maxMessageLength() + 1 : m_driver.maxMessageLength();
+}
+
+bool RHCompactDriver::waitPacketSent() {
+
+  return m_driver.waitPacketSent();
+}
+
+void RHCompactDriver::setThisAddress (uint8_t thisAddress) {
+
+  m_driver.setThisAddress (thisAddress);
+}
+
+void RHCompactDriver::setHeaderTo (uint8_t to) {
+
+  m_driver.setHeaderTo (to);
+}
+
+void RHCompactDriver::setHeaderFrom (uint8_t from) {
+
+  m_driver.setHeaderFrom (from);
+}
+
+void RHCompactDriver::setHeaderId (uint8_t id) {
+
+  m_driver.setHeaderId (id);
+}
+
+void RHCompactDriver::setHeaderFlags (uint8_t set, uint8_t clear) {
+
+  // the compact flag belongs to us
+  m_driver.setHeaderFlags (set & ~RH_COMPACT_FLAG, clear & ~RH_COMPACT_FLAG);
+}
+
+uint8_t RHCompactDriver::headerTo() {
+
+  return m_driver.headerTo();
+}
+
+uint8_t RHCompactDriver::headerFrom() {
+
+  return m_driver.headerFrom();
+}
+
+uint8_t RHCompactDriver::headerId() {
+
+  return m_driver.headerId();
+}
+
+uint8_t RHCompactDriver::headerFlags() {
+
+  return m_driver.headerFlags() & ~RH_COMPACT_FLAG;
+}
+
+int16_t RHCompactDriver::lastRssi() {
+
+  return m_driver.lastRssi();
+}
+
+RHGenericDriver::RHMode RHCompactDriver::mode() {
+
+  return m_driver.mode();
+}
+
+void RHCompactDriver::setModeIdle() {
+
+  m_driver.setModeIdle();
+}
+
+void RHCompactDriver::setModeRx() {
+
+  m_driver.setModeRx();
+}
+
+void RHCompactDriver::setModeTx() {
+
+  m_driver.setModeTx();
+}
@@ -0,0 +1,175 @@
+#include <string.h>
+#include "RHCtrEncryptedDriver.h"
+
+RHCtrEncryptedDriver::RHCtrEncryptedDriver (RHGenericDriver & driver, BlockCipher & cipher, Role role, uint8_t node) :
+  m_driver (driver), m_cipher (cipher), m_role (role), m_node (node), m_counter (0), m_own (0), m_answered (true) {
+}
+
+void RHCtrEncryptedDriver::crypt (const uint8_t *nonce, uint8_t *out, const uint8_t *in, uint8_t len) {
+  uint8_t block[16];
+  uint8_t stream[16];
+  uint8_t i = 0;
+
+  while (len > 0) {
+    uint8_t n = len < 16 ? len : 16;
+
+    memcpy (block, nonce, RH_CTR_NONCE_LEN);
+    memset (block + RH_CTR_NONCE_LEN, 0, 15 - RH_CTR_NONCE_LEN);
+    block[15] = i++;
+    m_cipher.encryptBlock (stream, block);
+    for (uint8_t j = 0; j < n; j++) {
+      out[j] = in[j] ^ stream[j];
+    }
+    out += n;
+    in += n;
+    len -= n;
+  }
+}
+
+bool RHCtrEncryptedDriver::init() {
+
+  return m_driver.init();
+}
+
+bool RHCtrEncryptedDriver::available() {
+
+  return m_driver.available();
+}
+
+bool RHCtrEncryptedDriver::recv (uint8_t *buf, uint8_t *len) {
+  uint8_t rxlen = sizeof (m_buf);
+
+  if (!m_driver.recv (m_buf, &rxlen) || rxlen < RH_CTR_NONCE_LEN) {
+    return false;
+  }
+
+  rxlen -= RH_CTR_NONCE_LEN;
+  if (rxlen > *len) {
+    return false;
+  }
+
+  if (m_role == Slave && m_buf[0] >= RH_CTR_MASTER_NODE) {
+    // the answer will use the counter of this request, not those of the
+    // frames of the other slaves
+    m_counter = ( (uint32_t) m_buf[1] << 24) | ( (uint32_t) m_buf[2] << 16) | ( (uint32_t) m_buf[3] << 8) | m_buf[4];
+    m_answered = false;
+  }
+  crypt (m_buf, buf, m_buf + RH_CTR_NONCE_LEN, rxlen);
+  *len = rxlen;
+  return true;
+}
+
+bool RHCtrEncryptedDriver::send (const uint8_t *data, uint8_t len) {
+
+  if (len > maxMessageLength()) {
+    return false;
+  }
+
+  uint32_t counter;
+  if (m_role == Master) {
+
+    m_counter = (m_counter + 1) & ~RH_CTR_OWN_FLAG;
+    counter = m_counter;
+  }
+  else if (!m_answered) {
+
+    // the answer to the last request
+    counter = m_counter;
+    m_answered = true;
+  }
+  else {
+
+    // a frame sent on its own, a report after the answer must not reuse
+    // the counter of the request
+    m_own = (m_own + 1) & ~RH_CTR_OWN_FLAG;
+    counter = m_own | RH_CTR_OWN_FLAG;
+  }
+  m_buf[0] = m_node;
+  m_buf[1] = counter >> 24;
+  m_buf[2] = counter >> 16;
+  m_buf[3] = counter >> 8;
+  m_buf[4] = counter;
+  crypt (m_buf, m_buf + RH_CTR_NONCE_LEN, data, len);
+  return m_driver.send (m_buf, len + RH_CTR_NONCE_LEN);
+}
+
+uint8_t RHCtrEncryptedDriver::maxMessageLength() {
+
+  // m_buf holds any message of the driver (255 bytes at most)
+  return m_driver.maxMessageLength() - RH_CTR_NONCE_LEN;
+}
+
+bool RHCtrEncryptedDriver::waitPacketSent() {
+
+  return m_driver.waitPacketSent();
+}
+
+void RHCtrEncryptedDriver::setThisAddress (uint8_t thisAddress) {
+
+  m_driver.setThisAddress (thisAddress);
+}
+
+void RHCtrEncryptedDriver::setHeaderTo (uint8_t to) {
+
+  m_driver.setHeaderTo (to);
+}
+
+void RHCtrEncryptedDriver::setHeaderFrom (uint8_t from) {
+
+  m_driver.setHeaderFrom (from);
+}
+
+void RHCtrEncryptedDriver::setHeaderId (uint8_t id) {
+
+  m_driver.setHeaderId (id);
+}
+
+void RHCtrEncryptedDriver::setHeaderFlags (uint8_t set, uint8_t clear) {
+
+  m_driver.setHeaderFlags (set, clear);
+}
+
+uint8_t RHCtrEncryptedDriver::headerTo() {
+
+  return m_driver.headerTo();
+}
+
+uint8_t RHCtrEncryptedDriver::headerFrom() {
+
+  return m_driver.headerFrom();
+}
+
+uint8_t RHCtrEncryptedDriver::headerId() {
+
+  return m_driver.headerId();
+}
+
+uint8_t RHCtrEncryptedDriver::headerFlags() {
+
+  return m_driver.headerFlags();
+}
+
+int16_t RHCtrEncryptedDriver::lastRssi() {
+
+  return m_driver.lastRssi();
+}
+
+RHGenericDriver::RHMode RHCtrEncryptedDriver::mode() {
+
+  return m_driver.mode();
+}
+
+void RHCtrEncryptedDriver::setModeIdle() {
+
+  m_driver.setModeIdle();
+}
+
+void RHCtrEncryptedDriver::setModeRx() {
+
+  m_driver.setModeRx();
+}
+
+void RHCtrEncryptedDriver::setModeTx() {
+
+  m_driver.setModeTx();
+}
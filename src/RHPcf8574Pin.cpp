@@ -1,33 +1,133 @@
 #include <Arduino.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "RHPcf8574Pin.h"
 
-RHPcf8574Pin::RHPcf8574Pin (int pinNumber, Pcf8574 & ctrl) :
-  RHPin (false), m_pinNumber (pinNumber), m_ctrl (ctrl) {
+RHPcf8574Pin::RHPcf8574Pin (int pinNumber, Pcf8574 & ctrl, unsigned long minPulse) :
+  RHPin (false), m_pinNumber (pinNumber), m_ctrl (ctrl), m_state (false), m_pulse (false),
+  m_running (false), m_sleeping (false), m_minPulse (minPulse), m_changes (0), m_writes (0) {
+
+  m_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+RHPcf8574Pin::~RHPcf8574Pin() {
+
+  stop();
+  if (m_fd >= 0) {
+    close (m_fd);
+  }
 }
 
 //Effectue les opérations d'initialisation des ressources matérielles.
 void RHPcf8574Pin::begin() {
+
   m_ctrl.pinMode (m_pinNumber, OUTPUT);
-  setState (false);
+  write (false);
+  m_state = m_pulse = false;
+  if (!m_running && m_fd >= 0) {
+
+    m_running = true;
+    m_thread = std::thread (&RHPcf8574Pin::run, this);
+  }
+}
+
+void RHPcf8574Pin::stop() {
+
+  if (m_running) {
+
+    m_running = false;
+    eventfd_write (m_fd, 1);
+    m_thread.join();
+  }
 }
 
 //Lecture de l'état binaire de la led.
 //true si allumée.
 bool RHPcf8574Pin::state() const {
-  return m_ctrl.digitalRead (m_pinNumber) == polarity();
+  return m_state;
 }
 
 //Modifie l'état allumée / éteinte
 //true pour allumée.
 void RHPcf8574Pin::setState (bool on) {
-  m_ctrl.digitalWrite (m_pinNumber, on ^ ! polarity());
+
+  if (m_state.exchange (on) == on) {
+    return;
+  }
+  m_changes++;
+  if (!m_running) {
+    // no thread (not started or stopped), written by the caller
+    write (on);
+    return;
+  }
+  if (on) {
+    m_pulse = true;
+  }
+  // a system call only when the thread sleeps
+  if (m_sleeping.load()) {
+    eventfd_write (m_fd, 1);
+  }
 }
 
 //Bascule de l'état binaire d'une led.
 //Si elle était éteinte, elle s'allume.
 //Si elle était allumée, elle s'éteint.
-
 void RHPcf8574Pin::toggleState() {
-  setState (!state());
+  setState (!m_state);
+}
+
+void RHPcf8574Pin::write (bool on) {
+
+  m_ctrl.digitalWrite (m_pinNumber, on ^ ! polarity());
+  m_writes++;
+}
+
+// true if the led shown must change
+bool RHPcf8574Pin::isPending (bool shown) const {
+
+  return m_state != shown || (!shown && m_pulse);
+}
+
+// Thread of the led, the only one which writes the expander once started
+void RHPcf8574Pin::run() {
+  bool shown = false;
+  unsigned long changed = millis() - m_minPulse;
+
+  while (m_running) {
+    unsigned long elapsed = millis() - changed;
+    int timeout = 100;
+
+    if (elapsed >= m_minPulse) {
+      // an on switched off meanwhile is shown, the changes while the led was
+      // on are merged in its pulse
+      bool next = m_state;
+
+      if (m_pulse.exchange (false)) {
+        next = next || !shown;
+      }
+      if (next != shown) {
+
+        write (next);
+        shown = next;
+        changed = millis();
+        continue;
+      }
+    }
+    else {
+
+      timeout = m_minPulse - elapsed;
+    }
+
+    m_sleeping = true;
+    if (m_running && (timeout < 100 || !isPending (shown))) {
+      struct pollfd pfd = { m_fd, POLLIN, 0 };
+      eventfd_t v;
+
+      poll (&pfd, 1, timeout);
+      eventfd_read (m_fd, &v);
+    }
+    m_sleeping = false;
+  }
 }
@@ -0,0 +1,140 @@
+#include <string.h>
+#include <Arduino.h>
+#include "RHRelayDriver.h"
+
+RHRelayDriver::RHRelayDriver (RHGenericDriver & driver, uint8_t address) :
+  m_driver (driver), m_relay (address), m_repeater (true), m_jitter (RH_RELAY_JITTER), m_len (0) {
+}
+
+bool RHRelayDriver::init() {
+
+  return m_driver.init();
+}
+
+bool RHRelayDriver::available() {
+
+  while (m_len == 0 && m_driver.available()) {
+    uint8_t len = m_driver.maxMessageLength() < sizeof (m_buf) ? m_driver.maxMessageLength() : sizeof (m_buf);
+
+    if (!m_driver.recv (m_buf, &len) || len == 0) {
+      continue;
+    }
+    bool relay = len > 1 && m_buf[1] == ModbusRelay::Function;
+
+    // a slave which is not a repeater only answers the discovery of its route
+    if (m_repeater || (relay && m_buf[0] == m_relay.address() &&
+                       (m_buf[2] & ModbusRelay::TypeMask) == ModbusRelay::Discover)) {
+      size_t n = m_relay.onFrame (m_buf, len, millis(), m_out, m_driver.maxMessageLength());
+
+      if (n > 0) {
+
+        if ( (m_out[2] & ModbusRelay::TypeMask) == ModbusRelay::Discover && m_jitter > 0) {
+          delay (random (m_jitter + 1));
+        }
+        m_driver.send (m_out, n);
+        m_driver.waitPacketSent();
+      }
+    }
+    if (!relay) {
+      m_len = len;
+    }
+  }
+  return m_len > 0;
+}
+
+bool RHRelayDriver::recv (uint8_t *buf, uint8_t *len) {
+
+  if (!available() || m_len > *len) {
+    m_len = 0;
+    return false;
+  }
+  memcpy (buf, m_buf, m_len);
+  *len = m_len;
+  m_len = 0;
+  return true;
+}
+
+bool RHRelayDriver::send (const uint8_t *data, uint8_t len) {
+
+  return m_driver.send (data, len);
+}
+
+uint8_t RHRelayDriver::maxMessageLength() {
+
+  return m_driver.maxMessageLength();
+}
+
+bool RHRelayDriver::waitPacketSent() {
+
+  return m_driver.waitPacketSent();
+}
+
+void RHRelayDriver::setThisAddress (uint8_t thisAddress) {
+
+  m_driver.setThisAddress (thisAddress);
+}
+
+void RHRelayDriver::setHeaderTo (uint8_t to) {
+
+  m_driver.setHeaderTo (to);
+}
+
+void RHRelayDriver::setHeaderFrom (uint8_t from) {
+
+  m_driver.setHeaderFrom (from);
+}
+
+void RHRelayDriver::setHeaderId (uint8_t id) {
+
+  m_driver.setHeaderId (id);
+}
+
+void RHRelayDriver::setHeaderFlags (uint8_t set, uint8_t clear) {
+
+  m_driver.setHeaderFlags (set, clear);
+}
+
+uint8_t RHRelayDriver::headerTo() {
+
+  return m_driver.headerTo();
+}
+
+uint8_t RHRelayDriver::headerFrom() {
+
+  return m_driver.headerFrom();
+}
+
+uint8_t RHRelayDriver::headerId() {
+
+  return m_driver.headerId();
+}
+
+uint8_t RHRelayDriver::headerFlags() {
+
+  return m_driver.headerFlags();
+}
+
+int16_t RHRelayDriver::lastRssi() {
+
+  return m_driver.lastRssi();
+}
+
+RHGenericDriver::RHMode RHRelayDriver::mode() {
+
+  return m_driver.mode();
+}
+
+void RHRelayDriver::setModeIdle() {
+
+  m_driver.setModeIdle();
+}
+
+void RHRelayDriver::setModeRx() {
+
+  m_driver.setModeRx();
+}
+
+void RHRelayDriver::setModeTx() {
+
+  m_driver.setModeTx();
+}
@@ -0,0 +1,81 @@
+#include <Arduino.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "RH_RF95Event.h"
+
+RH_RF95Event *RH_RF95Event::m_deviceForInterrupt[RH_RF95_EVENT_NUM_INTERRUPTS] = { nullptr, nullptr, nullptr };
+uint8_t RH_RF95Event::m_interruptCount = 0;
+
+RH_RF95Event::RH_RF95Event (uint8_t slaveSelectPin, uint8_t interruptPin) :
+  RH_RF95 (slaveSelectPin, interruptPin), m_interruptPin (interruptPin),
+  m_myInterruptIndex (0xff), m_fd (eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+}
+
+RH_RF95Event::~RH_RF95Event() {
+
+  if (m_myInterruptIndex < RH_RF95_EVENT_NUM_INTERRUPTS) {
+
+    detachInterrupt (digitalPinToInterrupt (m_interruptPin));
+    m_deviceForInterrupt[m_myInterruptIndex] = nullptr;
+  }
+  ::close (m_fd);
+}
+
+bool RH_RF95Event::init() {
+
+  if (m_fd < 0 || !RH_RF95::init()) {
+    return false;
+  }
+
+  if (m_myInterruptIndex == 0xff) {
+
+    if (m_interruptCount >= RH_RF95_EVENT_NUM_INTERRUPTS) {
+      return false;
+    }
+    m_myInterruptIndex = m_interruptCount++;
+  }
+  m_deviceForInterrupt[m_myInterruptIndex] = this;
+
+  // RH_RF95::init() attached its own routine, the handling is the same but
+  // ours signals the event loop once the interrupt has been handled
+  int interruptNumber = digitalPinToInterrupt (m_interruptPin);
+  detachInterrupt (interruptNumber);
+  if (m_myInterruptIndex == 0) {
+    attachInterrupt (interruptNumber, isr0, RISING);
+  }
+  else if (m_myInterruptIndex == 1) {
+    attachInterrupt (interruptNumber, isr1, RISING);
+  }
+  else {
+    attachInterrupt (interruptNumber, isr2, RISING);
+  }
+  return true;
+}
+
+void RH_RF95Event::handleEvent() {
+
+  handleInterrupt();
+  eventfd_write (m_fd, 1);
+}
+
+void RH_RF95Event::isr0() {
+
+  if (m_deviceForInterrupt[0]) {
+    m_deviceForInterrupt[0]->handleEvent();
+  }
+}
+
+void RH_RF95Event::isr1() {
+
+  if (m_deviceForInterrupt[1]) {
+    m_deviceForInterrupt[1]->handleEvent();
+  }
+}
+
+void RH_RF95Event::isr2() {
+
+  if (m_deviceForInterrupt[2]) {
+    m_deviceForInterrupt[2]->handleEvent();
+  }
+}
@@ -0,0 +1,216 @@
+#include "ReadCache.h"
+#include "ModbusCrc.h"
+
+ReadCache::ReadCache (size_t maxEntries) :
+  m_maxEntries (maxEntries), m_ttl (0),
+  m_hits (0), m_misses (0), m_invalidations (0) {
+}
+
+void ReadCache::setSlaveTtl (uint8_t slave, unsigned long usec) {
+
+  m_slaveTtl[slave] = usec;
+}
+
+void ReadCache::setFunctionTtl (uint8_t function, unsigned long usec) {
+
+  m_functionTtl[function] = usec;
+}
+
+unsigned long ReadCache::ttl (uint8_t slave, uint8_t function) const {
+  auto s = m_slaveTtl.find (slave);
+
+  if (s != m_slaveTtl.end()) {
+    return s->second;
+  }
+
+  auto f = m_functionTtl.find (function);
+  if (f != m_functionTtl.end()) {
+    return f->second;
+  }
+  return m_ttl;
+}
+
+bool ReadCache::isEnabled() const {
+
+  if (m_ttl) {
+    return true;
+  }
+  for (const auto & t : m_slaveTtl) {
+    if (t.second) {
+      return true;
+    }
+  }
+  for (const auto & t : m_functionTtl) {
+    if (t.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadCache::isRead (uint8_t function) {
+
+  return function >= 0x01 && function <= 0x04;
+}
+
+bool ReadCache::isWrite (uint8_t function) {
+
+  switch (function) {
+    case 0x05: // Write Single Coil
+    case 0x06: // Write Single Register
+    case 0x0F: // Write Multiple Coils
+    case 0x10: // Write Multiple Registers
+    case 0x16: // Mask Write Register
+    case 0x17: // Read/Write Multiple Registers
+      return true;
+    default:
+      break;
+  }
+  return false;
+}
+
+bool ReadCache::writtenRange (const uint8_t *request, size_t len, uint8_t & table, uint16_t & start, uint16_t & quantity) {
+
+  if (len < 6 || !isWrite (request[1])) {
+    return false;
+  }
+
+  switch (request[1]) {
+    case 0x05:
+    case 0x0F:
+      table = 0x01;
+      break;
+    default:
+      table = 0x03;
+      break;
+  }
+  switch (request[1]) {
+    case 0x0F:
+    case 0x10:
+      start = pduWord (&request[2]);
+      quantity = pduWord (&request[4]);
+      break;
+    case 0x17:
+      // read range first, then the write range
+      if (len < 10) {
+        return false;
+      }
+      start = pduWord (&request[6]);
+      quantity = pduWord (&request[8]);
+      break;
+    default:
+      start = pduWord (&request[2]);
+      quantity = 1;
+      break;
+  }
+  return true;
+}
+
+bool ReadCache::lookup (const uint8_t *request, size_t len, unsigned long now, std::vector<uint8_t> & response) {
+
+  // slave, function, start, quantity, CRC
+  if (len != 8 || request[0] == 0 || !isRead (request[1])) {
+    return false;
+  }
+
+  unsigned long t = ttl (request[0], request[1]);
+  if (t == 0) {
+    return false;
+  }
+
+  uint16_t start = pduWord (&request[2]);
+  uint16_t quantity = pduWord (&request[4]);
+  for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+
+    if (it->slave == request[0] && it->function == request[1] &&
+        it->start == start && it->quantity == quantity) {
+
+      if ( (now - it->time) < t) {
+
+        response = it->response;
+        m_hits++;
+        return true;
+      }
+      m_entries.erase (it);
+      break;
+    }
+  }
+  m_misses++;
+  return false;
+}
+
+void ReadCache::store (const uint8_t *request, size_t len, const uint8_t *response, size_t rlen, unsigned long now) {
+
+  if (len != 8 || rlen < 5 || request[0] == 0 || !isRead (request[1]) ||
+      response[0] != request[0] || response[1] != request[1]) {
+    return;
+  }
+
+  if (ttl (request[0], request[1]) == 0) {
+    return;
+  }
+
+  Entry e;
+  e.slave = request[0];
+  e.function = request[1];
+  e.start = pduWord (&request[2]);
+  e.quantity = pduWord (&request[4]);
+  e.time = now;
+  e.response.assign (response, response + rlen);
+
+  auto oldest = m_entries.end();
+  for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+
+    if (it->slave == e.slave && it->function == e.function &&
+        it->start == e.start && it->quantity == e.quantity) {
+
+      *it = std::move (e);
+      return;
+    }
+    if (oldest == m_entries.end() || (long) (it->time - oldest->time) < 0) {
+      oldest = it;
+    }
+  }
+
+  if (m_entries.size() >= m_maxEntries && oldest != m_entries.end()) {
+    m_entries.erase (oldest);
+  }
+  m_entries.push_back (std::move (e));
+}
+
+size_t ReadCache::invalidate (const uint8_t *request, size_t len) {
+  uint8_t table;
+  uint16_t start, quantity;
+  size_t count = 0;
+
+  if (!writtenRange (request, len, table, start, quantity)) {
+    return 0;
+  }
+
+  invalidate (request[0], table, start, quantity, count);
+  m_invalidations += count;
+  return count;
+}
+
+void ReadCache::invalidate (uint8_t slave, uint8_t function, uint16_t start, uint16_t quantity, size_t & count) {
+  unsigned long end = (unsigned long) start + quantity;
+
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+
+    // a broadcast writes to all the slaves
+    if ( (slave == 0 || it->slave == slave) && it->function == function &&
+         it->start < end && start < (unsigned long) it->start + it->quantity) {
+
+      it = m_entries.erase (it);
+      count++;
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+void ReadCache::clear() {
+
+  m_entries.clear();
+}
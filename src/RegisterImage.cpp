@@ -0,0 +1,210 @@
+#include "RegisterImage.h"
+#include "ModbusCrc.h"
+#include "ReadCache.h"
+
+RegisterImage::RegisterImage() :
+  m_maxAge (0), m_reports (0), m_gaps (0), m_hits (0), m_misses (0), m_stale (0) {
+
+  for (auto & s : m_sequence) {
+    s = -1;
+  }
+}
+
+bool RegisterImage::subscribe (uint8_t slave, uint8_t table, uint16_t start, uint16_t quantity,
+                               unsigned long maxAge, bool mirrored) {
+
+  if (!ReadCache::isRead (table) || slave == 0 || quantity == 0 || (unsigned long) start + quantity > 0x10000UL) {
+    return false;
+  }
+  Range r;
+
+  r.slave = slave;
+  r.table = table;
+  r.start = start;
+  r.quantity = quantity;
+  r.updated = 0;
+  r.maxAge = maxAge;
+  r.mirrored = mirrored;
+  r.values.assign (quantity, 0);
+  r.known.assign (quantity, false);
+  m_ranges.push_back (std::move (r));
+  return true;
+}
+
+bool RegisterImage::onReport (const ModbusReport::Report & report, unsigned long now) {
+  int16_t & last = m_sequence[report.slave];
+
+  // a repeated report is harmless, a jump means that one has been lost
+  if (last >= 0 && report.sequence != last && report.sequence != ( (last + 1) & ModbusReport::SequenceMask)) {
+
+    invalidate (report.slave);
+    m_gaps++;
+  }
+  last = report.sequence;
+
+  if (store (report.slave, report.table, report.start, report.quantity, report.data, now) == 0) {
+    return false;
+  }
+
+  // the link is up and nothing has been lost, the values known are current
+  for (auto & r : m_ranges) {
+    if (r.slave == report.slave) {
+      r.updated = now;
+    }
+  }
+  m_reports++;
+  return true;
+}
+
+size_t RegisterImage::store (uint8_t slave, uint8_t table, uint16_t start, uint16_t quantity,
+                             const uint8_t *data, unsigned long now) {
+  unsigned long end = (unsigned long) start + quantity;
+  size_t count = 0;
+
+  for (auto & r : m_ranges) {
+
+    if (r.slave != slave || r.table != table || r.start >= end || start >= (unsigned long) r.start + r.quantity) {
+      continue;
+    }
+    unsigned long first = r.start > start ? r.start : start;
+    unsigned long last = (unsigned long) r.start + r.quantity < end ? (unsigned long) r.start + r.quantity : end;
+
+    for (unsigned long a = first; a < last; a++) {
+      size_t i = a - start;
+
+      r.values[a - r.start] = table <= 0x02 ? (data[i / 8] >> (i % 8)) & 1 : pduWord (&data[i * 2]);
+      r.known[a - r.start] = true;
+      count++;
+    }
+    if (first == r.start && last == (unsigned long) r.start + r.quantity) {
+      r.updated = now;
+    }
+  }
+  return count;
+}
+
+size_t RegisterImage::store (const uint8_t *request, size_t len, const uint8_t *response, size_t rlen, unsigned long now) {
+
+  if (m_ranges.empty() || len != 8 || request[0] == 0 || !ReadCache::isRead (request[1]) ||
+      rlen < 5 || response[0] != request[0] || response[1] != request[1]) {
+    return 0;
+  }
+
+  uint16_t quantity = pduWord (&request[4]);
+  if (response[2] != ModbusReport::dataSize (request[1], quantity) || rlen != 3U + response[2] + 2) {
+    return 0;
+  }
+  return store (request[0], request[1], pduWord (&request[2]), quantity, &response[3], now);
+}
+
+RegisterImage::Result RegisterImage::lookup (const uint8_t *request, size_t len, unsigned long now,
+    std::vector<uint8_t> & response) {
+
+  // slave, function, start, quantity, CRC
+  if (len != 8 || request[0] == 0 || !ReadCache::isRead (request[1])) {
+    return Absent;
+  }
+
+  uint8_t table = request[1];
+  uint16_t start = pduWord (&request[2]);
+  uint16_t quantity = pduWord (&request[4]);
+  size_t count = ModbusReport::dataSize (table, quantity);
+  unsigned long end = (unsigned long) start + quantity;
+  bool subscribed = false;
+  bool mirrored = false;
+
+  if (quantity == 0 || count > 250) {
+    return Absent;
+  }
+  for (const auto & r : m_ranges) {
+
+    if (r.slave != request[0] || r.table != table || r.start >= end || start >= (unsigned long) r.start + r.quantity) {
+      continue;
+    }
+    subscribed = true;
+    if (start < r.start || end > (unsigned long) r.start + r.quantity) {
+      continue;
+    }
+    unsigned long maxAge = r.maxAge ? r.maxAge : m_maxAge;
+    bool known = !maxAge || (now - r.updated) < maxAge;
+
+    for (unsigned long a = start; a < end && known; a++) {
+      known = r.known[a - r.start];
+    }
+    if (!known) {
+      mirrored |= r.mirrored;
+      continue;
+    }
+
+    response.assign (3 + count + 2, 0);
+    response[0] = request[0];
+    response[1] = table;
+    response[2] = count;
+    for (unsigned long a = start; a < end; a++) {
+      size_t i = a - start;
+      uint16_t v = r.values[a - r.start];
+
+      if (table <= 0x02) {
+        response[3 + i / 8] |= v << (i % 8);
+      }
+      else {
+        response[3 + i * 2] = v >> 8;
+        response[4 + i * 2] = v & 0xFF;
+      }
+    }
+    ModbusCrc::append (response.data(), 3 + count);
+    m_hits++;
+    return Found;
+  }
+  if (mirrored) {
+
+    m_stale++;
+    return Stale;
+  }
+  if (subscribed) {
+    m_misses++;
+  }
+  return Absent;
+}
+
+size_t RegisterImage::invalidate (const uint8_t *request, size_t len) {
+  uint8_t table;
+  uint16_t start, quantity;
+  size_t count = 0;
+
+  if (!ReadCache::writtenRange (request, len, table, start, quantity)) {
+    return 0;
+  }
+
+  invalidate (request[0], table, start, quantity, count);
+  return count;
+}
+
+void RegisterImage::invalidate (uint8_t slave, uint8_t table, uint16_t start, uint16_t quantity, size_t & count) {
+  unsigned long end = (unsigned long) start + quantity;
+
+  for (auto & r : m_ranges) {
+
+    // a broadcast writes to all the slaves
+    if ( (slave != 0 && r.slave != slave) || r.table != table ||
+         r.start >= end || start >= (unsigned long) r.start + r.quantity) {
+      continue;
+    }
+    for (unsigned long a = r.start > start ? r.start : start; a < end && a < (unsigned long) r.start + r.quantity; a++) {
+
+      if (r.known[a - r.start]) {
+        r.known[a - r.start] = false;
+        count++;
+      }
+    }
+  }
+}
+
+void RegisterImage::invalidate (uint8_t slave) {
+
+  for (auto & r : m_ranges) {
+    if (r.slave == slave) {
+      r.known.assign (r.quantity, false);
+    }
+  }
+}
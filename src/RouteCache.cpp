@@ -0,0 +1,90 @@
+#include <string.h>
+#include "RouteCache.h"
+
+RouteCache::RouteCache() :
+  m_enabled (false), m_holdTime (60000000UL), m_sequence (0),
+  m_discoveries (0), m_learned (0), m_failed (0), m_lost (0) {
+
+  memset (m_routes, 0, sizeof (m_routes));
+}
+
+void RouteCache::setDiscovery (uint8_t slave, bool enable) {
+
+  m_routes[slave].discover = enable;
+  m_enabled |= enable;
+}
+
+bool RouteCache::setPath (uint8_t slave, const uint8_t *path, uint8_t count) {
+  Route & r = m_routes[slave];
+
+  if (slave == 0 || count > ModbusRelay::MaxHops) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (path[i] == slave || path[i] == 0) {
+      return false;
+    }
+  }
+  memcpy (r.path, path, count);
+  r.count = count;
+  r.known = r.fixed = true;
+  m_enabled = true;
+  return true;
+}
+
+bool RouteCache::isMiss (uint8_t slave, unsigned long now) const {
+  const Route & r = m_routes[slave];
+
+  return r.discover && !r.fixed && !r.known && !r.pending && (long) (now - r.held) >= 0;
+}
+
+size_t RouteCache::discover (uint8_t slave, uint8_t *frame, size_t size) {
+
+  m_routes[slave].pending = true;
+  m_discoveries++;
+  return ModbusRelay::discover (slave, m_sequence++, frame, size);
+}
+
+bool RouteCache::learn (const ModbusRelay::Frame & route) {
+  Route & r = m_routes[route.slave];
+
+  if (route.type != ModbusRelay::Route || !r.discover || r.fixed) {
+    return false;
+  }
+  memcpy (r.path, route.path, route.count);
+  r.count = route.count;
+  r.known = true;
+  r.pending = false;
+  m_learned++;
+  return true;
+}
+
+void RouteCache::onDiscoverTimeout (uint8_t slave, unsigned long now) {
+  Route & r = m_routes[slave];
+
+  // the requests go along the last route, direct if none has been learned
+  r.pending = false;
+  r.known = false;
+  r.held = now + m_holdTime;
+  m_failed++;
+}
+
+void RouteCache::onTimeout (uint8_t slave) {
+  Route & r = m_routes[slave];
+
+  // the route is kept until a new one is learned
+  if (r.known && !r.fixed) {
+
+    r.known = false;
+    m_lost++;
+  }
+}
+
+size_t RouteCache::maxLength (uint8_t slave, size_t len) const {
+  const Route & r = m_routes[slave];
+
+  if (r.discover && !r.fixed) {
+    return ModbusRelay::wrappedLength (len, ModbusRelay::MaxHops);
+  }
+  return r.count > 0 ? ModbusRelay::wrappedLength (len, r.count) : len;
+}
@@ -0,0 +1,1480 @@
+#include <Piduino.h>
+#include <algorithm>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "RtuBridge.h"
+#include "ModbusCrc.h"
+#include "RHAdaptiveDriver.h"
+#include "RHRelayDriver.h"
+
+// Response time of a slave which has not answered yet, out of the time on air
+const unsigned long DefaultTurnaround = 100000UL;
+
+RtuBridge::Radio::Radio (EventLoop & loop, RHGenericDriver & drv, int notifyFd, size_t n) :
+  driver (drv), fd (notifyFd), index (n), rf95 (nullptr), dutyCycle (0),
+  deadlineTimer (loop, nullptr), dutyCycleTimer (loop, nullptr), holdTimer (loop, nullptr) {
+}
+
+RtuBridge::Port::Port (EventLoop & loop, SerialLine & line, size_t n, RtuFramer::Handler handler) :
+  serial (line), index (n), priority (0), framer (handler), frameTimer (loop, nullptr), replyTimer (loop, nullptr),
+  lineFree (0), charInterval (750), frameInterval (1750), byteTime (286) {
+}
+
+RtuBridge::RtuBridge (SerialLine & serial, RHGenericDriver & driver, int radioFd) :
+  m_serialThread (false), m_maxDutyDelay (0), m_retryGuard (50000UL), m_relayDelay (50000UL),
+  m_probeTimer (m_loop, [this]() { onProbeTimer(); }),
+  m_pollTimer (m_loop, [this]() { onPollTimer(); }), m_pollReserve (0.5), m_exceptions (false), m_capture (nullptr), m_exporter (nullptr), m_metricsPeriod (0),
+  m_metricsTimer (m_loop, [this]() { m_exporter->publish (m_metrics); }),
+  m_quiet (false) {
+
+  memset (m_route, 0, sizeof (m_route));
+  memset (m_turnaround, 0, sizeof (m_turnaround));
+  memset (m_writes, 0, sizeof (m_writes));
+  m_log.setPrefix (Piduino::System::progName() + ": ");
+  m_coalescer.setMaxLength (driver.maxMessageLength());
+  addPort (serial);
+  addRadio (driver, radioFd);
+}
+
+RtuBridge::~RtuBridge() {
+
+  for (auto & p : m_ports) {
+
+    if (p->reader) {
+
+      p->reader->stop();
+      m_loop.remove (p->reader->fd());
+    }
+    m_loop.remove (p->serial.fd());
+  }
+  m_tcp.reset();
+  for (auto & r : m_radios) {
+    m_loop.remove (r->fd);
+  }
+}
+
+size_t RtuBridge::addRadio (RHGenericDriver & driver, int radioFd, const LoraModem & modem) {
+  Radio *r = new Radio (m_loop, driver, radioFd, m_radios.size());
+
+  r->modem = modem;
+  r->deadlineTimer.setHandler ([this, r]() { onDeadlineTimer (*r); });
+  r->dutyCycleTimer.setHandler ([this, r]() { dispatch (*r); });
+  r->holdTimer.setHandler ([this, r]() { dispatch (*r); });
+  if (!m_radios.empty()) {
+    const Radio & first = *m_radios.front();
+
+    r->transactions.setTimeout (first.transactions.timeout());
+    r->transactions.setMaxInFlight (first.transactions.maxInFlight());
+    r->transactions.setRetries (first.transactions.retries());
+    r->transactions.setAging (first.transactions.aging());
+    r->dutyCycle.setRatio (first.dutyCycle.ratio());
+  }
+  m_radios.push_back (std::unique_ptr<Radio> (r));
+
+  // a merged read must fit in the frames of all the radios
+  if (driver.maxMessageLength() < m_coalescer.maxLength()) {
+    m_coalescer.setMaxLength (driver.maxMessageLength());
+  }
+  return r->index;
+}
+
+void RtuBridge::setRoute (uint8_t slave, size_t radio) {
+
+  if (radio < m_radios.size()) {
+    m_route[slave] = radio;
+  }
+}
+
+size_t RtuBridge::route (uint8_t slave) const {
+
+  return m_route[slave];
+}
+
+size_t RtuBridge::addPort (SerialLine & serial, uint8_t priority) {
+  size_t n = m_ports.size();
+  Port *p = new Port (m_loop, serial, n, [this, n] (const uint8_t *frame, size_t len, RtuFramer::Status status) {
+    onSerialFrame (*m_ports[n], frame, len, status);
+  });
+
+  p->priority = priority;
+  p->frameTimer.setHandler ([this, p]() { onFrameTimer (*p); });
+  p->replyTimer.setHandler ([this, p]() { flushReplies (*p); });
+  m_ports.push_back (std::unique_ptr<Port> (p));
+  setTimings (p->charInterval, p->frameInterval, n);
+  return n;
+}
+
+void RtuBridge::setPriority (uint8_t priority, size_t port) {
+
+  m_ports[port]->priority = priority;
+}
+
+void RtuBridge::setAging (unsigned long usec) {
+
+  for (auto & r : m_radios) {
+    r->transactions.setAging (usec);
+  }
+}
+
+void RtuBridge::setSerialThread (bool enable) {
+
+  m_serialThread = enable;
+}
+
+bool RtuBridge::listenTcp (const std::string & address, uint16_t port, size_t maxClients) {
+
+  m_tcp.reset (new ModbusTcpServer (m_loop, [this] (uint32_t master, const uint8_t *frame, size_t len) {
+
+    onRequest (frame, len, master);
+    dispatch();
+  }));
+  m_tcp->setMaxClients (maxClients);
+  if (!m_tcp->listen (address, port)) {
+
+    m_tcp.reset();
+    return false;
+  }
+  return true;
+}
+
+bool RtuBridge::begin() {
+
+  if (!m_loop.isOpen() || (!m_ports[0]->serial.isOpen() && !m_tcp)) {
+    return false;
+  }
+
+  for (auto & p : m_ports) {
+    Port *port = p.get();
+
+    if (!port->serial.isOpen()) {
+      continue; // without serial line, the bridge serves the TCP clients only
+    }
+    if (m_serialThread) {
+
+      port->reader.reset (new SerialReader (port->serial));
+      if (!m_loop.add (port->reader->fd(), EPOLLIN, [this, port] (uint32_t) { onSerialChunks (*port); }) ||
+          !port->reader->start()) {
+        return false;
+      }
+    }
+    else if (!m_loop.add (port->serial.fd(), EPOLLIN, [this, port] (uint32_t) { onSerialReadable (*port); })) {
+      return false;
+    }
+  }
+  m_log.start();
+
+  if (m_exporter) {
+
+    m_exporter->publish (m_metrics);
+    m_metricsTimer.start (m_metricsPeriod, true);
+  }
+
+  for (auto & r : m_radios) {
+    Radio *radio = r.get();
+
+    radio->tuned = radio->modem;
+    if (!m_loop.add (radio->fd, EPOLLIN, [this, radio] (uint32_t) { onRadioEvent (*radio); })) {
+      return false;
+    }
+  }
+
+  // a frame may have been received before we were watching
+  for (auto & r : m_radios) {
+    onRadioEvent (*r);
+  }
+  m_poller.start (micros());
+  schedulePoll();
+  return true;
+}
+
+bool RtuBridge::watch (int fd, std::function<void()> handler) {
+
+  return m_loop.add (fd, EPOLLIN, [handler] (uint32_t) { handler(); });
+}
+
+bool RtuBridge::addPoll (uint8_t slave, uint8_t function, uint16_t start, uint16_t quantity,
+                         unsigned long period, unsigned long maxAge) {
+
+  return m_poller.add (slave, function, start, quantity, period) >= 0 &&
+         m_image.subscribe (slave, function, start, quantity, maxAge, true);
+}
+
+void RtuBridge::setMetricsExporter (MetricsExporter *exporter, unsigned long period) {
+
+  m_exporter = exporter;
+  m_metricsPeriod = period;
+}
+
+void RtuBridge::setTimings (unsigned long charInterval, unsigned long frameInterval, size_t port) {
+  Port & p = *m_ports[port];
+
+  p.charInterval = charInterval;
+  p.frameInterval = frameInterval;
+  // 1 character = 11 bits (8E1)
+  p.byteTime = 11000000UL / (p.serial.baudrate() ? p.serial.baudrate() : 38400);
+  p.framer.setTimings (charInterval, frameInterval, p.byteTime);
+}
+
+void RtuBridge::setTimeout (unsigned long usec) {
+
+  for (auto & r : m_radios) {
+    r->transactions.setTimeout (usec);
+  }
+}
+
+void RtuBridge::setMaxInFlight (size_t maxInFlight) {
+
+  for (auto & r : m_radios) {
+    r->transactions.setMaxInFlight (maxInFlight);
+  }
+}
+
+void RtuBridge::setRetries (unsigned int retries, unsigned long guard) {
+
+  for (auto & r : m_radios) {
+    r->transactions.setRetries (retries);
+  }
+  m_retryGuard = guard;
+}
+
+void RtuBridge::setDutyCycle (double ratio, unsigned long maxDelay) {
+
+  for (auto & r : m_radios) {
+    r->dutyCycle.setRatio (ratio);
+  }
+  m_maxDutyDelay = maxDelay;
+}
+
+void RtuBridge::poll (int timeoutMs) {
+
+  m_loop.run (timeoutMs);
+}
+
+// Bytes received on a serial line, they are read as soon as they arrive
+// and timestamped for the RTU framer
+void RtuBridge::onSerialReadable (Port & port) {
+  uint8_t buf[RtuFramer::BufferSize];
+  ssize_t n;
+
+  while ( (n = port.serial.read (buf, sizeof (buf))) > 0) {
+
+    port.framer.receive (buf, n, micros());
+  }
+  onSerialReceived (port);
+}
+
+// Chunks read and timestamped by the serial ingress thread of a port
+void RtuBridge::onSerialChunks (Port & port) {
+  const SerialReader::Chunk *c;
+  uint64_t events;
+
+  // reset the eventfd counter before emptying the ring, a chunk committed
+  // after that signals it again
+  while (::read (port.reader->fd(), &events, sizeof (events)) > 0);
+
+  while ( (c = port.reader->front()) != nullptr) {
+
+    port.framer.receive (c->data, c->len, c->time);
+    port.reader->pop();
+  }
+  onSerialReceived (port);
+}
+
+void RtuBridge::onSerialReceived (Port & port) {
+
+  // the master is talking, our replies must wait for its silence
+  port.lineFree = port.framer.deadline();
+
+  if (port.framer.pending()) {
+    long delay = port.framer.deadline() - micros();
+
+    port.frameTimer.start (delay > 0 ? delay : 0);
+  }
+  else {
+
+    port.frameTimer.stop();
+  }
+}
+
+// T3.5 may have elapsed since the last byte
+void RtuBridge::onFrameTimer (Port & port) {
+
+  if (!port.framer.timeout (micros())) {
+    long delay = port.framer.deadline() - micros();
+
+    port.frameTimer.start (delay > 0 ? delay : 0);
+  }
+}
+
+// A frame has been received on a serial line, its master id is the index
+// of the port
+void RtuBridge::onSerialFrame (Port & port, const uint8_t *frame, size_t len, RtuFramer::Status status) {
+
+  if (status == RtuFramer::FrameOk) {
+
+    onRequest (frame, len, port.index);
+  }
+  else if (status == RtuFramer::CrcError || status == RtuFramer::Overflow) {
+
+    capture (CaptureRing::FromMaster, CaptureRing::CrcError, *m_radios[0], frame, len);
+    m_metrics.slave (len > 0 ? frame[0] : 0).crcErrors++;
+    m_log.log (Logger::Err, false, "CRC Error ! > ", frame, len);
+  }
+  else {
+
+    // message trop court
+    capture (CaptureRing::FromMaster, CaptureRing::Flushed, *m_radios[0], frame, len);
+    m_metrics.slave (len > 0 ? frame[0] : 0).flushed++;
+    if (!m_quiet) {
+      m_log.log (Logger::Out, true, "Message flushed ! > ", frame, len);
+    }
+  }
+  dispatch();
+}
+
+// A valid request of a master, the serial line (0) or a Modbus TCP client
+void RtuBridge::onRequest (const uint8_t *frame, size_t len, uint32_t master) {
+  Radio & radio = *m_radios[m_route[frame[0]]];
+
+  // wrapped in a relay frame if the slave is reached through repeaters
+  if (m_routes.maxLength (frame[0], len) > radio.driver.maxMessageLength()) {
+
+    capture (CaptureRing::FromMaster, CaptureRing::TooLong, radio, frame, len);
+    m_metrics.slave (frame[0]).dropped++;
+    m_log.log (Logger::Err, false, "Message too long for the radio ! > ", frame, len);
+    if (m_exceptions) {
+      except (frame, len, 0x0A, master);
+    }
+  }
+  else {
+    std::vector<uint8_t> response;
+    unsigned long now = micros();
+
+    RegisterImage::Result image = m_image.lookup (frame, len, now, response);
+
+    if (image == RegisterImage::Stale) {
+
+      // the background reads fail, the master is not kept waiting
+      capture (CaptureRing::FromMaster, CaptureRing::Unreachable, radio, frame, len);
+      m_metrics.slave (frame[0]).stale++;
+      except (frame, len, 0x0B, master);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, false, "", frame, len);
+        m_log.log (Logger::Out, true, "Mirror stale > ", frame, len);
+      }
+      return;
+    }
+
+    if (image == RegisterImage::Found) {
+
+      // the slave reports its changes or is read in the background, the image is current
+      capture (CaptureRing::FromMaster, CaptureRing::Cached, radio, frame, len);
+      m_metrics.slave (frame[0]).imaged++;
+      reply (response.data(), response.size(), master);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, false, "", frame, len);
+        m_log.log (Logger::Out, true, "Image hit > ", response.data(), response.size(), false);
+      }
+      return;
+    }
+
+    if (m_cache.lookup (frame, len, now, response)) {
+
+      // answered without the radio
+      capture (CaptureRing::FromMaster, CaptureRing::Cached, radio, frame, len);
+      m_metrics.slave (frame[0]).cached++;
+      reply (response.data(), response.size(), master);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, false, "", frame, len);
+        m_log.log (Logger::Out, true, "Cache hit > ", response.data(), response.size(), false);
+      }
+      return;
+    }
+
+    if (m_fanOut.isGroup (frame[0])) {
+
+      capture (CaptureRing::FromMaster, CaptureRing::Ok, radio, frame, len);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, false, "", frame, len);
+      }
+      writeGroup (frame, len, now, master);
+      return;
+    }
+
+    if (frame[0] != 0 && m_breaker.isOpen (frame[0])) {
+
+      // answered at once, the radio is kept for the other slaves
+      capture (CaptureRing::FromMaster, CaptureRing::Unreachable, radio, frame, len);
+      except (frame, len, 0x0B, master);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, false, "", frame, len);
+        m_log.log (Logger::Out, true, "Slave unreachable > ", frame, len);
+      }
+      return;
+    }
+
+    bool logged = false;
+    capture (CaptureRing::FromMaster, CaptureRing::Ok, radio, frame, len);
+    m_breaker.setProbeRequest (frame, len);
+    invalidate (frame, len);
+    if (frame[0] == 0) {
+
+      // broadcast, on all the radios
+      for (auto & r : m_radios) {
+        logged |= broadcast (*r, frame, len, now, master);
+      }
+    }
+    else {
+
+      logged = queue (*m_radios[m_route[frame[0]]], frame, len, now, master);
+    }
+
+    // On affiche le message
+    if (!logged && !m_quiet && len) {
+      m_log.log (Logger::Out, false, "", frame, len);
+    }
+  }
+}
+
+// Queues a request of a master on a radio, merged in a queued read if possible
+// Returns true if the request has been logged
+bool RtuBridge::queue (Radio & radio, const uint8_t *frame, size_t len, unsigned long now, uint32_t master) {
+
+  discover (radio, frame[0], now);
+  if (m_coalescer.isEnabled() && Coalescer::isMergeable (frame, len)) {
+    Transaction *q = radio.transactions.mergeable (frame[0], frame[1]);
+
+    // nobody would answer the master merged in a read of the bridge
+    if (q && !q->probe && !q->shadow && m_coalescer.merge (*q, frame, len, master)) {
+
+      // the merged read leaves with its most urgent master
+      q->priority = std::min (q->priority, priority (master));
+      m_metrics.onQueued (master);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Merged > ", frame, len);
+        return true;
+      }
+      return false;
+    }
+    if (radio.transactions.push (frame, len, now, m_coalescer.window())) {
+
+      queued (radio, frame, master);
+      return false;
+    }
+  }
+  else if (radio.transactions.push (frame, len, now)) {
+
+    queued (radio, frame, master);
+    return false;
+  }
+
+  m_metrics.onRejected (master);
+  capture (CaptureRing::ToRadio, CaptureRing::QueueFull, radio, frame, len);
+  m_metrics.slave (frame[0]).dropped++;
+  m_log.log (Logger::Err, false, "Queue full, message dropped ! > ", frame, len);
+  if (m_exceptions) {
+    except (frame, len, 0x0A, master);
+  }
+  return true;
+}
+
+// The request of a master has just been queued on a radio
+void RtuBridge::queued (Radio & radio, const uint8_t *frame, uint32_t master) {
+  Transaction *t = radio.transactions.queued (frame[0], frame[1]);
+
+  t->master = master;
+  t->priority = priority (master);
+  m_metrics.onQueued (master);
+}
+
+// Queues the discovery of the route of a slave whose route is unknown,
+// before the request which needs it. The discover leaves in the class 0 as
+// the probes, the requests to the slave wait for its answer.
+void RtuBridge::discover (Radio & radio, uint8_t slave, unsigned long now) {
+  uint8_t frame[ModbusRelay::HeaderSize + 2];
+
+  if (slave == 0 || !m_routes.isMiss (slave, now)) {
+    return;
+  }
+  size_t len = m_routes.discover (slave, frame, sizeof (frame));
+  if (radio.transactions.push (frame, len, now)) {
+
+    radio.transactions.queued (slave, ModbusRelay::Function)->discover = true;
+    if (!m_quiet) {
+      m_log.log (Logger::Out, true, "Discover > ", frame, len);
+    }
+  }
+  else {
+
+    m_routes.onDiscoverTimeout (slave, now);
+  }
+}
+
+// Priority class of the requests of a master, that of its serial port, the
+// TCP clients are in the class 0
+uint8_t RtuBridge::priority (uint32_t master) const {
+
+  return master < m_ports.size() ? m_ports[master]->priority : 0;
+}
+
+// A request leaves the queue of a radio, sent or dropped, for the
+// statistics of the ports which wait for it
+void RtuBridge::leave (const Transaction & t, unsigned long now, bool sent) {
+
+  // a part of a merged read sent again has already left once
+  if (t.probe || t.shadow || t.discover || t.split) {
+    return;
+  }
+  if (t.masters.empty()) {
+
+    m_metrics.onDequeued (t.master, now - t.received, sent);
+  }
+  for (uint32_t master : t.masters) {
+
+    m_metrics.onDequeued (master, now - t.received, sent);
+  }
+}
+
+// Queues a broadcast on a radio, once for each profile of the slaves routed
+// to it with the adaptive data rate, returns true if it has been logged
+bool RtuBridge::broadcast (Radio & radio, const uint8_t *frame, size_t len, unsigned long now, uint32_t master) {
+  unsigned int profiles = 1; // the slaves never seen listen to the profile 0
+
+  if (!m_adapter.isEnabled()) {
+    return queue (radio, frame, len, now, master);
+  }
+
+  for (unsigned int slave = 1; slave < 248; slave++) {
+
+    if (m_route[slave] == radio.index) {
+      profiles |= 1U << m_adapter.profile (slave, now);
+      profiles |= 1U << m_adapter.next (slave, now);
+    }
+  }
+  for (uint8_t p = 0; p <= LinkAdapter::MaxProfile; p++) {
+
+    if (profiles & (1U << p)) {
+
+      if (queue (radio, frame, len, now, master)) {
+        return true;
+      }
+      radio.transactions.queued (0, frame[1])->profile = p;
+    }
+  }
+  return false;
+}
+
+// true if a request with the function code can be sent again without harm,
+// the reads and the writes of a value, a diagnostic (0x08) may clear the
+// counters of the slave and a read of its FIFO queue (0x18) empties it
+static bool isIdempotent (uint8_t function) {
+
+  switch (function) {
+    case 0x01:
+    case 0x02:
+    case 0x03:
+    case 0x04:
+    case 0x05:
+    case 0x06:
+    case 0x0F:
+    case 0x10:
+    case 0x16:
+    case 0x17:
+      return true;
+    default:
+      break;
+  }
+  return false;
+}
+
+void RtuBridge::dispatch() {
+
+  for (auto & r : m_radios) {
+    dispatch (*r);
+  }
+}
+
+// Sends the queued requests as long as the radio is free and the duty cycle
+// budget allows it
+void RtuBridge::dispatch (Radio & radio) {
+  const Transaction *t;
+
+  // RH_RF95::send() would wait for the end of the previous transmission
+  while (radio.driver.mode() != RHGenericDriver::RHModeTx) {
+    unsigned long now = micros();
+
+    // the requests sent again go first, their master waits for longer
+    bool retry = (t = radio.transactions.due()) != nullptr;
+    if (!retry && (t = radio.transactions.peek (now)) == nullptr) {
+      break;
+    }
+    uint8_t slave = t->slave;
+
+    if (!retry && !t->probe && !t->discover && m_breaker.isOpen (slave)) {
+
+      // queued before the breaker opened
+      capture (CaptureRing::ToRadio, CaptureRing::Unreachable, radio, t->request.data(), t->request.size());
+      leave (*t, now, false);
+      except (*t, 0x0B);
+      radio.transactions.discard (now);
+      continue;
+    }
+    uint8_t profile = slave ? m_adapter.profile (slave, now) : t->profile;
+    LoraModem modem = LinkAdapter::modem (radio.modem, profile);
+
+    // the radio listens with one spreading factor, and a slave which has
+    // been announced a profile must have answered before it is used
+    if (m_adapter.isEnabled() && radio.transactions.inFlight() > (retry ? 1U : 0U) &&
+        (modem.spreadingFactor != radio.tuned.spreadingFactor || (!retry && slave && m_adapter.isChanging (slave)))) {
+      break;
+    }
+
+    // along the route of the slave, the repeaters pass the relay frame on
+    uint8_t relayed[RH_RELAY_MAX_MESSAGE_LEN];
+    size_t len = t->request.size();
+    uint8_t hops = t->discover ? 0 : m_routes.hops (slave);
+    if (hops > 0) {
+      const RouteCache::Route & r = m_routes.route (slave);
+
+      len = ModbusRelay::wrap (ModbusRelay::Request, 0, r.path, r.count,
+                               t->request.data(), t->request.size(), relayed, sizeof (relayed));
+    }
+
+    unsigned long airtime = modem.messageTimeOnAir (len);
+    unsigned long when;
+
+    if (!radio.dutyCycle.earliest (airtime, now, when) ||
+        (when != now && (retry ? (long) (when - t->deadline) >= 0 : (when - t->received) > m_maxDutyDelay))) {
+
+      radio.dutyCycle.countRejected();
+      if (retry) {
+
+        // the request stays in progress until its deadline
+        m_log.log (Logger::Err, false, "Duty cycle exceeded, retry dropped ! > ",
+                   t->request.data(), t->request.size());
+        radio.transactions.abandon();
+        continue;
+      }
+
+      // the master will time out anyway
+      capture (CaptureRing::ToRadio, CaptureRing::DutyCycle, radio, t->request.data(), t->request.size());
+      m_metrics.slave (t->request[0]).dropped++;
+      m_log.log (Logger::Err, false, "Duty cycle exceeded, message dropped ! > ",
+                 t->request.data(), t->request.size());
+      leave (*t, now, false);
+      if (t->discover) {
+        m_routes.onDiscoverTimeout (slave, now);
+      }
+      else if ( (m_exceptions || t->fanout || t->shadow) && !t->probe) {
+        except (*t, 0x0A);
+      }
+      radio.transactions.discard (now);
+      continue;
+    }
+
+    if (when != now) {
+
+      // the oldest transmissions leave the window at when
+      if (!radio.dutyCycleTimer.isActive()) {
+        radio.dutyCycle.countDelayed();
+      }
+      radio.dutyCycleTimer.start (when - now);
+      break;
+    }
+
+    unsigned long settle = slave && !t->discover ? roundTrip (modem, *t) : 0;
+    unsigned long wait = settle && radio.transactions.retries() > 0 && isIdempotent (t->function) ?
+                         retryAfter (modem, *t) : 0;
+    unsigned long extend = relayTime (modem, *t);
+    t = retry ? radio.transactions.resend (now, wait) :
+        radio.transactions.next (now, wait, extend, settle, m_writes[slave]);
+    radio.dutyCycle.record (airtime, now);
+    if (m_adapter.isEnabled()) {
+
+      tune (radio, modem);
+      radio.driver.setHeaderFlags (slave ? m_adapter.next (slave, now) : profile, RH_ADR_PROFILE_MASK);
+      if (slave) {
+        m_adapter.onSent (slave, now);
+      }
+    }
+    radio.driver.send (hops > 0 ? relayed : t->request.data(), len);
+    if (t->discover) {
+      continue; // not a request of a master
+    }
+    if (retry) {
+
+      capture (CaptureRing::ToRadio, CaptureRing::Retry, radio, t->request.data(), t->request.size());
+      m_metrics.slave (slave).retries++;
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Retry > ", t->request.data(), t->request.size());
+      }
+    }
+    else {
+
+      capture (CaptureRing::ToRadio, CaptureRing::Ok, radio, t->request.data(), t->request.size());
+      m_metrics.onRequest (t->request[0], now - t->received);
+      leave (*t, now, true);
+    }
+    m_metrics.slave (t->request[0]).spreadingFactor = modem.spreadingFactor;
+    m_metrics.slave (t->request[0]).hops = hops;
+  }
+
+  if (radio.transactions.inFlight() > 0) {
+    long delay = radio.transactions.nextDeadline() - micros();
+
+    radio.deadlineTimer.start (delay > 0 ? delay : 0);
+  }
+  else {
+
+    radio.deadlineTimer.stop();
+  }
+
+  // reads waiting for other reads to merge with, keys waiting for late responses
+  unsigned long now = micros();
+  unsigned long ready;
+  if (radio.transactions.nextReady (now, ready)) {
+
+    radio.holdTimer.start (ready - now);
+  }
+  else {
+
+    radio.holdTimer.stop();
+  }
+
+  // the radio may have nothing left to send
+  schedulePoll();
+}
+
+// Changes the modem settings of a radio to those of a slave profile
+void RtuBridge::tune (Radio & radio, const LoraModem & modem) {
+
+  if (modem.spreadingFactor == radio.tuned.spreadingFactor) {
+    return;
+  }
+  if (radio.modemHandler) {
+
+    radio.modemHandler (modem);
+  }
+  else if (radio.rf95) {
+
+    radio.rf95->setSpreadingFactor (modem.spreadingFactor);
+  }
+  radio.tuned = modem;
+}
+
+// Length of the response to a request, its own length if unknown
+static size_t responseLength (const uint8_t *request, size_t len) {
+
+  if (len >= 8) {
+    size_t quantity = (request[4] << 8) | request[5];
+
+    switch (request[1]) {
+      case 0x01:
+      case 0x02:
+        return 5 + (quantity + 7) / 8;
+      case 0x03:
+      case 0x04:
+        return 5 + 2 * quantity;
+      case 0x05:
+      case 0x06:
+      case 0x0F:
+      case 0x10:
+        return 8;
+      default:
+        break;
+    }
+  }
+  return len;
+}
+
+// Time within which the response to a request sent now with modem is
+// expected: its round trip on air, the response time of the slave with its
+// deviation and the guard
+unsigned long RtuBridge::roundTrip (const LoraModem & modem, const Transaction & t) const {
+  const Turnaround & ta = m_turnaround[t.slave];
+
+  return modem.messageTimeOnAir (t.request.size()) +
+         modem.messageTimeOnAir (responseLength (t.request.data(), t.request.size())) +
+         (ta.mean ? ta.mean + 4 * ta.deviation : DefaultTurnaround) + m_retryGuard +
+         relayTime (modem, t);
+}
+
+// Time after which a request sent now with modem is sent again without
+// response: its round trip, doubled at each attempt already made
+unsigned long RtuBridge::retryAfter (const LoraModem & modem, const Transaction & t) const {
+
+  return roundTrip (modem, t) << (t.attempts < 4 ? t.attempts : 4);
+}
+
+// Time the repeaters add to the round trip of a request sent with modem,
+// each one receives the request and the response and sends them again.
+// A discover may go through all the repeaters in range and wait their
+// random delay at each hop, its answer comes back along the path.
+unsigned long RtuBridge::relayTime (const LoraModem & modem, const Transaction & t) const {
+
+  if (t.discover) {
+    unsigned long hop = modem.messageTimeOnAir (ModbusRelay::HeaderSize + ModbusRelay::MaxHops + 2);
+
+    return ModbusRelay::MaxHops * (2 * hop + 2 * m_relayDelay + RH_RELAY_JITTER * 1000UL);
+  }
+  uint8_t hops = m_routes.hops (t.slave);
+  size_t len = t.request.size();
+
+  if (hops == 0) {
+    return 0;
+  }
+  return hops * (modem.messageTimeOnAir (ModbusRelay::wrappedLength (len, hops)) +
+                 modem.messageTimeOnAir (ModbusRelay::wrappedLength (responseLength (t.request.data(), len), hops)) +
+                 2 * m_relayDelay);
+}
+
+// Updates the response time of a slave from the round trip dt of a response
+// of len bytes, as TCP estimates its round trip time
+void RtuBridge::onTurnaround (const Radio & radio, const Transaction & t, size_t len, unsigned long dt) {
+  Turnaround & ta = m_turnaround[t.slave];
+  unsigned long air = radio.tuned.messageTimeOnAir (t.request.size()) + radio.tuned.messageTimeOnAir (len) +
+                      relayTime (radio.tuned, t);
+  long sample = dt > air ? dt - air : 1;
+
+  if (ta.mean == 0) {
+
+    ta.mean = sample;
+    ta.deviation = sample / 2;
+  }
+  else {
+    long error = sample - (long) ta.mean;
+
+    ta.deviation += ( (error < 0 ? -error : error) - (long) ta.deviation) / 4;
+    ta.mean += error / 8;
+    if (ta.mean == 0) {
+      ta.mean = 1;
+    }
+  }
+}
+
+// Transactions without response
+void RtuBridge::onDeadlineTimer (Radio & radio) {
+
+  unsigned long now = micros();
+
+  radio.transactions.expire (now, [this, &radio, now] (const Transaction & t) {
+
+    if (t.discover) {
+
+      // in range of the bridge, or out of reach
+      m_routes.onDiscoverTimeout (t.slave, now);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Route not found ! > ", t.request.data(), t.request.size());
+      }
+      return;
+    }
+    capture (CaptureRing::FromRadio, CaptureRing::Timeout, radio, t.request.data(), t.request.size());
+    m_metrics.slave (t.request[0]).timeouts++;
+    m_adapter.onTimeout (t.slave);
+    m_breaker.onTimeout (t.slave, now);
+    m_routes.onTimeout (t.slave);
+    m_metrics.slave (t.slave).unreachable = m_breaker.isOpen (t.slave);
+    if (!m_quiet) {
+      m_log.log (Logger::Out, true, t.probe ? "Probe timeout ! > " : "Timeout ! > ", t.request.data(), t.request.size());
+    }
+    if ( (m_exceptions || t.fanout || t.shadow) && !t.probe) {
+      except (t, 0x0B);
+    }
+  }, [this] (const Transaction & t) {
+
+    // an attempt is lost, the request will be sent again
+    m_adapter.onTimeout (t.slave);
+  });
+  scheduleProbe();
+  dispatch (radio);
+}
+
+// Queues a probe for each unreachable slave whose probe is due
+void RtuBridge::onProbeTimer() {
+  unsigned long now = micros();
+  uint8_t slave;
+
+  while ( (slave = m_breaker.probe (now)) != 0) {
+    Radio & radio = *m_radios[m_route[slave]];
+    uint8_t frame[8];
+    size_t len = m_breaker.probeRequest (slave, frame);
+
+    discover (radio, slave, now);
+    if (radio.transactions.push (frame, len, now)) {
+
+      radio.transactions.queued (frame[0], frame[1])->probe = true;
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Probe > ", frame, len);
+      }
+    }
+  }
+  scheduleProbe();
+  dispatch();
+}
+
+void RtuBridge::scheduleProbe() {
+  unsigned long when;
+
+  if (m_breaker.nextProbe (when)) {
+    long delay = when - micros();
+
+    m_probeTimer.start (delay > 0 ? delay : 0);
+  }
+  else {
+
+    m_probeTimer.stop();
+  }
+}
+
+// Queues the background reads which are due, one at a time on a radio which
+// has no request of a master waiting, within the duty cycle budget left to
+// the poller
+void RtuBridge::onPollTimer() {
+  unsigned long now = micros();
+
+  for (size_t i = 0; i < m_poller.size(); i++) {
+    uint8_t slave = m_poller.entry (i).slave;
+    Radio & radio = *m_radios[m_route[slave]];
+
+    if (!m_poller.isDue (i, now) || !isPollable (radio)) {
+      continue;
+    }
+
+    uint8_t frame[8];
+    size_t len = m_poller.request (i, frame);
+    unsigned long airtime = LinkAdapter::modem (radio.modem, m_adapter.profile (slave, now)).messageTimeOnAir (len);
+
+    if (m_breaker.isOpen (slave) || (radio.dutyCycle.isEnabled() &&
+                                     radio.dutyCycle.remaining (now) < airtime + m_pollReserve * radio.dutyCycle.budget())) {
+
+      // the probes of the breaker look after an unreachable slave
+      m_poller.defer (i, now);
+      continue;
+    }
+    discover (radio, slave, now);
+    if (radio.transactions.push (frame, len, now)) {
+      Transaction *t = radio.transactions.queued (frame[0], frame[1]);
+
+      t->master = ShadowPoller::Master;
+      t->priority = ShadowPoller::Priority;
+      t->shadow = i + 1;
+      m_poller.sent (i);
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Poll > ", frame, len);
+      }
+    }
+  }
+  dispatch();
+}
+
+// Starts the poll timer for the first background read due on a radio which
+// can take it
+void RtuBridge::schedulePoll() {
+  unsigned long now = micros();
+  bool found = false;
+  long delay = 0;
+
+  for (size_t i = 0; i < m_poller.size(); i++) {
+    const ShadowPoller::Entry & e = m_poller.entry (i);
+
+    if (!e.pending && isPollable (*m_radios[m_route[e.slave]])) {
+      long d = e.due - now;
+
+      if (!found || d < delay) {
+        delay = d;
+        found = true;
+      }
+    }
+  }
+  if (found) {
+
+    m_pollTimer.start (delay > 0 ? delay : 0);
+  }
+  else {
+
+    m_pollTimer.stop();
+  }
+}
+
+// A radio takes a background read if no request waits and none is pending
+bool RtuBridge::isPollable (const Radio & radio) const {
+
+  if (radio.transactions.queued() > 0) {
+    return false;
+  }
+  for (size_t i = 0; i < m_poller.size(); i++) {
+
+    if (m_poller.entry (i).pending && m_route[m_poller.entry (i).slave] == radio.index) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A background read has ended, its values are in the image if ok
+void RtuBridge::onPollResult (const Transaction & t, bool ok) {
+
+  m_poller.done (t.shadow - 1, ok, micros());
+  if (!ok && !m_quiet) {
+    m_log.log (Logger::Out, true, "Poll failed ! > ", t.request.data(), t.request.size());
+  }
+}
+
+// A write to a slave has been received or answered, the values of the
+// registers it may change are forgotten, and the reads already sent to the
+// slave may return the values before it
+void RtuBridge::invalidate (const uint8_t *frame, size_t len) {
+
+  if (len < 6 || !ReadCache::isWrite (frame[1])) {
+    return;
+  }
+  m_cache.invalidate (frame, len);
+  m_image.invalidate (frame, len);
+  if (frame[0] == 0) {
+
+    for (auto & w : m_writes) {
+      w++;
+    }
+  }
+  else {
+
+    m_writes[frame[0]]++;
+  }
+}
+
+// true if no write to the slave has been received or answered since the
+// read t was sent, its response can be stored
+bool RtuBridge::isCurrent (const Transaction & t) const {
+
+  return t.generation == m_writes[t.slave];
+}
+
+// Answers a master with an exception to a request, nothing to a broadcast
+void RtuBridge::except (const uint8_t *request, size_t len, uint8_t code, uint32_t master) {
+
+  if (len >= 2 && request[0] != 0) {
+    uint8_t e[5] = { request[0], (uint8_t) (request[1] | 0x80), code };
+
+    ModbusCrc::append (e, 3);
+    m_metrics.slave (request[0]).exceptions++;
+    reply (e, sizeof (e), master);
+  }
+}
+
+// Answers the master with an exception to each request merged in t, a
+// member of a group write fails
+void RtuBridge::except (const Transaction & t, uint8_t code) {
+
+  if (t.fanout) {
+
+    onFanOutResult (t, FanOut::Failed, code);
+  }
+  else if (t.shadow) {
+
+    onPollResult (t, false);
+  }
+  else if (t.parts.empty()) {
+
+    except (t.request.data(), t.request.size(), code, t.master);
+  }
+  else {
+
+    for (size_t i = 0; i < t.parts.size(); i++) {
+      except (t.parts[i].data(), t.parts[i].size(), code, t.masters[i]);
+    }
+  }
+}
+
+// Sends a write to a group to each of its members, the master is answered
+// once all have answered (onFanOutResult())
+void RtuBridge::writeGroup (const uint8_t *frame, size_t len, unsigned long now, uint32_t master) {
+
+  if (!FanOut::isWrite (frame, len)) {
+
+    // nobody to read from
+    except (frame, len, 0x01, master);
+    return;
+  }
+
+  uint16_t id = m_fanOut.start (frame, len, now, master);
+  std::vector<uint8_t> copy;
+  std::vector<uint8_t> members (m_fanOut.members (frame[0]));
+
+  for (uint8_t slave : members) {
+    Radio & radio = *m_radios[m_route[slave]];
+    Transaction t;
+
+    FanOut::copy (frame, len, slave, copy);
+    invalidate (copy.data(), copy.size());
+    if (!m_breaker.isOpen (slave)) {
+      discover (radio, slave, now);
+    }
+    if (!m_breaker.isOpen (slave) && radio.transactions.push (copy.data(), copy.size(), now)) {
+
+      queued (radio, copy.data(), master);
+      radio.transactions.queued (slave, frame[1])->fanout = id;
+      continue;
+    }
+
+    t.slave = slave;
+    t.fanout = id;
+    if (m_breaker.isOpen (slave)) {
+
+      capture (CaptureRing::ToRadio, CaptureRing::Unreachable, radio, copy.data(), copy.size());
+      onFanOutResult (t, FanOut::Failed, 0x0B);
+    }
+    else {
+
+      capture (CaptureRing::ToRadio, CaptureRing::QueueFull, radio, copy.data(), copy.size());
+      m_metrics.onRejected (master);
+      m_metrics.slave (slave).dropped++;
+      m_log.log (Logger::Err, false, "Queue full, message dropped ! > ", copy.data(), copy.size());
+      onFanOutResult (t, FanOut::Failed, 0x0A);
+    }
+  }
+  dispatch();
+}
+
+// A member of a group write has answered or failed
+void RtuBridge::onFanOutResult (const Transaction & t, FanOut::Result result, uint8_t code) {
+  std::vector<uint8_t> r;
+  FanOut::Operation op;
+
+  if (m_fanOut.onResult (t.fanout, t.slave, result, code, r, op)) {
+
+    reply (r.data(), r.size(), op.master);
+    if (!m_quiet) {
+      unsigned int ok = 0, exceptions = 0, failed = 0;
+
+      for (const auto & m : op.members) {
+        ok += m.result == FanOut::Ok;
+        exceptions += m.result == FanOut::Exception;
+        failed += m.result == FanOut::Failed;
+      }
+      m_log.printf (Logger::Out, "Group %u: %u ok, %u exceptions, %u failed in %lums", op.request[0],
+                    ok, exceptions, failed, (micros() - op.received) / 1000UL);
+    }
+  }
+}
+
+// The radio has signaled an interrupt, a frame may be available
+void RtuBridge::onRadioEvent (Radio & radio) {
+  uint64_t events;
+
+  // reset the eventfd (or timerfd) counter
+  while (::read (radio.fd, &events, sizeof (events)) > 0);
+
+  // available() also puts the radio back in receive mode after a transmission
+  while (radio.driver.available()) {
+    // On a reçu une trame
+    uint8_t rxlen = sizeof (m_rxbuf);
+
+    if (radio.driver.recv (m_rxbuf, &rxlen)) {
+
+      onRadioFrame (radio, m_rxbuf, rxlen);
+    }
+  }
+
+  // the radio may be free now
+  dispatch (radio);
+}
+
+// A frame has been received from the radio
+void RtuBridge::onRadioFrame (Radio & radio, const uint8_t *frame, size_t len) {
+
+  if (!RtuFramer::isValid (frame, len)) {
+
+    capture (CaptureRing::FromRadio, CaptureRing::Invalid, radio, frame, len);
+    m_metrics.slave (len > 0 ? frame[0] : 0).crcErrors++;
+    if (!m_quiet) {
+      m_log.log (Logger::Out, true, "Invalid radio message dropped ! > ", frame, len, false);
+    }
+    return;
+  }
+
+  if (len > 1 && frame[1] == ModbusReport::Function) {
+
+    onReport (radio, frame, len);
+    return;
+  }
+
+  if (len > 1 && frame[1] == ModbusRelay::Function) {
+
+    onRelay (radio, frame, len);
+    return;
+  }
+
+  if (m_routes.hops (frame[0]) > 0) {
+
+    // the last repeater passing a request on, or the slave answering it,
+    // the response comes along the route
+    capture (CaptureRing::FromRadio, CaptureRing::Unexpected, radio, frame, len);
+    if (!m_quiet) {
+      m_log.log (Logger::Out, true, "Frame of a relayed slave dropped ! > ", frame, len, false);
+    }
+    return;
+  }
+  onResponse (radio, frame, len);
+}
+
+// A response of a slave, direct or along its route
+void RtuBridge::onResponse (Radio & radio, const uint8_t *frame, size_t len) {
+  Transaction t;
+
+  switch (radio.transactions.match (frame, len, micros(), t)) {
+
+    case TransactionTable::Matched: {
+      // le message correspond à une requête en cours, on l'envoie sur la liaisons série
+      unsigned long now = micros();
+      unsigned long dt = now - t.sent;
+
+      if (t.discover) {
+        // a slave in range which does not relay rejects the discover
+        ModbusRelay::Frame direct = { t.slave, ModbusRelay::Route, ModbusRelay::Bridge, 0, nullptr, nullptr, 0 };
+
+        if (m_routes.learn (direct) && !m_quiet) {
+          m_log.log (Logger::Out, true, "Route direct > ", frame, len, false);
+        }
+        break;
+      }
+
+      capture (CaptureRing::FromRadio, CaptureRing::Ok, radio, frame, len);
+      onTurnaround (radio, t, len, dt);
+      bool wasOpen = m_breaker.isOpen (t.slave);
+      m_breaker.onResponse (t.slave);
+      if (wasOpen) {
+
+        m_metrics.slave (t.slave).unreachable = 0;
+        scheduleProbe();
+        if (!m_quiet) {
+          m_log.log (Logger::Out, true, "Slave reachable again > ", frame, len, false);
+        }
+      }
+      if (t.attempts > 1) {
+        m_metrics.slave (t.slave).recovered++;
+      }
+      m_metrics.onResponse (frame[0], radio.index, dt, radio.driver.lastRssi(),
+                            radio.rf95 ? radio.rf95->lastSNR() : 0, radio.rf95 != nullptr);
+      m_adapter.onResponse (t.slave, radio.modem, radio.driver.lastRssi(),
+                            radio.rf95 ? radio.rf95->lastSNR() : 0, radio.rf95 != nullptr);
+      if (t.probe) {
+        break; // nobody waits for it
+      }
+      if (t.shadow) {
+
+        // a read answered across a write is not stored, the poller reads it again
+        onPollResult (t, !(frame[1] & 0x80) &&
+                      (!isCurrent (t) || m_image.store (t.request.data(), t.request.size(), frame, len, now) > 0));
+        break;
+      }
+      if (t.fanout) {
+
+        onFanOutResult (t, frame[1] & 0x80 ? FanOut::Exception : FanOut::Ok, len > 2 ? frame[2] : 0);
+      }
+      else if (t.parts.empty()) {
+
+        reply (frame, len, t.master, true, now);
+        if (isCurrent (t)) {
+
+          m_cache.store (t.request.data(), t.request.size(), frame, len, now);
+          m_image.store (t.request.data(), t.request.size(), frame, len, now);
+        }
+      }
+      else if (frame[1] & 0x80) {
+
+        // the exception may come from a part or from the registers between
+        // the parts, each request is sent again alone
+        for (size_t i = t.parts.size(); i-- > 0;) {
+          Transaction *p = radio.transactions.requeue (t.parts[i].data(), t.parts[i].size(), t.received);
+
+          p->master = t.masters[i];
+          p->priority = priority (t.masters[i]);
+        }
+        if (!m_quiet) {
+          m_log.log (Logger::Out, true, "Merged read failed, sent again unmerged > ", frame, len, false);
+        }
+      }
+      else {
+        std::vector<std::vector<uint8_t>> replies;
+
+        // one reply for each request merged
+        if (!Coalescer::split (t, frame, len, replies)) {
+
+          if (!m_quiet) {
+            m_log.log (Logger::Out, true, "Invalid merged response dropped ! > ", frame, len, false);
+          }
+          return;
+        }
+        for (size_t i = 0; i < replies.size(); i++) {
+
+          reply (replies[i].data(), replies[i].size(), t.masters[i], true, now);
+          if (isCurrent (t)) {
+
+            m_cache.store (t.parts[i].data(), t.parts[i].size(), replies[i].data(), replies[i].size(), now);
+            m_image.store (t.parts[i].data(), t.parts[i].size(), replies[i].data(), replies[i].size(), now);
+          }
+        }
+      }
+      // a read may have been answered between the write and its response
+      invalidate (t.request.data(), t.request.size());
+      m_poller.expedite (t.request.data(), t.request.size(), now);
+
+      // On affiche le message reçu et le temps entre émission et réception
+      if (!m_quiet) {
+        m_log.log (Logger::Out, false, "", frame, len, false);
+        if (radio.dutyCycle.isEnabled()) {
+          m_log.printf (Logger::Out, "Reply time: %lums, duty cycle budget left: %lums",
+                        dt / 1000UL, radio.dutyCycle.remaining (micros()) / 1000UL);
+        }
+        else {
+          m_log.printf (Logger::Out, "Reply time: %lums", dt / 1000UL);
+        }
+      }
+    }
+    break;
+
+    case TransactionTable::Late:
+      capture (CaptureRing::FromRadio, CaptureRing::Late, radio, frame, len);
+      m_metrics.slave (frame[0]).late++;
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Late response dropped ! > ", frame, len, false);
+      }
+      break;
+
+    case TransactionTable::Orphan:
+      capture (CaptureRing::FromRadio, CaptureRing::Unexpected, radio, frame, len);
+      m_metrics.slave (frame[0]).unexpected++;
+      if (!m_quiet) {
+        m_log.log (Logger::Out, true, "Unexpected response dropped ! > ", frame, len, false);
+      }
+      break;
+  }
+}
+
+// A relay frame for the bridge has been received, the response of a slave
+// along its route or the answer to a discover
+void RtuBridge::onRelay (Radio & radio, const uint8_t *frame, size_t len) {
+  ModbusRelay::Frame f;
+
+  // the frames between two repeaters and the discovers passed on are ignored
+  if (!ModbusRelay::decode (frame, len, f) || f.type == ModbusRelay::Request ||
+      f.type == ModbusRelay::Discover || f.hop != ModbusRelay::Bridge) {
+    return;
+  }
+
+  if (f.type == ModbusRelay::Response) {
+    uint8_t rtu[RH_RELAY_MAX_MESSAGE_LEN];
+    size_t n = ModbusRelay::unwrap (f, rtu, sizeof (rtu));
+
+    if (n > 0) {
+      onResponse (radio, rtu, n);
+    }
+    return;
+  }
+
+  // the first answer wins, the others are late
+  Transaction t;
+  if (radio.transactions.match (frame, len, micros(), t) == TransactionTable::Matched &&
+      t.discover && m_routes.learn (f) && !m_quiet) {
+
+    m_log.log (Logger::Out, true, f.count ? "Route > " : "Route direct > ", frame, len, false);
+  }
+}
+
+// A slave has reported a change or its integrity, without request
+void RtuBridge::onReport (Radio & radio, const uint8_t *frame, size_t len) {
+  ModbusReport::Report report;
+
+  if (!ModbusReport::decode (frame, len, report) || !m_image.onReport (report, micros())) {
+
+    capture (CaptureRing::FromRadio, CaptureRing::Unexpected, radio, frame, len);
+    m_metrics.slave (frame[0]).unexpected++;
+    if (!m_quiet) {
+      m_log.log (Logger::Out, true, "Unexpected report dropped ! > ", frame, len, false);
+    }
+    return;
+  }
+  capture (CaptureRing::FromRadio, CaptureRing::Report, radio, frame, len);
+  m_metrics.slave (frame[0]).reports++;
+  if (!m_quiet) {
+    m_log.log (Logger::Out, true, "Report > ", frame, len, false);
+  }
+}
+
+// Records a frame in the capture ring, with the RSSI and the SNR of the
+// frames received from the radio
+void RtuBridge::capture (CaptureRing::Direction direction, CaptureRing::Status status,
+                         const Radio & radio, const uint8_t *frame, size_t len) {
+
+  if (m_capture) {
+    int16_t rssi = 0;
+    int8_t snr = CaptureRing::NoSnr;
+
+    if (direction == CaptureRing::FromRadio && status != CaptureRing::Timeout) {
+
+      rssi = radio.driver.lastRssi();
+      if (radio.rf95) {
+        snr = radio.rf95->lastSNR();
+      }
+    }
+    m_capture->write (direction, status, radio.index, frame, len, rssi, snr);
+  }
+}
+
+// Queues a frame for a master on the serial line of its port, a TCP client
+// receives it at once
+// fromRadio: the frame is a response received at micros() received
+void RtuBridge::reply (const uint8_t *frame, size_t len, uint32_t master, bool fromRadio, unsigned long received) {
+
+  if (master >= ModbusTcpServer::FirstMaster) {
+
+    if (m_tcp && m_tcp->reply (master, frame, len)) {
+
+      if (fromRadio) {
+        m_metrics.onReply (micros() - received);
+      }
+      if (m_capture) {
+        m_capture->write (CaptureRing::ToMaster, CaptureRing::Ok, len > 0 ? m_route[frame[0]] : 0, frame, len);
+      }
+    }
+    return;
+  }
+  if (master < m_ports.size()) {
+    Port & port = *m_ports[master];
+
+    port.replies.push_back (Reply { std::vector<uint8_t> (frame, frame + len), fromRadio, received });
+    flushReplies (port);
+  }
+}
+
+// Writes the queued frames to the serial line of a port, each one after a
+// silence of T3.5 on the line
+void RtuBridge::flushReplies (Port & port) {
+
+  while (!port.replies.empty()) {
+    long wait = port.lineFree - micros();
+
+    // the line is never busy longer than a frame of 256 bytes, an older
+    // date has wrapped around
+    if (wait > 0 && (unsigned long) wait <= 256 * port.byteTime + port.frameInterval) {
+
+      port.replyTimer.start (wait);
+      return;
+    }
+
+    const Reply & reply = port.replies.front();
+    const std::vector<uint8_t> & r = reply.frame;
+    port.serial.write (r.data(), r.size());
+    if (reply.fromRadio) {
+      m_metrics.onReply (micros() - reply.received);
+    }
+    if (m_capture) {
+      m_capture->write (CaptureRing::ToMaster, CaptureRing::Ok, r.size() > 0 ? m_route[r[0]] : 0, r.data(), r.size());
+    }
+    // write() returns when the bytes are in the driver, not on the line
+    port.lineFree = micros() + r.size() * port.byteTime + port.frameInterval;
+    port.replies.pop_front();
+  }
+}
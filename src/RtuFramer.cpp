@@ -0,0 +1,239 @@
+#include <string.h>
+
+#include "RtuFramer.h"
+#include "ModbusCrc.h"
+
+// Limits the backtracking when a burst is split
+const size_t MaxSplitDepth = 16;
+
+RtuFramer::RtuFramer (Handler handler) :
+  m_handler (handler), m_charInterval (750), m_frameInterval (1750), m_byteTime (286),
+  m_last (0), m_gap (false), m_len (0), m_candidates (0),
+  m_frames (0), m_crcErrors (0), m_gapErrors (0), m_splits (0) {
+}
+
+void RtuFramer::setTimings (unsigned long charInterval, unsigned long frameInterval, unsigned long byteTime) {
+
+  m_charInterval = charInterval;
+  m_frameInterval = frameInterval;
+  m_byteTime = byteTime;
+}
+
+void RtuFramer::clear() {
+
+  m_len = 0;
+  m_candidates = 0;
+  m_gap = false;
+  m_crc.reset();
+}
+
+void RtuFramer::receive (const uint8_t *data, size_t len, unsigned long t) {
+
+  if (len == 0) {
+    return;
+  }
+
+  if (m_len > 0) {
+    // silence before the first byte of this chunk, t is the time of the last one
+    long gap = (long) (t - m_last) - (long) (len * m_byteTime);
+
+    if (gap >= (long) m_frameInterval) {
+
+      flush(); // the previous frame has ended
+    }
+    else if (gap > (long) m_charInterval) {
+
+      m_gap = true;
+    }
+  }
+  m_last = t;
+
+  // The CRC is updated as the bytes arrive, a null register marks a frame
+  // boundary candidate. Requests whose length is known from the function code
+  // are emitted at once, the master can pipeline its requests.
+  while (len--) {
+
+    m_buf[m_len++] = *data++;
+    m_crc.update (m_buf[m_len - 1]);
+
+    if (m_len >= 4 && m_crc.isResidueOk()) {
+
+      if (requestLength (m_buf, m_len) == m_len) {
+
+        emit (m_buf, m_len, FrameOk);
+        clear();
+      }
+      else if (m_candidates < MaxCandidates) {
+
+        m_candidate[m_candidates++] = m_len;
+      }
+    }
+
+    if (m_len == BufferSize) {
+
+      emit (m_buf, m_len, Overflow);
+      clear();
+    }
+  }
+}
+
+bool RtuFramer::timeout (unsigned long t) {
+
+  if (m_len == 0) {
+    return true;
+  }
+  if ( (long) (t - m_last) < (long) m_frameInterval) {
+    return false;
+  }
+  flush();
+  return true;
+}
+
+// T3.5 elapsed, the bytes received form one or more frames
+void RtuFramer::flush() {
+  size_t ends[MaxSplitDepth + 1];
+  size_t count = 0;
+
+  if (m_len < 4) {
+
+    emit (m_buf, m_len, TooShort);
+  }
+  else if (m_crc.isResidueOk()) {
+
+    emit (m_buf, m_len, FrameOk); // most of the time
+  }
+  else if (split (0, 0, ends, count)) {
+    size_t pos = 0;
+
+    m_splits += count - 1;
+    for (size_t i = 0; i < count; i++) {
+
+      emit (&m_buf[pos], ends[i] - pos, FrameOk);
+      pos = ends[i];
+    }
+  }
+  else {
+
+    m_crcErrors++;
+    emit (m_buf, m_len, CrcError);
+  }
+  clear();
+}
+
+// Looks for the ends of the frames contained in m_buf[pos..m_len[, returns
+// false if these bytes can not be split into valid frames
+bool RtuFramer::split (size_t pos, size_t depth, size_t *ends, size_t & count) {
+  size_t remaining = m_len - pos;
+  size_t candidate[MaxCandidates];
+  size_t candidates = 0;
+
+  if (remaining == 0) {
+    return true;
+  }
+  if (remaining < 4 || depth > MaxSplitDepth) {
+    return false;
+  }
+
+  // frame lengths for which the CRC checks, the ones of the first frame were
+  // found as the bytes arrived
+  if (pos == 0) {
+
+    candidates = m_candidates;
+    memcpy (candidate, m_candidate, candidates * sizeof (size_t));
+  }
+  else {
+    ModbusCrc crc;
+
+    for (size_t k = 1; k <= remaining && candidates < MaxCandidates; k++) {
+
+      crc.update (m_buf[pos + k - 1]);
+      if (k >= 4 && crc.isResidueOk()) {
+        candidate[candidates++] = k;
+      }
+    }
+  }
+
+  if (candidates > 0 && candidate[candidates - 1] == remaining) {
+
+    ends[count++] = m_len; // all the remaining bytes form one frame
+    return true;
+  }
+
+  // Otherwise, the first boundary which allows splitting the rest is chosen,
+  // the length expected from the function code is tried first
+  size_t expected = requestLength (&m_buf[pos], remaining);
+  for (size_t i = 0; i < candidates; i++) {
+
+    if (candidate[i] == expected && i > 0) {
+      // tried first
+      memmove (&candidate[1], &candidate[0], i * sizeof (size_t));
+      candidate[0] = expected;
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < candidates; i++) {
+    size_t k = candidate[i];
+
+    ends[count] = pos + k;
+    if (split (pos + k, depth + 1, ends, ++count)) {
+      return true;
+    }
+    count--;
+  }
+  return false;
+}
+
+void RtuFramer::emit (const uint8_t *frame, size_t len, Status status) {
+
+  if (status == FrameOk) {
+
+    m_frames++;
+    if (m_gap) {
+      m_gapErrors++;
+    }
+  }
+  m_handler (frame, len, status);
+}
+
+bool RtuFramer::isValid (const uint8_t *frame, size_t len) {
+
+  return len >= 4 && ModbusCrc::compute (frame, len) == 0;
+}
+
+size_t RtuFramer::requestLength (const uint8_t *frame, size_t len) {
+
+  if (len < 2) {
+    return 0;
+  }
+
+  switch (frame[1]) {
+    case 0x01: // Read Coils
+    case 0x02: // Read Discrete Inputs
+    case 0x03: // Read Holding Registers
+    case 0x04: // Read Input Registers
+    case 0x05: // Write Single Coil
+    case 0x06: // Write Single Register
+    case 0x08: // Diagnostics
+      return 8;
+    case 0x07: // Read Exception Status
+    case 0x0B: // Get Comm Event Counter
+    case 0x0C: // Get Comm Event Log
+    case 0x11: // Report Server ID
+      return 4;
+    case 0x18: // Read FIFO Queue
+      return 6;
+    case 0x16: // Mask Write Register
+      return 10;
+    case 0x0F: // Write Multiple Coils
+    case 0x10: // Write Multiple Registers
+      return len > 6 ? 9 + frame[6] : 0;
+    case 0x14: // Read File Record
+    case 0x15: // Write File Record
+      return len > 2 ? 5 + frame[2] : 0;
+    case 0x17: // Read/Write Multiple Registers
+      return len > 10 ? 13 + frame[10] : 0;
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <cerrno>
+
+#include "SerialLine.h"
+
+// return the termios speed of baudrate, B0 if not supported
+static speed_t termiosSpeed (unsigned long baudrate) {
+  static const struct {
+    unsigned long baudrate;
+    speed_t speed;
+  } speeds[] = {
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+    { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+    { 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 }, { 576000, B576000 },
+    { 921600, B921600 }, { 1000000, B1000000 }, { 1152000, B1152000 }, { 1500000, B1500000 },
+    { 2000000, B2000000 }, { 2500000, B2500000 }, { 3000000, B3000000 }, { 3500000, B3500000 },
+    { 4000000, B4000000 }
+  };
+
+  for (const auto & s : speeds) {
+    if (s.baudrate == baudrate) {
+      return s.speed;
+    }
+  }
+  return B0;
+}
+
+SerialLine::SerialLine() : m_fd (-1), m_baudrate (0) {
+}
+
+SerialLine::~SerialLine() {
+  close();
+}
+
+bool SerialLine::open (const std::string & path, unsigned long baudrate) {
+  struct termios tio;
+  speed_t speed = termiosSpeed (baudrate);
+
+  if (speed == B0) {
+    return false;
+  }
+
+  close();
+  m_fd = ::open (path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (m_fd < 0) {
+    return false;
+  }
+
+  if (tcgetattr (m_fd, &tio) < 0) {
+
+    close();
+    return false;
+  }
+  cfmakeraw (&tio);
+  tio.c_cflag &= ~ (CSIZE | PARODD | CSTOPB | CRTSCTS);
+  tio.c_cflag |= CS8 | PARENB | CLOCAL | CREAD; // 8E1
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed (&tio, speed);
+  cfsetospeed (&tio, speed);
+  if (tcsetattr (m_fd, TCSANOW, &tio) < 0) {
+
+    close();
+    return false;
+  }
+  tcflush (m_fd, TCIOFLUSH);
+
+  // USB adapters (FTDI...) delay the bytes received by up to 16 ms unless the
+  // low latency mode is set, this fails silently on ports that do not support it
+  struct serial_struct ss;
+  if (ioctl (m_fd, TIOCGSERIAL, &ss) == 0) {
+
+    ss.flags |= ASYNC_LOW_LATENCY;
+    ioctl (m_fd, TIOCSSERIAL, &ss);
+  }
+
+  m_baudrate = baudrate;
+  m_path = path;
+  return true;
+}
+
+void SerialLine::close() {
+
+  if (m_fd >= 0) {
+
+    ::close (m_fd);
+    m_fd = -1;
+  }
+}
+
+ssize_t SerialLine::read (uint8_t *buf, size_t len) {
+  ssize_t n = ::read (m_fd, buf, len);
+
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return 0;
+  }
+  return n;
+}
+
+ssize_t SerialLine::write (const uint8_t *buf, size_t len) {
+  size_t done = 0;
+
+  while (done < len) {
+    ssize_t n = ::write (m_fd, buf + done, len - done);
+
+    if (n < 0) {
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = { m_fd, POLLOUT, 0 };
+
+        poll (&pfd, 1, -1);
+        continue;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+  return done;
+}
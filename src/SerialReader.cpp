@@ -0,0 +1,85 @@
+#include <Piduino.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "SerialReader.h"
+
+SerialReader::SerialReader (SerialLine & serial) :
+  m_serial (serial), m_running (false), m_stalls (0) {
+
+  m_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_stopFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+SerialReader::~SerialReader() {
+
+  stop();
+  if (m_fd >= 0) {
+    close (m_fd);
+  }
+  if (m_stopFd >= 0) {
+    close (m_stopFd);
+  }
+}
+
+bool SerialReader::start() {
+
+  if (m_running) {
+    return true;
+  }
+  if (m_fd < 0 || m_stopFd < 0 || !m_serial.isOpen()) {
+    return false;
+  }
+  m_running = true;
+  m_thread = std::thread (&SerialReader::run, this);
+  return true;
+}
+
+void SerialReader::stop() {
+
+  if (m_running) {
+
+    m_running = false;
+    eventfd_write (m_stopFd, 1);
+    m_thread.join();
+  }
+}
+
+// Serial ingress thread
+void SerialReader::run() {
+  struct pollfd pfd[2] = {
+    { m_serial.fd(), POLLIN, 0 },
+    { m_stopFd, POLLIN, 0 }
+  };
+
+  while (m_running) {
+    Chunk *c = m_ring.reserve();
+
+    if (!c) {
+
+      // the event loop is late, the bytes wait in the kernel buffer
+      m_stalls++;
+      ::poll (&pfd[1], 1, 1);
+      continue;
+    }
+
+    if (::poll (pfd, 2, -1) <= 0 || (pfd[1].revents & POLLIN)) {
+      continue;
+    }
+
+    ssize_t n = m_serial.read (c->data, sizeof (c->data));
+    if (n > 0) {
+
+      c->time = micros();
+      c->len = n;
+      m_ring.commit();
+      eventfd_write (m_fd, 1);
+    }
+    else if (n < 0) {
+
+      // port closed or in error, do not spin
+      ::poll (&pfd[1], 1, 100);
+    }
+  }
+}
@@ -0,0 +1,146 @@
+#include "ShadowPoller.h"
+#include "ModbusCrc.h"
+#include "ModbusReport.h"
+#include "ReadCache.h"
+
+ShadowPoller::ShadowPoller() {}
+
+int ShadowPoller::add (uint8_t slave, uint8_t function, uint16_t start, uint16_t quantity, unsigned long period) {
+  size_t count = ModbusReport::dataSize (function, quantity);
+
+  // slave, function, byte count, data and CRC in a RadioHead message
+  if (!ReadCache::isRead (function) || slave == 0 || quantity == 0 || count == 0 || count > 240 ||
+      (unsigned long) start + quantity > 0x10000UL || period == 0) {
+    return -1;
+  }
+  Entry e;
+
+  e.slave = slave;
+  e.function = function;
+  e.start = start;
+  e.quantity = quantity;
+  e.period = period;
+  e.due = 0;
+  e.pending = e.again = false;
+  e.polls = e.failures = e.deferred = 0;
+  m_entries.push_back (e);
+  return m_entries.size() - 1;
+}
+
+void ShadowPoller::start (unsigned long now) {
+
+  // not all at once, the first reads would wait for each other
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    Entry & e = m_entries[i];
+
+    e.due = now + e.period / m_entries.size() * i;
+    e.pending = e.again = false;
+  }
+}
+
+bool ShadowPoller::isDue (size_t index, unsigned long now) const {
+  const Entry & e = m_entries[index];
+
+  return !e.pending && (long) (now - e.due) >= 0;
+}
+
+size_t ShadowPoller::request (size_t index, uint8_t *frame) const {
+  const Entry & e = m_entries[index];
+
+  frame[0] = e.slave;
+  frame[1] = e.function;
+  frame[2] = e.start >> 8;
+  frame[3] = e.start & 0xFF;
+  frame[4] = e.quantity >> 8;
+  frame[5] = e.quantity & 0xFF;
+  ModbusCrc::append (frame, 6);
+  return 8;
+}
+
+void ShadowPoller::sent (size_t index) {
+  Entry & e = m_entries[index];
+
+  e.pending = true;
+  e.polls++;
+}
+
+void ShadowPoller::done (size_t index, bool ok, unsigned long now) {
+  Entry & e = m_entries[index];
+
+  e.pending = false;
+  if (!ok) {
+    e.failures++;
+  }
+  if (e.again) {
+
+    // the response may predate the write
+    e.again = false;
+    e.due = now;
+    return;
+  }
+  schedule (e, now);
+}
+
+void ShadowPoller::defer (size_t index, unsigned long now) {
+  Entry & e = m_entries[index];
+
+  e.deferred++;
+  schedule (e, now);
+}
+
+// next due time after now, in step with the period
+void ShadowPoller::schedule (Entry & e, unsigned long now) {
+
+  while ( (long) (now - e.due) >= 0) {
+    e.due += e.period;
+  }
+}
+
+size_t ShadowPoller::expedite (const uint8_t *request, size_t len, unsigned long now) {
+  uint8_t table;
+  uint16_t start, quantity;
+  size_t count = 0;
+
+  if (!ReadCache::writtenRange (request, len, table, start, quantity)) {
+    return 0;
+  }
+
+  for (auto & e : m_entries) {
+
+    if ( (request[0] == 0 || e.slave == request[0]) && e.function == table &&
+         e.start < (unsigned long) start + quantity && start < (unsigned long) e.start + e.quantity) {
+
+      e.again = e.pending;
+      e.due = now;
+      count++;
+    }
+  }
+  return count;
+}
+
+unsigned long ShadowPoller::polls() const {
+  unsigned long n = 0;
+
+  for (const auto & e : m_entries) {
+    n += e.polls;
+  }
+  return n;
+}
+
+unsigned long ShadowPoller::failures() const {
+  unsigned long n = 0;
+
+  for (const auto & e : m_entries) {
+    n += e.failures;
+  }
+  return n;
+}
+
+unsigned long ShadowPoller::deferred() const {
+  unsigned long n = 0;
+
+  for (const auto & e : m_entries) {
+    n += e.deferred;
+  }
+  return n;
+}
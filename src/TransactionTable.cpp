@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <bitset>
+#include "TransactionTable.h"
+#include "ReadCache.h"
+
+// The expired transactions are remembered this long to detect late responses
+const unsigned long LateWindow = 10000000UL;
+const size_t MaxExpired = 64;
+
+TransactionTable::TransactionTable (size_t maxQueue, size_t maxInFlight) :
+  m_maxQueue (maxQueue), m_maxInFlight (maxInFlight), m_timeout (1000000UL), m_retries (0), m_aging (1000000UL),
+  m_requests (0), m_responses (0), m_timeouts (0), m_late (0), m_orphans (0),
+  m_overflows (0), m_resent (0), m_recovered (0), m_maxDepth (0) {
+}
+
+bool TransactionTable::push (const uint8_t *frame, size_t len, unsigned long now, unsigned long hold) {
+
+  if (m_queue.size() >= m_maxQueue || len < 2) {
+
+    m_overflows++;
+    return false;
+  }
+
+  m_queue.push_back (Transaction());
+  init (m_queue.back(), frame, len, now);
+  m_queue.back().ready = now + hold;
+
+  m_requests++;
+  if (m_queue.size() > m_maxDepth) {
+    m_maxDepth = m_queue.size();
+  }
+  return true;
+}
+
+Transaction *TransactionTable::requeue (const uint8_t *frame, size_t len, unsigned long received) {
+
+  m_queue.push_front (Transaction());
+  init (m_queue.front(), frame, len, received);
+  m_queue.front().split = true;
+  if (m_queue.size() > m_maxDepth) {
+    m_maxDepth = m_queue.size();
+  }
+  return &m_queue.front();
+}
+
+// A new request, ready when received
+void TransactionTable::init (Transaction & t, const uint8_t *frame, size_t len, unsigned long received) {
+
+  t.slave = frame[0];
+  t.function = frame[1];
+  t.received = t.ready = received;
+  t.sent = t.deadline = t.retry = 0;
+  t.settle = 0;
+  t.profile = t.priority = 0;
+  t.attempts = 0;
+  t.generation = 0;
+  t.due = t.probe = t.discover = t.split = false;
+  t.fanout = 0;
+  t.shadow = 0;
+  t.master = 0;
+  t.request.assign (frame, frame + len);
+}
+
+Transaction *TransactionTable::queued (uint8_t slave, uint8_t function) {
+
+  for (auto it = m_queue.rbegin(); it != m_queue.rend(); ++it) {
+
+    if (it->slave == slave && it->function == function) {
+      return & (*it);
+    }
+  }
+  return nullptr;
+}
+
+Transaction *TransactionTable::mergeable (uint8_t slave, uint8_t function) {
+
+  for (auto it = m_queue.rbegin(); it != m_queue.rend(); ++it) {
+
+    if (it->slave == slave) {
+
+      // a read merged across a write would be answered with the data of the
+      // wrong side of the write
+      return it->function == function && !it->split ? & (*it) : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+std::deque<Transaction>::iterator TransactionTable::candidate (unsigned long now) {
+  bool full = m_inFlight.size() >= m_maxInFlight;
+  auto best = m_queue.end();
+  long long bestRank = 0;
+
+  std::bitset<256> held; // slaves with a read held to be merged
+  m_keys.clear();
+
+  // the most urgent request whose key is free, the oldest one in its class,
+  // the order of the requests of a master to the same slave and function is
+  // kept, a broadcast is never in progress, a write does not pass a held read
+  for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+    bool read = ReadCache::isRead (it->function);
+
+    if ( (long) (now - it->ready) < 0) {
+
+      if (read) {
+        held.set (it->slave);
+      }
+      continue;
+    }
+    if (!read && (it->slave == 0 ? held.any() : held.test (it->slave))) {
+      continue;
+    }
+    uint64_t key = ( (uint64_t) it->master << 16) | it->key();
+    bool first = std::find (m_keys.begin(), m_keys.end(), key) == m_keys.end();
+
+    if (first) {
+      m_keys.push_back (key);
+    }
+    unsigned long until;
+    if (!first || (it->slave != 0 && (full || isInFlight (it->key()) || isBlocked (it->key(), now, until) ||
+                                      (!it->discover && isDiscovering (it->slave))))) {
+      continue;
+    }
+
+    // the queue is in arrival order, the first one wins a tie
+    long long rank = m_aging ? (long long) it->priority * m_aging - (long long) (now - it->received) : it->priority;
+    if (best == m_queue.end() || rank < bestRank) {
+
+      best = it;
+      bestRank = rank;
+    }
+  }
+  return best;
+}
+
+const Transaction *TransactionTable::next (unsigned long now, unsigned long retryAfter, unsigned long extend,
+                                          unsigned long settle, uint32_t generation) {
+  auto it = candidate (now);
+
+  if (it == m_queue.end()) {
+    return nullptr;
+  }
+  it->generation = generation;
+
+  if (it->slave == 0) {
+
+    // no response expected
+    it->sent = it->deadline = it->retry = now;
+    it->attempts = 1;
+    m_broadcast = std::move (*it);
+    m_queue.erase (it);
+    return &m_broadcast;
+  }
+
+  it->deadline = now + m_timeout + extend;
+  it->settle = settle;
+  it->attempts = 0;
+  schedule (*it, now, retryAfter);
+  m_inFlight.push_back (std::move (*it));
+  m_queue.erase (it);
+  return &m_inFlight.back();
+}
+
+// The request is sent now, it is sent again after retryAfter if it has
+// attempts left and time before its deadline
+void TransactionTable::schedule (Transaction & t, unsigned long now, unsigned long retryAfter) {
+
+  t.sent = now;
+  t.attempts++;
+  t.due = false;
+  if (retryAfter > 0 && t.attempts <= m_retries && (long) (t.deadline - (now + retryAfter)) > 0) {
+
+    t.retry = now + retryAfter;
+  }
+  else {
+
+    t.retry = t.deadline;
+  }
+}
+
+// Index of the oldest due transaction, inFlight() if none
+size_t TransactionTable::firstDue() const {
+  size_t first = m_inFlight.size();
+
+  for (size_t i = 0; i < m_inFlight.size(); i++) {
+
+    if (m_inFlight[i].due &&
+        (first == m_inFlight.size() || (long) (m_inFlight[i].received - m_inFlight[first].received) < 0)) {
+      first = i;
+    }
+  }
+  return first;
+}
+
+const Transaction *TransactionTable::due() const {
+  size_t i = firstDue();
+
+  return i < m_inFlight.size() ? &m_inFlight[i] : nullptr;
+}
+
+const Transaction *TransactionTable::resend (unsigned long now, unsigned long retryAfter) {
+  size_t i = firstDue();
+
+  if (i == m_inFlight.size()) {
+    return nullptr;
+  }
+  schedule (m_inFlight[i], now, retryAfter);
+  m_resent++;
+  return &m_inFlight[i];
+}
+
+void TransactionTable::abandon() {
+  size_t i = firstDue();
+
+  if (i < m_inFlight.size()) {
+    m_inFlight[i].due = false;
+  }
+}
+
+const Transaction *TransactionTable::peek (unsigned long now) {
+  auto it = candidate (now);
+
+  return it == m_queue.end() ? nullptr : & (*it);
+}
+
+bool TransactionTable::discard (unsigned long now) {
+  auto it = candidate (now);
+
+  if (it == m_queue.end()) {
+    return false;
+  }
+  m_queue.erase (it);
+  return true;
+}
+
+bool TransactionTable::nextReady (unsigned long now, unsigned long & when) const {
+  bool held = false;
+
+  for (const auto & t : m_queue) {
+    unsigned long ready = t.ready;
+    unsigned long until;
+
+    if (t.slave != 0 && isBlocked (t.key(), now, until) && (long) (until - ready) > 0) {
+      ready = until;
+    }
+    if ( (long) (ready - now) > 0 && (!held || (long) (ready - when) < 0)) {
+      when = ready;
+      held = true;
+    }
+  }
+  return held;
+}
+
+TransactionTable::Match TransactionTable::match (const uint8_t *frame, size_t len, unsigned long now, Transaction & t) {
+
+  if (len >= 2) {
+    // an exception response has the bit 7 of the function code set
+    uint16_t key = (frame[0] << 8) | (frame[1] & 0x7F);
+
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end(); ++it) {
+
+      if (it->key() == key) {
+
+        t = std::move (*it);
+        m_inFlight.erase (it);
+        m_responses++;
+        if (t.attempts > 1) {
+
+          // the responses to the other attempts may follow
+          remember (key, now, t.deadline, t.attempts - 1);
+          m_recovered++;
+        }
+        return Matched;
+      }
+    }
+
+    for (auto it = m_expired.rbegin(); it != m_expired.rend(); ++it) {
+
+      if (it->key == key && (now - it->time) < LateWindow) {
+
+        if (it->pending > 0) {
+          it->pending--;
+        }
+        m_late++;
+        return Late;
+      }
+    }
+  }
+  m_orphans++;
+  return Orphan;
+}
+
+size_t TransactionTable::expire (unsigned long now, std::function<void (const Transaction &)> handler,
+                                 std::function<void (const Transaction &)> lost) {
+  size_t count = 0;
+
+  for (auto it = m_inFlight.begin(); it != m_inFlight.end();) {
+
+    if ( (long) (now - it->deadline) >= 0) {
+      Transaction t = std::move (*it);
+
+      it = m_inFlight.erase (it);
+      remember (t.key(), now, now + t.settle, t.attempts);
+      m_timeouts++;
+      count++;
+      handler (t);
+    }
+    else {
+
+      if (!it->due && it->retry != it->deadline && (long) (now - it->retry) >= 0) {
+
+        // the retry time no longer wakes the deadline timer
+        it->due = true;
+        it->retry = it->deadline;
+        if (lost) {
+          lost (*it);
+        }
+      }
+      ++it;
+    }
+  }
+  return count;
+}
+
+// Remembers an ended transaction to detect the late responses, its key is
+// blocked until until or the pending responses have come
+void TransactionTable::remember (uint16_t key, unsigned long now, unsigned long until, uint8_t pending) {
+
+  m_expired.push_back (Expired { key, pending, now, (long) (until - now) > 0 ? until : now });
+  if (m_expired.size() > MaxExpired) {
+    m_expired.pop_front();
+  }
+}
+
+unsigned long TransactionTable::nextDeadline() const {
+  unsigned long deadline = m_inFlight.front().retry;
+
+  // the retry time is never after the deadline
+  for (const auto & t : m_inFlight) {
+
+    if ( (long) (t.retry - deadline) < 0) {
+      deadline = t.retry;
+    }
+  }
+  return deadline;
+}
+
+bool TransactionTable::isInFlight (uint16_t key) const {
+
+  for (const auto & t : m_inFlight) {
+    if (t.key() == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// true if a late response may still come for the key, until receives the
+// time from which it is free
+bool TransactionTable::isBlocked (uint16_t key, unsigned long now, unsigned long & until) const {
+  bool blocked = false;
+
+  for (const auto & e : m_expired) {
+
+    if (e.key == key && e.pending > 0 && (long) (e.until - now) > 0 && (!blocked || (long) (e.until - until) > 0)) {
+      until = e.until;
+      blocked = true;
+    }
+  }
+  return blocked;
+}
+
+// true if the route of the slave is being discovered, its discover queued or in progress
+bool TransactionTable::isDiscovering (uint8_t slave) const {
+
+  for (const auto & t : m_inFlight) {
+    if (t.discover && t.slave == slave) {
+      return true;
+    }
+  }
+  for (const auto & t : m_queue) {
+    if (t.discover && t.slave == slave) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -3,8 +3,8 @@
 //
 // rf95_rtu_bridge -h
 //
-// rf95_rtu_bridge [OPTION]... serial_port
-//   serial_port:  serial port path, eg /dev/ttyUSB0, /dev/tnt1...
+// rf95_rtu_bridge [OPTION]... [serial_port]
+//   serial_port:  serial port path, eg /dev/ttyUSB0, /dev/tnt1..., may be omitted with --tcp
 // Allowed options:
 //   -h, --help                   produce help message
 //   -v, --verbose                be verbose
@@ -14,20 +14,65 @@
 //   -d, --dio0-pin arg           sets the dio0 pin number, must be set !        > use `pido readall` to find the pin number
 //   -l, --led-pin arg            sets the Rx/Tx led pin number (optionnal)      > use `pido readall` to find the pin number
 //   -y, --wire-bus arg           sets the wire bus where a PCF8574 wich Rx/Tx led is connected
+//   --led-pulse arg (=30)        sets the minimum time in milliseconds the PCF8574 led stays on or off, faster changes are merged
 //   -b, --baudrate arg (=38400)  sets serial baudrate
 //   -k, --key arg                sets the secret key for AES128 encryption, must be 16 characters long
+//   --aes-backend arg (=auto)    sets the AES implementation, auto, table, aes-ni or armv8
+//   --aes-mode arg (=ecb)        sets the encryption mode, ecb (16 bytes blocks, RHEncryptedDriver) or ctr (no padding, the slaves must support it)
 //   -p, --tx-power arg           sets the transmitter power output level in dBm (5..23, default 13)
 //   -s, --spreading-factor arg   sets the radio spreading factor (6..12, default 7)
 //   -w, --bandwidth arg          sets the radio signal bandwidth in Hz (62500, 125000, 250000, 500000, default 125000)
 //   -r, --coding-rate arg        sets the coding rate to 4/5, 4/6, 4/7 or 4/8 (denominator 5..8, default 5)
+//   -t, --timeout arg (=1000)    sets the response timeout of a radio slave in milliseconds
+//   --in-flight arg (=1)         sets the number of requests which can wait for their response at the same time
+//   --retries arg (=0)           sets the number of times the bridge sends again a request without response before the timeout
+//   --retry-guard arg (=50)      sets the time in milliseconds added to the expected round trip before a request is sent again
+//   --exceptions                 answers the master with an exception 0x0B when a slave does not respond, 0x0A when a request is dropped
+//   --breaker arg (=0)           sets the number of timeouts in a row after which a slave is answered at once with an exception until it responds to a probe (0 disables it)
+//   --breaker-probe arg (=10)    sets the time in seconds between two probes of an unreachable slave
+//   --group arg                  sets a group of slaves to which a write is sent at once, group:first[-last][,first[-last]...] with group between 248 and 255, eg 250:20-29,31, may be repeated
+//   --duty-cycle arg (=1)        sets the transmit duty cycle limit in percent over a rolling hour (0 disables it)
+//   --duty-delay arg (=1000)     sets the maximum time in milliseconds a request may wait for the duty cycle budget
+//   --cache-ttl arg (=0)         sets the time in milliseconds a read response is answered from the cache (0 disables it)
+//   --cache-slave-ttl arg        sets the cache TTL of a slave, slave:ms, eg 10:500, may be repeated
+//   --cache-fc-ttl arg           sets the cache TTL of a read function code, fc:ms, eg 4:2000, may be repeated
+//   --report arg                 answers the reads of a range from the image kept with the reports of a slave which reports by exception, slave:fc:first[-last] with fc between 1 and 4, eg 10:3:0-15, may be repeated
+//   --report-age arg (=130)      sets the time in seconds after which the image of a slave which has reported nothing is stale (0 never)
+//   --poll arg                   reads a range of a slave in the background and answers the reads of the masters in it from the mirror, slave:fc:first[-last]:period_ms[:max_age_ms] with fc between 1 and 4, the max age is 3 periods by default, eg 10:3:0-15:5000, may be repeated
+//   --poll-reserve arg (=50)     sets the percentage of the duty cycle budget the background reads leave to the masters
+//   --coalesce arg (=0)          sets the time in milliseconds a read waits for other reads to the same slave to merge with (0 disables it)
+//   --coalesce-gap arg (=4)      sets the maximum number of registers or coils between two merged reads
+//   --compact                    sends the requests in the compact over-the-air encoding, the slaves must support it
+//   --compact-delta              allows the delta encoding of the registers written with the compact encoding
+//   --radio arg                  adds a radio, cs:dio0[:frequency[:sf[:bw[:cr]]]], eg 11:5:869.5:9, may be repeated
+//   --route arg                  routes slaves to a radio, first[-last]:radio, eg 20-29:1, may be repeated
+//   --adr                        adapts the spreading factor of each slave to its link, the slaves must support it
+//   --adr-margin arg (=5)        sets the margin in dB above the demodulation floor kept by the adaptive data rate
+//   --adr-fallback arg (=60)     sets the time in seconds without request after which a slave comes back to the spreading factor of the radio
+//   --relay arg                  discovers the route through the repeaters of slaves which may be out of range, first[-last], eg 30-39, may be repeated
+//   --relay-path arg             relays a slave along a fixed route, slave:repeater[,repeater...] with at most 4 repeaters, eg 40:12,14, may be repeated
+//   --relay-delay arg (=50)      sets the time in milliseconds a repeater takes to pass a frame on
+//   --tcp arg                    serves the Modbus TCP clients on this port, [address:]port, eg 502 or 127.0.0.1:1502, the serial port is then optional
+//   --tcp-clients arg (=16)      sets the maximum number of Modbus TCP clients connected at the same time
+//   --port arg                   adds the serial port of another master, path[:baudrate[:priority]], eg /dev/ttyUSB1:9600:1, may be repeated
+//   --priority arg (=0)          sets the priority class of the requests of the first serial port, 0 is the most urgent
+//   --aging arg (=1000)          sets the time in milliseconds after which a waiting request gains a priority class (0 for strict priorities)
 #include <Piduino.h>  // All the magic is here ;-)
 #include <csignal>
+#include <random>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
 #include <SPI.h>
-#include <RH_RF95.h>
+#include <RH_RF95Event.h>
 #include <RHPcf8574Pin.h>
 #include <RHGpioPin.h>
 #include <RHEncryptedDriver.h>
-#include <AES.h>
+#include "AesCipher.h"
+#include "RHCtrEncryptedDriver.h"
+#include "RHCompactDriver.h"
+#include "RtuBridge.h"
 
 // ---------------------------
 // --cs-pin and --dio0-pin options must be set
@@ -49,14 +94,40 @@ float frequency = 868.0;
 // ---------------------------
 // End of configuration
 
-RH_RF95 *rf95 = nullptr;  //  Pointer on the RF95 driver
-RHEncryptedDriver *encryptDrv = nullptr;  //  Driver which encrypts the data
+RH_RF95Event *rf95 = nullptr;  //  Pointer on the RF95 driver
+RHGenericDriver *encryptDrv = nullptr;  //  Driver which encrypts the data, ECB or CTR
+RHCompactDriver *compactDrv = nullptr;  //  Driver which compacts the frames
 RHGenericDriver *driver = nullptr; //  Generic driver which can be RF95 or encrypted
-AES128 cipher;                               // cipher AES128
+AesCipher cipher;                            // cipher AES128, accelerated if the CPU allows it
+
+// Radios added with --radio, the first one is above
+struct Radio {
+  int csPin;
+  int dio0Pin;
+  float frequency;
+  LoraModem modem;
+  RH_RF95Event *rf95;
+  RHGenericDriver *encryptDrv;
+  RHCompactDriver *compactDrv;
+};
+std::vector<Radio> radios;
+
+// We use our own serial line, because the Arduino serial port introduces
+// delays that do not allow to respect the Modbus RTU delays, and the bridge
+// needs the file descriptor to wait for the bytes in epoll
+SerialLine serial;
+
+// Serial ports of the other masters, added with --port
+std::vector<SerialLine *> ports;
+
+// Modbus RTU bridge between the serial line and the radio driver
+RtuBridge *bridge = nullptr;
+
+// Traffic recorded with --capture
+CaptureRing capture;
 
-// We use a Piduino serial port, because the Arduino serial port introduces
-// delays that do not allow to respect the Modbus RTU delays
-Piduino::SerialPort serial;
+// Metrics exported with --stats-file and --stats-socket
+MetricsExporter exporter;
 
 // Led controler on NanoPi4DinBox
 // cf https://github.com/epsilonrt/poo-toolbox
@@ -67,26 +138,67 @@ RHPin *led = nullptr; // Pointer on the led Tx (GPIO pin or PCF8574)
 
 unsigned long charInterval; // maximum time  between 2 characters (1.5c)
 unsigned long frameInterval; // minimum time between 2 frames (3.5c)
-unsigned long t0; // time of the last request
-uint8_t txlen; // length of the string from the serial port
 bool isEncrypted = false;
+bool isCtr = false; // AES-CTR instead of the 16 bytes blocks of RHEncryptedDriver
 bool isQuiet = false; // if true, no output on the console
+LoraModem modem; // radio settings, for the time on air of the messages
+int signalFd = -1; // SIGINT and SIGTERM, read by the event loop
 
 using namespace std;
 
-// Affiche un message modbus sur la console en Hexa
-// msg:  buffer contenant le message
-// len:  taille du message
-// req:  true les octets sont encadrés par [], false par <>
-void printModbusMessage (const uint8_t *msg, uint8_t len, bool req = true);
+// Interception handler for SIGINT and SIGTERM, called from the event loop
+void sig_handler (int sig);
 
-// Calcule le CRC d'une trame
-word calcCrc (byte address, byte *pduFrame, byte pduLen);
+// Reads the signal pending on signalFd and stops the bridge
+void onSignal();
 
-// Interception handler for SIGINT and SIGTERM
-void sig_handler (int sig);
+// Parses a "key:ms" option value, returns false if invalid
+bool parseTtl (const string & str, unsigned int & key, unsigned long & ttl);
+
+// Parses a --radio option value, the missing settings are those of the first radio
+bool parseRadio (const string & str, Radio & radio);
+
+// Parses a --route option value, returns false if invalid
+bool parseRoute (const string & str, unsigned int & first, unsigned int & last, unsigned int & radio);
+
+// Parses a --group option value, returns false if invalid
+bool parseGroup (const string & str, unsigned int & group, vector<uint8_t> & members);
+
+// Parses a --relay option value, returns false if invalid
+bool parseRelay (const string & str, unsigned int & first, unsigned int & last);
+
+// Parses a --relay-path option value, returns false if invalid
+bool parseRelayPath (const string & str, unsigned int & slave, vector<uint8_t> & path);
+
+// Parses a --report option value, returns false if invalid
+bool parseReport (const string & str, unsigned int & slave, unsigned int & fc, unsigned int & first, unsigned int & last);
+
+// Parses a --poll option value, maxAge is 0 if not given
+bool parsePoll (const string & str, unsigned int & slave, unsigned int & fc, unsigned int & first, unsigned int & last,
+                unsigned long & period, unsigned long & maxAge);
+
+// Parses a --tcp option value, address is empty for all the interfaces
+bool parseTcp (const string & str, string & address, unsigned int & port);
+
+// Parses a --port option value, the missing settings are left unchanged
+bool parsePort (const string & str, string & path, unsigned long & baudrate, unsigned int & priority);
+
+// RTU Modbus timing of a baud rate
+void rtuTimings (unsigned long baudrate, unsigned long & charInterval, unsigned long & frameInterval);
+
+// Encrypted driver of a radio, in the mode chosen by --aes-mode
+RHGenericDriver *newEncryptedDriver (RHGenericDriver & radio, size_t index);
 
 void setup() {
+  sigset_t signals;
+
+  // SIGINT and SIGTERM are blocked before any thread is started, so that
+  // none of them receives them, and read from a signalfd by the event loop
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &signals, nullptr);
+  signalFd = signalfd (-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
 
   // Setting up command line options and parameters, cf
   // https://github.com/epsilonrt/popl/blob/master/example/popl_example.cpp
@@ -99,25 +211,68 @@ void setup() {
   auto dio0pin_option = op.add<Piduino::Value<int>> ("d", "dio0-pin", "sets the dio0 pin number, must be set !        > use `pido readall` to find the pin number");
   auto led_option = op.add<Piduino::Value<int>> ("l", "led-pin",      "sets the Rx/Tx led pin number (optionnal)      > use `pido readall` to find the pin number");
   auto wirebus_option = op.add<Piduino::Value<int>> ("y", "wire-bus", "sets the wire bus where a PCF8574 wich Rx/Tx led is connected");
+  auto ledpulse_option = op.add<Piduino::Value<unsigned long>> ("", "led-pulse", "sets the minimum time in milliseconds the PCF8574 led stays on or off, faster changes are merged", 30);
   auto baudrate_option = op.add<Piduino::Value<unsigned long>> ("b", "baudrate", "sets serial baudrate", 38400);
   auto key_option = op.add<Piduino::Value<std::string>> ("k", "key", "sets the secret key for AES128 encryption, must be 16 characters long");
+  auto aesbackend_option = op.add<Piduino::Value<std::string>> ("", "aes-backend", "sets the AES implementation, auto, table, aes-ni or armv8", "auto");
+  auto aesmode_option = op.add<Piduino::Value<std::string>> ("", "aes-mode", "sets the encryption mode, ecb (16 bytes blocks, RHEncryptedDriver) or ctr (no padding, the slaves must support it)", "ecb");
   auto txpower_option = op.add<Piduino::Value<int>> ("p", "tx-power", "sets the transmitter power output level in dBm (5..23, default 13)");
   auto spfactor_option = op.add<Piduino::Value<int>> ("s", "spreading-factor", "sets the radio spreading factor (6..12, default 7)");
   auto bw_option = op.add<Piduino::Value<int>> ("w", "bandwidth", "sets the radio signal bandwidth in Hz (62500, 125000, 250000, 500000, default 125000)");
   auto codrate_option = op.add<Piduino::Value<int>> ("r", "coding-rate", "sets the coding rate to 4/5, 4/6, 4/7 or 4/8 (denominator 5..8, default 5)");
+  auto timeout_option = op.add<Piduino::Value<unsigned long>> ("t", "timeout", "sets the response timeout of a radio slave in milliseconds", 1000);
+  auto inflight_option = op.add<Piduino::Value<int>> ("", "in-flight", "sets the number of requests which can wait for their response at the same time", 1);
+  auto retries_option = op.add<Piduino::Value<int>> ("", "retries", "sets the number of times the bridge sends again a request without response before the timeout", 0);
+  auto retryguard_option = op.add<Piduino::Value<unsigned long>> ("", "retry-guard", "sets the time in milliseconds added to the expected round trip before a request is sent again", 50);
+  auto exceptions_option = op.add<Piduino::Switch> ("", "exceptions", "answers the master with an exception 0x0B when a slave does not respond, 0x0A when a request is dropped");
+  auto breaker_option = op.add<Piduino::Value<int>> ("", "breaker", "sets the number of timeouts in a row after which a slave is answered at once with an exception until it responds to a probe (0 disables it)", 0);
+  auto breakerprobe_option = op.add<Piduino::Value<unsigned long>> ("", "breaker-probe", "sets the time in seconds between two probes of an unreachable slave", 10);
+  auto group_option = op.add<Piduino::Value<std::string>> ("", "group", "sets a group of slaves to which a write is sent at once, group:first[-last][,first[-last]...] with group between 248 and 255, eg 250:20-29,31, may be repeated");
+  auto dutycycle_option = op.add<Piduino::Value<double>> ("", "duty-cycle", "sets the transmit duty cycle limit in percent over a rolling hour (0 disables it)", 1);
+  auto dutydelay_option = op.add<Piduino::Value<unsigned long>> ("", "duty-delay", "sets the maximum time in milliseconds a request may wait for the duty cycle budget", 1000);
+  auto cachettl_option = op.add<Piduino::Value<unsigned long>> ("", "cache-ttl", "sets the time in milliseconds a read response is answered from the cache (0 disables it)", 0);
+  auto slavettl_option = op.add<Piduino::Value<std::string>> ("", "cache-slave-ttl", "sets the cache TTL of a slave, slave:ms, eg 10:500, may be repeated");
+  auto fcttl_option = op.add<Piduino::Value<std::string>> ("", "cache-fc-ttl", "sets the cache TTL of a read function code, fc:ms, eg 4:2000, may be repeated");
+  auto report_option = op.add<Piduino::Value<std::string>> ("", "report", "answers the reads of a range from the image kept with the reports of a slave which reports by exception, slave:fc:first[-last] with fc between 1 and 4, eg 10:3:0-15, may be repeated");
+  auto reportage_option = op.add<Piduino::Value<unsigned long>> ("", "report-age", "sets the time in seconds after which the image of a slave which has reported nothing is stale (0 never)", 130);
+  auto poll_option = op.add<Piduino::Value<std::string>> ("", "poll", "reads a range of a slave in the background and answers the reads of the masters in it from the mirror, slave:fc:first[-last]:period_ms[:max_age_ms] with fc between 1 and 4, the max age is 3 periods by default, eg 10:3:0-15:5000, may be repeated");
+  auto pollreserve_option = op.add<Piduino::Value<int>> ("", "poll-reserve", "sets the percentage of the duty cycle budget the background reads leave to the masters", 50);
+  auto coalesce_option = op.add<Piduino::Value<unsigned long>> ("", "coalesce", "sets the time in milliseconds a read waits for other reads to the same slave to merge with (0 disables it)", 0);
+  auto coalescegap_option = op.add<Piduino::Value<int>> ("", "coalesce-gap", "sets the maximum number of registers or coils between two merged reads", 4);
+  auto compact_option = op.add<Piduino::Switch> ("", "compact", "sends the requests in the compact over-the-air encoding, the slaves must support it");
+  auto compactdelta_option = op.add<Piduino::Switch> ("", "compact-delta", "allows the delta encoding of the registers written with the compact encoding");
+  auto capture_option = op.add<Piduino::Value<std::string>> ("", "capture", "records the traffic in a binary ring file, read it with rf95_capture");
+  auto capturesize_option = op.add<Piduino::Value<unsigned long>> ("", "capture-size", "sets the size of the capture ring file in KiB", 1024);
+  auto statsfile_option = op.add<Piduino::Value<std::string>> ("", "stats-file", "rewrites the metrics in this file in the Prometheus text format");
+  auto statssocket_option = op.add<Piduino::Value<std::string>> ("", "stats-socket", "serves the metrics in the Prometheus text format on this Unix socket");
+  auto statsperiod_option = op.add<Piduino::Value<unsigned long>> ("", "stats-period", "sets the period of the metrics export in seconds", 10);
+  auto tcp_option = op.add<Piduino::Value<std::string>> ("", "tcp", "serves the Modbus TCP clients on this port, [address:]port, eg 502 or 127.0.0.1:1502, the serial port is then optional");
+  auto tcpclients_option = op.add<Piduino::Value<int>> ("", "tcp-clients", "sets the maximum number of Modbus TCP clients connected at the same time", 16);
+  auto port_option = op.add<Piduino::Value<std::string>> ("", "port", "adds the serial port of another master, path[:baudrate[:priority]], eg /dev/ttyUSB1:9600:1, may be repeated");
+  auto priority_option = op.add<Piduino::Value<int>> ("", "priority", "sets the priority class of the requests of the first serial port, 0 is the most urgent", 0);
+  auto aging_option = op.add<Piduino::Value<unsigned long>> ("", "aging", "sets the time in milliseconds after which a waiting request gains a priority class (0 for strict priorities)", 1000);
+  auto inlineio_option = op.add<Piduino::Switch> ("", "inline-io", "reads the serial port in the event loop instead of a dedicated thread");
+  auto radio_option = op.add<Piduino::Value<std::string>> ("", "radio", "adds a radio, cs:dio0[:frequency[:sf[:bw[:cr]]]], eg 11:5:869.5:9, may be repeated");
+  auto route_option = op.add<Piduino::Value<std::string>> ("", "route", "routes slaves to a radio, first[-last]:radio, eg 20-29:1, may be repeated");
+  auto adr_option = op.add<Piduino::Switch> ("", "adr", "adapts the spreading factor of each slave to its link, the slaves must support it");
+  auto adrmargin_option = op.add<Piduino::Value<double>> ("", "adr-margin", "sets the margin in dB above the demodulation floor kept by the adaptive data rate", 5);
+  auto adrfallback_option = op.add<Piduino::Value<unsigned long>> ("", "adr-fallback", "sets the time in seconds without request after which a slave comes back to the spreading factor of the radio", 60);
+  auto relay_option = op.add<Piduino::Value<std::string>> ("", "relay", "discovers the route through the repeaters of slaves which may be out of range, first[-last], eg 30-39, may be repeated");
+  auto relaypath_option = op.add<Piduino::Value<std::string>> ("", "relay-path", "relays a slave along a fixed route, slave:repeater[,repeater...] with at most 4 repeaters, eg 40:12,14, may be repeated");
+  auto relaydelay_option = op.add<Piduino::Value<unsigned long>> ("", "relay-delay", "sets the time in milliseconds a repeater takes to pass a frame on", 50);
   op.parse (argc, argv);
 
   if (help_option->is_set()) {
 
-    std::cout << Piduino::System::progName() << " [OPTION]... serial_port" << endl;
-    std::cout << "  serial_port:\tserial port path, eg /dev/ttyUSB0, /dev/tnt1..." << endl;
+    std::cout << Piduino::System::progName() << " [OPTION]... [serial_port]" << endl;
+    std::cout << "  serial_port:\tserial port path, eg /dev/ttyUSB0, /dev/tnt1..., may be omitted with --tcp" << endl;
     std::cout << op << endl;
     exit (EXIT_SUCCESS);
   }
 
-  if (op.non_option_args().size() < 1) {
+  if (op.non_option_args().size() < 1 && !tcp_option->is_set()) {
 
-    cerr << "A serial port must be specified!" << endl << op << endl;
+    cerr << "A serial port or --tcp must be specified!" << endl << op << endl;
     exit (EXIT_FAILURE);
   }
 
@@ -136,16 +291,28 @@ void setup() {
   int csPin = cspin_option->value();
   int dio0Pin = dio0pin_option->value();
 
-  rf95 = new RH_RF95 (csPin, dio0Pin); // Pointeur sur le driver RF95
+  rf95 = new RH_RF95Event (csPin, dio0Pin); // Pointeur sur le driver RF95
 
   if (key_option->is_set()) {
     string  key = key_option->value();
+    AesCipher::Backend backend;
 
+    if (!AesCipher::backendFromName (aesbackend_option->value().c_str(), backend) || !cipher.setBackend (backend)) {
+
+      cerr << "AES backend " << aesbackend_option->value() << " not supported by this CPU !" << endl << op << endl;
+      exit (EXIT_FAILURE);
+    }
+    if (aesmode_option->value() != "ecb" && aesmode_option->value() != "ctr") {
+
+      cerr << "Invalid AES mode " << aesmode_option->value() << ", must be ecb or ctr" << endl << op << endl;
+      exit (EXIT_FAILURE);
+    }
+    isCtr = aesmode_option->value() == "ctr";
     if (cipher.setKey (reinterpret_cast<const uint8_t *> (key.data()), key.size())) {
 
-      encryptDrv = new RHEncryptedDriver (*rf95, cipher); // Driver qui assemble chiffreur et transmetteur RF
+      encryptDrv = newEncryptedDriver (*rf95, 0); // Driver qui assemble chiffreur et transmetteur RF
       if (!isQuiet) {
-        std::cout <<  "Encryption enabled" << endl;
+        std::cout <<  "Encryption enabled (" << (isCtr ? "ctr, " : "ecb, ") << AesCipher::backendName (cipher.backend()) << ")" << endl;
       }
       driver = encryptDrv;
       isEncrypted = true;
@@ -161,6 +328,16 @@ void setup() {
     driver = rf95;
   }
 
+  // The compact driver always decodes the compact responses, it encodes the
+  // requests only with --compact
+  compactDrv = new RHCompactDriver (*driver, RHCompactDriver::Master);
+  compactDrv->setCompact (compact_option->is_set());
+  compactDrv->setDelta (compactdelta_option->is_set());
+  if (compact_option->is_set() && !isQuiet) {
+    std::cout <<  "Compact encoding enabled" << endl;
+  }
+  driver = compactDrv;
+
   if (led_option->is_set()) {
     // process the --led option
     // if --wirebus is not set, we use GPIO pins
@@ -179,7 +356,8 @@ void setup() {
       if (led_option->is_set()) {
         int ledPin = led_option->value();
 
-        led = new RHPcf8574Pin (ledPin, pcf8574); // Led Tx
+        // written by its own thread, out of the radio path
+        led = new RHPcf8574Pin (ledPin, pcf8574, ledpulse_option->value()); // Led Tx
         if (verbose_option->is_set()) {
           std::cout << Piduino::System::progName() << ": " << "Use PCF8574 on bus " << wireBus << " for Rx/Tx led " << ledPin << endl;
         }
@@ -200,40 +378,20 @@ void setup() {
         rf95->setRxLed (*led);
       }
     }
-
-    // sig_handler() intercepte le CTRL+C
-    signal (SIGINT, sig_handler);
-    signal (SIGTERM, sig_handler);
   }
 
-  string portName = op.non_option_args() [0];
+  string portName = op.non_option_args().empty() ? "" : op.non_option_args() [0];
   unsigned long baudrate = baudrate_option->value();
   // end of command line options
 
-  //  Open the serial port
-  serial.setPortName (portName);
-  serial.setParity (Piduino::SerialPort::EvenParity);
-  serial.setBaudRate (baudrate);
-
-  if (!serial.open (Piduino::IoDevice::ReadWrite | Piduino::IoDevice::Binary)) {
+  //  Open the serial port, 8E1
+  if (!portName.empty() && !serial.open (portName, baudrate)) {
 
     cerr << "Unable to open " <<  portName << endl;
     exit (EXIT_FAILURE);
   }
 
-  // RTU Modbus timing, the silence between two frames must be at least 3.5T
-  // and the time between two characters must be less than 1.5T
-  if (baudrate > 19200UL) {
-    // if baudrate > 19200, we use a delay of 750us between two characters
-    // and 1750us between two frames
-    charInterval = 750;
-    frameInterval = 1750;
-  }
-  else {
-
-    charInterval = 16500000UL / baudrate; // 1T * 1.5 = T1.5, 1T = 11 bits
-    frameInterval = 38500000UL / baudrate; // 1T * 3.5 = T3.5, 1T = 11 bits
-  }
+  rtuTimings (baudrate, charInterval, frameInterval);
   if (!isQuiet) {
     std::cout << Piduino::System::progName() << ": " << portName << ", " << baudrate << " bd, " << frameInterval << "us" << endl;
   }
@@ -274,6 +432,7 @@ void setup() {
       exit (EXIT_FAILURE);
     }
     rf95->setSpreadingFactor (spFactor);
+    modem.spreadingFactor = spFactor;
   }
 
   if (bw_option->is_set()) {
@@ -284,6 +443,7 @@ void setup() {
       exit (EXIT_FAILURE);
     }
     rf95->setSignalBandwidth (sbw);
+    modem.bandwidth = LoraModem::supportedBandwidth (sbw);
   }
 
   if (codrate_option->is_set()) {
@@ -294,164 +454,337 @@ void setup() {
       exit (EXIT_FAILURE);
     }
     rf95->setCodingRate4 (cdrate);
+    modem.codingRate = cdrate;
   }
+  modem.encryption = isEncrypted ? (isCtr ? LoraModem::Stream : LoraModem::Padded) : LoraModem::Clear;
 
-  // rf95->printRegisters (Console);
-  if (!isQuiet) {
-    std::cout << "Waiting for incoming messages...." << endl;
+  bridge = new RtuBridge (serial, *driver, rf95->eventFd());
+  bridge->setRf95 (*rf95);
+
+  for (size_t i = 0; i < radio_option->count(); i++) {
+    Radio r;
+
+    r.frequency = frequency;
+    r.modem = modem;
+    if (!parseRadio (radio_option->value (i), r)) {
+      cerr << "Invalid radio " << radio_option->value (i) << ", must be cs:dio0[:frequency[:sf[:bw[:cr]]]]" << endl;
+      exit (EXIT_FAILURE);
+    }
+    if (radios.size() + 1 >= RH_RF95_EVENT_NUM_INTERRUPTS) {
+      cerr << "Too many radios, " << RH_RF95_EVENT_NUM_INTERRUPTS << " at most" << endl;
+      exit (EXIT_FAILURE);
+    }
+
+    r.rf95 = new RH_RF95Event (r.csPin, r.dio0Pin);
+    if (!r.rf95->init()) {
+      cerr << "RF95 init failed on radio " << radio_option->value (i) << " !" << endl;
+      exit (EXIT_FAILURE);
+    }
+    r.rf95->setFrequency (r.frequency);
+    if (txpower_option->is_set()) {
+      r.rf95->setTxPower (txpower_option->value());
+    }
+    r.rf95->setSpreadingFactor (r.modem.spreadingFactor);
+    r.rf95->setSignalBandwidth (r.modem.bandwidth);
+    r.rf95->setCodingRate4 (r.modem.codingRate);
+
+    // same driver stack as the first radio
+    RHGenericDriver *drv = r.rf95;
+    r.encryptDrv = nullptr;
+    if (isEncrypted) {
+      r.encryptDrv = newEncryptedDriver (*r.rf95, radios.size() + 1);
+      drv = r.encryptDrv;
+    }
+    r.compactDrv = new RHCompactDriver (*drv, RHCompactDriver::Master);
+    r.compactDrv->setCompact (compact_option->is_set());
+    r.compactDrv->setDelta (compactdelta_option->is_set());
+
+    size_t index = bridge->addRadio (*r.compactDrv, r.rf95->eventFd(), r.modem);
+    bridge->setRf95 (*r.rf95, index);
+    radios.push_back (r);
+    if (verbose_option->is_set()) {
+      std::cout << Piduino::System::progName() << ": " << "Radio " << index << " on CS " << r.csPin << ", DIO0 " << r.dio0Pin
+                << ", " << r.frequency << " MHz" << endl;
+    }
   }
-  if (isDaemon) {
 
-    Piduino::Syslog.open();
+  for (size_t i = 0; i < route_option->count(); i++) {
+    unsigned int first, last, radio;
+
+    if (!parseRoute (route_option->value (i), first, last, radio) || radio >= bridge->radios()) {
+      cerr << "Invalid route " << route_option->value (i) << ", must be first[-last]:radio with slaves between 1 and 247" << endl;
+      exit (EXIT_FAILURE);
+    }
+    for (unsigned int slave = first; slave <= last; slave++) {
+      bridge->setRoute (slave, radio);
+    }
   }
 
-}
+  for (size_t i = 0; i < group_option->count(); i++) {
+    unsigned int group;
+    vector<uint8_t> members;
 
-// Dont put this on the stack:
-uint8_t rxbuf[RH_RF95_MAX_MESSAGE_LEN];
-uint8_t txbuf[RH_RF95_MAX_MESSAGE_LEN];
+    if (!parseGroup (group_option->value (i), group, members)) {
+      cerr << "Invalid group " << group_option->value (i) << ", must be group:first[-last][,first[-last]...] with group between 248 and 255 and slaves between 1 and 247" << endl;
+      exit (EXIT_FAILURE);
+    }
+    bridge->fanOut().setGroup (group, members);
+  }
 
-void loop() {
+  bridge->setTimings (charInterval, frameInterval);
+  if (priority_option->value() < 0 || priority_option->value() > 15) {
+    cerr << "Invalid priority, must be between 0 and 15" << endl;
+    exit (EXIT_FAILURE);
+  }
+  bridge->setPriority (priority_option->value());
+  bridge->setAging (aging_option->value() * 1000UL);
+  for (size_t i = 0; i < port_option->count(); i++) {
+    string path;
+    unsigned long portBaudrate = baudrate, portChar, portFrame;
+    unsigned int priority = 0;
+
+    if (!parsePort (port_option->value (i), path, portBaudrate, priority)) {
+      cerr << "Invalid port " << port_option->value (i) << ", must be path[:baudrate[:priority]] with priority between 0 and 15" << endl;
+      exit (EXIT_FAILURE);
+    }
+    if (bridge->ports() >= Metrics::MaxPorts) {
+      cerr << "Too many serial ports, " << Metrics::MaxPorts << " at most" << endl;
+      exit (EXIT_FAILURE);
+    }
+    SerialLine *line = new SerialLine;
+    if (!line->open (path, portBaudrate)) {
 
-  txlen = 0;
+      cerr << "Unable to open " << path << endl;
+      exit (EXIT_FAILURE);
+    }
+    ports.push_back (line);
 
-  while (serial.available() > txlen) {
+    size_t index = bridge->addPort (*line, priority);
+    rtuTimings (portBaudrate, portChar, portFrame);
+    bridge->setTimings (portChar, portFrame, index);
+    if (!isQuiet) {
+      std::cout << Piduino::System::progName() << ": " << path << ", " << portBaudrate << " bd, " << portFrame
+                << "us, priority " << priority << endl;
+    }
+  }
+  bridge->setQuiet (isQuiet);
+  // the ports which are not open are ignored
+  bridge->setSerialThread (!inlineio_option->is_set());
+  if (tcp_option->is_set()) {
+    string address;
+    unsigned int port;
+
+    if (!parseTcp (tcp_option->value(), address, port) || tcpclients_option->value() < 1) {
+      cerr << "Invalid Modbus TCP server " << tcp_option->value() << ", must be [address:]port with at least 1 client" << endl;
+      exit (EXIT_FAILURE);
+    }
+    if (!bridge->listenTcp (address, port, tcpclients_option->value())) {
+      cerr << "Unable to listen on " << tcp_option->value() << endl;
+      exit (EXIT_FAILURE);
+    }
+    if (verbose_option->is_set()) {
+      std::cout << Piduino::System::progName() << ": " << "Modbus TCP on " << (address.empty() ? "*" : address) << ":" << port << endl;
+    }
+  }
+  if (capture_option->is_set()) {
 
-    txlen = serial.available();
-    delayMicroseconds (charInterval);
+    if (!capture.open (capture_option->value(), capturesize_option->value() * 1024UL)) {
+      cerr << "Unable to open the capture file " << capture_option->value() << endl;
+      exit (EXIT_FAILURE);
+    }
+    bridge->setCapture (&capture);
   }
+  if (statsfile_option->is_set() || statssocket_option->is_set()) {
 
-  if (txlen > 0) {
+    if (statsfile_option->is_set()) {
+      exporter.setFile (statsfile_option->value());
+    }
+    if (statssocket_option->is_set()) {
+      exporter.setSocket (statssocket_option->value());
+    }
+    if (statsperiod_option->value() < 1 || !exporter.start()) {
+      cerr << "Unable to export the metrics, check the period and the socket path" << endl;
+      exit (EXIT_FAILURE);
+    }
+    bridge->setMetricsExporter (&exporter, statsperiod_option->value() * 1000000UL);
+  }
+  bridge->setTimeout (timeout_option->value() * 1000UL);
+  if (inflight_option->value() < 1) {
+    cerr << "Invalid number of requests in flight, must be at least 1" << endl;
+    exit (EXIT_FAILURE);
+  }
+  bridge->setMaxInFlight (inflight_option->value());
+  if (retries_option->value() < 0 || retries_option->value() > 8) {
+    cerr << "Invalid number of retries, must be between 0 and 8" << endl;
+    exit (EXIT_FAILURE);
+  }
+  bridge->setRetries (retries_option->value(), retryguard_option->value() * 1000UL);
+  if (breaker_option->value() < 0 || breaker_option->value() > 255 || breakerprobe_option->value() < 1) {
+    cerr << "Invalid circuit breaker, the number of timeouts must be between 0 and 255 and the probe period at least 1 s" << endl;
+    exit (EXIT_FAILURE);
+  }
+  // the breaker answers with exceptions
+  bridge->setExceptions (exceptions_option->is_set() || breaker_option->value() > 0);
+  bridge->breaker().setThreshold (breaker_option->value());
+  bridge->breaker().setProbePeriod (breakerprobe_option->value() * 1000000UL);
+  bridge->setModem (modem);
+  if (dutycycle_option->value() < 0 || dutycycle_option->value() > 100) {
+    cerr << "Invalid duty cycle, must be between 0 and 100 %" << endl;
+    exit (EXIT_FAILURE);
+  }
+  bridge->setDutyCycle (dutycycle_option->value() / 100.0, dutydelay_option->value() * 1000UL);
 
-    if (serial.read (reinterpret_cast<char *> (&txbuf[0]), txlen) >= 4) {
+  bridge->cache().setTtl (cachettl_option->value() * 1000UL);
+  for (size_t i = 0; i < slavettl_option->count(); i++) {
+    unsigned int slave;
+    unsigned long ttl;
 
-      // Last two bytes = crc
-      word crc = ( (txbuf[txlen - 2] << 8) | txbuf[txlen - 1]);
+    if (!parseTtl (slavettl_option->value (i), slave, ttl) || slave < 1 || slave > 247) {
+      cerr << "Invalid slave cache TTL, must be slave:ms with slave between 1 and 247" << endl;
+      exit (EXIT_FAILURE);
+    }
+    bridge->cache().setSlaveTtl (slave, ttl * 1000UL);
+  }
+  for (size_t i = 0; i < fcttl_option->count(); i++) {
+    unsigned int fc;
+    unsigned long ttl;
 
-      // CRC Check
-      if (crc == calcCrc (txbuf[0], txbuf + 1, txlen - 3)) {
+    if (!parseTtl (fcttl_option->value (i), fc, ttl) || !ReadCache::isRead (fc)) {
+      cerr << "Invalid function code cache TTL, must be fc:ms with fc between 1 and 4" << endl;
+      exit (EXIT_FAILURE);
+    }
+    bridge->cache().setFunctionTtl (fc, ttl * 1000UL);
+  }
 
-        t0 = micros(); // we save the time of the last message for calculating the delay between the request and the response
-        driver->send (txbuf, txlen);
-      }
-      else {
+  // a slave reports with its own spreading factor, the radio listens with the
+  // one of the last slave polled and would miss the reports again and again
+  if (report_option->is_set() && adr_option->is_set()) {
+    cerr << "The reports by exception do not work with --adr" << endl;
+    exit (EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < report_option->count(); i++) {
+    unsigned int slave, fc, first, last;
 
-        cerr << "CRC Error ! > ";
-      }
+    if (!parseReport (report_option->value (i), slave, fc, first, last)) {
+      cerr << "Invalid report range " << report_option->value (i) << ", must be slave:fc:first[-last] with slave between 1 and 247 and fc between 1 and 4" << endl;
+      exit (EXIT_FAILURE);
     }
-    else {
+    bridge->image().subscribe (slave, fc, first, last - first + 1);
+  }
+  bridge->image().setMaxAge (reportage_option->value() * 1000000UL);
 
-      // message trop court
-      if (!isQuiet) {
-        std::cout << Piduino::System::progName() << ": " << "Message flushed ! > ";
-      }
+  for (size_t i = 0; i < poll_option->count(); i++) {
+    unsigned int slave, fc, first, last;
+    unsigned long period, maxAge;
+
+    if (!parsePoll (poll_option->value (i), slave, fc, first, last, period, maxAge) ||
+        !bridge->addPoll (slave, fc, first, last - first + 1, period * 1000UL, (maxAge ? maxAge : 3 * period) * 1000UL)) {
+      cerr << "Invalid poll " << poll_option->value (i) << ", must be slave:fc:first[-last]:period_ms[:max_age_ms] with slave between 1 and 247, fc between 1 and 4 and at most 120 registers or 1920 coils" << endl;
+      exit (EXIT_FAILURE);
+    }
+  }
+  if (pollreserve_option->value() < 0 || pollreserve_option->value() > 100) {
+    cerr << "Invalid poll reserve, must be between 0 and 100 %" << endl;
+    exit (EXIT_FAILURE);
+  }
+  bridge->setPollReserve (pollreserve_option->value() / 100.0);
+
+  if (coalescegap_option->value() < 0 || coalescegap_option->value() > 2000) {
+    cerr << "Invalid coalescing gap, must be between 0 and 2000" << endl;
+    exit (EXIT_FAILURE);
+  }
+  bridge->coalescer().setWindow (coalesce_option->value() * 1000UL);
+  bridge->coalescer().setMaxGap (coalescegap_option->value());
+
+  if (adr_option->is_set()) {
+
+    if (adrmargin_option->value() < 0 || adrfallback_option->value() < 1) {
+      cerr << "Invalid adaptive data rate margin or fallback" << endl;
+      exit (EXIT_FAILURE);
     }
-    // On affiche le message et on rétablit le compteur txlen
+    bridge->adapter().setEnabled (true);
+    bridge->adapter().setMargin (adrmargin_option->value());
+    bridge->adapter().setFallback (adrfallback_option->value() * 1000000UL);
     if (!isQuiet) {
-      printModbusMessage (txbuf, txlen);
-    }
-    txlen = 0;
-  }
-
-  if (driver->available()) {
-    // On a reçu une trame
-    uint8_t rxlen = sizeof (rxbuf);
-    // Should be a message for us now
-    if (driver->recv ( (uint8_t *) rxbuf, &rxlen)) {
-
-      if (rxlen >= 4) {
-        // le message est suffisament long, on l'envoie sur la liaisons série
-        serial.write (reinterpret_cast<char *> (&rxbuf[0]), rxlen);
-        unsigned long dt = micros() - t0;
-        serial.flush(); // on vide le buffer interne pour forcer l'envoi
-        // On affiche le message reçu et le temps entre émission et réception
-        if (!isQuiet) {
-          printModbusMessage (rxbuf, rxlen, false);
-          std::cout << "Reply time: " << dt / 1000UL << "ms" << endl;
-        }
-      }
+      std::cout <<  "Adaptive data rate enabled, SF" << (int) modem.spreadingFactor << " to SF"
+                << (int) LinkAdapter::modem (modem, LinkAdapter::profiles (modem) - 1).spreadingFactor << endl;
     }
   }
-}
+  if (relay_option->is_set() || relaypath_option->is_set()) {
 
-// Print modbus message on console in Hexa
-void printModbusMessage (const uint8_t *msg, uint8_t len, bool req) {
+    // a repeater would send the compact requests as responses, a slave
+    // profile is unknown to the repeaters, and a response passed on would
+    // reuse the counter of the request
+    if (compact_option->is_set() || adr_option->is_set() || (isEncrypted && isCtr)) {
+      cerr << "The relaying does not work with --compact, --adr and --aes-mode ctr" << endl;
+      exit (EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < relay_option->count(); i++) {
+      unsigned int first, last;
 
-  if (len) {
-    char str[3]; // buffer for the hexadecimal representation of the byte
-    for (uint8_t i = 0; i < len; i++) {
+      if (!parseRelay (relay_option->value (i), first, last)) {
+        cerr << "Invalid relay " << relay_option->value (i) << ", must be first[-last] with slaves between 1 and 247" << endl;
+        exit (EXIT_FAILURE);
+      }
+      for (unsigned int slave = first; slave <= last; slave++) {
+        bridge->routes().setDiscovery (slave, true);
+      }
+    }
+    for (size_t i = 0; i < relaypath_option->count(); i++) {
+      unsigned int slave;
+      vector<uint8_t> path;
+
+      if (!parseRelayPath (relaypath_option->value (i), slave, path) ||
+          !bridge->routes().setPath (slave, path.data(), path.size())) {
+        cerr << "Invalid relay path " << relaypath_option->value (i) << ", must be slave:repeater[,repeater...] with at most "
+             << (int) ModbusRelay::MaxHops << " repeaters between 1 and 247, other than the slave" << endl;
+        exit (EXIT_FAILURE);
+      }
+    }
+    bridge->setRelayDelay (relaydelay_option->value() * 1000UL);
+  }
+  if (verbose_option->is_set()) {
 
-      sprintf (str, "%02X", msg[i]); // str store the string with the hexadecimal representation of the byte
-      std::cout << (req ? '[' : '<') << str << (req ? ']' : '>');
+    // a read request is 8 bytes long
+    std::cout << Piduino::System::progName() << ": " << "SF" << (int) modem.spreadingFactor << ", "
+              << modem.bandwidth << " Hz, CR 4/" << (int) modem.codingRate << ", "
+              << modem.messageTimeOnAir (8) / 1000UL << "ms on air for a read request" << endl;
+    if (bridge->dutyCycle().isEnabled()) {
+      std::cout << Piduino::System::progName() << ": " << "Duty cycle " << dutycycle_option->value() << "%, "
+                << bridge->dutyCycle().budget() / 1000UL << "ms of airtime per hour" << endl;
     }
-    std::cout <<  endl;
   }
-}
+  // sig_handler() intercepte le CTRL+C
+  if (signalFd < 0 || !bridge->watch (signalFd, onSignal) || !bridge->begin()) {
+    cerr << "Unable to start the event loop !" << endl;
+    exit (EXIT_FAILURE);
+  }
 
-/* Table of CRC values for highorder byte */
-const byte _auchCRCHi[] = {
-  0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-  0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-  0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
-  0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-  0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81,
-  0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-  0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
-  0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-  0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-  0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-  0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
-  0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-  0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-  0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-  0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
-  0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-  0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
-  0x40
-};
+  // rf95->printRegisters (Console);
+  if (!isQuiet) {
+    std::cout << "Waiting for incoming messages...." << endl;
+  }
+  if (isDaemon) {
 
-/* Table of CRC values for loworder byte */
-const byte _auchCRCLo[] = {
-  0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
-  0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
-  0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD,
-  0x1D, 0x1C, 0xDC, 0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
-  0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32, 0x36, 0xF6, 0xF7,
-  0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D, 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A,
-  0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE,
-  0x2E, 0x2F, 0xEF, 0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
-  0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1, 0x63, 0xA3, 0xA2,
-  0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F,
-  0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB,
-  0x7B, 0x7A, 0xBA, 0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
-  0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0, 0x50, 0x90, 0x91,
-  0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
-  0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88,
-  0x48, 0x49, 0x89, 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
-  0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80,
-  0x40
-};
+    Piduino::Syslog.open();
+  }
 
-// return the CRC of the message
-// address: 1st byte of the message
-// pduFrame: pointer to the message
-// pduLen: length of the message
-// CRC is calculated on the address and the PDU frame
-// CRC is 2 bytes long, high byte first
-word calcCrc (byte address, byte *pduFrame, byte pduLen) {
-  byte CRCHi = 0xFF, CRCLo = 0x0FF, Index;
+}
 
-  Index = CRCHi ^ address;
-  CRCHi = CRCLo ^ _auchCRCHi[Index];
-  CRCLo = _auchCRCLo[Index];
+void loop() {
 
-  while (pduLen--) {
-    Index = CRCHi ^ *pduFrame++;
-    CRCHi = CRCLo ^ _auchCRCHi[Index];
-    CRCLo = _auchCRCLo[Index];
-  }
+  // sleeps until the serial port, the radio or a timer needs us
+  bridge->poll();
+}
 
-  return (CRCHi << 8) | CRCLo;
+// -----------------------------------------------------------------------------
+void
+onSignal() {
+  struct signalfd_siginfo si;
+
+  if (read (signalFd, &si, sizeof (si)) == sizeof (si)) {
+    sig_handler (si.ssi_signo);
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -460,8 +793,107 @@ sig_handler (int sig) {
 
   if (rf95) {
 
+    if (bridge) {
+      // the lines still in the log ring are written before ours
+      bridge->logger().stop();
+      if (bridge->logger().overflows() > 0) {
+
+        cerr << endl << "log: " << bridge->logger().overflows() << " lines lost, console too slow";
+      }
+    }
+    if (bridge && bridge->cache().isEnabled() && !isQuiet) {
+      const ReadCache & cache = bridge->cache();
+
+      cout << endl << "cache: " << cache.hits() << " hits, " << cache.misses() << " misses, "
+           << cache.invalidations() << " invalidations";
+    }
+    if (bridge && bridge->image().isEnabled() && !isQuiet) {
+      const RegisterImage & image = bridge->image();
+
+      cout << endl << "image: " << image.reports() << " reports, " << image.gaps() << " lost, "
+           << image.hits() << " hits, " << image.misses() << " misses";
+    }
+    if (bridge && bridge->poller().isEnabled() && !isQuiet) {
+      const ShadowPoller & poller = bridge->poller();
+
+      cout << endl << "poller: " << poller.polls() << " reads, " << poller.failures() << " failed, "
+           << poller.deferred() << " deferred, " << bridge->image().stale() << " stale answers";
+    }
+    if (bridge && bridge->coalescer().isEnabled() && !isQuiet) {
+
+      cout << endl << "coalescer: " << bridge->coalescer().merged() << " requests merged";
+    }
+    if (bridge && bridge->transactions().retries() > 0 && !isQuiet) {
+      unsigned long resent = 0, recovered = 0;
+
+      for (size_t i = 0; i < bridge->radios(); i++) {
+        resent += bridge->transactions (i).resent();
+        recovered += bridge->transactions (i).recovered();
+      }
+      cout << endl << "retries: " << resent << " requests sent again, " << recovered << " recovered";
+    }
+    if (bridge && bridge->breaker().isEnabled() && !isQuiet) {
+      const CircuitBreaker & breaker = bridge->breaker();
+
+      cout << endl << "breaker: " << breaker.opened() << " opened, " << breaker.closed() << " closed, "
+           << breaker.probes() << " probes";
+    }
+    if (bridge && bridge->fanOut().isEnabled() && !isQuiet) {
+      const FanOut & fanOut = bridge->fanOut();
+
+      cout << endl << "groups: " << fanOut.writes() << " writes, " << fanOut.complete() << " complete, "
+           << fanOut.partial() << " partial";
+    }
+    if (bridge && bridge->tcpServer() && !isQuiet) {
+      const ModbusTcpServer & tcp = *bridge->tcpServer();
+
+      cout << endl << "tcp: " << tcp.connections() << " connections, " << tcp.received() << " requests, "
+           << tcp.sent() << " responses, " << tcp.forgotten() << " forgotten, " << tcp.errors() << " errors";
+    }
+    if (bridge && bridge->ports() > 1 && !isQuiet) {
+      const Metrics & m = bridge->metrics();
+
+      for (size_t i = 0; i < bridge->ports(); i++) {
+        const Metrics::Port & port = m.port (i);
+
+        cout << endl << "port " << i << ": " << port.requests << " requests, " << port.dropped << " dropped, wait p50 "
+             << port.wait.percentile (0.5) / 1000UL << "ms, p99 " << port.wait.percentile (0.99) / 1000UL
+             << "ms, max depth " << port.maxDepth;
+      }
+    }
+    if (bridge && bridge->routes().isEnabled() && !isQuiet) {
+      const RouteCache & routes = bridge->routes();
+
+      cout << endl << "relay: " << routes.discoveries() << " discoveries, " << routes.learned() << " routes learned, "
+           << routes.failed() << " failed, " << routes.lost() << " lost";
+    }
+    if (bridge && bridge->adapter().isEnabled() && !isQuiet) {
+      const LinkAdapter & adapter = bridge->adapter();
+
+      cout << endl << "adr: " << adapter.promotions() << " promotions, " << adapter.demotions() << " demotions, "
+           << adapter.fallbacks() << " fallbacks";
+    }
+    delete bridge; // Delete the bridge before the drivers it uses
+    bridge = nullptr;
+    for (auto p : ports) {
+      delete p;
+    }
+    ports.clear();
+    capture.close();
+    exporter.stop();
     SPI.end(); // Stop the SPI bus
+    if (RHPcf8574Pin *pcfLed = dynamic_cast<RHPcf8574Pin *> (led)) {
+      pcfLed->stop(); // its thread uses the I2C bus
+    }
     Wire.end(); // Stop the I2C bus
+    delete compactDrv; // Delete the compact driver
+    compactDrv = nullptr;
+    for (auto & r : radios) {
+      delete r.compactDrv;
+      delete r.rf95;
+      delete r.encryptDrv;
+    }
+    radios.clear();
     delete rf95; // Delete the RF95 driver
     rf95 = nullptr; //  Pointer on the RF95 driver
     delete encryptDrv; // Delete the encrypted driver
@@ -473,4 +905,284 @@ sig_handler (int sig) {
   }
   cout << endl << "Have a nice day !" << endl;
   exit (EXIT_SUCCESS);
-}
\ No newline at end of file
+}
+// -----------------------------------------------------------------------------
+RHGenericDriver *
+newEncryptedDriver (RHGenericDriver & radio, size_t index) {
+
+  if (!isCtr) {
+    return new RHEncryptedDriver (radio, cipher);
+  }
+
+  // the counter starts at a random value, a restart must not reuse the
+  // nonces of the previous run with the same key
+  std::random_device rd;
+  RHCtrEncryptedDriver *drv = new RHCtrEncryptedDriver (radio, cipher, RHCtrEncryptedDriver::Master, RH_CTR_MASTER_NODE + index);
+  drv->setCounter (rd());
+  return drv;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseTtl (const string & str, unsigned int & key, unsigned long & ttl) {
+  char *end;
+
+  key = strtoul (str.c_str(), &end, 0);
+  if (end == str.c_str() || *end != ':') {
+    return false;
+  }
+
+  const char *p = end + 1;
+  ttl = strtoul (p, &end, 10);
+  return end != p && *end == '\0';
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseRadio (const string & str, Radio & radio) {
+  vector<string> fields;
+  size_t begin = 0, end;
+
+  do {
+    end = str.find (':', begin);
+    fields.push_back (str.substr (begin, end == string::npos ? string::npos : end - begin));
+    begin = end + 1;
+  }
+  while (end != string::npos);
+
+  if (fields.size() < 2 || fields.size() > 6) {
+    return false;
+  }
+
+  try {
+    radio.csPin = stoi (fields[0]);
+    radio.dio0Pin = stoi (fields[1]);
+    if (fields.size() > 2) {
+      radio.frequency = stof (fields[2]);
+    }
+    if (fields.size() > 3) {
+      radio.modem.spreadingFactor = stoi (fields[3]);
+    }
+    if (fields.size() > 4) {
+      radio.modem.bandwidth = LoraModem::supportedBandwidth (stol (fields[4]));
+    }
+    if (fields.size() > 5) {
+      radio.modem.codingRate = stoi (fields[5]);
+    }
+  }
+  catch (const std::exception &) {
+    return false;
+  }
+  return radio.modem.spreadingFactor >= 6 && radio.modem.spreadingFactor <= 12 &&
+         radio.modem.codingRate >= 5 && radio.modem.codingRate <= 8;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseRoute (const string & str, unsigned int & first, unsigned int & last, unsigned int & radio) {
+  char *end;
+
+  first = last = strtoul (str.c_str(), &end, 10);
+  if (*end == '-') {
+    last = strtoul (end + 1, &end, 10);
+  }
+  if (*end != ':') {
+    return false;
+  }
+
+  const char *p = end + 1;
+  radio = strtoul (p, &end, 10);
+  return end != p && *end == '\0' && first >= 1 && first <= last && last <= 247;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseGroup (const string & str, unsigned int & group, vector<uint8_t> & members) {
+  char *end;
+
+  group = strtoul (str.c_str(), &end, 10);
+  if (*end != ':' || group < 248 || group > 255) {
+    return false;
+  }
+
+  members.clear();
+  do {
+    const char *p = end + 1;
+    unsigned int first, last;
+
+    first = last = strtoul (p, &end, 10);
+    if (end == p) {
+      return false;
+    }
+    if (*end == '-') {
+      last = strtoul (end + 1, &end, 10);
+    }
+    if (first < 1 || first > last || last > 247) {
+      return false;
+    }
+    for (unsigned int slave = first; slave <= last; slave++) {
+      members.push_back (slave);
+    }
+  }
+  while (*end == ',');
+  return *end == '\0';
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseRelay (const string & str, unsigned int & first, unsigned int & last) {
+  const char *p = str.c_str();
+  char *end;
+
+  first = last = strtoul (p, &end, 10);
+  if (end == p) {
+    return false;
+  }
+  if (*end == '-') {
+    last = strtoul (end + 1, &end, 10);
+  }
+  return *end == '\0' && first >= 1 && first <= last && last <= 247;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseRelayPath (const string & str, unsigned int & slave, vector<uint8_t> & path) {
+  char *end;
+
+  slave = strtoul (str.c_str(), &end, 10);
+  if (*end != ':' || slave < 1 || slave > 247) {
+    return false;
+  }
+
+  path.clear();
+  do {
+    const char *p = end + 1;
+    unsigned int repeater = strtoul (p, &end, 10);
+
+    if (end == p || repeater < 1 || repeater > 247) {
+      return false;
+    }
+    path.push_back (repeater);
+  }
+  while (*end == ',');
+  return *end == '\0';
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseReport (const string & str, unsigned int & slave, unsigned int & fc, unsigned int & first, unsigned int & last) {
+  const char *p = str.c_str();
+  char *end;
+
+  slave = strtoul (p, &end, 10);
+  if (end == p || *end != ':') {
+    return false;
+  }
+  p = end + 1;
+  fc = strtoul (p, &end, 10);
+  if (end == p || *end != ':') {
+    return false;
+  }
+  p = end + 1;
+  first = last = strtoul (p, &end, 10);
+  if (end == p) {
+    return false;
+  }
+  if (*end == '-') {
+    last = strtoul (end + 1, &end, 10);
+  }
+  return *end == '\0' && slave >= 1 && slave <= 247 && ReadCache::isRead (fc) &&
+         first <= last && last <= 0xFFFF;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parsePoll (const string & str, unsigned int & slave, unsigned int & fc, unsigned int & first, unsigned int & last,
+           unsigned long & period, unsigned long & maxAge) {
+  size_t colon = str.find (':');
+
+  // slave:fc:first[-last] then the times
+  colon = colon == string::npos ? colon : str.find (':', colon + 1);
+  colon = colon == string::npos ? colon : str.find (':', colon + 1);
+  if (colon == string::npos || !parseReport (str.substr (0, colon), slave, fc, first, last)) {
+    return false;
+  }
+
+  const char *p = str.c_str() + colon + 1;
+  char *end;
+
+  period = strtoul (p, &end, 10);
+  maxAge = 0;
+  if (end == p) {
+    return false;
+  }
+  if (*end == ':') {
+    p = end + 1;
+    maxAge = strtoul (p, &end, 10);
+    if (end == p) {
+      return false;
+    }
+  }
+  return *end == '\0' && period > 0;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parseTcp (const string & str, string & address, unsigned int & port) {
+  size_t colon = str.rfind (':');
+  string p = colon == string::npos ? str : str.substr (colon + 1);
+  char *end;
+
+  address = colon == string::npos ? "" : str.substr (0, colon);
+  port = strtoul (p.c_str(), &end, 10);
+  return !p.empty() && *end == '\0' && port >= 1 && port <= 65535;
+}
+
+// -----------------------------------------------------------------------------
+bool
+parsePort (const string & str, string & path, unsigned long & baudrate, unsigned int & priority) {
+  size_t colon = str.find (':');
+  char *end;
+
+  path = str.substr (0, colon);
+  if (path.empty()) {
+    return false;
+  }
+  if (colon == string::npos) {
+    return true;
+  }
+
+  const char *p = str.c_str() + colon + 1;
+  baudrate = strtoul (p, &end, 10);
+  if (end == p || baudrate == 0) {
+    return false;
+  }
+  if (*end == ':') {
+
+    p = end + 1;
+    priority = strtoul (p, &end, 10);
+    if (end == p || priority > 15) {
+      return false;
+    }
+  }
+  return *end == '\0';
+}
+
+// -----------------------------------------------------------------------------
+// The silence between two frames must be at least 3.5T and the time between
+// two characters must be less than 1.5T
+void
+rtuTimings (unsigned long baudrate, unsigned long & charInterval, unsigned long & frameInterval) {
+
+  if (baudrate > 19200UL) {
+    // if baudrate > 19200, we use a delay of 750us between two characters
+    // and 1750us between two frames
+    charInterval = 750;
+    frameInterval = 1750;
+  }
+  else {
+
+    charInterval = 16500000UL / baudrate; // 1T * 1.5 = T1.5, 1T = 11 bits
+    frameInterval = 38500000UL / baudrate; // 1T * 3.5 = T3.5, 1T = 11 bits
+  }
+}
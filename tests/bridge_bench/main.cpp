@@ -0,0 +1,1238 @@
+// Bridge benchmark
+
+// Runs the bridge against a pty pair (the Modbus master side is the pty
+// master) and a simulated radio, then reports:
+// - the CPU usage of the bridge while idle and under load
+// - the latency between the end of a request on the serial line and its
+//   transmission on the radio (serial -> air), the latency between the reply
+//   available on the radio and its reception by the master (air -> serial)
+//   and the round trip seen by the master
+
+// bridge_bench [-b baudrate] [-n frames] [-D slave_delay_us] [-i idle_seconds] [-P pipeline] [-C window_us] [-R radios]
+//              [-T] [-V] [-W capture] [-s sf [-w bandwidth] [-r coding_rate]] [-L loss_percent] [-S slaves] [-A]
+//              [-Y retries] [-J] [-U [-E] [-B failures]] [-G] [-F in_flight] [-M clients] [-K depth [-Q]] [-X period_ms]
+//              [-O period_ms] [-H hops] [-I] [-Z]
+//              [--sweep] [--legacy]
+// -P sends that number of requests in one write(), as a pipelining master
+// would, the bridge must split them
+// -C merges the pipelined reads in one radio frame, the replies are checked
+// -R simulates that number of radios, the pipelined requests go to slaves
+// routed to each radio in turn
+// -s simulates the time on air of the frames with these modem settings, the
+// radio is busy during the transmissions like a RFM95
+// -L loses this percentage of the requests and of the answers on the air, the
+// requests without answer are counted as lost, not as errors
+// -S sends the requests to that number of slaves in turn, at distances from
+// near (-80 dBm) to 3 dB above the sensitivity of the modem set by -s
+// -A enables the adaptive data rate, the simulated slaves follow it
+// -Y the bridge sends again a request without response that many times, the
+// timeout of the bridge and of the master is lengthened for the attempts
+// -J one answer in 10 comes late: after the answer to the first retry with
+// -Y, just after the timeout of the bridge otherwise (with -E), when the next
+// request to the slave may already be on the air, it must not receive the
+// late answer
+// -U the last slave does not answer during the first half of the requests,
+// its requests are counted as lost, or as exceptions with -E
+// -E the bridge answers with an exception when a slave does not
+// -B opens the circuit breaker of a slave after that many timeouts, its
+// requests are answered at once until a probe succeeds (implies -E)
+// -G writes a register of all the slaves (-S) at once through a group, the
+// bridge sends the copies back to back and answers once all have answered
+// -F sets the number of requests in flight of the bridge
+// -M the requests come from that number of Modbus TCP clients on localhost
+// instead of the serial line, each one polls its slave (one per radio or
+// per -S slave) with -P requests at a time
+// -K a bulk master on a second serial port keeps that many reads to the slave
+// queued, in the priority class 1, the round trip of the master measures how
+// long it waits behind them
+// -Q the bulk master has the priority of the master (class 0)
+// -X the slaves report by exception: each one sends an integrity report of
+// its registers 0 to 67 every period, the bridge answers the reads from its
+// image, only the reads of a slave whose image is unknown go on the air
+// -O the bridge reads the registers 0 to 7 of each slave every period in
+// the background, the reads of the master are answered from the mirror
+// -H the slaves are out of range of the bridge, behind that number of
+// repeaters in line, the bridge discovers their route and wraps the requests
+// -I the slaves have no register at the addresses 4 and 5 modulo 6, the
+// pipelined reads are 2 registers apart: merged with -C, they get the
+// exception 0x02 and must be sent again alone
+// -Z each burst of the master reads 4 registers, writes the second one and
+// reads them again, the first read must return the value before the write,
+// the second one the value written (with -C, the reads are held to be merged)
+// --sweep runs -n requests for each baud rate (9600 to 115200) and modem
+// setting (SF7 and SF9, 125 and 500 kHz) and prints one line each
+// --legacy measures the previous busy polling loop instead of the event loop
+
+// This example code is in the public domain.
+#include <Piduino.h>  // All the magic is here ;-)
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "RtuBridge.h"
+#include "ModbusCrc.h"
+#include "ModbusReport.h"
+#include "RHRelayDriver.h"
+#include "RHSimDriver.h"
+
+using namespace std;
+
+const uint8_t SlaveId = 10;
+const uint8_t GroupId = 250; // all the slaves, -G
+std::atomic<bool> stopBridge (false);
+std::atomic<int> deadSlave (-1); // does not answer
+const uint16_t ReportRange = 68; // registers reported by the slaves, -X
+const uint16_t PollRange = 8;    // registers read in the background, within the timeout of the bench, -O
+const unsigned long RelayDelay = 2000; // time a repeater takes to pass a frame on, -H
+std::atomic<bool> holes (false); // the registers 4 and 5 modulo 6 do not exist, -I
+std::map<uint32_t, uint16_t> written; // (slave << 16) | address -> value written, by the bridge thread only
+
+// Value of a register of a simulated slave, its address until written
+uint16_t registerValue (uint8_t slave, uint16_t address) {
+  auto it = written.find ( ( (uint32_t) slave << 16) | address);
+
+  return it == written.end() ? address : it->second;
+}
+
+// Simulated slaves SlaveId, SlaveId + 1..., one per radio, the repeaters
+// of -H are below SlaveId
+// They answer to read holding registers (0x03), value = address until
+// written, store write single register (0x06) and echo it and diagnostics
+// (0x08)
+uint8_t slaveResponder (const uint8_t *req, uint8_t len, uint8_t *resp) {
+
+  if (len < 6 || req[0] < SlaveId || req[0] == deadSlave) {
+    return 0;
+  }
+  if (req[1] == 0x08 || (req[1] == 0x06 && len == 8)) {
+
+    if (req[1] == 0x06) {
+      written[ ( (uint32_t) req[0] << 16) | (req[2] << 8) | req[3]] = (req[4] << 8) | req[5];
+    }
+    memcpy (resp, req, len);
+    return len;
+  }
+  if (len != 8 || req[1] != 0x03) {
+    return 0;
+  }
+  uint16_t start = (req[2] << 8) | req[3];
+  uint16_t qty = (req[4] << 8) | req[5];
+  uint8_t rlen = 3;
+
+  resp[0] = req[0];
+  resp[1] = req[1];
+  for (uint16_t i = 0; holes && i < qty; i++) {
+
+    if ( (start + i) % 6 >= 4) {
+      // illegal data address
+      resp[1] |= 0x80;
+      resp[2] = 0x02;
+      rlen = 3;
+      qty = 0;
+    }
+  }
+  if (qty > 0) {
+    resp[2] = qty * 2;
+  }
+  for (uint16_t i = 0; i < qty; i++) {
+    uint16_t value = registerValue (req[0], start + i);
+
+    resp[rlen++] = value >> 8;
+    resp[rlen++] = value & 0xFF;
+  }
+  uint16_t crc = calcCrc (resp[0], resp + 1, rlen - 1);
+  resp[rlen++] = crc >> 8;
+  resp[rlen++] = crc & 0xFF;
+  return rlen;
+}
+
+// Checks the replies of the master: one frame of 4 registers for each
+// request, valid CRC and value = address. With several radios, the replies
+// of different slaves may come in any order, those of a slave in order.
+bool checkReplies (const uint8_t *req, const uint8_t *resp, int count) {
+
+  for (int j = 0; j < count; j++) {
+    const uint8_t *r = &resp[j * 13];
+    const uint8_t *q = nullptr;
+    int n = 0; // previous replies of this slave
+
+    for (int k = 0; k < j; k++) {
+      n += resp[k * 13] == r[0];
+    }
+    for (int k = 0; k < count && !q; k++) {
+      if (req[k * 8] == r[0] && n-- == 0) {
+        q = &req[k * 8];
+      }
+    }
+    if (!q) {
+      return false;
+    }
+    uint16_t start = (q[2] << 8) | q[3];
+
+    if (r[1] != 0x03 || r[2] != 8 || ModbusCrc::compute (r, 13) != 0) {
+      return false;
+    }
+    for (int i = 0; i < 4; i++) {
+      if ( ( (r[3 + i * 2] << 8) | r[4 + i * 2]) != start + i) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Checks a reply of 4 registers from start, the second one is second
+bool checkRead (const uint8_t *resp, uint8_t slave, uint16_t start, uint16_t second) {
+
+  if (resp[0] != slave || resp[1] != 0x03 || resp[2] != 8 || ModbusCrc::compute (resp, 13) != 0) {
+    return false;
+  }
+  for (int i = 0; i < 4; i++) {
+    if ( ( (resp[3 + i * 2] << 8) | resp[4 + i * 2]) != (i == 1 ? second : start + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Previous bridge loop, polls the serial port and the radio
+void legacyLoop (SerialLine & serial, RHGenericDriver & driver, unsigned long charInterval) {
+  uint8_t buf[RH_RF95_MAX_MESSAGE_LEN];
+
+  while (!stopBridge) {
+    int avail = 0, txlen = 0;
+
+    ioctl (serial.fd(), FIONREAD, &avail);
+    while (avail > txlen) {
+
+      txlen = avail;
+      usleep (charInterval);
+      ioctl (serial.fd(), FIONREAD, &avail);
+    }
+    if (txlen > 0) {
+      ssize_t n = serial.read (buf, txlen);
+
+      if (n >= 4 && ( (buf[n - 2] << 8) | buf[n - 1]) == calcCrc (buf[0], buf + 1, n - 3)) {
+        driver.send (buf, n);
+      }
+    }
+    if (driver.available()) {
+      uint8_t len = sizeof (buf);
+
+      if (driver.recv (buf, &len)) {
+        serial.write (buf, len);
+      }
+    }
+  }
+}
+
+double threadCpuSeconds (pthread_t thread) {
+  clockid_t cid;
+  struct timespec ts;
+
+  pthread_getcpuclockid (thread, &cid);
+  clock_gettime (cid, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void printPercentiles (const char *name, vector<unsigned long> & v) {
+
+  if (v.empty()) {
+    return;
+  }
+  sort (v.begin(), v.end());
+  cout << name << " (us): p50 " << v[v.size() / 2] << ", p90 " << v[v.size() * 9 / 10]
+       << ", p99 " << v[v.size() * 99 / 100] << ", max " << v.back() << endl;
+}
+
+// Settings of a run
+struct Config {
+  unsigned long baudrate = 38400;
+  int frames = 1000;
+  unsigned long slaveDelay = 5000;
+  int idle = 2;
+  int pipeline = 1;
+  unsigned long coalesce = 0;
+  int radios = 1;
+  bool serialThread = false;
+  bool verbose = false;
+  std::string capture;
+  bool legacy = false;
+  bool airtime = false; // simulates the time on air with modem
+  LoraModem modem;
+  double loss = 0;      // probability that a request or an answer is lost
+  int slaves = 1;       // slaves at different distances on the radio 0
+  bool adr = false;     // adaptive data rate
+  int retries = 0;      // by the bridge
+  bool late = false;    // one answer in 10 comes late
+  bool unreachable = false; // the last slave does not answer during the first half
+  bool exceptions = false;
+  int breaker = 0;      // timeouts which open the circuit breaker
+  bool group = false;   // writes to all the slaves through a group
+  int inFlight = 1;
+  int tcpClients = 0;   // Modbus TCP clients instead of the serial master
+  int bulk = 0;         // reads kept queued by the bulk master
+  bool samePriority = false;
+  unsigned long report = 0; // period of the integrity reports of the slaves in us
+  unsigned long poll = 0;   // period of the background reads of the bridge in us
+  int hops = 0;             // repeaters between the bridge and the slaves
+  bool holes = false;       // registers missing between the pipelined reads
+  bool ordering = false;    // bursts of read, write, read of the same registers
+};
+
+// Measurements of a run
+struct Result {
+  double idleCpu = 0;
+  double loadCpu = 0;   // seconds
+  double elapsed = 0;   // seconds
+  unsigned long ok = 0; // requests answered
+  unsigned long errors = 0;
+  unsigned long lost = 0;
+  unsigned long exceptions = 0; // replied by the bridge for the dead slave
+  unsigned long radioFrames = 0;
+  vector<unsigned long> toAir, toSerial, roundTrip;
+  vector<unsigned long> exceptionTrip; // round trip of the exceptions
+  unsigned long bulkOk = 0;     // responses received by the bulk master
+  unsigned long bulkErrors = 0;
+};
+
+// Modbus TCP client of -M, sends requests requests to its slave, pipeline
+// at a time with their own transaction ids, and checks the responses
+void tcpClient (uint16_t port, int index, int requests, int pipeline, uint8_t slave, int wait,
+                Result & res, std::mutex & lock) {
+  Result r;
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  int on = 1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (fd < 0 || connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+
+    std::lock_guard<std::mutex> guard (lock);
+    res.errors += requests;
+    return;
+  }
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on));
+
+  for (int i = 0; i < requests; i += pipeline) {
+    int n = min (pipeline, requests - i);
+    uint8_t req[12 * 8];
+    uint8_t resp[17 * 8];
+    size_t len = 0;
+
+    for (int j = 0; j < n; j++) {
+      uint8_t *q = &req[j * 12];
+      uint16_t tid = (index << 12) | ( (i + j) & 0xFFF);
+
+      // MBAP header then read 4 holding registers from tid & 0x7F
+      uint8_t h[12] = { (uint8_t) (tid >> 8), (uint8_t) tid, 0, 0, 0, 6, slave, 0x03, 0, (uint8_t) (tid & 0x7F), 0, 4 };
+      memcpy (q, h, sizeof (h));
+    }
+    unsigned long tw = micros();
+    if (write (fd, req, 12 * n) != 12 * n) {
+      r.errors += n;
+      break;
+    }
+    while (len < 17U * n) {
+      struct pollfd pfd = { fd, POLLIN, 0 };
+
+      if (poll (&pfd, 1, wait) <= 0) {
+        break;
+      }
+      ssize_t k = read (fd, resp + len, sizeof (resp) - len);
+      if (k <= 0) {
+        break;
+      }
+      len += k;
+    }
+    unsigned long tr = micros();
+    if (len != 17U * n) {
+      r.errors += n;
+      continue;
+    }
+
+    // the responses of a slave come in order
+    bool ok = true;
+    for (int j = 0; j < n && ok; j++) {
+      const uint8_t *p = &resp[j * 17];
+      uint16_t start = req[j * 12 + 9];
+
+      ok = p[0] == req[j * 12] && p[1] == req[j * 12 + 1] && p[2] == 0 && p[3] == 0 && p[4] == 0 && p[5] == 11 &&
+           p[6] == slave && p[7] == 0x03 && p[8] == 8;
+      for (int k = 0; k < 4 && ok; k++) {
+        ok = ( (p[9 + k * 2] << 8) | p[10 + k * 2]) == start + k;
+      }
+    }
+    if (!ok) {
+      r.errors += n;
+      continue;
+    }
+    r.roundTrip.push_back (tr - tw);
+  }
+  close (fd);
+
+  std::lock_guard<std::mutex> guard (lock);
+  res.errors += r.errors;
+  res.roundTrip.insert (res.roundTrip.end(), r.roundTrip.begin(), r.roundTrip.end());
+}
+
+// Bulk master of -K on the pty fd, keeps depth reads of 4 registers to the
+// slave pending, one more each time a response comes, until stop
+void bulkMaster (int fd, int depth, std::atomic<bool> & stop, Result & res) {
+  uint8_t resp[RH_RF95_MAX_MESSAGE_LEN];
+  size_t len = 0;
+  int next = 0;
+
+  auto send = [&] (int n) {
+    uint8_t req[8 * 32];
+
+    for (int j = 0; j < n; j++, next++) {
+      uint8_t *r = &req[j * 8];
+      uint16_t crc;
+
+      r[0] = SlaveId;
+      r[1] = 0x03;
+      r[2] = 0;
+      r[3] = 0x80 | (next & 0x7F);
+      r[4] = 0;
+      r[5] = 4;
+      crc = calcCrc (r[0], r + 1, 5);
+      r[6] = crc >> 8;
+      r[7] = crc & 0xFF;
+    }
+    return write (fd, req, 8 * n) == 8 * n;
+  };
+
+  if (!send (depth)) {
+    res.bulkErrors += depth;
+    return;
+  }
+  while (!stop) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    if (poll (&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    ssize_t n = read (fd, resp + len, sizeof (resp) - len);
+    if (n <= 0) {
+      continue;
+    }
+    len += n;
+
+    // the responses are 13 bytes long, they come in order
+    int done = 0;
+    while (len >= 13) {
+
+      if (resp[0] == SlaveId && resp[1] == 0x03 && resp[2] == 8 && ModbusCrc::compute (resp, 13) == 0) {
+        res.bulkOk++;
+      }
+      else {
+        res.bulkErrors++;
+      }
+      memmove (resp, resp + 13, len - 13);
+      len -= 13;
+      done++;
+    }
+    if (done > 0 && !send (done)) {
+      res.bulkErrors += done;
+    }
+  }
+}
+
+// Runs the bridge with the simulated radios and the scripted master
+bool runBench (const Config & c, Result & res, bool print) {
+  int frames = c.frames;
+  int pipeline = c.ordering ? 3 : max (1, min (c.pipeline, 8));
+  unsigned long baudrate = c.baudrate;
+  unsigned long slaveDelay = c.slaveDelay;
+  unsigned long charInterval = baudrate > 19200UL ? 750 : 16500000UL / baudrate;
+  unsigned long frameInterval = baudrate > 19200UL ? 1750 : 38500000UL / baudrate;
+
+  stopBridge = false;
+  holes = c.holes;
+  written.clear();
+  // pty pair, the bridge opens the slave side like a serial port
+  int master = posix_openpt (O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt (master) < 0 || unlockpt (master) < 0) {
+    cerr << "Unable to create a pty pair !" << endl;
+    return false;
+  }
+  SerialLine serial;
+  if (!serial.open (ptsname (master), baudrate)) {
+    cerr << "Unable to open " << ptsname (master) << endl;
+    close (master);
+    return false;
+  }
+
+  int nRadios = max (1, min (c.radios, 8));
+  vector<unique_ptr<RHSimDriver>> sims;
+  for (int k = 0; k < nRadios; k++) {
+    sims.push_back (unique_ptr<RHSimDriver> (new RHSimDriver));
+    sims.back()->init();
+    sims.back()->setResponder (slaveResponder, slaveDelay);
+    if (c.airtime) {
+      sims.back()->setModem (c.modem);
+    }
+    if (c.loss > 0) {
+      sims.back()->setLoss (c.loss, c.loss, k + 1);
+    }
+  }
+
+  int nSlaves = max (1, min (c.slaves, 200));
+  if (c.report > 0) {
+    int targets = max (nSlaves, nRadios);
+
+    // each radio reports its slaves in turn, value = address
+    for (int k = 0; k < nRadios; k++) {
+      vector<uint8_t> slaves;
+      for (int i = k; i < targets; i += nRadios) {
+        slaves.push_back (SlaveId + i);
+      }
+      auto next = make_shared<size_t> (0);
+      auto sequences = make_shared<vector<uint8_t>> (slaves.size(), 0);
+
+      sims[k]->setReporter ([slaves, next, sequences] (uint8_t *frame) -> uint8_t {
+        size_t i = (*next)++ % slaves.size();
+        uint8_t data[ReportRange * 2];
+
+        for (uint16_t a = 0; a < ReportRange; a++) {
+          data[a * 2] = a >> 8;
+          data[a * 2 + 1] = a & 0xFF;
+        }
+        return ModbusReport::encode (slaves[i], (*sequences)[i]++, true, 0x03, 0, ReportRange,
+                                     data, frame, RH_RF95_MAX_MESSAGE_LEN);
+      }, c.report / slaves.size());
+    }
+  }
+  RHSimDriver & radio = *sims[0];
+  // frames sent on all the radios, time of the last one
+  auto sent = [&]() {
+    unsigned long n = 0;
+    for (auto & r : sims) {
+      n += r->sent();
+    }
+    return n;
+  };
+  auto lastSend = [&]() {
+    unsigned long t = radio.lastSend();
+    for (auto & r : sims) {
+      if ( (long) (r->lastSend() - t) > 0) {
+        t = r->lastSend();
+      }
+    }
+    return t;
+  };
+  auto lastReady = [&]() {
+    unsigned long t = radio.lastReady();
+    for (auto & r : sims) {
+      if ( (long) (r->lastReady() - t) > 0) {
+        t = r->lastReady();
+      }
+    }
+    return t;
+  };
+
+  // time of a request and its answer (4 registers) on a radio
+  unsigned long exchange = slaveDelay;
+  if (c.airtime) {
+    exchange += c.modem.messageTimeOnAir (8) + c.modem.messageTimeOnAir (13);
+  }
+  // passed on by each repeater, wrapped with the path
+  for (int h = 0; h < c.hops; h++) {
+    exchange += 2 * RelayDelay;
+    if (c.airtime) {
+      exchange += c.modem.messageTimeOnAir (ModbusRelay::wrappedLength (8, c.hops)) +
+                  c.modem.messageTimeOnAir (ModbusRelay::wrappedLength (13, c.hops));
+    }
+  }
+
+  RtuBridge bridge (serial, radio, radio.eventFd());
+  for (int k = 1; k < nRadios; k++) {
+    bridge.setRoute (SlaveId + k, bridge.addRadio (*sims[k], sims[k]->eventFd(), c.modem));
+  }
+
+  // the farthest slave is 3 dB above the sensitivity
+  for (int i = 1; i < nSlaves; i++) {
+    int rssi = -80 + (int) ( (c.modem.sensitivity() + 3 + 80) * i / (nSlaves - 1));
+
+    for (auto & r : sims) {
+      r->setSlaveRssi (SlaveId + i, rssi);
+    }
+  }
+  if (c.adr) {
+
+    bridge.adapter().setEnabled (true);
+    for (int k = 0; k < nRadios; k++) {
+      RHSimDriver *sim = sims[k].get();
+
+      sim->setAdaptive (c.modem.spreadingFactor, bridge.adapter().fallback());
+      bridge.setModemHandler ([sim] (const LoraModem & m) { sim->setModem (m); }, k);
+    }
+  }
+  if (c.hops > 0) {
+
+    // the bridge, the repeaters 1 to hops in line, then the slaves
+    for (int h = 1; h <= c.hops; h++) {
+      radio.addLink (h - 1, h);
+    }
+    for (int i = 0; i < nSlaves; i++) {
+      radio.addLink (c.hops, SlaveId + i);
+      bridge.routes().setDiscovery (SlaveId + i, true);
+    }
+    radio.setRelayDelay (RelayDelay);
+    bridge.setRelayDelay (RelayDelay);
+  }
+  if (c.group) {
+    vector<uint8_t> members;
+
+    for (int i = 0; i < nSlaves; i++) {
+      members.push_back (SlaveId + i);
+    }
+    bridge.fanOut().setGroup (GroupId, members);
+  }
+  bridge.setMaxInFlight (max (1, c.inFlight));
+  bridge.setModem (c.modem);
+  bridge.setTimings (charInterval, frameInterval);
+  // the waits double at each attempt
+  unsigned long timeout = (exchange + 100000UL) << (c.retries > 0 ? c.retries + 1 : 0);
+  bridge.setTimeout (timeout);
+  // a slave lost on the air is discovered again soon
+  bridge.routes().setHoldTime (timeout);
+  bridge.setRetries (c.retries, 50000UL);
+  for (auto & r : sims) {
+
+    // between the retry and the expected round trip after it, or after the deadline
+    if (c.late) {
+      r->setLate (0.1, c.retries > 0 ? exchange + 50000UL + exchange / 2 : timeout);
+    }
+  }
+  bridge.setExceptions (c.exceptions || c.breaker > 0);
+  bridge.breaker().setThreshold (c.breaker);
+  bridge.breaker().setProbePeriod (500000UL);
+  bridge.setQuiet (!c.verbose);
+  bridge.setSerialThread (c.serialThread);
+  int devnull = open ("/dev/null", O_WRONLY);
+  bridge.logger().setOutput (devnull, devnull);
+  CaptureRing capture;
+  if (!c.capture.empty()) {
+
+    if (!capture.open (c.capture, 1024 * 1024)) {
+      cerr << "Unable to open " << c.capture << endl;
+      return false;
+    }
+    bridge.setCapture (&capture);
+  }
+  bridge.coalescer().setWindow (c.coalesce);
+  if (c.report > 0) {
+
+    for (int i = 0; i < max (nSlaves, nRadios); i++) {
+      bridge.image().subscribe (SlaveId + i, 0x03, 0, ReportRange);
+    }
+    // two reports lost in a row
+    bridge.image().setMaxAge (c.report * 5 / 2);
+  }
+  for (int i = 0; c.poll > 0 && i < max (nSlaves, nRadios); i++) {
+
+    bridge.addPoll (SlaveId + i, 0x03, 0, PollRange, c.poll, 3 * c.poll);
+  }
+
+  // second pty pair for the bulk master
+  int bulk = -1;
+  SerialLine bulkSerial;
+  if (c.bulk > 0) {
+
+    bulk = posix_openpt (O_RDWR | O_NOCTTY);
+    if (bulk < 0 || grantpt (bulk) < 0 || unlockpt (bulk) < 0 || !bulkSerial.open (ptsname (bulk), baudrate)) {
+      cerr << "Unable to create the pty pair of the bulk master !" << endl;
+      return false;
+    }
+    size_t port = bridge.addPort (bulkSerial, c.samePriority ? 0 : 1);
+    bridge.setTimings (charInterval, frameInterval, port);
+  }
+  if (c.tcpClients > 0 && !bridge.listenTcp ("127.0.0.1", 0)) {
+    cerr << "Unable to listen on localhost !" << endl;
+    return false;
+  }
+  if (!bridge.begin()) {
+    cerr << "Unable to start the bridge !" << endl;
+    return false;
+  }
+
+  std::thread bridgeThread ([&]() {
+    if (c.legacy) {
+      legacyLoop (serial, radio, charInterval);
+    }
+    else {
+      while (!stopBridge) {
+        bridge.poll (100);
+      }
+    }
+  });
+
+  if (print) {
+    cout << (c.legacy ? "legacy loop" : "event loop") << ", " << nRadios << " radio(s), " << nSlaves << " slave(s), " << baudrate
+         << " bd, slave delay " << slaveDelay << "us, " << frames << " requests"
+         << (c.serialThread ? ", serial thread" : "") << (c.verbose ? ", verbose" : "")
+         << (c.capture.empty() ? "" : ", capture") << (c.adr ? ", adaptive data rate" : "") << endl;
+    if (c.tcpClients > 0) {
+      cout << c.tcpClients << " Modbus TCP clients on port " << bridge.tcpServer()->port() << ", pipeline " << pipeline << endl;
+    }
+    if (c.bulk > 0) {
+      cout << "bulk master on a second port, " << c.bulk << " reads queued, priority class " << (c.samePriority ? 0 : 1) << endl;
+    }
+    if (c.report > 0) {
+      cout << "slaves report by exception, integrity every " << c.report / 1000UL << "ms" << endl;
+    }
+    if (c.poll > 0) {
+      cout << "background reads every " << c.poll / 1000UL << "ms, mirror" << endl;
+    }
+    if (c.group) {
+      cout << "writes to group " << (int) GroupId << ", " << c.inFlight << " in flight" << endl;
+    }
+    if (c.retries > 0) {
+      cout << c.retries << " retries, timeout " << timeout / 1000UL << "ms" << endl;
+    }
+    if (c.late) {
+      cout << "one answer in 10 late" << endl;
+    }
+    if (c.holes) {
+      cout << "registers missing between the reads" << endl;
+    }
+    if (c.ordering) {
+      cout << "bursts of read, write, read" << endl;
+    }
+    if (c.hops > 0) {
+      cout << "slaves behind " << c.hops << " repeaters, route discovery" << endl;
+    }
+    if (c.unreachable) {
+      cout << "slave " << SlaveId + nSlaves - 1 << " unreachable during " << frames / 2 << " requests"
+           << (c.exceptions || c.breaker > 0 ? ", exceptions" : "");
+      if (c.breaker > 0) {
+        cout << ", circuit breaker after " << c.breaker << " timeouts";
+      }
+      cout << endl;
+    }
+    if (c.airtime) {
+      cout << "SF" << (int) c.modem.spreadingFactor << ", " << c.modem.bandwidth << " Hz, CR 4/" << (int) c.modem.codingRate
+           << ", " << c.modem.messageTimeOnAir (8) << "us request on air, " << c.loss * 100.0 << "% loss" << endl;
+    }
+  }
+
+  // Idle CPU usage
+  double cpu0;
+  unsigned long t0;
+  if (c.idle > 0) {
+    cpu0 = threadCpuSeconds (bridgeThread.native_handle());
+    t0 = micros();
+    sleep (c.idle);
+    res.idleCpu = (threadCpuSeconds (bridgeThread.native_handle()) - cpu0) / ( (micros() - t0) / 1e6);
+    if (print) {
+      cout << "idle CPU: " << res.idleCpu * 100.0 << "%" << endl;
+    }
+  }
+
+  if (c.report > 0 || c.poll > 0) {
+    // every slave has reported or been read once
+    usleep (max (c.report, c.poll) + exchange * max (nSlaves, nRadios));
+  }
+
+  // Load
+  // the master waits for all the answers of its requests, one radio after the other at worst
+  int wait = ( (c.group ? nSlaves : pipeline) * timeout) / 1000UL + 500;
+  if (c.hops > 0) {
+    // the discovery of a route goes first, through all the repeaters at worst
+    wait += (c.group ? nSlaves : 1) * (timeout + ModbusRelay::MaxHops * (2 * exchange + RH_RELAY_JITTER * 1000UL)) / 1000UL;
+  }
+  res.radioFrames = sent();
+  cpu0 = threadCpuSeconds (bridgeThread.native_handle());
+  t0 = micros();
+  std::atomic<bool> stopBulk (false);
+  std::thread bulkThread;
+  if (c.bulk > 0) {
+
+    bulkThread = std::thread (bulkMaster, bulk, c.bulk, std::ref (stopBulk), std::ref (res));
+    usleep (100000); // the queue of the bulk master is full
+  }
+  if (c.tcpClients > 0) {
+    vector<std::thread> clients;
+    std::mutex lock;
+    int targets = max (nSlaves, nRadios);
+
+    for (int k = 0; k < c.tcpClients; k++) {
+      int requests = frames / c.tcpClients + (k < frames % c.tcpClients);
+
+      clients.push_back (std::thread (tcpClient, bridge.tcpServer()->port(), k, requests, pipeline,
+                                      SlaveId + k % targets, wait * c.tcpClients, std::ref (res), std::ref (lock)));
+    }
+    for (auto & t : clients) {
+      t.join();
+    }
+  }
+  // the serial master is idle with -M
+  std::map<uint16_t, uint16_t> model; // registers written by the bursts of -Z
+  for (int i = 0; c.tcpClients == 0 && i < frames; i += pipeline) {
+    uint8_t req[8 * 8];
+    uint8_t resp[RH_RF95_MAX_MESSAGE_LEN * 8];
+    size_t rlen = (5 + 2 * 4) * pipeline;
+    size_t len = 0;
+
+    deadSlave = c.unreachable && i < frames / 2 ? SlaveId + nSlaves - 1 : -1;
+
+    for (int j = 0; j < pipeline; j++) {
+      uint8_t *r = &req[j * 8];
+      uint16_t crc;
+
+      r[0] = SlaveId + (nSlaves > 1 ? (i + j) % nSlaves : j % nRadios);
+      r[1] = 0x03;
+      r[2] = 0;
+      r[3] = (i + j) & (c.poll > 0 ? PollRange - 4 : c.report > 0 ? 0x3F : 0x7F);
+      r[4] = 0;
+      r[5] = 4;
+      if (c.group) {
+        // setpoint i to all the slaves
+        r[0] = GroupId;
+        r[1] = 0x06;
+        r[4] = i >> 8;
+        r[5] = i & 0xFF;
+        rlen = 8;
+      }
+      if (c.holes) {
+        r[3] = ( (i + j) % 21) * 6;
+      }
+      if (c.ordering) {
+        // read, write of the second register, read again
+        r[3] = i & 0x7C;
+        if (j == 1) {
+          r[1] = 0x06;
+          r[3]++;
+          r[4] = 0x80 | (i >> 8);
+          r[5] = i & 0xFF;
+        }
+        rlen = 13 + 8 + 13;
+      }
+      crc = calcCrc (r[0], r + 1, 5);
+      r[6] = crc >> 8;
+      r[7] = crc & 0xFF;
+    }
+    // the bridge answers for the dead slave with an exception
+    bool dead = pipeline == 1 && req[0] == deadSlave;
+    if (dead && (c.exceptions || c.breaker > 0)) {
+      rlen = 5;
+    }
+    unsigned long sent0 = sent();
+    unsigned long tw = micros();
+    if (write (master, req, 8 * pipeline) != 8 * pipeline) {
+      res.errors++;
+      continue;
+    }
+
+    while (len < rlen) {
+      struct pollfd pfd = { master, POLLIN, 0 };
+
+      if (poll (&pfd, 1, wait) <= 0) {
+        break;
+      }
+      ssize_t n = read (master, resp + len, sizeof (resp) - len);
+      if (n > 0) {
+        len += n;
+      }
+      if (pipeline == 1 && len == 5 && (resp[1] & 0x80)) {
+        break; // an exception of the bridge
+      }
+    }
+    unsigned long tr = micros();
+
+    if (c.group) {
+      // the echo of the request, or 0x0B if a member has not answered
+      if (len == 8 && memcmp (resp, req, 8) == 0 &&
+          (sent() == sent0 + nSlaves || c.retries > 0 || c.breaker > 0 || c.hops > 0)) {
+
+        res.roundTrip.push_back (tr - tw);
+      }
+      else if (len == 5 && resp[0] == GroupId && resp[1] == 0x86 && resp[2] == 0x0B &&
+               ModbusCrc::compute (resp, 5) == 0 && (c.loss > 0 || c.unreachable)) {
+        res.lost++;
+      }
+      else {
+        res.errors++;
+      }
+      usleep (frameInterval);
+      continue;
+    }
+    if (c.ordering) {
+      uint16_t start = req[3];
+      uint16_t value = (req[12] << 8) | req[13];
+      uint16_t before = model.count (start + 1) ? model[start + 1] : start + 1;
+
+      if (len == rlen && checkRead (resp, SlaveId, start, before) && memcmp (&resp[13], &req[8], 8) == 0 &&
+          checkRead (&resp[21], SlaveId, start, value)) {
+
+        res.roundTrip.push_back (tr - tw);
+      }
+      else {
+        res.errors++;
+      }
+      model[start + 1] = value;
+      usleep (frameInterval);
+      continue;
+    }
+    if (dead && len == 5 && rlen == 5) {
+
+      if (resp[0] != req[0] || resp[1] != 0x83 || resp[2] != 0x0B || ModbusCrc::compute (resp, 5) != 0) {
+        res.errors++;
+      }
+      else {
+
+        res.exceptions++;
+        res.exceptionTrip.push_back (tr - tw);
+      }
+      usleep (frameInterval);
+      continue;
+    }
+    if (c.late && len == 5 && resp[0] == req[0] && resp[1] == 0x83 && resp[2] == 0x0B &&
+        ModbusCrc::compute (resp, 5) == 0) {
+      // the answer comes after the deadline
+      res.lost++;
+      usleep (frameInterval);
+      continue;
+    }
+    if (len < rlen && (c.loss > 0 || dead || c.late)) {
+      // answers lost on the air, the bridge has timed out
+      res.lost++;
+      usleep (frameInterval);
+      continue;
+    }
+    bool imaged = c.report > 0 || c.poll > 0;
+    if (len != rlen || (sent() == sent0 && !imaged) ||
+        (!bridge.coalescer().isEnabled() && sent() != sent0 + pipeline && c.retries == 0 && c.breaker == 0 &&
+         c.bulk == 0 && c.hops == 0 && !imaged) ||
+        !checkReplies (req, resp, pipeline)) {
+      res.errors++;
+      continue;
+    }
+    if (sent() != sent0 && c.poll == 0) {
+      // answered from the image otherwise
+      res.toAir.push_back (lastSend() - tw);
+      res.toSerial.push_back (tr - lastReady());
+    }
+    res.roundTrip.push_back (tr - tw);
+    usleep (frameInterval); // silence between two requests
+  }
+  if (c.bulk > 0) {
+
+    stopBulk = true;
+    bulkThread.join();
+  }
+  res.elapsed = (micros() - t0) / 1e6;
+  res.radioFrames = sent() - res.radioFrames;
+  res.loadCpu = threadCpuSeconds (bridgeThread.native_handle()) - cpu0;
+  res.ok = c.tcpClients > 0 ? frames - res.errors : res.roundTrip.size() * (c.group ? 1 : pipeline);
+
+  stopBridge = true;
+  bridgeThread.join();
+
+  if (print) {
+    cout << "radio frames: " << res.radioFrames << ", " << bridge.coalescer().merged() << " requests merged" << endl;
+    cout << "load CPU: " << res.loadCpu * 100.0 / res.elapsed << "%, " << res.loadCpu * 1e6 / max (frames, 1) << "us per request" << endl;
+    cout << "requests: " << res.ok << " ok, " << res.errors << " errors, ";
+    if (c.loss > 0 || c.unreachable || c.late) {
+      cout << res.lost << " lost, ";
+    }
+    if (res.exceptions > 0) {
+      cout << res.exceptions << " exceptions, ";
+    }
+    cout << res.ok / res.elapsed << " req/s" << endl;
+    if (!c.legacy) {
+      const RtuFramer & framer = bridge.framer();
+      const Metrics & m = bridge.metrics();
+
+      cout << "framer: " << framer.frames() << " frames, " << framer.splits() << " splits, "
+           << framer.crcErrors() << " CRC errors, " << framer.gapErrors() << " T1.5 errors" << endl;
+      bridge.logger().stop();
+      cout << "log: " << bridge.logger().overflows() << " lines lost";
+      if (bridge.serialReader()) {
+        cout << ", serial thread: " << bridge.serialReader()->stalls() << " stalls";
+      }
+      cout << endl;
+      if (c.retries > 0 || c.late) {
+        unsigned long resent = 0, recovered = 0, late = 0;
+
+        for (int k = 0; k < nRadios; k++) {
+          resent += bridge.transactions (k).resent();
+          recovered += bridge.transactions (k).recovered();
+          late += bridge.transactions (k).late();
+        }
+        cout << "retries: " << resent << " requests sent again, " << recovered << " recovered, "
+             << late << " late responses" << endl;
+      }
+      if (c.tcpClients > 0) {
+        const ModbusTcpServer & tcp = *bridge.tcpServer();
+
+        cout << "tcp: " << tcp.connections() << " connections, " << tcp.received() << " requests, " << tcp.sent()
+             << " responses, " << tcp.forgotten() << " forgotten, " << tcp.errors() << " errors" << endl;
+      }
+      if (c.bulk > 0) {
+
+        cout << "bulk: " << res.bulkOk << " responses, " << res.bulkErrors << " errors, " << res.bulkOk / res.elapsed << " req/s" << endl;
+        for (size_t k = 0; k < bridge.ports(); k++) {
+          const Metrics::Port & p = m.port (k);
+
+          cout << "port " << k << ": " << p.requests << " requests, " << p.dropped << " dropped, wait p50 "
+               << p.wait.percentile (0.5) << "us, p99 " << p.wait.percentile (0.99) << "us, max depth " << p.maxDepth << endl;
+        }
+      }
+      if (c.report > 0) {
+        const RegisterImage & image = bridge.image();
+        unsigned long reported = 0;
+
+        for (auto & r : sims) {
+          reported += r->reported();
+        }
+        cout << "image: " << reported << " reports sent, " << image.reports() << " applied, " << image.gaps() << " lost, "
+             << image.hits() << " hits, " << image.misses() << " misses" << endl;
+      }
+      if (c.poll > 0) {
+        const ShadowPoller & p = bridge.poller();
+
+        cout << "poller: " << p.polls() << " reads, " << p.failures() << " failed, " << p.deferred() << " deferred, "
+             << bridge.image().hits() << " hits, " << bridge.image().stale() << " stale" << endl;
+      }
+      if (c.group) {
+        const FanOut & f = bridge.fanOut();
+
+        cout << "groups: " << f.writes() << " writes, " << f.complete() << " complete, " << f.partial() << " partial, "
+             << f.inProgress() << " in progress" << endl;
+      }
+      if (c.hops > 0) {
+        const RouteCache & routes = bridge.routes();
+
+        cout << "relay: " << routes.discoveries() << " discoveries, " << routes.learned() << " routes learned, "
+             << routes.failed() << " failed, " << routes.lost() << " lost, hops";
+        for (int i = 0; i < nSlaves; i++) {
+          cout << " " << (int) routes.hops (SlaveId + i);
+        }
+        cout << endl;
+      }
+      if (c.breaker > 0) {
+        const CircuitBreaker & b = bridge.breaker();
+
+        cout << "breaker: " << b.opened() << " opened, " << b.closed() << " closed, " << b.probes() << " probes" << endl;
+      }
+      if (c.adr) {
+        const LinkAdapter & a = bridge.adapter();
+
+        cout << "adr: " << a.promotions() << " promotions, " << a.demotions() << " demotions, "
+             << a.fallbacks() << " fallbacks, SF";
+        for (int i = 0; i < nSlaves; i++) {
+          cout << " " << (int) m.slave (SlaveId + i).spreadingFactor;
+        }
+        cout << endl;
+      }
+      cout << "bridge latency (us): p50 " << m.latency().percentile (0.5) << ", p99 " << m.latency().percentile (0.99)
+           << ", serial -> air p50 " << m.serialToAir().percentile (0.5) << ", p99 " << m.serialToAir().percentile (0.99)
+           << ", air -> serial p50 " << m.airToSerial().percentile (0.5) << ", p99 " << m.airToSerial().percentile (0.99) << endl;
+    }
+    printPercentiles ("serial -> air", res.toAir);
+    printPercentiles ("air -> serial", res.toSerial);
+    printPercentiles ("round trip", res.roundTrip);
+    printPercentiles ("exception round trip", res.exceptionTrip);
+  }
+  close (devnull);
+  close (master);
+  if (bulk >= 0) {
+    close (bulk);
+  }
+  return true;
+}
+
+// One line of the sweep table
+void printRow (const Config & c, Result & r) {
+  char modem[32];
+  vector<unsigned long> & rt = r.roundTrip;
+
+  sort (rt.begin(), rt.end());
+  snprintf (modem, sizeof (modem), "SF%d/%lukHz", c.modem.spreadingFactor, c.modem.bandwidth / 1000);
+  printf ("%7lu %-12s %9.2f %10.1f %10.1f %9.1f %6lu %6lu\n", c.baudrate, modem, r.ok / r.elapsed,
+          rt.empty() ? 0.0 : rt[rt.size() / 2] / 1000.0, rt.empty() ? 0.0 : rt[rt.size() * 99 / 100] / 1000.0,
+          r.loadCpu * 1e6 / max (c.frames, 1), r.lost, r.errors);
+  fflush (stdout);
+}
+
+void setup() {
+  Piduino::OptionParser &op = CmdLine;
+  auto baudrate_option = op.add<Piduino::Value<unsigned long>> ("b", "baudrate", "sets serial baudrate", 38400);
+  auto frames_option = op.add<Piduino::Value<int>> ("n", "frames", "number of requests", 1000);
+  auto delay_option = op.add<Piduino::Value<unsigned long>> ("D", "slave-delay", "simulated reply delay in us", 5000);
+  auto idle_option = op.add<Piduino::Value<int>> ("i", "idle", "idle measurement duration in seconds", 2);
+  auto pipeline_option = op.add<Piduino::Value<int>> ("P", "pipeline", "requests sent back to back", 1);
+  auto coalesce_option = op.add<Piduino::Value<unsigned long>> ("C", "coalesce", "coalescing window in us (0 disables it)", 0);
+  auto radios_option = op.add<Piduino::Value<int>> ("R", "radios", "number of simulated radios", 1);
+  auto thread_option = op.add<Piduino::Switch> ("T", "serial-thread", "reads the serial port in a dedicated thread");
+  auto verbose_option = op.add<Piduino::Switch> ("V", "verbose", "logs the frames like the bridge does, to /dev/null");
+  auto capture_option = op.add<Piduino::Value<std::string>> ("W", "capture", "records the traffic in a capture ring file");
+  auto sf_option = op.add<Piduino::Value<int>> ("s", "spreading-factor", "simulates the time on air with this spreading factor (6..12)");
+  auto bw_option = op.add<Piduino::Value<int>> ("w", "bandwidth", "bandwidth in Hz of the time on air", 125000);
+  auto cr_option = op.add<Piduino::Value<int>> ("r", "coding-rate", "coding rate denominator (5..8) of the time on air", 5);
+  auto loss_option = op.add<Piduino::Value<double>> ("L", "loss", "percentage of the requests and of the answers lost on the air", 0);
+  auto slaves_option = op.add<Piduino::Value<int>> ("S", "slaves", "number of slaves polled in turn, from near to far", 1);
+  auto adr_option = op.add<Piduino::Switch> ("A", "adr", "enables the adaptive data rate");
+  auto retries_option = op.add<Piduino::Value<int>> ("Y", "retries", "number of times the bridge sends again a request without response", 0);
+  auto late_option = op.add<Piduino::Switch> ("J", "late", "one answer in 10 comes after the first retry, or after the timeout of the bridge");
+  auto unreachable_option = op.add<Piduino::Switch> ("U", "unreachable", "the last slave does not answer during the first half of the requests");
+  auto exceptions_option = op.add<Piduino::Switch> ("E", "exceptions", "the bridge answers with an exception when a slave does not");
+  auto breaker_option = op.add<Piduino::Value<int>> ("B", "breaker", "timeouts which open the circuit breaker of a slave (0 disables it)", 0);
+  auto group_option = op.add<Piduino::Switch> ("G", "group", "writes a register of all the slaves at once through a group");
+  auto inflight_option = op.add<Piduino::Value<int>> ("F", "in-flight", "number of requests in flight of the bridge", 1);
+  auto tcp_option = op.add<Piduino::Value<int>> ("M", "tcp-clients", "number of Modbus TCP clients instead of the serial master", 0);
+  auto bulk_option = op.add<Piduino::Value<int>> ("K", "bulk", "reads kept queued by a bulk master on a second serial port, priority class 1", 0);
+  auto same_option = op.add<Piduino::Switch> ("Q", "same-priority", "the bulk master has the priority of the master");
+  auto report_option = op.add<Piduino::Value<unsigned long>> ("X", "report", "the slaves report by exception, integrity report period in ms (0 disables it)", 0);
+  auto poll_option = op.add<Piduino::Value<unsigned long>> ("O", "poll", "the bridge reads the slaves in the background, period in ms (0 disables it)", 0);
+  auto hops_option = op.add<Piduino::Value<int>> ("H", "hops", "the slaves are behind that number of repeaters (0 direct)", 0);
+  auto holes_option = op.add<Piduino::Switch> ("I", "holes", "the pipelined reads are 2 registers apart, the slaves have none in between");
+  auto ordering_option = op.add<Piduino::Switch> ("Z", "ordering", "bursts of read, write, read of the same registers");
+  auto sweep_option = op.add<Piduino::Switch> ("", "sweep", "runs the baud rates and modem settings matrix, one line each");
+  auto legacy_option = op.add<Piduino::Switch> ("", "legacy", "measure the previous busy polling loop");
+  op.parse (argc, argv);
+
+  Config c;
+  c.baudrate = baudrate_option->value();
+  c.frames = frames_option->value();
+  c.slaveDelay = delay_option->value();
+  c.idle = idle_option->value();
+  c.pipeline = pipeline_option->value();
+  c.coalesce = coalesce_option->value();
+  c.radios = radios_option->value();
+  c.serialThread = thread_option->is_set();
+  c.verbose = verbose_option->is_set();
+  c.capture = capture_option->is_set() ? capture_option->value() : "";
+  c.legacy = legacy_option->is_set();
+  c.airtime = sf_option->is_set();
+  if (c.airtime) {
+    c.modem.spreadingFactor = sf_option->value();
+  }
+  c.modem.bandwidth = LoraModem::supportedBandwidth (bw_option->value());
+  c.modem.codingRate = cr_option->value();
+  c.loss = loss_option->value() / 100.0;
+  c.slaves = slaves_option->value();
+  c.adr = adr_option->is_set();
+  c.retries = retries_option->value();
+  c.late = late_option->is_set();
+  c.unreachable = unreachable_option->is_set();
+  c.exceptions = exceptions_option->is_set();
+  c.breaker = breaker_option->value();
+  c.group = group_option->is_set();
+  c.inFlight = inflight_option->value();
+  c.tcpClients = tcp_option->value();
+  c.bulk = bulk_option->value();
+  c.samePriority = same_option->is_set();
+  c.report = report_option->value() * 1000UL;
+  c.poll = poll_option->value() * 1000UL;
+  c.hops = hops_option->value();
+  c.holes = holes_option->is_set();
+  c.ordering = ordering_option->is_set();
+  if (c.modem.spreadingFactor < 6 || c.modem.spreadingFactor > 12 || c.modem.codingRate < 5 ||
+      c.modem.codingRate > 8 || c.loss < 0 || c.loss > 1 || c.retries < 0 || c.retries > 4) {
+    cerr << "Invalid spreading factor, coding rate, loss or retries" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.late && (c.pipeline > 1 || c.group || c.tcpClients > 0 || c.bulk > 0 || c.hops > 0 || c.legacy)) {
+    cerr << "-J needs no pipeline, without -G, -M, -K, -H and the legacy loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.unreachable && (c.pipeline > 1 || c.slaves < 2)) {
+    cerr << "-U needs at least 2 slaves (-S) and no pipeline" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.group && (c.pipeline > 1 || c.slaves < 2 || c.legacy)) {
+    cerr << "-G needs at least 2 slaves (-S), no pipeline and the event loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.tcpClients > 0 && (c.group || c.unreachable || c.loss > 0 || c.legacy || c.tcpClients > 16)) {
+    cerr << "-M accepts 1 to 16 clients, without -G, -U, -L and the legacy loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.bulk > 0 && (c.bulk > 16 || c.pipeline > 1 || c.group || c.tcpClients > 0 || c.legacy || c.loss > 0 || c.unreachable)) {
+    cerr << "-K accepts 1 to 16 reads, without -P, -G, -M, -L, -U and the legacy loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.hops < 0 || c.hops > ModbusRelay::MaxHops ||
+      (c.hops > 0 && (c.radios > 1 || c.adr || c.report > 0 || c.legacy))) {
+    cerr << "-H accepts 0 to " << (int) ModbusRelay::MaxHops << " repeaters, without -R, -A, -X and the legacy loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.holes && (c.pipeline < 2 || c.coalesce == 0 || c.group || c.tcpClients > 0 || c.bulk > 0 || c.report > 0 ||
+                  c.poll > 0 || c.ordering || c.legacy)) {
+    cerr << "-I needs -P and -C, without -G, -M, -K, -X, -O, -Z and the legacy loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.ordering && (c.pipeline > 1 || c.radios > 1 || c.slaves > 1 || c.loss > 0 || c.group || c.tcpClients > 0 ||
+                     c.bulk > 0 || c.report > 0 || c.poll > 0 || c.late || c.legacy)) {
+    cerr << "-Z needs one radio and one slave, without -P, -L, -G, -M, -K, -X, -O, -J and the legacy loop" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.adr && c.report > 0) {
+    cerr << "The adaptive data rate does not work with -X" << endl;
+    exit (EXIT_FAILURE);
+  }
+  if (c.adr && !c.airtime) {
+    cerr << "The adaptive data rate needs the time on air, -s must be set" << endl;
+    exit (EXIT_FAILURE);
+  }
+
+  if (sweep_option->is_set()) {
+    const unsigned long bauds[] = { 9600, 19200, 38400, 115200 };
+    const int sfs[] = { 7, 9 };
+    const long bws[] = { 125000, 500000 };
+    bool failed = false;
+
+    c.idle = 0;
+    c.airtime = true;
+    printf ("%d requests per line, pipeline %d, slave delay %luus, %.1f%% loss\n",
+            c.frames, c.pipeline, c.slaveDelay, c.loss * 100.0);
+    printf ("   baud modem            req/s  p50 rt ms  p99 rt ms us/req CPU   lost errors\n");
+    for (unsigned long baud : bauds) {
+      for (int sf : sfs) {
+        for (long bw : bws) {
+          Result r;
+
+          c.baudrate = baud;
+          c.modem.spreadingFactor = sf;
+          c.modem.bandwidth = bw;
+          if (!runBench (c, r, false)) {
+            exit (EXIT_FAILURE);
+          }
+          printRow (c, r);
+          failed = failed || r.errors;
+        }
+      }
+    }
+    exit (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  Result r;
+  if (!runBench (c, r, true)) {
+    exit (EXIT_FAILURE);
+  }
+  exit (r.errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+void loop() {
+}
@@ -0,0 +1,165 @@
+// AES-128 backends: known answer tests and micro-benchmark
+
+// 1. checks every AesCipher backend supported by the CPU against the FIPS-197
+//    vector and against the table backend on random keys and blocks
+// 2. measures the encryption and decryption of frames of 16 to 240 bytes
+//    (ECB block after block, as RHEncryptedDriver does) and the throughput,
+//    AES128 of the Crypto library is measured too for comparison
+
+// cipher_bench [iterations]
+// Returns EXIT_FAILURE if a backend gives a wrong result.
+
+// This example code is in the public domain.
+#include <AES.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include "AesCipher.h"
+
+using namespace std;
+
+const AesCipher::Backend Backends[] = {
+  AesCipher::Table, AesCipher::AesNi, AesCipher::ArmCrypto
+};
+
+int checkBackends (mt19937 & rng) {
+  // FIPS-197 appendix C.1
+  const uint8_t key[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+  };
+  const uint8_t plain[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+  };
+  const uint8_t cipher[16] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+  };
+  int errors = 0;
+
+  for (AesCipher::Backend b : Backends) {
+    AesCipher aes;
+    uint8_t out[16];
+
+    if (!aes.setBackend (b)) {
+      continue;
+    }
+    aes.setKey (key, sizeof (key));
+    aes.encryptBlock (out, plain);
+    if (memcmp (out, cipher, 16) != 0) {
+      cerr << AesCipher::backendName (b) << ": FIPS-197 encryption failed" << endl;
+      errors++;
+    }
+    aes.decryptBlock (out, cipher);
+    if (memcmp (out, plain, 16) != 0) {
+      cerr << AesCipher::backendName (b) << ": FIPS-197 decryption failed" << endl;
+      errors++;
+    }
+  }
+
+  for (int n = 0; n < 2000; n++) {
+    uint8_t k[16], in[16], ref[16], out[16];
+    AesCipher table (AesCipher::Table);
+
+    for (int i = 0; i < 16; i++) {
+      k[i] = rng();
+      in[i] = rng();
+    }
+    table.setKey (k, sizeof (k));
+    table.encryptBlock (ref, in);
+
+    for (AesCipher::Backend b : Backends) {
+      AesCipher aes;
+
+      if (!aes.setBackend (b)) {
+        continue;
+      }
+      aes.setKey (k, sizeof (k));
+      aes.encryptBlock (out, in);
+      if (memcmp (out, ref, 16) != 0) {
+        cerr << AesCipher::backendName (b) << ": differs from the table backend" << endl;
+        errors++;
+        break;
+      }
+      aes.decryptBlock (out, ref);
+      if (memcmp (out, in, 16) != 0) {
+        cerr << AesCipher::backendName (b) << ": decryption does not give the plaintext back" << endl;
+        errors++;
+        break;
+      }
+    }
+  }
+  return errors;
+}
+
+// ns per frame of size bytes, encryption then decryption of each block
+double measure (BlockCipher & c, uint8_t *frame, size_t size, long iterations) {
+  auto t0 = chrono::steady_clock::now();
+
+  for (long n = 0; n < iterations; n++) {
+    frame[0] = n; // prevents the compiler from hoisting the computation
+    for (size_t i = 0; i < size; i += 16) {
+      c.encryptBlock (frame + i, frame + i);
+    }
+    for (size_t i = 0; i < size; i += 16) {
+      c.decryptBlock (frame + i, frame + i);
+    }
+  }
+  return chrono::duration<double, nano> (chrono::steady_clock::now() - t0).count() / iterations;
+}
+
+void printRow (const char *name, BlockCipher & c, uint8_t *frame, const size_t *sizes, size_t count, long iterations) {
+  double ns = 0;
+
+  cout << setw (12) << name;
+  for (size_t i = 0; i < count; i++) {
+    ns = measure (c, frame, sizes[i], iterations);
+    cout << setw (9) << fixed << setprecision (1) << ns;
+  }
+  // throughput from the largest frame, both directions
+  cout << setw (11) << fixed << setprecision (1) << (2 * sizes[count - 1] * 1e3 / ns) << endl;
+}
+
+int main (int argc, char **argv) {
+  mt19937 rng (42);
+  long iterations = argc > 1 ? atol (argv[1]) : 200000;
+  const size_t sizes[] = { 16, 32, 64, 128, 240 };
+  const size_t count = sizeof (sizes) / sizeof (sizes[0]);
+  uint8_t key[16];
+  uint8_t frame[240];
+
+  int errors = checkBackends (rng);
+  cout << "known answer tests: " << (errors ? "FAILED" : "ok") << endl;
+  cout << "best backend: " << AesCipher::backendName (AesCipher::bestBackend()) << endl << endl;
+
+  for (size_t i = 0; i < sizeof (key); i++) {
+    key[i] = rng();
+  }
+  for (size_t i = 0; i < sizeof (frame); i++) {
+    frame[i] = rng();
+  }
+
+  cout << setw (12) << "ns/frame";
+  for (size_t size : sizes) {
+    cout << setw (9) << size;
+  }
+  cout << setw (11) << "MB/s" << endl;
+
+  for (AesCipher::Backend b : Backends) {
+    AesCipher aes;
+
+    if (!aes.setBackend (b)) {
+      cout << setw (12) << AesCipher::backendName (b) << "  not supported" << endl;
+      continue;
+    }
+    aes.setKey (key, sizeof (key));
+    printRow (AesCipher::backendName (b), aes, frame, sizes, count, iterations);
+  }
+
+  AES128 crypto;
+  crypto.setKey (key, sizeof (key));
+  printRow ("AES128", crypto, frame, sizes, count, iterations);
+
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,339 @@
+#include <Arduino.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "RHSimDriver.h"
+#include "RHAdaptiveDriver.h"
+#include "RHRelayDriver.h"
+
+RHSimDriver::RHSimDriver() :
+  m_delay (0), m_airtime (false), m_requestLoss (0), m_responseLoss (0), m_lateProbability (0), m_lateDelay (0), m_rssi (-60),
+  m_adaptive (false), m_spreadingFactor (7), m_fallback (0), m_relayDelay (0), m_reportPeriod (0), m_nextReport (0), m_txEnd (0),
+  m_fd (timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+  m_lastSend (0), m_lastReady (0), m_sent (0), m_lost (0), m_late (0), m_reported (0) {
+}
+
+RHSimDriver::~RHSimDriver() {
+  ::close (m_fd);
+}
+
+bool RHSimDriver::init() {
+
+  setMode (RHModeRx);
+  return m_fd >= 0;
+}
+
+void RHSimDriver::setResponder (Responder responder, unsigned long delay) {
+
+  m_responder = responder;
+  m_delay = delay;
+}
+
+void RHSimDriver::setSlaveDelay (uint8_t slave, unsigned long delay) {
+
+  m_slaveDelays[slave] = delay;
+}
+
+void RHSimDriver::setSlaveRssi (uint8_t slave, int16_t rssi) {
+
+  m_slaveRssi[slave] = rssi;
+}
+
+void RHSimDriver::setAdaptive (uint8_t spreadingFactor, unsigned long fallback) {
+
+  m_adaptive = true;
+  m_spreadingFactor = spreadingFactor;
+  m_fallback = fallback;
+  m_listeners.clear();
+}
+
+void RHSimDriver::addLink (uint8_t a, uint8_t b) {
+
+  m_links[a].push_back (b);
+  m_links[b].push_back (a);
+  m_relays.emplace (a, ModbusRelay (a));
+  m_relays.emplace (b, ModbusRelay (b));
+}
+
+void RHSimDriver::setReporter (Reporter reporter, unsigned long period) {
+
+  m_reporter = reporter;
+  m_reportPeriod = period;
+  m_nextReport = micros() + period;
+  armTimer();
+}
+
+void RHSimDriver::setModem (const LoraModem & modem) {
+
+  m_modem = modem;
+  m_airtime = true;
+}
+
+void RHSimDriver::setLoss (double requestLoss, double responseLoss, unsigned int seed) {
+
+  m_requestLoss = requestLoss;
+  m_responseLoss = responseLoss;
+  m_random.seed (seed);
+}
+
+void RHSimDriver::setLate (double probability, unsigned long delay) {
+
+  m_lateProbability = probability;
+  m_lateDelay = delay;
+}
+
+unsigned long RHSimDriver::airtime (size_t len) const {
+
+  return m_airtime ? m_modem.messageTimeOnAir (len) : 0;
+}
+
+// true if the slave hears the request being sent
+bool RHSimDriver::hears (uint8_t slave, int16_t rssi) {
+
+  if (m_airtime && rssi < m_modem.sensitivity()) {
+    return false;
+  }
+  if (m_adaptive) {
+    auto it = m_listeners.find (slave);
+
+    if (it == m_listeners.end()) {
+      it = m_listeners.insert (std::make_pair (slave, Listener { m_spreadingFactor, m_lastSend })).first;
+    }
+    Listener & l = it->second;
+    if (l.spreadingFactor != m_spreadingFactor && (m_lastSend - l.last) > m_fallback) {
+      l.spreadingFactor = m_spreadingFactor;
+    }
+    if (l.spreadingFactor != m_modem.spreadingFactor) {
+      return false;
+    }
+    l.last = m_lastSend;
+  }
+  return true;
+}
+
+bool RHSimDriver::available() {
+
+  // end of transmission, back in receive mode like RH_RF95::available()
+  if (mode() == RHModeTx && (long) (micros() - m_txEnd) >= 0) {
+
+    setMode (RHModeRx);
+    armTimer();
+  }
+  report();
+  return mode() != RHModeTx && !m_frames.empty() && (long) (micros() - m_frames.front().ready) >= 0;
+}
+
+bool RHSimDriver::recv (uint8_t *buf, uint8_t *len) {
+
+  if (!available()) {
+    return false;
+  }
+
+  Frame & f = m_frames.front();
+  if (*len > f.data.size()) {
+    *len = f.data.size();
+  }
+  memcpy (buf, f.data.data(), *len);
+  m_lastReady = f.ready;
+  _lastRssi = f.rssi;
+  m_frames.pop_front();
+  armTimer();
+  return true;
+}
+
+bool RHSimDriver::send (const uint8_t *data, uint8_t len) {
+  std::uniform_real_distribution<double> uniform (0, 1);
+
+  m_lastSend = micros();
+  m_sent++;
+  m_txEnd = m_lastSend + airtime (len);
+  if (m_airtime) {
+    setMode (RHModeTx);
+  }
+
+  if (len > 0 && data[0] != 0 && m_links.count (data[0])) {
+
+    relay (data, len);
+  }
+  else if (m_responder) {
+    uint8_t resp[RH_RF95_MAX_MESSAGE_LEN];
+    uint8_t rlen = m_responder (data, len, resp);
+    auto r = m_slaveRssi.find (data[0]);
+    int16_t rssi = r != m_slaveRssi.end() ? r->second : m_rssi;
+
+    if (rlen > 0 && (!hears (data[0], rssi) || (m_requestLoss > 0 && uniform (m_random) < m_requestLoss))) {
+
+      m_lost++;
+      rlen = 0;
+    }
+    if (rlen > 0 && m_adaptive) {
+      uint8_t sf = m_spreadingFactor;
+
+      // the answer goes with the spreading factor of the request, the slave
+      // switches after it
+      for (uint8_t p = 0; p < (_txHeaderFlags & RH_ADR_PROFILE_MASK) && sf > 7; p++) {
+        sf--;
+      }
+      m_listeners[data[0]].spreadingFactor = sf;
+    }
+    if (rlen > 0 && m_responseLoss > 0 && uniform (m_random) < m_responseLoss) {
+
+      m_lost++;
+      rlen = 0;
+    }
+    if (rlen > 0) {
+      auto d = m_slaveDelays.find (data[0]);
+      Frame f;
+
+      f.ready = m_txEnd + (d != m_slaveDelays.end() ? d->second : m_delay) + airtime (rlen);
+      if (m_lateProbability > 0 && uniform (m_random) < m_lateProbability) {
+
+        f.ready += m_lateDelay;
+        m_late++;
+      }
+      f.rssi = rssi;
+      f.data.assign (resp, resp + rlen);
+      enqueue (f);
+    }
+  }
+  armTimer();
+  return true;
+}
+
+// Passes a frame of the bridge through the mesh, in simulated time: each
+// node hears the frames of its links at the end of their time on air, the
+// collisions are ignored. The frames heard by the bridge are queued.
+void RHSimDriver::relay (const uint8_t *data, uint8_t len) {
+  std::uniform_real_distribution<double> uniform (0, 1);
+  std::deque<Transmission> air; // by start
+  size_t count = 0;
+
+  air.push_back (Transmission { m_lastSend, 0, std::vector<uint8_t> (data, data + len) });
+  while (!air.empty() && count++ < 1000) {
+    Transmission tx = air.front();
+    unsigned long end = tx.start + airtime (tx.data.size());
+
+    air.pop_front();
+    for (uint8_t node : m_links[tx.from]) {
+      uint8_t out[RH_RF95_MAX_MESSAGE_LEN];
+      unsigned long start = end;
+      size_t n;
+
+      if (uniform (m_random) < (tx.from == 0 ? m_requestLoss : m_responseLoss)) {
+
+        m_lost++;
+        continue;
+      }
+      if (node == 0) {
+        Frame f;
+
+        f.ready = end;
+        f.rssi = m_rssi;
+        f.data = tx.data;
+        enqueue (f);
+        continue;
+      }
+      if (tx.data.size() > 1 && tx.data[1] != ModbusRelay::Function && tx.data[0] == node) {
+        auto d = m_slaveDelays.find (node);
+
+        // a request to the slave of the node
+        n = m_responder ? m_responder (tx.data.data(), tx.data.size(), out) : 0;
+        start += d != m_slaveDelays.end() ? d->second : m_delay;
+      }
+      else {
+
+        n = m_relays.at (node).onFrame (tx.data.data(), tx.data.size(), end / 1000UL, out, sizeof (out));
+        start += m_relayDelay;
+        if (n > 0 && (out[2] & ModbusRelay::TypeMask) == ModbusRelay::Discover) {
+          start += uniform (m_random) * RH_RELAY_JITTER * 1000UL;
+        }
+      }
+      if (n > 0) {
+        auto it = air.end();
+
+        while (it != air.begin() && (long) ( (it - 1)->start - start) > 0) {
+          --it;
+        }
+        air.insert (it, Transmission { start, node, std::vector<uint8_t> (out, out + n) });
+      }
+    }
+  }
+}
+
+// Queues a frame for the bridge, ordered by availability, a fast slave may
+// answer before a slow one
+void RHSimDriver::enqueue (const Frame & f) {
+  auto it = m_frames.end();
+
+  while (it != m_frames.begin() && (long) ( (it - 1)->ready - f.ready) > 0) {
+    --it;
+  }
+  m_frames.insert (it, f);
+}
+
+uint8_t RHSimDriver::maxMessageLength() {
+
+  return RH_RF95_MAX_MESSAGE_LEN;
+}
+
+// the reporter is due, its frame is queued once on air
+void RHSimDriver::report() {
+
+  while (m_reporter && (long) (micros() - m_nextReport) >= 0) {
+    std::uniform_real_distribution<double> uniform (0, 1);
+    uint8_t buf[RH_RF95_MAX_MESSAGE_LEN];
+    uint8_t len = m_reporter (buf);
+
+    if (len > 0) {
+
+      m_reported++;
+      if (m_responseLoss > 0 && uniform (m_random) < m_responseLoss) {
+        m_lost++;
+      }
+      else {
+        Frame f;
+
+        f.ready = m_nextReport + airtime (len);
+        f.rssi = m_rssi;
+        f.data.assign (buf, buf + len);
+        enqueue (f);
+      }
+    }
+    m_nextReport += m_reportPeriod;
+  }
+  armTimer();
+}
+
+// arms the timerfd for the end of the transmission or the first frame waiting
+void RHSimDriver::armTimer() {
+  struct itimerspec its = {{0, 0}, {0, 0}};
+  bool armed = false;
+  unsigned long next = 0;
+
+  if (mode() == RHModeTx) {
+
+    next = m_txEnd;
+    armed = true;
+  }
+  else if (!m_frames.empty()) {
+
+    next = m_frames.front().ready;
+    armed = true;
+  }
+  if (m_reporter && (!armed || (long) (next - m_nextReport) > 0)) {
+
+    next = m_nextReport;
+    armed = true;
+  }
+
+  if (armed) {
+    long usec = next - micros();
+
+    if (usec < 1) {
+      usec = 1;
+    }
+    its.it_value.tv_sec = usec / 1000000L;
+    its.it_value.tv_nsec = (usec % 1000000L) * 1000L;
+  }
+  timerfd_settime (m_fd, 0, &its, nullptr);
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <RHGenericDriver.h>
+#include <RH_RF95.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+#include "LoraAirtime.h"
+#include "ModbusRelay.h"
+
+// Simulated radio for the tests and benchmarks, no hardware needed
+// Each frame sent is given to a responder (the simulated slaves) and its
+// answer becomes available after a delay. eventFd() is a timerfd armed for
+// the next event, it plays the role of RH_RF95Event::eventFd().
+// Once a modem is set, the time on air is simulated like a RFM95 does: the
+// driver stays in RHModeTx during the transmission of a request, the answer
+// is available after the request on air, the delay of the slave and the
+// answer on air. An answer which arrives during a transmission is received
+// at its end. The requests and the answers can be lost or late at random, and a
+// slave whose RSSI is below the sensitivity of the modem does not hear.
+// With setAdaptive(), the slaves follow the profiles announced by the bridge
+// like RHAdaptiveDriver: a slave hears only the requests sent with its
+// spreading factor, and switches to the announced one after its answer.
+// With setReporter(), the slaves also send frames without request, at a
+// fixed period, like the slaves which report by exception.
+// With addLink(), the nodes form a mesh: the bridge (node 0) reaches the
+// nodes of its links only, each node passes the relay frames on like
+// RHRelayDriver and answers the plain requests to it, the frames it sends
+// are heard by the nodes of its links. The nodes without link are in range
+// of the bridge only.
+class RHSimDriver : public RHGenericDriver {
+  public:
+    // Fills resp with the answer to req and returns its length, 0 if no answer
+    typedef std::function<uint8_t (const uint8_t *req, uint8_t len, uint8_t *resp)> Responder;
+
+    // Fills frame with a frame sent without request and returns its length, 0 if none
+    typedef std::function<uint8_t (uint8_t *frame)> Reporter;
+
+    RHSimDriver();
+    virtual ~RHSimDriver();
+
+    virtual bool init();
+    virtual bool available();
+    virtual bool recv (uint8_t *buf, uint8_t *len);
+    virtual bool send (const uint8_t *data, uint8_t len);
+    virtual uint8_t maxMessageLength();
+
+    // delay: time in microseconds between the request received by the slave
+    // and its answer sent
+    void setResponder (Responder responder, unsigned long delay);
+
+    // Answer delay of a slave, overrides the delay of setResponder()
+    void setSlaveDelay (uint8_t slave, unsigned long delay);
+
+    // Calls the reporter every period microseconds, its frames are lost like the answers
+    void setReporter (Reporter reporter, unsigned long period);
+
+    // Simulates the time on air of the frames with these modem settings
+    void setModem (const LoraModem & modem);
+
+    // Probability (0..1) that a request, or an answer, is lost
+    void setLoss (double requestLoss, double responseLoss, unsigned int seed = 1);
+
+    // Probability (0..1) that an answer comes delay microseconds later, a
+    // slave busy or a frame waiting for a free channel
+    void setLate (double probability, unsigned long delay);
+
+    // Signal of the answers received
+    inline void setRssi (int16_t rssi) {
+      m_rssi = rssi;
+    }
+
+    // Signal of a slave, overrides the one of setRssi()
+    void setSlaveRssi (uint8_t slave, int16_t rssi);
+
+    // The slaves follow the profiles of the adaptive data rate
+    // spreadingFactor: profile 0, fallback: time without request before it
+    void setAdaptive (uint8_t spreadingFactor, unsigned long fallback);
+
+    // Nodes a and b hear each other, 0 is the bridge
+    void addLink (uint8_t a, uint8_t b);
+
+    // Time a node takes to pass a relay frame on, without the random wait
+    // before a discover
+    inline void setRelayDelay (unsigned long delay) {
+      m_relayDelay = delay;
+    }
+
+  private:
+    struct Frame {
+      unsigned long ready; // micros() when the frame can be received
+      int16_t rssi;
+      std::vector<uint8_t> data;
+    };
+
+    // Spreading factor a slave listens with
+    struct Listener {
+      uint8_t spreadingFactor;
+      unsigned long last; // micros() of the last request heard
+    };
+
+    // Frame sent by a node of the mesh
+    struct Transmission {
+      unsigned long start;
+      uint8_t from;
+      std::vector<uint8_t> data;
+    };
+
+    void armTimer();
+    void report();
+    void enqueue (const Frame & f);
+    void relay (const uint8_t *data, uint8_t len);
+    unsigned long airtime (size_t len) const;
+    bool hears (uint8_t slave, int16_t rssi);
+
+    Responder m_responder;
+    unsigned long m_delay;
+    std::map<uint8_t, unsigned long> m_slaveDelays;
+    bool m_airtime;
+    LoraModem m_modem;
+    double m_requestLoss;
+    double m_responseLoss;
+    double m_lateProbability;
+    unsigned long m_lateDelay;
+    std::mt19937 m_random;
+    int16_t m_rssi;
+    std::map<uint8_t, int16_t> m_slaveRssi;
+    bool m_adaptive;
+    uint8_t m_spreadingFactor; // profile 0
+    unsigned long m_fallback;
+    std::map<uint8_t, Listener> m_listeners;
+    std::map<uint8_t, std::vector<uint8_t>> m_links; // nodes heard by each node
+    std::map<uint8_t, ModbusRelay> m_relays;
+    unsigned long m_relayDelay;
+    std::deque<Frame> m_frames;
+    Reporter m_reporter;
+    unsigned long m_reportPeriod;
+    unsigned long m_nextReport; // micros() of the next call of the reporter
+    unsigned long m_txEnd; // micros() at the end of the transmission in progress
+    int m_fd;
+    volatile unsigned long m_lastSend;
+    volatile unsigned long m_lastReady;
+    volatile unsigned long m_sent;
+    volatile unsigned long m_lost;
+    volatile unsigned long m_late;
+    volatile unsigned long m_reported;
+
+  public:
+    inline int eventFd() const {
+      return m_fd;
+    }
+
+    //micros() lors du dernier send().
+    inline unsigned long lastSend() const {
+      return m_lastSend;
+    }
+
+    // micros() when the last answer received was available
+    inline unsigned long lastReady() const {
+      return m_lastReady;
+    }
+
+    //Nombre de trames émises.
+    inline unsigned long sent() const {
+      return m_sent;
+    }
+
+    // Number of frames sent by the reporter
+    inline unsigned long reported() const {
+      return m_reported;
+    }
+
+    // Number of requests and answers lost
+    inline unsigned long lost() const {
+      return m_lost;
+    }
+
+    // Number of answers delayed by setLate()
+    inline unsigned long late() const {
+      return m_late;
+    }
+};
@@ -0,0 +1,238 @@
+// Compact over-the-air encoding: round-trip tests and micro-benchmark
+
+// 1. encodes random RTU frames of every function in both directions, with and
+//    without delta encoding, and checks that decoding gives the frame back
+// 2. decodes random compact frames, checks that a decoded frame has a valid
+//    CRC and fits in its buffer, and that encoding it again gives it back
+// 3. measures the encoding and decoding of each kind of frame and the size
+//    saved on air
+
+// compact_bench [iterations]
+// Returns EXIT_FAILURE if a frame is not decoded back.
+
+// This example code is in the public domain.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include "ModbusCompact.h"
+#include "ModbusCrc.h"
+
+using namespace std;
+
+struct Kind {
+  const char *name;
+  ModbusCompact::Direction dir;
+  uint8_t function;
+};
+
+const Kind Kinds[] = {
+  { "read req", ModbusCompact::Request, 0x03 },
+  { "read coils", ModbusCompact::Response, 0x01 },
+  { "read regs", ModbusCompact::Response, 0x03 },
+  { "write coil", ModbusCompact::Request, 0x05 },
+  { "write reg", ModbusCompact::Request, 0x06 },
+  { "write coils", ModbusCompact::Request, 0x0F },
+  { "write regs", ModbusCompact::Request, 0x10 },
+  { "write echo", ModbusCompact::Response, 0x10 },
+  { "exception", ModbusCompact::Response, 0x83 },
+  { "other", ModbusCompact::Request, 0x17 }
+};
+
+static void putWord (vector<uint8_t> & f, uint16_t w) {
+  f.push_back (w >> 8);
+  f.push_back (w & 0xFF);
+}
+
+// Registers close to each other half of the time, as the delta encoding
+// expects, random otherwise
+static void putRegisters (vector<uint8_t> & f, size_t n, mt19937 & rng) {
+  uint16_t v = rng();
+  bool close = rng() & 1;
+
+  for (size_t i = 0; i < n; i++) {
+    v = close ? v + (int) (rng() % 64) - 32 : rng();
+    putWord (f, v);
+  }
+}
+
+// Random RTU frame of a kind, CRC included
+static vector<uint8_t> makeFrame (const Kind & k, mt19937 & rng) {
+  vector<uint8_t> f;
+  size_t n = 1 + rng() % 60;
+
+  f.push_back (1 + rng() % 247);
+  f.push_back (k.function);
+  switch (k.function) {
+    case 0x01:
+      f.push_back (n);
+      for (size_t i = 0; i < n; i++) {
+        f.push_back (rng());
+      }
+      break;
+
+    case 0x03:
+      if (k.dir == ModbusCompact::Request) {
+        putWord (f, rng());
+        putWord (f, 1 + rng() % 125);
+      }
+      else {
+        f.push_back (n * 2);
+        putRegisters (f, n, rng);
+      }
+      break;
+
+    case 0x05:
+      putWord (f, rng());
+      putWord (f, (rng() & 1) ? 0xFF00 : 0);
+      break;
+
+    case 0x06:
+      putWord (f, rng());
+      putWord (f, rng());
+      break;
+
+    case 0x0F:
+      putWord (f, rng());
+      putWord (f, n * 8);
+      f.push_back (n);
+      for (size_t i = 0; i < n; i++) {
+        f.push_back (rng());
+      }
+      break;
+
+    case 0x10:
+      putWord (f, rng());
+      putWord (f, n);
+      if (k.dir == ModbusCompact::Request) {
+        f.push_back (n * 2);
+        putRegisters (f, n, rng);
+      }
+      break;
+
+    case 0x83:
+      f.push_back (1 + rng() % 4);
+      break;
+
+    default:
+      for (size_t i = 0; i < n; i++) {
+        f.push_back (rng());
+      }
+      break;
+  }
+  uint16_t crc = ModbusCrc::compute (f.data(), f.size());
+  f.push_back (crc & 0xFF);
+  f.push_back (crc >> 8);
+  return f;
+}
+
+int checkRoundTrip (mt19937 & rng) {
+  int errors = 0;
+
+  for (int n = 0; n < 20000; n++) {
+    const Kind & k = Kinds[n % (sizeof (Kinds) / sizeof (Kinds[0]))];
+    vector<uint8_t> frame = makeFrame (k, rng);
+
+    for (int delta = 0; delta < 2; delta++) {
+      uint8_t air[256], back[256];
+      size_t len = ModbusCompact::encode (frame.data(), frame.size(), air, sizeof (air), k.dir, delta != 0);
+      size_t backLen = len ? ModbusCompact::decode (air, len, back, sizeof (back), k.dir) : 0;
+
+      if (len == 0 || len > frame.size() - 1) {
+
+        cerr << k.name << ": encoded in " << len << " bytes, frame of " << frame.size() << endl;
+        errors++;
+      }
+      else if (backLen != frame.size() || memcmp (back, frame.data(), backLen) != 0) {
+
+        cerr << k.name << (delta ? " (delta)" : "") << ": decoded frame differs" << endl;
+        errors++;
+      }
+    }
+  }
+  return errors;
+}
+
+int checkRandomDecode (mt19937 & rng) {
+  int errors = 0;
+
+  for (int n = 0; n < 200000; n++) {
+    ModbusCompact::Direction dir = (n & 1) ? ModbusCompact::Response : ModbusCompact::Request;
+    uint8_t air[64], frame[80], again[80], back[80];
+    size_t len = 1 + rng() % sizeof (air);
+    size_t frameSize = 4 + rng() % (sizeof (frame) - 3);
+
+    for (size_t i = 0; i < len; i++) {
+      air[i] = rng();
+    }
+    if (rng() & 1) {
+      air[1] = 0x40 | (rng() & 0x3F); // compact form more often
+    }
+
+    size_t frameLen = ModbusCompact::decode (air, len, frame, frameSize, dir);
+    if (frameLen == 0) {
+      continue;
+    }
+    if (frameLen > frameSize || frameLen < 4 || ModbusCrc::compute (frame, frameLen) != 0) {
+
+      cerr << "random frame of " << len << " bytes decoded to an invalid frame" << endl;
+      errors++;
+      continue;
+    }
+
+    size_t againLen = ModbusCompact::encode (frame, frameLen, again, sizeof (again), dir);
+    size_t backLen = againLen ? ModbusCompact::decode (again, againLen, back, sizeof (back), dir) : 0;
+    if (backLen != frameLen || memcmp (back, frame, frameLen) != 0) {
+
+      cerr << "random frame of " << len << " bytes not decoded back after encoding" << endl;
+      errors++;
+    }
+  }
+  return errors;
+}
+
+int main (int argc, char **argv) {
+  mt19937 rng (42);
+  long iterations = argc > 1 ? atol (argv[1]) : 200000;
+
+  int errors = checkRoundTrip (rng);
+  cout << "round trip: " << (errors ? "FAILED" : "ok") << endl;
+  int randomErrors = checkRandomDecode (rng);
+  cout << "random decode: " << (randomErrors ? "FAILED" : "ok") << endl << endl;
+  errors += randomErrors;
+
+  cout << setw (12) << "" << setw (9) << "bytes" << setw (9) << "on air"
+       << setw (12) << "encode ns" << setw (12) << "decode ns" << endl;
+
+  for (const Kind & k : Kinds) {
+    vector<uint8_t> frame = makeFrame (k, rng);
+    uint8_t air[256], back[256];
+    size_t len = ModbusCompact::encode (frame.data(), frame.size(), air, sizeof (air), k.dir);
+    uint8_t first = frame[2];
+    volatile size_t sink = 0;
+
+    auto t0 = chrono::steady_clock::now();
+    for (long n = 0; n < iterations; n++) {
+      frame[2] = n; // prevents the compiler from hoisting the computation
+      sink = sink + ModbusCompact::encode (frame.data(), frame.size(), air, sizeof (air), k.dir);
+    }
+    double encodeNs = chrono::duration<double, nano> (chrono::steady_clock::now() - t0).count() / iterations;
+    frame[2] = first;
+    ModbusCompact::encode (frame.data(), frame.size(), air, sizeof (air), k.dir);
+
+    t0 = chrono::steady_clock::now();
+    for (long n = 0; n < iterations; n++) {
+      sink = sink + ModbusCompact::decode (air, len, back, sizeof (back), k.dir);
+    }
+    double decodeNs = chrono::duration<double, nano> (chrono::steady_clock::now() - t0).count() / iterations;
+
+    cout << setw (12) << k.name << setw (9) << frame.size() << setw (9) << len
+         << setw (12) << fixed << setprecision (1) << encodeNs
+         << setw (12) << decodeNs << endl;
+  }
+
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+// Time on air of a recorded Modbus traffic
+
+// Reads the frames of a traffic sample, the console output of rf95_rtu_bridge
+// for example, and reports the bytes and the time on air with the RTU frames
+// forwarded as they are and with the compact encoding (--compact), then
+// the time on air of both encodings in clear, with the 16 bytes blocks of
+// RHEncryptedDriver (--aes-mode ecb) and with AES-CTR (--aes-mode ctr).
+// A line holds one frame in hexadecimal, the bytes of a request between [],
+// those of a response between <>: [0A][03][00][00][00][04][44][B2]
+// The other lines are ignored, the frames with a wrong CRC are skipped.
+
+// rf95_airtime [-s sf] [-w bandwidth] [-r coding_rate] [-k|-c] [-d] [-v] [file]
+// -k: AES encryption (RHEncryptedDriver padding)
+// -c: AES-CTR encryption (RHCtrEncryptedDriver nonce)
+// -d: delta encoding of the registers
+// -v: one line per frame
+// reads stdin without file
+
+// This example code is in the public domain.
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <getopt.h>
+#include "LoraAirtime.h"
+#include "ModbusCompact.h"
+#include "ModbusCrc.h"
+
+using namespace std;
+
+// Parses a line, returns false if it does not hold a frame
+bool parseFrame (const string & line, vector<uint8_t> & frame, bool & request) {
+  size_t pos = 0;
+
+  frame.clear();
+  while ( (pos = line.find_first_of ("[<", pos)) != string::npos) {
+    char close = line[pos] == '[' ? ']' : '>';
+
+    if (pos + 3 >= line.size() || line[pos + 3] != close ||
+        !isxdigit (line[pos + 1]) || !isxdigit (line[pos + 2])) {
+      pos++;
+      continue;
+    }
+    if (frame.empty()) {
+      request = line[pos] == '[';
+    }
+    frame.push_back (strtoul (line.substr (pos + 1, 2).c_str(), nullptr, 16));
+    pos += 4;
+  }
+  return frame.size() >= 4;
+}
+
+int main (int argc, char **argv) {
+  LoraModem modem;
+  bool delta = false;
+  bool verbose = false;
+  int opt;
+
+  while ( (opt = getopt (argc, argv, "s:w:r:kcdvh")) != -1) {
+    switch (opt) {
+      case 's':
+        modem.spreadingFactor = atoi (optarg);
+        break;
+      case 'w':
+        modem.bandwidth = LoraModem::supportedBandwidth (atol (optarg));
+        break;
+      case 'r':
+        modem.codingRate = atoi (optarg);
+        break;
+      case 'k':
+        modem.encryption = LoraModem::Padded;
+        break;
+      case 'c':
+        modem.encryption = LoraModem::Stream;
+        break;
+      case 'd':
+        delta = true;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        cerr << "Usage: " << argv[0] << " [-s sf] [-w bandwidth] [-r coding_rate] [-k|-c] [-d] [-v] [file]" << endl;
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (modem.spreadingFactor < 6 || modem.spreadingFactor > 12 || modem.codingRate < 5 || modem.codingRate > 8) {
+    cerr << "Invalid spreading factor or coding rate" << endl;
+    return EXIT_FAILURE;
+  }
+
+  ifstream file;
+  if (optind < argc) {
+    file.open (argv[optind]);
+    if (!file) {
+      cerr << "Unable to open " << argv[optind] << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  istream & in = optind < argc ? file : cin;
+
+  unsigned long frames = 0, skipped = 0, errors = 0;
+  unsigned long rawBytes = 0, compactBytes = 0;
+  unsigned long long rawAirtime = 0, compactAirtime = 0;
+  // time on air of each encryption, raw and compact frames
+  const LoraModem::Encryption encryptions[] = { LoraModem::Clear, LoraModem::Padded, LoraModem::Stream };
+  const char *encryptionNames[] = { "clear", "AES-ECB", "AES-CTR" };
+  unsigned long long airtime[3][2] = { { 0 } };
+  LoraModem other = modem;
+  string line;
+  vector<uint8_t> frame;
+  bool request;
+
+  while (getline (in, line)) {
+
+    if (!parseFrame (line, frame, request)) {
+      continue;
+    }
+    if (ModbusCrc::compute (frame.data(), frame.size()) != 0 || frame.size() > 256) {
+      skipped++;
+      continue;
+    }
+
+    ModbusCompact::Direction dir = request ? ModbusCompact::Request : ModbusCompact::Response;
+    uint8_t compact[256];
+    uint8_t decoded[256];
+    size_t n = ModbusCompact::encode (frame.data(), frame.size(), compact, sizeof (compact), dir, delta);
+    size_t m = ModbusCompact::decode (compact, n, decoded, sizeof (decoded), dir);
+
+    if (n == 0 || m != frame.size() || !equal (frame.begin(), frame.end(), decoded)) {
+      errors++;
+      continue;
+    }
+
+    unsigned long rawToa = modem.messageTimeOnAir (frame.size());
+    unsigned long compactToa = modem.messageTimeOnAir (n);
+    frames++;
+    rawBytes += frame.size();
+    compactBytes += n;
+    rawAirtime += rawToa;
+    compactAirtime += compactToa;
+    for (int e = 0; e < 3; e++) {
+      other.encryption = encryptions[e];
+      airtime[e][0] += other.messageTimeOnAir (frame.size());
+      airtime[e][1] += other.messageTimeOnAir (n);
+    }
+    if (verbose) {
+      cout << (request ? "req " : "rsp ") << setw (3) << frame.size() << " -> " << setw (3) << n
+           << " bytes, " << rawToa << " -> " << compactToa << " us" << endl;
+    }
+  }
+
+  if (frames == 0) {
+    cerr << "No frame found" << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "SF" << (int) modem.spreadingFactor << ", " << modem.bandwidth << " Hz, CR 4/" << (int) modem.codingRate
+       << (modem.encryption == LoraModem::Padded ? ", AES-ECB" : modem.encryption == LoraModem::Stream ? ", AES-CTR" : "")
+       << (delta ? ", delta" : "") << endl;
+  cout << frames << " frames, " << skipped << " skipped (CRC), " << errors << " encoding errors" << endl;
+  cout << fixed << setprecision (1);
+  cout << "bytes:   " << rawBytes << " -> " << compactBytes << ", "
+       << 100.0 * (rawBytes - compactBytes) / rawBytes << "% saved" << endl;
+  cout << "airtime: " << rawAirtime / 1000.0 << " ms -> " << compactAirtime / 1000.0 << " ms, "
+       << 100.0 * (rawAirtime - compactAirtime) / rawAirtime << "% saved" << endl;
+
+  cout << endl << setw (10) << "ms" << setw (12) << "raw" << setw (12) << "compact" << endl;
+  for (int e = 0; e < 3; e++) {
+    cout << setw (10) << encryptionNames[e] << setw (12) << airtime[e][0] / 1000.0 << setw (12) << airtime[e][1] / 1000.0 << endl;
+  }
+  cout << "AES-CTR saves " << 100.0 * (airtime[1][0] - airtime[2][0]) / airtime[1][0] << "% (raw), "
+       << 100.0 * (airtime[1][1] - airtime[2][1]) / airtime[1][1] << "% (compact) of the AES-ECB airtime" << endl;
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
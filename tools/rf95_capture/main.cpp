@@ -0,0 +1,296 @@
+// Decoder of the traffic captured by rf95_rtu_bridge --capture
+
+// Prints the records of a capture file, from the oldest to the newest, and a
+// summary for each slave: requests sent on the radio, responses, errors and
+// radio round trip latency (from the end of the send to the response).
+// A line holds the time in seconds, the direction, the radio, the status,
+// the RSSI and SNR of the radio frames and the bytes, a request between [],
+// a response between <>, so that the output can be read by rf95_airtime:
+//   rf95_capture -d radio -q capture.bin | rf95_airtime
+
+// rf95_capture [-s slave] [-f function] [-r radio] [-d master|radio] [-e] [-q] [-S] [-w] file
+// -s, -f, -r: only the records of this slave, function code or radio
+// -d: only the records of the serial line (master) or of the radios (radio)
+// -e: only the errors (status other than ok, cached and report)
+// -q: no summary
+// -S: summary only
+// -w: wall clock time instead of the time since the start of the capture
+
+// This example code is in the public domain.
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "CaptureRing.h"
+
+using namespace std;
+
+// Counters of a slave
+struct SlaveStats {
+  unsigned long requests = 0;  // sent on the radio
+  unsigned long responses = 0;
+  unsigned long cached = 0;
+  unsigned long timeouts = 0;
+  unsigned long late = 0;
+  unsigned long unexpected = 0;
+  unsigned long invalid = 0;
+  unsigned long dropped = 0;   // queue full or duty cycle
+  unsigned long retries = 0;   // sent again by the bridge
+  long rssiSum = 0;
+  long snrSum = 0;
+  unsigned long snrCount = 0;
+  vector<uint64_t> latency;    // ns
+  deque<uint64_t> pending;     // send times of the requests without response
+};
+
+void printRecord (const CaptureRecord & r, const CaptureHeader & h, bool wallClock) {
+  char line[64 + 4 * 256];
+  char *p = line;
+
+  if (wallClock) {
+    int64_t ns = h.realtime + ( (int64_t) r.time - h.monotonic);
+    time_t sec = ns / 1000000000LL;
+    struct tm tm;
+
+    localtime_r (&sec, &tm);
+    p += strftime (p, 32, "%Y-%m-%d %H:%M:%S", &tm);
+    p += sprintf (p, ".%06lld", (long long) (ns % 1000000000LL) / 1000);
+  }
+  else {
+
+    p += sprintf (p, "%12.6f", ( (int64_t) r.time - h.monotonic) / 1e9);
+  }
+  p += sprintf (p, " %-7s r%u %-10s", CaptureRing::directionName (r.direction), r.radio,
+                CaptureRing::statusName (r.status));
+  if (r.direction == CaptureRing::FromRadio && r.status != CaptureRing::Timeout) {
+    p += sprintf (p, " %4d dBm", r.rssi);
+    if (r.snr != CaptureRing::NoSnr) {
+      p += sprintf (p, " %3d dB", r.snr);
+    }
+  }
+  *p++ = ' ';
+
+  // the timeouts hold the request
+  bool request = r.direction == CaptureRing::FromMaster || r.direction == CaptureRing::ToRadio ||
+                 r.status == CaptureRing::Timeout;
+  static const char hex[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < r.len; i++) {
+    *p++ = request ? '[' : '<';
+    *p++ = hex[r.data() [i] >> 4];
+    *p++ = hex[r.data() [i] & 0x0F];
+    *p++ = request ? ']' : '>';
+  }
+  *p++ = '\n';
+  fwrite (line, 1, p - line, stdout);
+}
+
+// Updates the statistics of the slave of a record
+void account (map<int, SlaveStats> & slaves, const CaptureRecord & r) {
+  SlaveStats & s = slaves[r.slave];
+  // the responses are matched with the requests of the same radio
+  deque<uint64_t> & pending = slaves[0x100 * (r.radio + 1) + r.slave].pending;
+
+  switch (r.direction) {
+
+    case CaptureRing::FromMaster:
+      if (r.status == CaptureRing::Cached) {
+        s.cached++;
+      }
+      break;
+
+    case CaptureRing::ToRadio:
+      if (r.status == CaptureRing::Ok) {
+
+        s.requests++;
+        if (r.slave != 0) {
+          pending.push_back (r.time);
+        }
+      }
+      else if (r.status == CaptureRing::Retry) {
+
+        // the latency is counted from the last attempt
+        s.retries++;
+        if (!pending.empty()) {
+          pending.front() = r.time;
+        }
+      }
+      else {
+
+        s.dropped++;
+      }
+      break;
+
+    case CaptureRing::FromRadio:
+      switch (r.status) {
+        case CaptureRing::Ok:
+          s.responses++;
+          s.rssiSum += r.rssi;
+          if (r.snr != CaptureRing::NoSnr) {
+            s.snrSum += r.snr;
+            s.snrCount++;
+          }
+          if (!pending.empty()) {
+            s.latency.push_back (r.time - pending.front());
+            pending.pop_front();
+          }
+          break;
+        case CaptureRing::Timeout:
+          s.timeouts++;
+          if (!pending.empty()) {
+            pending.pop_front();
+          }
+          break;
+        case CaptureRing::Late:
+          s.late++;
+          break;
+        case CaptureRing::Unexpected:
+          s.unexpected++;
+          break;
+        case CaptureRing::Report:
+          break; // not an answer to a request
+        default:
+          s.invalid++;
+          break;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void printSummary (const map<int, SlaveStats> & slaves, unsigned long serialErrors) {
+
+  cout << endl << "slave  requests retries responses  cached timeouts late unexp. invalid dropped  error%"
+       << "   p50 ms   p90 ms   max ms  rssi   snr" << endl;
+  for (auto & it : slaves) {
+
+    if (it.first > 0xFF) {
+      continue; // pending requests of a radio
+    }
+    const SlaveStats & s = it.second;
+    vector<uint64_t> lat (s.latency);
+    unsigned long errors = s.timeouts + s.invalid;
+
+    sort (lat.begin(), lat.end());
+    printf ("%5d %9lu %7lu %9lu %7lu %8lu %4lu %6lu %7lu %7lu %7.2f", it.first, s.requests, s.retries, s.responses, s.cached,
+            s.timeouts, s.late, s.unexpected, s.invalid, s.dropped,
+            s.requests ? 100.0 * errors / s.requests : 0.0);
+    if (lat.empty()) {
+      printf ("        -        -        -");
+    }
+    else {
+      printf (" %8.2f %8.2f %8.2f", lat[lat.size() / 2] / 1e6, lat[lat.size() * 9 / 10] / 1e6, lat.back() / 1e6);
+    }
+    if (s.responses) {
+      printf (" %5ld", s.rssiSum / (long) s.responses);
+    }
+    else {
+      printf ("     -");
+    }
+    if (s.snrCount) {
+      printf (" %5ld\n", s.snrSum / (long) s.snrCount);
+    }
+    else {
+      printf ("     -\n");
+    }
+  }
+  if (serialErrors) {
+    printf ("serial line: %lu frames with a wrong CRC or too short\n", serialErrors);
+  }
+}
+
+int main (int argc, char **argv) {
+  int slave = -1, function = -1, radio = -1;
+  int direction = 0; // 0: all, 1: serial line, 2: radios
+  bool errorsOnly = false, quiet = false, summaryOnly = false, wallClock = false;
+  int opt;
+
+  while ( (opt = getopt (argc, argv, "s:f:r:d:eqSwh")) != -1) {
+    switch (opt) {
+      case 's':
+        slave = atoi (optarg);
+        break;
+      case 'f':
+        function = strtol (optarg, nullptr, 0);
+        break;
+      case 'r':
+        radio = atoi (optarg);
+        break;
+      case 'd':
+        direction = strcmp (optarg, "master") == 0 ? 1 : (strcmp (optarg, "radio") == 0 ? 2 : -1);
+        if (direction < 0) {
+          cerr << "Invalid direction " << optarg << ", must be master or radio" << endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'e':
+        errorsOnly = true;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 'S':
+        summaryOnly = true;
+        break;
+      case 'w':
+        wallClock = true;
+        break;
+      default:
+        cerr << "Usage: " << argv[0] << " [-s slave] [-f function] [-r radio] [-d master|radio] [-e] [-q] [-S] [-w] file" << endl;
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (optind >= argc) {
+    cerr << "A capture file must be specified!" << endl;
+    return EXIT_FAILURE;
+  }
+
+  CaptureReader reader;
+  if (!reader.open (argv[optind])) {
+    cerr << "Unable to read the capture " << argv[optind] << endl;
+    return EXIT_FAILURE;
+  }
+  const CaptureHeader & h = *reader.header();
+
+  map<int, SlaveStats> slaves;
+  unsigned long serialErrors = 0, records = 0;
+  const CaptureRecord *r;
+
+  while (reader.next (r)) {
+    bool serial = r->direction == CaptureRing::FromMaster || r->direction == CaptureRing::ToMaster;
+
+    if ( (slave >= 0 && r->slave != slave) || (function >= 0 && r->function != function) ||
+         (radio >= 0 && r->radio != radio) || (direction == 1 && !serial) || (direction == 2 && serial) ||
+         (errorsOnly && (r->status == CaptureRing::Ok || r->status == CaptureRing::Cached ||
+                         r->status == CaptureRing::Report))) {
+      continue;
+    }
+
+    records++;
+    if (r->direction == CaptureRing::FromMaster &&
+        (r->status == CaptureRing::CrcError || r->status == CaptureRing::Flushed)) {
+      serialErrors++;
+    }
+    else {
+      account (slaves, *r);
+    }
+    if (!summaryOnly) {
+      printRecord (*r, h, wallClock);
+    }
+  }
+
+  if (!quiet) {
+    cout << records << " records, " << h.records << " captured, " << h.overwritten << " overwritten" << endl;
+    printSummary (slaves, serialErrors);
+  }
+  return EXIT_SUCCESS;
+}
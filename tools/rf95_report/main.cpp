@@ -0,0 +1,212 @@
+// Traffic model of the report by exception against the polling
+
+// Compares, for a population of slaves, the time on air spent to keep the
+// values of the master current:
+// - polling: the master reads all the registers of each slave every period,
+//   the bridge sends the request and the slave answers
+// - report by exception: each change of a slave is reported at once
+//   (ModbusReport), and all its registers every heartbeat period in
+//   integrity reports, the bridge answers the reads of the master from its
+//   image and sends nothing
+// For each mode, it prints the frames and the time on air per hour, the duty
+// cycle of the bridge and of a slave against the limit, and the age of the
+// values seen by the master. The frames are built like the bridge does, then
+// measured with the RadioHead header, the compact encoding (-z) and the
+// encryption (-k, -c).
+
+// rf95_report [-s sf] [-w bandwidth] [-r coding_rate] [-k|-c] [-z] [-n slaves] [-q registers]
+//             [-p poll_s] [-e changes_per_hour] [-g registers_per_change] [-H heartbeat_s] [-l duty_percent]
+// -n: number of slaves (10)
+// -q: registers of a slave, read at once by the poll (16)
+// -p: polling period in seconds (10)
+// -e: changes of a slave per hour (60)
+// -g: registers in the report of a change (1)
+// -H: heartbeat period in seconds (60)
+// -l: duty cycle limit in percent (1, EU 868 MHz)
+
+// This example code is in the public domain.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <stdlib.h>
+#include <getopt.h>
+#include "LoraAirtime.h"
+#include "ModbusCompact.h"
+#include "ModbusCrc.h"
+#include "ModbusReport.h"
+
+using namespace std;
+
+// Largest number of registers in one report or read response
+const unsigned MaxRegisters = 120;
+
+// Traffic of a mode during one hour
+struct Traffic {
+  double frames = 0;
+  double bridgeAirtime = 0; // us, sent by the bridge
+  double slaveAirtime = 0;  // us, sent by one slave
+};
+
+// Time on air of a RTU frame (CRC included)
+unsigned long frameAirtime (const LoraModem & modem, const vector<uint8_t> & frame, bool compact, bool request) {
+
+  if (compact) {
+    uint8_t out[256];
+    size_t n = ModbusCompact::encode (frame.data(), frame.size(), out, sizeof (out),
+                                      request ? ModbusCompact::Request : ModbusCompact::Response, false);
+    return modem.messageTimeOnAir (n);
+  }
+  return modem.messageTimeOnAir (frame.size());
+}
+
+// Read of quantity registers from start and its response
+void readFrames (uint16_t start, uint16_t quantity, vector<uint8_t> & request, vector<uint8_t> & response) {
+
+  request.assign ({ 10, 0x03, uint8_t (start >> 8), uint8_t (start & 0xFF), uint8_t (quantity >> 8), uint8_t (quantity & 0xFF), 0, 0 });
+  ModbusCrc::append (request.data(), 6);
+  response.assign (3 + quantity * 2 + 2, 0);
+  response[0] = 10;
+  response[1] = 0x03;
+  response[2] = quantity * 2;
+  for (uint16_t i = 0; i < quantity; i++) {
+    response[4 + i * 2] = i + 1; // values of a real process, not zeros
+  }
+  ModbusCrc::append (response.data(), 3 + quantity * 2);
+}
+
+// Report of quantity registers from start
+vector<uint8_t> reportFrame (uint16_t start, uint16_t quantity, bool integrity) {
+  vector<uint8_t> data (quantity * 2, 0);
+  vector<uint8_t> frame (ModbusReport::HeaderSize + data.size() + 2);
+
+  for (uint16_t i = 0; i < quantity; i++) {
+    data[i * 2 + 1] = i + 1;
+  }
+  frame.resize (ModbusReport::encode (10, 0, integrity, 0x03, start, quantity, data.data(), frame.data(), frame.size()));
+  return frame;
+}
+
+void print (const char *name, const Traffic & t, unsigned slaves, double limit, double age) {
+
+  cout << setw (10) << name << setw (10) << t.frames * slaves << setw (12) << t.bridgeAirtime / 1e6 * slaves
+       << setw (12) << t.slaveAirtime / 1e6 * slaves << setw (9) << t.bridgeAirtime * slaves / 36e8 * 100.0
+       << (t.bridgeAirtime * slaves / 36e8 > limit ? "!" : " ") << setw (8) << t.slaveAirtime / 36e8 * 100.0
+       << (t.slaveAirtime / 36e8 > limit ? "!" : " ") << setw (10) << age << endl;
+}
+
+int main (int argc, char **argv) {
+  LoraModem modem;
+  bool compact = false;
+  unsigned slaves = 10, registers = 16, perChange = 1;
+  double poll = 10, changes = 60, heartbeat = 60, limit = 1;
+  int opt;
+
+  while ( (opt = getopt (argc, argv, "s:w:r:kczn:q:p:e:g:H:l:h")) != -1) {
+    switch (opt) {
+      case 's':
+        modem.spreadingFactor = atoi (optarg);
+        break;
+      case 'w':
+        modem.bandwidth = LoraModem::supportedBandwidth (atol (optarg));
+        break;
+      case 'r':
+        modem.codingRate = atoi (optarg);
+        break;
+      case 'k':
+        modem.encryption = LoraModem::Padded;
+        break;
+      case 'c':
+        modem.encryption = LoraModem::Stream;
+        break;
+      case 'z':
+        compact = true;
+        break;
+      case 'n':
+        slaves = atoi (optarg);
+        break;
+      case 'q':
+        registers = atoi (optarg);
+        break;
+      case 'p':
+        poll = atof (optarg);
+        break;
+      case 'e':
+        changes = atof (optarg);
+        break;
+      case 'g':
+        perChange = atoi (optarg);
+        break;
+      case 'H':
+        heartbeat = atof (optarg);
+        break;
+      case 'l':
+        limit = atof (optarg);
+        break;
+      default:
+        cerr << "Usage: " << argv[0] << " [-s sf] [-w bandwidth] [-r coding_rate] [-k|-c] [-z] [-n slaves] [-q registers]"
+             << " [-p poll_s] [-e changes_per_hour] [-g registers_per_change] [-H heartbeat_s] [-l duty_percent]" << endl;
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (modem.spreadingFactor < 6 || modem.spreadingFactor > 12 || modem.codingRate < 5 || modem.codingRate > 8 ||
+      slaves < 1 || registers < 1 || registers > 2000 || perChange < 1 || perChange > registers ||
+      poll <= 0 || changes < 0 || heartbeat <= 0 || limit <= 0) {
+    cerr << "Invalid settings" << endl;
+    return EXIT_FAILURE;
+  }
+  limit /= 100.0;
+
+  // polling, the registers are read MaxRegisters at a time
+  Traffic polling;
+  for (unsigned start = 0; start < registers; start += MaxRegisters) {
+    unsigned quantity = min (registers - start, MaxRegisters);
+    vector<uint8_t> request, response;
+
+    readFrames (start, quantity, request, response);
+    polling.frames += 2 * 3600.0 / poll;
+    polling.bridgeAirtime += frameAirtime (modem, request, compact, true) * 3600.0 / poll;
+    polling.slaveAirtime += frameAirtime (modem, response, compact, false) * 3600.0 / poll;
+  }
+
+  // report by exception: the changes, then the integrity reports
+  Traffic reports;
+  unsigned long changeAirtime = frameAirtime (modem, reportFrame (0, perChange, false), compact, false);
+  reports.frames = changes;
+  reports.slaveAirtime = changeAirtime * changes;
+  for (unsigned start = 0; start < registers; start += MaxRegisters) {
+    unsigned quantity = min (registers - start, MaxRegisters);
+
+    reports.frames += 3600.0 / heartbeat;
+    reports.slaveAirtime += frameAirtime (modem, reportFrame (start, quantity, true), compact, false) * 3600.0 / heartbeat;
+  }
+
+  cout << "SF" << (int) modem.spreadingFactor << ", " << modem.bandwidth << " Hz, CR 4/" << (int) modem.codingRate
+       << (modem.encryption == LoraModem::Padded ? ", AES-ECB" : modem.encryption == LoraModem::Stream ? ", AES-CTR" : "")
+       << (compact ? ", compact" : "") << endl;
+  cout << slaves << " slaves of " << registers << " registers, polled every " << poll << " s, "
+       << changes << " changes of " << perChange << " registers per hour, heartbeat " << heartbeat << " s" << endl;
+  cout << fixed << setprecision (2);
+  cout << endl << setw (10) << "per hour" << setw (10) << "frames" << setw (12) << "bridge s" << setw (12) << "slaves s"
+       << setw (10) << "bridge %" << setw (9) << "slave %" << setw (10) << "age s" << endl;
+  // the master sees a polled value half a period old on average, a reported
+  // one as old as its report on the air
+  print ("polling", polling, slaves, limit, poll / 2);
+  print ("report", reports, slaves, limit, changeAirtime / 1e6);
+
+  double total = (polling.bridgeAirtime + polling.slaveAirtime) * slaves;
+  double reported = reports.slaveAirtime * slaves;
+  cout << endl << "report by exception uses " << 100.0 * reported / total << "% of the polling airtime";
+  if (changeAirtime > 0) {
+    // changes per hour of a slave at which both modes use the same airtime
+    double breakEven = (polling.bridgeAirtime + polling.slaveAirtime - (reports.slaveAirtime - changeAirtime * changes)) / changeAirtime;
+
+    cout << ", same airtime at " << max (0.0, breakEven) << " changes per hour";
+  }
+  cout << endl;
+  if (polling.bridgeAirtime * slaves / 36e8 > limit || polling.slaveAirtime / 36e8 > limit ||
+      reports.slaveAirtime / 36e8 > limit) {
+    cout << "! over the duty cycle limit of " << limit * 100.0 << "%" << endl;
+  }
+  return EXIT_SUCCESS;
+}